@@ -11,4 +11,10 @@ void board_int4_btnc_init(void);
 bool board_int4_btnc_fired(void);     // true una volta quando arriva l'interrupt
 void board_int4_btnc_clear(void);     // clear del flag software
 
+/* --- INT3 / TCS34725 INT (open-drain, attivo basso) --- */
+void board_int3_tcs_init(void);
+bool board_int3_tcs_fired(void);      // true quando il sensore ha segnalato un evento
+void board_int3_tcs_clear(void);      // clear del flag software
+bool board_int3_tcs_asserted(void);   // livello: pin INT basso adesso
+
 #endif
@@ -0,0 +1,88 @@
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tcs34725.h"
+
+/*
+ * Calibrazione colore per unita':
+ *   x'   = x - dark                  (offset a sensore coperto, C/R/G/B)
+ *   RGB' = M * (RGB - dark_rgb)      (M 3x3 in virgola fissa Q12)
+ *   C'   = C - dark_c
+ * M e' scelta in modo che il bianco di riferimento dia R'=G'=B'=C'
+ * (RGB8 = 255,255,255). Con i tre primari misurati M rimuove anche
+ * il crosstalk fra i filtri; senza, M e' diagonale (bilanciamento del bianco).
+ *
+ * Tutto lavora sul campione normalizzato (conteggi/ms @1x, Q8), quindi
+ * resta valido per ogni passo AGC. Persistenza in FLASH_REGION_CALIB.
+ */
+
+#define CALIB_MAGIC            0x424C4143u  // "CALB"
+#define CALIB_VERSION          1u
+#define CALIB_Q                12           // bit frazionari di M
+#define CALIB_ONE              (1L << CALIB_Q)
+
+#define CALIB_CAPTURE_SAMPLES  16u          // campioni mediati per riferimento
+#define CALIB_MIN_WHITE_NORM   (64u * 256u) // bianco netto minimo (64 conteggi/ms @1x)
+
+#define CALIB_F_MATRIX         0x0001u      // M completa (primari misurati)
+
+typedef enum {
+    CALIB_REF_DARK = 0,
+    CALIB_REF_WHITE,
+    CALIB_REF_RED,
+    CALIB_REF_GREEN,
+    CALIB_REF_BLUE,
+    CALIB_REF_COUNT
+} calib_ref_t;
+
+// Record salvato in flash (little endian, CRC sui campi precedenti)
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t dark[4];           // C, R, G, B normalizzati (Q8)
+    int32_t  m[9];              // righe R', G', B' (Q12)
+    uint32_t white_c;           // clear netto del bianco (informativo)
+    uint16_t reserved;
+    uint16_t crc;
+} calib_data_t;
+
+/**
+ * Carica la calibrazione dalla flash. Se assente o corrotta la correzione
+ * resta disattivata (campioni invariati).
+ * return true se una calibrazione valida e' attiva.
+ */
+bool calib_init(void);
+
+bool calib_is_active(void);
+const calib_data_t *calib_get(void);
+
+/**
+ * Correzione in place di un campione normalizzato (offset + matrice).
+ * Costo: 4 sottrazioni e 9 MAC; nessuna divisione.
+ */
+void calib_apply(tcs34725_norm_t *n);
+
+/**
+ * Acquisizione di un riferimento: begin, poi add a ogni nuovo campione
+ * finche' non ritorna true (media di CALIB_CAPTURE_SAMPLES campioni).
+ * I campioni saturi vengono ignorati.
+ */
+void calib_capture_begin(calib_ref_t ref);
+bool calib_capture_add(const tcs34725_norm_t *n);
+
+/**
+ * Calcolo di M dai riferimenti acquisiti (dark e white obbligatori).
+ * full=true usa anche i primari R/G/B per la matrice completa.
+ * Il risultato diventa attivo subito ma non viene salvato.
+ */
+bool calib_fit(bool full);
+
+// Salvataggio del risultato attivo / cancellazione della regione
+bool calib_save(void);
+bool calib_erase(void);
+
+#endif // CALIB_H
@@ -0,0 +1,52 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tcs34725.h"
+
+/*
+ * Classificatore colore a tabella: RGB8 (normalizzato su C, dopo la
+ * calibrazione) quantizzato a CLASSIFY_BITS per canale -> indice classe.
+ * Una sola lettura di tabella per campione, qualunque sia il numero di
+ * classi. La tabella (classify_lut.c) e' generata sul PC da campioni
+ * etichettati: tools/colorlut/gen_color_lut.py.
+ */
+
+#define CLASSIFY_BITS          5u
+#define CLASSIFY_LEVELS        (1u << CLASSIFY_BITS)
+#define CLASSIFY_LUT_ENTRIES   (CLASSIFY_LEVELS * CLASSIFY_LEVELS * CLASSIFY_LEVELS)
+#define CLASSIFY_LUT_BYTES     (CLASSIFY_LUT_ENTRIES / 2u)   // 2 classi (4 bit) per byte
+
+// Ordine e nomi devono coincidere con CLASSES in gen_color_lut.py
+typedef enum {
+    CLASSIFY_NONE = 0,      // neutro / non riconosciuto
+    CLASSIFY_RED,
+    CLASSIFY_ORANGE,
+    CLASSIFY_YELLOW,
+    CLASSIFY_GREEN,
+    CLASSIFY_BLUE,
+    CLASSIFY_VIOLET,
+    CLASSIFY_COUNT
+} classify_class_t;
+
+// Tabella generata (classify_lut.c)
+extern const uint8_t classify_lut[CLASSIFY_LUT_BYTES];
+
+/**
+ * Classe di un campione RGB 0..255.
+ */
+static inline uint8_t classify_rgb8(const tcs34725_rgb8_t *rgb)
+{
+    const uint8_t sh = (uint8_t)(8u - CLASSIFY_BITS);
+    const uint32_t idx = ((uint32_t)(rgb->r >> sh) << (2u * CLASSIFY_BITS))
+                       | ((uint32_t)(rgb->g >> sh) << CLASSIFY_BITS)
+                       |  (uint32_t)(rgb->b >> sh);
+    const uint8_t v = classify_lut[idx >> 1];
+    return (idx & 1u) ? (uint8_t)(v >> 4) : (uint8_t)(v & 0x0Fu);
+}
+
+const char *classify_name(uint8_t cls);
+
+#endif // CLASSIFY_H
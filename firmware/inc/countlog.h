@@ -0,0 +1,62 @@
+#ifndef COUNTLOG_H
+#define COUNTLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flash.h"
+
+/*
+ * Log dei contatori append-only su un anello di settori
+ * (FLASH_REGION_COUNTLOG): ogni salvataggio e' un page program di un
+ * record, un settore si cancella solo quando l'anello ci rientra.
+ * Usura distribuita su COUNTLOG_SECTORS settori.
+ *
+ * Record in slot da COUNTLOG_SLOT_SIZE byte (mai a cavallo di pagina):
+ * seq crescente, valori, CRC16. Al boot l'ultimo record si trova con
+ * una ricerca binaria su seq (O(log n) letture da 4 byte); una testa
+ * rovinata (CRC errato) non viene creduta, si riparte dall'ultimo
+ * record valido.
+ * I contatori del vecchio formato (FLASH_REGION_LEGACY_COUNTER) li
+ * importa app.c al primo boot con il log vuoto.
+ */
+
+#define COUNTLOG_VALUES         8u
+#define COUNTLOG_SLOT_SIZE      64u
+#define COUNTLOG_SECTORS        8u
+#define COUNTLOG_SLOTS_PER_SEC  (FLASH_SECTOR_SIZE_4K / COUNTLOG_SLOT_SIZE)
+#define COUNTLOG_SLOTS          (COUNTLOG_SECTORS * COUNTLOG_SLOTS_PER_SEC)
+
+typedef struct {
+    uint32_t seq;               // 0xFFFFFFFF = slot vuoto
+    uint32_t v[COUNTLOG_VALUES];
+    uint16_t reserved;
+    uint16_t crc;
+} countlog_rec_t;
+
+/**
+ * Cerca l'ultimo record valido. return false solo per errori flash
+ * (log vuoto = ok, valori a zero).
+ */
+bool countlog_init(void);
+
+// Ultimi valori salvati (zeri se il log e' vuoto)
+void countlog_get(uint32_t *v, uint8_t n);
+
+// Esito di un salvataggio (da flash_task()): seq del record scritto
+typedef void (*countlog_cb_t)(bool ok, uint32_t seq);
+
+/**
+ * Aggiunge un record con n valori (i restanti a zero) senza attese:
+ * erase del settore (se serve), scrittura e rilettura di verifica vanno
+ * nella coda flash, l'esito arriva in cb (opzionale).
+ * return false se un salvataggio e' gia' in corso o la coda e' piena.
+ */
+bool countlog_append(const uint32_t *v, uint8_t n, countlog_cb_t cb);
+
+// Salvataggio in corso
+bool countlog_busy(void);
+
+uint32_t countlog_seq(void);
+
+#endif // COUNTLOG_H
@@ -0,0 +1,57 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tcs34725.h"
+
+/*
+ * Filtro sui campioni normalizzati, fra acquisizione e classificazione.
+ * Stato tutto dentro filter_t (ring buffer a dimensione fissa): nessuna
+ * allocazione, piu' istanze indipendenti.
+ *
+ * Latenza (campioni) per un gradino in ingresso:
+ *   MOVAVG  win        (uscita valida dopo win campioni)
+ *   MEDIAN  win/2 + 1  (3 o 5, rete di ordinamento)
+ *   IIR     ~2^k       (y += (x - y) / 2^k)
+ */
+
+#define FILTER_WIN_MAX      8u
+#define FILTER_IIR_K_MAX    6u
+
+typedef enum {
+    FILTER_NONE = 0,
+    FILTER_MOVAVG,
+    FILTER_MEDIAN,
+    FILTER_IIR
+} filter_mode_t;
+
+typedef struct {
+    filter_mode_t mode;
+    uint8_t  win;                       // campioni nella finestra (avg/median)
+    uint8_t  k;                         // IIR: alpha = 1/2^k
+    uint8_t  head;
+    uint8_t  count;
+    uint8_t  sat_mask;                  // bit i: slot i saturo
+    uint32_t ring[FILTER_WIN_MAX][4];   // C, R, G, B
+    uint32_t sum[4];                    // somma della finestra (avg)
+    uint32_t acc[4];                    // IIR: y * 2^k
+} filter_t;
+
+/**
+ * Configura e azzera il filtro. win viene limitato a 1..FILTER_WIN_MAX
+ * (median: 3 o 5), k a 1..FILTER_IIR_K_MAX.
+ */
+void filter_init(filter_t *f, filter_mode_t mode, uint8_t win, uint8_t k);
+
+// Svuota la finestra mantenendo la configurazione (es. nuovo target)
+void filter_reset(filter_t *f);
+
+/**
+ * Inserisce un campione.
+ * return true se *out contiene un'uscita valida (finestra piena).
+ */
+bool filter_push(filter_t *f, const tcs34725_norm_t *in, tcs34725_norm_t *out);
+
+#endif // FILTER_H
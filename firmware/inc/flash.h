@@ -5,6 +5,8 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#include "clock.h"
+
 /*
  * Basys MX3 onboard SPI Flash (Spansion S25FL132, 4MB)
  * Address range: 0x000000 .. 0x3FFFFF
@@ -19,36 +21,199 @@
 #define FLASH_SIZE_BYTES          (4u * 1024u * 1024u)
 #define FLASH_SECTOR_SIZE_4K      4096u
 #define FLASH_PAGE_SIZE           256u
+#define FLASH_BLOCK_SIZE_64K      65536u
 
 // Comandi principali (compatibili con S25FL1xx)
 #define FLASH_CMD_WREN            0x06u
 #define FLASH_CMD_WRDI            0x04u
 #define FLASH_CMD_RDSR            0x05u
 #define FLASH_CMD_READ            0x03u
+#define FLASH_CMD_FAST_READ       0x0Bu  // + 1 byte dummy, qualunque SCK
 #define FLASH_CMD_PP              0x02u
 #define FLASH_CMD_SE_4K           0x20u
+#define FLASH_CMD_BE_64K          0xD8u
 #define FLASH_CMD_CE              0xC7u  // Chip Erase (alternativa spesso 0x60)
+#define FLASH_CMD_RDID            0x9Fu  // JEDEC ID: costruttore, tipo, capacita'
+#define FLASH_CMD_RDSR2           0x35u
+#define FLASH_CMD_SUSPEND         0x75u  // Erase/Program Suspend
+#define FLASH_CMD_RESUME          0x7Au  // Erase/Program Resume
 
 #define FLASH_SR_WIP              0x01u  // Write In Progress
+#define FLASH_SR2_SUS             0x80u  // program/erase sospeso
+
+// SCK: Fsck = PBCLK / (2*(BRG+1)). Il probe JEDEC gira sempre a SAFE,
+// poi per un chip riconosciuto si sale fino al suo limite (max PBCLK/2)
+#define FLASH_SCK_SAFE_HZ         1000000u
+#define FLASH_SCK_MAX_HZ          (PBCLK_HZ / 2u)
+
+typedef struct {
+    uint8_t  jedec[3];          // costruttore, tipo memoria, capacita'
+    bool     known;             // chip in tabella: SCK alto + FAST_READ
+    bool     fast_read;
+    bool     suspend;           // erase/program suspend (0x75/0x7A)
+    uint32_t sck_hz;
+} flash_info_t;
+
+// Suspend: tSUS massimo (datasheet 20 us, con margine) e tempo minimo
+// fra un resume e il suspend successivo, perche' l'erase possa avanzare
+#define FLASH_SUSPEND_MAX_US      50u
+#define FLASH_RESUME_GAP_US       100u
+
+// =====================
+// Mappa della flash: regioni riservate, allineate a settore 4KB.
+// Ogni modulo che persiste dati usa solo la propria regione.
+// =====================
+#define FLASH_REGION_LEGACY_COUNTER 0x000000u // vecchio contatore, importato nel log al boot
+#define FLASH_REGION_CALIB        0x001000u   // calibrazione colore (calib.c)
+#define FLASH_REGION_PALETTE      0x002000u   // palette HSV (palette.c)
+#define FLASH_REGION_KV           0x004000u   // impostazioni, 2 settori (kv.c)
+#define FLASH_REGION_COUNTLOG     0x008000u   // log contatori, 8 settori (countlog.c)
+#define FLASH_REGION_SWATCH       0x040000u   // libreria campioni Lab (swatch.c)
+#define FLASH_REGION_SWATCH_SIZE  0x040000u   // 256KB
+#define FLASH_REGION_RECORDER     0x100000u   // campioni grezzi (recorder.c)
+#define FLASH_REGION_RECORDER_SIZE 0x300000u  // 3MB, fino a fine flash
 
 // Inizializza SPI1 + pin CE e PPS mapping.
 void flash_init(void);
 
+// Legge il JEDEC ID (0x9F)
+void flash_read_jedec(uint8_t id[3]);
+
+// Imposta SCK (arrotondato per difetto al BRG possibile, limitato a
+// FLASH_SCK_MAX_HZ). Solo a flash inattiva. return SCK effettivo.
+uint32_t flash_set_sck(uint32_t hz);
+
+void flash_get_info(flash_info_t *info);
+
 // Read status register (0x05)
 uint8_t flash_read_status(void);
 
 // Attende che WIP=0 (flash pronta). timeout_ms=0 => attende "per sempre".
 bool flash_wait_ready(uint32_t timeout_ms);
 
-// Lettura generica
+// Lettura generica. Con un program/erase in corso (non chip erase) lo
+// sospende, legge e lo riprende: la latenza e' tSUS invece del tempo di
+// erase. Un DMA in corso viene prima lasciato finire (flash_task()).
+// Fallisce se l'area letta e' quella in modifica.
 bool flash_read(uint32_t addr, void *dst, size_t len);
 
 // Erase settore 4KB (addr pu essere qualunque: viene allineato a 4KB)
 bool flash_erase_sector_4k(uint32_t addr);
 
+// Erase blocco 64KB (addr allineato a 64KB). Non attende: vedi flash_busy()
+bool flash_erase_block_64k_start(uint32_t addr);
+
+// WIP ancora attivo (program/erase in corso), DMA o coda non vuota
+bool flash_busy(void);
+
+// Page program a pezzi, senza attese: begin (WREN + comando + indirizzo,
+// CE resta basso), uno o piu' data, end (CE alto = parte la programmazione).
+// Il totale non deve superare la pagina; fra begin ed end nessun'altra
+// operazione flash. Completamento: flash_busy() == false.
+bool flash_pp_begin(uint32_t addr);
+void flash_pp_data(const uint8_t *src, size_t len);
+void flash_pp_end(void);
+
+// =====================
+// DMA (SPI1 RX = canale 0, TX = canale 1): una operazione alla volta.
+// CE resta basso per tutto il trasferimento e torna alto in flash_task(),
+// che chiama anche la callback. Nel frattempo ogni altra funzione flash
+// fallisce (flash_busy() == true).
+// =====================
+#define FLASH_DMA_CHUNK           32768u    // per blocco DMA (DCHxSIZ 16 bit)
+#define FLASH_DMA_TIMEOUT_MS      2000u
+
+typedef void (*flash_dma_cb_t)(bool ok, void *ctx);   // da flash_task(), non in ISR
+
+// Lettura di len byte (anche oltre FLASH_DMA_CHUNK: blocchi in sequenza)
+bool flash_read_dma(uint32_t addr, void *dst, size_t len, flash_dma_cb_t cb, void *ctx);
+
+// Page program (len <= pagina, senza attraversarla). A fine trasferimento
+// parte il tPP: il completamento vero e' flash_busy() == false.
+bool flash_page_program_dma(uint32_t addr, const void *src, size_t len,
+                            flash_dma_cb_t cb, void *ctx);
+
+bool flash_dma_busy(void);
+
+// Chiude i trasferimenti DMA completati (e watchdog) e fa avanzare la
+// coda delle operazioni asincrone: nel superloop
+void flash_task(void);
+
+// =====================
+// Operazioni asincrone (erase / write / read) in coda, eseguite in ordine
+// da flash_task() senza attese attive: ogni passo lancia un comando o un
+// DMA e il completamento (WIP) viene controllato al giro successivo.
+// Il descrittore resta di chi lo accoda fino alla callback / status finale.
+// Un'operazione con after != NULL parte solo se after e' finita DONE;
+// altrimenti chiude in FLASH_OP_ERROR (callback compresa) senza toccare
+// la flash, e cosi' tutte quelle che dipendono da lei: una catena
+// erase -> write -> rilettura si ferma al primo passo fallito.
+// Le funzioni bloccanti prima completano coda e DMA (flash_task() in
+// attesa attiva); flash_read() aspetta solo il DMA e sospende
+// l'erase/program in corso. Dalle callback di flash_task() invece
+// falliscono subito, come le funzioni non bloccanti (flash_busy()).
+// =====================
+#define FLASH_QUEUE_LEN           8u
+
+typedef enum {
+    FLASH_OP_ERASE_4K = 0,      // addr allineato a 4KB
+    FLASH_OP_ERASE_64K,         // addr allineato a 64KB
+    FLASH_OP_CHIP_ERASE,
+    FLASH_OP_WRITE,             // page program pagina per pagina (DMA)
+    FLASH_OP_READ               // DMA
+} flash_op_type_t;
+
+typedef enum {
+    FLASH_OP_IDLE = 0,
+    FLASH_OP_QUEUED,
+    FLASH_OP_BUSY,
+    FLASH_OP_DONE,
+    FLASH_OP_ERROR              // timeout WIP o DMA fallito
+} flash_op_status_t;
+
+struct flash_op;
+typedef void (*flash_op_cb_t)(struct flash_op *op);    // da flash_task(), non in ISR
+
+typedef struct flash_op {
+    flash_op_type_t type;
+    uint32_t        addr;
+    const void     *src;        // FLASH_OP_WRITE
+    void           *dst;        // FLASH_OP_READ
+    size_t          len;        // write / read
+
+    const struct flash_op *after;   // opzionale, gia' accodata: vedi sopra
+
+    flash_op_cb_t   cb;         // opzionale
+    void           *ctx;
+
+    volatile flash_op_status_t status;
+} flash_op_t;
+
+/**
+ * Accoda un'operazione.
+ * return false se la coda e' piena o il descrittore non e' valido
+ * (anche after mai accodata)
+ */
+bool flash_submit(flash_op_t *op);
+
+/**
+ * Posti liberi in coda (per accodare piu' operazioni dipendenti in blocco)
+ */
+uint8_t flash_queue_free(void);
+
+/**
+ * true se nessuna operazione (coda, DMA) e' in corso. Non guarda WIP:
+ * per le operazioni dirette vedi flash_busy().
+ */
+bool flash_idle(void);
+
 // Scrittura (gestisce i boundary di pagina da 256B)
 bool flash_write(uint32_t addr, const void *src, size_t len);
 
+// Riscrive un settore 4KB con un record: erase + write + rilettura di verifica
+// (dati di configurazione piccoli e scritti di rado, es. calibrazione)
+bool flash_sector_store(uint32_t addr, const void *src, size_t len);
+
 // Chip erase (lento!)
 bool flash_chip_erase(void);
 
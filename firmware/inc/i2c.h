@@ -4,12 +4,58 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/**
+ * Velocita' bus selezionabili a runtime (I2C1BRG ricalcolato da PBCLK_HZ)
+ * Nota: il TCS34725 e' specificato fino a 400 kHz.
+ */
+typedef enum {
+    I2C_SPEED_100K = 0,
+    I2C_SPEED_400K,
+    I2C_SPEED_1M
+} i2c_speed_t;
+
+/**
+ * Codici di errore (ultimo errore in i2c_last_error())
+ */
+typedef enum {
+    I2C_OK = 0,
+    I2C_ERR_TIMEOUT,        // attesa scaduta (bus ripulito automaticamente)
+    I2C_ERR_NACK,           // slave non ha risposto
+    I2C_ERR_COLLISION,      // bus collision (BCL)
+    I2C_ERR_BUSY,           // motore asincrono occupato
+    I2C_ERR_BUS_STUCK       // SDA/SCL ancora bassi dopo il bus clear
+} i2c_err_t;
+
 /**
  * Inizializza I2C1 come master
- * Clock standard: 100 kHz
+ * Clock di default: 100 kHz
  */
 void i2c_init(void);
 
+/**
+ * Cambia velocita' (fallisce se ci sono transazioni in corso)
+ */
+bool i2c_set_speed(i2c_speed_t speed);
+i2c_speed_t i2c_get_speed(void);
+uint32_t i2c_speed_hz(i2c_speed_t speed);
+
+/**
+ * Ultimo errore registrato dalle primitive o dal motore asincrono
+ */
+i2c_err_t i2c_last_error(void);
+
+/**
+ * Bus clear: fino a 9 clock su SCL finche' SDA viene rilasciato, poi STOP.
+ * return true se entrambe le linee sono tornate alte
+ */
+bool i2c_bus_recover(void);
+
+/**
+ * Watchdog delle transazioni asincrone: da chiamare nel superloop.
+ * Con il bus bloccato (I2C_ERR_BUS_STUCK) ritenta il bus clear a coda vuota.
+ */
+void i2c_task(void);
+
 /**
  * Start condition
  */
@@ -35,7 +81,74 @@ bool i2c_write(uint8_t data);
  * Legge un byte
  * ack = true  -> ACK
  * ack = false -> NACK
+ * In caso di timeout ritorna 0: controllare i2c_last_error()
  */
 uint8_t i2c_read(bool ack);
 
+/**
+ * Statistiche bus (per misurare il costo I2C per campione)
+ * - transactions: START generati (RESTART esclusi)
+ * - bytes: byte trasferiti sul bus (indirizzi inclusi)
+ */
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;
+} i2c_stats_t;
+
+void i2c_get_stats(i2c_stats_t *out);
+void i2c_reset_stats(void);
+
+/* =====================
+ * Transazioni asincrone (ISR master I2C1)
+ * =====================
+ * L'app prepara un descrittore e lo accoda con i2c_submit(): la sequenza
+ * START / addr+W / write / RESTART / addr+R / read / STOP viene eseguita
+ * interamente dall'interrupt, il superloop non resta mai in attesa.
+ *
+ * Il descrittore (e i buffer) devono restare validi finche' status
+ * non diventa I2C_XFER_DONE o I2C_XFER_ERROR.
+ * Le primitive bloccanti sopra falliscono se la coda non e' vuota.
+ */
+#define I2C_QUEUE_LEN   4u
+
+typedef enum {
+    I2C_XFER_IDLE = 0,
+    I2C_XFER_PENDING,
+    I2C_XFER_DONE,
+    I2C_XFER_ERROR
+} i2c_xfer_status_t;
+
+struct i2c_xfer;
+typedef void (*i2c_xfer_cb_t)(struct i2c_xfer *x);   // chiamata in ISR! (puo' chiamare i2c_submit)
+
+typedef struct i2c_xfer {
+    uint8_t        addr;    // indirizzo 7-bit
+    const uint8_t *wbuf;    // byte da scrivere (puo' essere NULL se wlen=0)
+    uint8_t        wlen;
+    uint8_t       *rbuf;    // byte da leggere dopo RESTART (NULL se rlen=0)
+    uint8_t        rlen;
+    i2c_xfer_cb_t  cb;      // opzionale
+    void          *ctx;     // libero per il chiamante
+
+    volatile i2c_xfer_status_t status;
+    volatile i2c_err_t         err;     // valido con status = I2C_XFER_ERROR
+} i2c_xfer_t;
+
+/**
+ * Accoda una transazione (anche da una callback di completamento).
+ * return false se la coda e' piena, il descrittore non e' valido o il
+ * bus e' bloccato (I2C_ERR_BUS_STUCK, fino al bus clear di i2c_task())
+ */
+bool i2c_submit(i2c_xfer_t *x);
+
+/**
+ * true se ci sono transazioni in corso o in coda
+ */
+bool i2c_busy(void);
+
+/**
+ * Posti liberi in coda (per accodare piu' transazioni in blocco)
+ */
+uint8_t i2c_queue_free(void);
+
 #endif // I2C_H
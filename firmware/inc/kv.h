@@ -0,0 +1,49 @@
+#ifndef KV_H
+#define KV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flash.h"
+
+/*
+ * Archivio chiave/valore (u16 -> u32) per le impostazioni, sui due settori
+ * di FLASH_REGION_KV usati a turno. Ogni modifica aggiunge un record
+ * (chiave, CRC16, valore) in coda al settore attivo: vale l'ultimo per
+ * chiave. A settore pieno le sole voci vive vengono copiate nell'altro
+ * (compattazione); il suo header, con generazione piu' alta, e' scritto
+ * per ultimo e lo rende attivo solo a copia completa.
+ *
+ * Il settore attivo si legge una volta in kv_init(): le voci finiscono in
+ * un indice hash in RAM e kv_get() non tocca mai la SPI.
+ */
+
+#define KV_MAX_KEYS     32u
+#define KV_KEY_NONE     0xFFFFu     // riservata: slot flash vuoto
+
+/**
+ * Carica l'indice dal settore attivo (archivio vuoto se nessuno valido).
+ * return false solo per errori flash.
+ */
+bool kv_init(void);
+
+// Lookup in RAM, tempo costante. return false se la chiave non c'e'
+bool kv_get(uint16_t key, uint32_t *value);
+
+// Valore salvato o def se assente
+uint32_t kv_get_or(uint16_t key, uint32_t def);
+
+/**
+ * Salva una voce (nessuna scrittura se il valore non cambia). Bloccante:
+ * un page program, piu' erase e copia del settore se serve compattare.
+ * return false se la flash e' occupata, la scrittura fallisce o non c'e'
+ * posto per una nuova chiave.
+ */
+bool kv_set(uint16_t key, uint32_t value);
+
+uint8_t kv_count(void);
+
+// Cancella l'archivio (tutte le chiavi tornano ai default del chiamante)
+bool kv_clear(void);
+
+#endif // KV_H
@@ -0,0 +1,52 @@
+#ifndef LAB_H
+#define LAB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tcs34725.h"
+
+/*
+ * CIELAB (D65) in virgola fissa.
+ * Ingresso: RGB lineare in Q12 (4096 = bianco di riferimento).
+ *   XYZ/XYZn = M * rgb      (matrice sRGB con righe gia' divise per Xn, Zn)
+ *   f(t)     = LUT + interpolazione lineare (radice cubica / tratto lineare)
+ *   L = 116 f(Y) - 16,  a = 500 (f(X) - f(Y)),  b = 200 (f(Y) - f(Z))
+ * Uscita in Q4 (1/16 di unita' Lab).
+ */
+
+#define LAB_ONE         4096        // Q12
+#define LAB_Q           4           // frazione di L, a, b
+#define LAB_LUT_SHIFT   2           // passo LUT: 4/4096
+#define LAB_LUT_SIZE    ((LAB_ONE >> LAB_LUT_SHIFT) + 1)
+
+typedef struct {
+    int16_t L;
+    int16_t a;
+    int16_t b;
+} lab_t;
+
+// Precalcolo della LUT f(t) (solo interi, una volta al boot)
+void lab_init(void);
+
+void lab_from_linear(uint32_t r_q12, uint32_t g_q12, uint32_t b_q12, lab_t *out);
+
+/**
+ * Da un campione normalizzato e corretto dalla calibrazione: i canali
+ * vengono riferiti a white (clear netto del bianco) come riflettanza.
+ */
+void lab_from_norm(const tcs34725_norm_t *n, uint32_t white, lab_t *out);
+
+// Distanza al quadrato in unita' Q4 (confronto senza radice)
+static inline uint32_t lab_dist2(const lab_t *x, const lab_t *y)
+{
+    const int32_t dl = (int32_t)x->L - y->L;
+    const int32_t da = (int32_t)x->a - y->a;
+    const int32_t db = (int32_t)x->b - y->b;
+    return (uint32_t)(dl * dl + da * da + db * db);
+}
+
+// Delta E 1976 x100 da una distanza al quadrato in Q4
+uint16_t lab_de76_x100(uint32_t dist2);
+
+#endif // LAB_H
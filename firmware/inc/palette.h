@@ -0,0 +1,67 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tcs34725.h"
+
+/*
+ * Palette HSV: ogni voce e' un settore di hue (centro +/- tolleranza) con
+ * saturazione e valore minimi, associato a una classe di classify.h.
+ * La hue separa il colore dalla luminosita': le voci restano valide se
+ * cambia l'illuminazione. Le voci si insegnano presentando un campione
+ * (menu UART) e vengono salvate in FLASH_REGION_PALETTE.
+ */
+
+#define PALETTE_MAX             8u
+#define PALETTE_MAGIC           0x4C415050u  // "PPAL"
+#define PALETTE_VERSION         1u
+
+#define PALETTE_HUE_TOL_DEF     64u         // +/- 15 gradi (1536 = 360)
+#define PALETTE_S_MIN_FLOOR     40u         // sotto: neutro, mai classificato
+
+typedef struct {
+    uint16_t hue;               // centro, 0..TCS34725_HUE_RANGE-1
+    uint16_t hue_tol;
+    uint8_t  s_min;
+    uint8_t  v_min;
+    uint8_t  cls;               // classify_class_t
+    uint8_t  reserved;
+} palette_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    palette_entry_t e[PALETTE_MAX];
+    uint16_t reserved;
+    uint16_t crc;
+} palette_data_t;
+
+/**
+ * Carica la palette dalla flash (vuota se assente o corrotta).
+ * return true se caricata.
+ */
+bool palette_init(void);
+
+uint8_t palette_count(void);
+const palette_entry_t *palette_get(uint8_t i);
+
+/**
+ * Classe della voce con hue piu' vicina fra quelle che accettano il
+ * campione; CLASSIFY_NONE se nessuna.
+ */
+uint8_t palette_classify(const tcs34725_hsv_t *hsv);
+
+/**
+ * Nuova voce (o sostituzione di quella con la stessa classe) dal
+ * campione medio presentato: s_min/v_min a meta' dei valori misurati.
+ * return false se il campione e' troppo poco saturo o la palette e' piena.
+ */
+bool palette_teach(uint8_t cls, const tcs34725_hsv_t *hsv);
+
+void palette_clear(void);
+bool palette_save(void);
+
+#endif // PALETTE_H
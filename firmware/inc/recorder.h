@@ -0,0 +1,102 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flash.h"
+#include "tcs34725.h"
+
+/*
+ * Registratore dei campioni grezzi in FLASH_REGION_RECORDER, per l'analisi
+ * offline (tools/recorder).
+ *
+ * Ogni pagina e' un blocco compresso decodificabile da solo
+ * (tools/recorder/reclog.py):
+ *   [0] record nel blocco  [1] byte di payload  [2..3] CRC16 di [0..1]
+ *   e del payload; payload = primo record intero (recorder_rec_t), poi
+ *   per ogni record successivo (varint LEB128):
+ *     (zigzag(dt - dt precedente) << 2) | packed << 1 | ext
+ *     se ext: (buco di seq << 1) | chg, e se chg agc_step e flags (1 byte)
+ *     packed: zigzag(delta) di C, R, G, B in 4 bit ciascuno (2 byte),
+ *     altrimenti un varint zigzag(delta) per canale
+ * Campioni consecutivi differiscono poco: 3-6 byte invece di 16, quindi
+ * piu' storia nell'area e meno pagine da programmare.
+ *
+ * Doppio buffer di pagina: recorder_add() riempie un buffer mentre
+ * recorder_task() programma l'altro via DMA (flash_page_program_dma),
+ * cosi' ne' il trasferimento SPI ne' il tPP fermano il campionamento.
+ * Un campione si perde solo se entrambi i buffer sono pieni.
+ *
+ * L'area viene cancellata (blocchi da 64KB) alla partenza: durante la
+ * registrazione la flash esegue solo page program.
+ */
+
+#define RECORDER_REC_SIZE       16u
+#define RECORDER_PAGE_HDR       4u
+#define RECORDER_PAYLOAD        (FLASH_PAGE_SIZE - RECORDER_PAGE_HDR)
+#define RECORDER_ENC_MAX        22u     // record codificato, caso peggiore
+
+#define RECORDER_F_STALE        0x01u   // ciclo a cavallo di un cambio AGC
+
+typedef struct {
+    uint32_t t_us;              // dall'inizio della registrazione (wrap ~71 min)
+    tcs34725_raw_t raw;
+    uint8_t  agc_step;          // gain/ATIME del campione
+    uint8_t  flags;             // RECORDER_F_*
+    uint16_t seq;               // progressivo: un buco = campioni persi
+} recorder_rec_t;
+
+typedef enum {
+    RECORDER_IDLE = 0,
+    RECORDER_ERASING,           // cancellazione area, campioni ignorati
+    RECORDER_RUN,
+    RECORDER_FULL,              // area piena: campioni ignorati
+    RECORDER_ERROR
+} recorder_state_t;
+
+typedef struct {
+    recorder_state_t state;
+    uint32_t records;           // campioni registrati
+    uint32_t pages;             // blocchi chiusi
+    uint32_t pages_max;         // blocchi che entrano nell'area
+    uint32_t dropped;           // persi per buffer pieni
+    uint32_t erase_pct;         // avanzamento cancellazione
+} recorder_status_t;
+
+/**
+ * Avvia la registrazione su max_bytes (arrotondati a 64KB, limitati
+ * all'area): la cancellazione procede in recorder_task().
+ */
+bool recorder_start(uint32_t max_bytes);
+
+/**
+ * Ferma la registrazione: programma la pagina parziale e attende la flash.
+ * return false se una scrittura e' fallita.
+ */
+bool recorder_stop(void);
+
+bool recorder_active(void);
+
+/**
+ * Accoda un campione (nessun accesso SPI).
+ * return false se perso (buffer pieni) o se non si sta registrando.
+ */
+bool recorder_add(const tcs34725_raw_t *raw, uint8_t agc_step, uint8_t flags);
+
+// Avanza erase / programmazione: chiamato a ogni giro del superloop
+void recorder_task(void);
+
+void recorder_get_status(recorder_status_t *st);
+
+/**
+ * Numero di blocchi (pagine) in flash dell'ultima registrazione, anche
+ * dopo un reset: ricerca binaria della prima pagina vuota.
+ */
+uint32_t recorder_stored(void);
+
+// Lettura di n blocchi via DMA: esito nella callback (da flash_task())
+bool recorder_read_dma(uint32_t page, uint8_t *dst, uint32_t n,
+                       flash_dma_cb_t cb, void *ctx);
+
+#endif // RECORDER_H
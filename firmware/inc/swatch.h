@@ -0,0 +1,74 @@
+#ifndef SWATCH_H
+#define SWATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lab.h"
+
+/*
+ * Libreria di campioni di riferimento (es. cartella RAL) in flash SPI,
+ * FLASH_REGION_SWATCH. Immagine generata sul PC da
+ * tools/swatch/build_swatch_lib.py e caricata via UART.
+ *
+ * Layout (little endian):
+ *   swatch_header_t
+ *   swatch_node_t[count]  k-d tree implicito su (L, a, b):
+ *     il nodo del sottoalbero [lo, hi) e' mid = (lo + hi) / 2,
+ *     asse = profondita' % 3, figli [lo, mid) e [mid + 1, hi).
+ * Ricerca del piu' vicino con potatura sul piano di taglio: ~log2(N)
+ * nodi letti invece di N. I nodi dei livelli alti restano in una cache
+ * RAM a indirizzamento diretto.
+ */
+
+#define SWATCH_MAGIC        0x424C5753u  // "SWLB"
+#define SWATCH_VERSION      1u
+#define SWATCH_CODE_LEN     10u
+#define SWATCH_CACHE_SIZE   64u          // nodi in RAM (potenza di 2)
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint16_t node_size;         // sizeof(swatch_node_t)
+    uint16_t reserved;
+    uint16_t crc_nodes;         // CRC16 su tutti i nodi
+    uint16_t crc_hdr;           // CRC16 sui campi precedenti
+} swatch_header_t;
+
+typedef struct {
+    lab_t    lab;               // Q4
+    uint16_t id;
+    char     code[SWATCH_CODE_LEN];   // terminato da 0 se piu' corto
+} swatch_node_t;
+
+typedef struct {
+    uint16_t id;
+    char     code[SWATCH_CODE_LEN + 1u];
+    uint16_t de_x100;           // Delta E 1976 x100
+    uint16_t visited;           // nodi esaminati
+} swatch_match_t;
+
+/**
+ * Valida l'immagine in flash (header + CRC dei nodi).
+ * return true se la libreria e' utilizzabile.
+ */
+bool swatch_init(void);
+
+uint16_t swatch_count(void);
+
+/**
+ * Campione piu' vicino (Delta E 1976) a q.
+ * return false se libreria assente o errore di lettura flash.
+ */
+bool swatch_nearest(const lab_t *q, swatch_match_t *out);
+
+/*
+ * Caricamento: begin cancella i settori necessari, write scrive blocchi
+ * consecutivi (offset dall'inizio dell'immagine), end rilegge e valida.
+ */
+bool swatch_load_begin(uint32_t len);
+bool swatch_load_write(uint32_t off, const void *src, uint32_t len);
+bool swatch_load_end(void);
+
+#endif // SWATCH_H
@@ -0,0 +1,66 @@
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "classify.h"
+
+/*
+ * Conteggio a fronti: un evento per target fisico, non per campione.
+ * Una macchina a stati per classe, soglie in ms (indipendenti dalla
+ * frequenza di campionamento):
+ *   ingresso: classe vista senza interruzioni per enter_ms
+ *             e almeno min_gap_ms dall'ultima uscita della stessa classe
+ *   uscita:   classe assente da exit_ms (buchi piu' brevi tollerati)
+ *   dwell:    primo -> ultimo campione della classe
+ */
+
+typedef struct {
+    uint16_t enter_ms;
+    uint16_t exit_ms;
+    uint16_t min_gap_ms;
+} target_cfg_t;
+
+typedef struct {
+    bool     present;           // target confermato
+    bool     candidate;         // sequenza in corso, non ancora confermata
+    bool     exited;            // exit_at valido
+    uint32_t first_ms;          // primo campione della sequenza
+    uint32_t last_ms;           // ultimo campione della classe
+    uint32_t exit_at;           // ultima uscita (per min_gap_ms)
+} target_track_t;
+
+typedef enum {
+    TARGET_EV_ENTER = 0,
+    TARGET_EV_EXIT
+} target_ev_type_t;
+
+typedef struct {
+    target_ev_type_t type;
+    uint8_t  cls;
+    uint32_t dwell_ms;          // solo per TARGET_EV_EXIT
+} target_event_t;
+
+typedef struct {
+    target_cfg_t   cfg;
+    target_track_t t[CLASSIFY_COUNT];
+} target_t;
+
+void target_init(target_t *tg, const target_cfg_t *cfg);
+void target_reset(target_t *tg);
+
+/**
+ * Un campione classificato all'istante now_ms.
+ * Scrive fino a max_ev eventi in ev; return numero di eventi.
+ */
+uint8_t target_update(target_t *tg, uint8_t cls, uint32_t now_ms,
+                      target_event_t *ev, uint8_t max_ev);
+
+/**
+ * Chiude i target presenti (campo vuoto certo, es. prima di armare INT):
+ * eventi di uscita con il dwell fino all'ultimo campione.
+ */
+uint8_t target_flush(target_t *tg, target_event_t *ev, uint8_t max_ev);
+
+#endif // TARGET_H
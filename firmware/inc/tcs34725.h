@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /* =====================
  * I2C address
@@ -13,10 +14,17 @@
  * Register addresses
  * ===================== */
 #define TCS34725_CMD_BIT    0x80
+#define TCS34725_CMD_AUTOINC 0x20   // TYPE=01: auto-increment dell'indirizzo
+#define TCS34725_CMD_SPECIAL 0x60   // TYPE=11: special function
+#define TCS34725_SF_INT_CLEAR 0x06  // special function: clear RGBC interrupt
 
 #define TCS34725_REG_ENABLE 0x00
 #define TCS34725_REG_ATIME  0x01
+#define TCS34725_REG_AILTL  0x04    // soglia bassa clear (16 bit)
+#define TCS34725_REG_AIHTL  0x06    // soglia alta clear (16 bit)
+#define TCS34725_REG_PERS   0x0C
 #define TCS34725_REG_CONTROL 0x0F
+#define TCS34725_REG_STATUS 0x13
 
 #define TCS34725_REG_CDATAL 0x14
 #define TCS34725_REG_RDATAL 0x16
@@ -28,6 +36,13 @@
  * ===================== */
 #define TCS34725_ENABLE_PON 0x01
 #define TCS34725_ENABLE_AEN 0x02
+#define TCS34725_ENABLE_AIEN 0x10
+
+/* =====================
+ * STATUS register bits
+ * ===================== */
+#define TCS34725_STATUS_AVALID 0x01  // almeno un ciclo RGBC completato
+#define TCS34725_STATUS_AINT   0x10  // interrupt RGBC (con PERS=0: ogni ciclo)
 
 /* =====================
  * Integration times
@@ -50,6 +65,21 @@ typedef enum {
     TCS34725_GAIN_60X = 0x03
 } tcs34725_gain_t;
 
+/* =====================
+ * Persistence filter (PERS)
+ * Cicli consecutivi fuori soglia prima di AINT
+ * ===================== */
+typedef enum {
+    TCS34725_PERS_EVERY = 0x00,   // ogni ciclo (ignora le soglie)
+    TCS34725_PERS_1     = 0x01,
+    TCS34725_PERS_2     = 0x02,
+    TCS34725_PERS_3     = 0x03,
+    TCS34725_PERS_5     = 0x04,
+    TCS34725_PERS_10    = 0x05,
+    TCS34725_PERS_20    = 0x08,
+    TCS34725_PERS_60    = 0x0F
+} tcs34725_pers_t;
+
 /* =====================
  * Raw data struct
  * ===================== */
@@ -60,6 +90,73 @@ typedef struct {
     uint16_t b;
 } tcs34725_raw_t;
 
+/* =====================
+ * RGB 8-bit (normalizzato su C)
+ * ===================== */
+typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} tcs34725_rgb8_t;
+
+/* =====================
+ * HSV intero (da RGB8)
+ * h: 0..TCS34725_HUE_RANGE-1, 256 passi per sestante (60 gradi)
+ *    0 = rosso, 512 = verde, 1024 = blu
+ * s, v: 0..255 (v = canale massimo)
+ * ===================== */
+#define TCS34725_HUE_SECTOR     256u
+#define TCS34725_HUE_RANGE      (6u * TCS34725_HUE_SECTOR)
+
+typedef struct {
+    uint16_t h;
+    uint8_t  s;
+    uint8_t  v;
+} tcs34725_hsv_t;
+
+/* =====================
+ * Campione normalizzato
+ * Conteggi per ms di integrazione a gain 1x, in Q8 (x256):
+ * confrontabile fra configurazioni gain/ATIME diverse.
+ * ===================== */
+typedef struct {
+    uint32_t c;
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+    bool     saturated;     // clear oltre la saturazione (lux/CCT non validi)
+} tcs34725_norm_t;
+
+/* =====================
+ * Lux / CCT (coefficienti TCS3472, DN40)
+ *   IR  = (R + G + B - C) / 2
+ *   X'  = X - IR
+ *   G'' = 0.136 R' + 1.000 G' - 0.444 B'
+ *   Lux = G'' / CPL,  CPL = (ATIME_ms * gain) / (GA * DF)
+ *   CCT = 3810 * B' / R' + 1391
+ * Calcolati in interi (coefficienti x1000) partendo dal campione
+ * normalizzato: ATIME e gain sono gia' fuori dai conteggi.
+ * ===================== */
+#define TCS34725_LUX_DF          310
+#define TCS34725_LUX_R_COEF_M    136     // x1000
+#define TCS34725_LUX_G_COEF_M    1000
+#define TCS34725_LUX_B_COEF_M    (-444)
+#define TCS34725_CT_COEF         3810
+#define TCS34725_CT_OFFSET       1391
+
+typedef struct {
+    uint32_t lux_milli;     // illuminamento in millilux
+    uint16_t cct_k;         // temperatura di colore correlata (K)
+} tcs34725_light_t;
+
+/* =====================
+ * AGC (gain + ATIME automatici)
+ * ===================== */
+#define TCS34725_AGC_STEPS        8u
+#define TCS34725_AGC_START_STEP   2u    // 16x, 2.4 ms
+#define TCS34725_AGC_HIGH_PCT     80u   // sopra: passo meno sensibile
+#define TCS34725_AGC_LOW_PCT      50u   // passo piu' sensibile solo se resta sotto
+
 /* =====================
  * API
  * ===================== */
@@ -70,6 +167,117 @@ void tcs34725_enable(bool en);
 void tcs34725_set_integration_time(tcs34725_it_t it);
 void tcs34725_set_gain(tcs34725_gain_t gain);
 
+/**
+ * Legge C/R/G/B con un'unica transazione I2C (burst da CDATAL, auto-increment).
+ * I 4 canali provengono sempre dallo stesso ciclo di integrazione.
+ */
 bool tcs34725_read_raw(tcs34725_raw_t *out);
 
+/**
+ * Legge il registro STATUS (AVALID / AINT)
+ */
+bool tcs34725_read_status(uint8_t *status);
+
+/**
+ * Pulisce il flag AINT (special function 0x66)
+ */
+bool tcs34725_clear_int(void);
+
+/**
+ * Modalita' sincronizzata: PERS=0 + AIEN, cosi' AINT si alza alla fine di
+ * OGNI ciclo di integrazione e viene ripulito dopo ogni lettura.
+ * Un campione "nuovo" corrisponde esattamente a un ciclo completato.
+ */
+bool tcs34725_sync_enable(bool en);
+
+/**
+ * Modalita' a eventi: AINT (e il pin INT) si attivano solo quando il clear
+ * resta fuori da [lo, hi] per 'pers' cicli consecutivi. Nessun traffico I2C
+ * necessario finche' la scena non cambia.
+ */
+bool tcs34725_threshold_enable(uint16_t lo, uint16_t hi, tcs34725_pers_t pers);
+
+/**
+ * Durata del ciclo di integrazione corrente: (256 - ATIME) * 2.4 ms
+ */
+uint32_t tcs34725_integration_us(void);
+
+/**
+ * Versione non bloccante del burst (motore I2C in interrupt).
+ * Il burst parte da STATUS (0x13..0x1B, 9 byte): stato e dati arrivano
+ * nella stessa transazione.
+ * start: accoda la lettura (false se gia' in corso o coda piena)
+ * poll : vedi TCS34725_RD_*
+ */
+#define TCS34725_RD_ERROR    (-1)
+#define TCS34725_RD_PENDING    0    // transazione in corso
+#define TCS34725_RD_NEW        1    // campione di un ciclo nuovo in *out
+#define TCS34725_RD_STALE      2    // ciclo non ancora completato (ripetere)
+
+bool tcs34725_read_raw_start(void);
+int  tcs34725_read_raw_poll(tcs34725_raw_t *out);
+
+/**
+ * Scala un campione raw nella configurazione corrente a conteggi/ms @1x (Q8)
+ */
+void tcs34725_normalize(const tcs34725_raw_t *raw, tcs34725_norm_t *out);
+
+/**
+ * Inverso per il clear: valore normalizzato -> conteggi raw correnti
+ * (es. soglie AILT/AIHT calcolate da una baseline normalizzata)
+ */
+uint32_t tcs34725_norm_to_raw(uint32_t norm_q8);
+
+/**
+ * AGC: sceglie gain e ATIME dal clear dell'ultimo campione.
+ * - clear >= HIGH_PCT del fondo scala (o saturo) -> passo meno sensibile
+ * - passo piu' sensibile solo se il clear previsto resta < LOW_PCT
+ *   del nuovo fondo scala (isteresi: nessuna oscillazione fra due passi)
+ * A parita' di sensibilita' la tabella preferisce gain alto e
+ * integrazione corta (miglior SNR per ms).
+ *
+ * enable: applica il passo corrente con scritture bloccanti (bus libero).
+ */
+bool    tcs34725_agc_enable(bool en);
+uint8_t tcs34725_agc_step(void);
+
+/**
+ * Da chiamare per ogni campione nuovo (non bloccante: i cambi vengono
+ * accodati al motore I2C).
+ * return false se il campione va scartato (ciclo a cavallo di un cambio);
+ * altrimenti *norm (se non NULL) contiene il campione normalizzato.
+ */
+bool tcs34725_agc_process(const tcs34725_raw_t *raw, tcs34725_norm_t *norm);
+
+/**
+ * Lux e CCT compensati IR da un campione normalizzato.
+ * return false se saturo o se R' <= 0 (CCT indefinita); in quel caso
+ * lux_milli resta comunque valorizzato se calcolabile.
+ */
+bool tcs34725_calc_light(const tcs34725_norm_t *norm, tcs34725_light_t *out);
+
+/**
+ * RAW -> RGB 0..255 normalizzato su C: x8 = round(x * 255 / C), clamp a 255.
+ * Un solo reciproco di C per campione, canali con moltiplicazione+shift:
+ * risultato identico bit a bit alla divisione.
+ */
+void tcs34725_raw_to_rgb8(const tcs34725_raw_t *in, uint8_t *r8, uint8_t *g8, uint8_t *b8);
+
+/**
+ * Stessa conversione su n campioni (analisi offline di log)
+ */
+void tcs34725_raw_to_rgb8_batch(const tcs34725_raw_t *in, tcs34725_rgb8_t *out, size_t n);
+
+/**
+ * Stessa conversione da un campione normalizzato (es. dopo la calibrazione):
+ * canali riportati a 16 bit con lo stesso shift, il rapporto su C non cambia.
+ */
+void tcs34725_norm_to_rgb8(const tcs34725_norm_t *in, tcs34725_rgb8_t *out);
+
+/**
+ * RGB8 -> HSV intero: due divisioni per campione (s e frazione di hue).
+ * Grigi (max == min): h = 0, s = 0.
+ */
+void tcs34725_rgb8_to_hsv(const tcs34725_rgb8_t *in, tcs34725_hsv_t *out);
+
 #endif // TCS34725_H
@@ -1,22 +1,90 @@
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifndef UART_H
 #define UART_H
 
 /**
- * Inizializza UART1
- * - 115200 baud
+ * Inizializza UART4
+ * - UART_BAUD_DEFAULT (115200), high speed BRGH=1
  * - 8N1
+ *
+ * TX a interrupt: uart_putc() copia il carattere in un buffer circolare
+ * e ritorna, l'ISR UART4 lo svuota nella FIFO hardware (4 livelli).
+ * uart_puts()/uart_printf() costano qualche us invece di ~87 us a byte.
+ *
+ * RX a interrupt: l'ISR sposta i caratteri ricevuti in un secondo buffer
+ * (SPSC, senza lock), letto solo da uart_try_getc(). Un giro lento del
+ * superloop (LCD, attese flash) non perde i comandi in arrivo.
  */
 void uart_init(void);
 
+#define UART_BAUD_DEFAULT       115200UL
+#define UART_BAUD_ERR_MAX_PPM   20000L      // +/- 2%: oltre il campionamento a 4x sbaglia
+
+/**
+ * Divisore BRGH=1 per baud, da PBCLK_HZ: BRG = PBCLK / (4 * baud) - 1
+ * arrotondato, errore in ppm rispetto al baud chiesto. A 40 MHz:
+ * 115200 -0.22%, 921600 -1.36%, 1M / 2M esatti.
+ * return false se fuori range o con errore oltre UART_BAUD_ERR_MAX_PPM.
+ */
+bool uart_baud_calc(uint32_t baud, uint16_t *brg, int32_t *err_ppm);
+
+/**
+ * Cambia baud a runtime: svuota prima il TX (uart_flush) e scarta
+ * l'RX ricevuto durante il cambio.
+ * return false (baud invariato) se uart_baud_calc() lo rifiuta.
+ */
+bool uart_set_baud(uint32_t baud);
+
+uint32_t uart_get_baud(void);           // nominale
+int32_t  uart_get_baud_error_ppm(void);
+
+#define UART_TX_BUF_SIZE    1024u   // potenza di 2 (indici a 16 bit)
+#define UART_RX_BUF_SIZE    256u    // potenza di 2 (indici a 16 bit)
+
+// Cosa fa uart_putc() con il buffer TX pieno
+typedef enum {
+    UART_TX_BLOCK = 0,  // attende spazio (default: nessun byte perso)
+    UART_TX_DROP        // scarta il carattere e lo conta
+} uart_tx_policy_t;
+
+void uart_set_tx_policy(uart_tx_policy_t p);
+
 void uart_putc(char c);
 void uart_puts(const char *s);
 void uart_printf(const char *fmt, ...);
 
-// non-blocking
+// Attende che buffer e shift register siano vuoti (prima di reset / cambi baud)
+void uart_flush(void);
+
+/**
+ * Statistiche TX / RX
+ * - tx_full: volte in cui uart_putc() ha trovato il buffer pieno
+ * - tx_dropped: caratteri scartati (UART_TX_DROP)
+ * - tx_max_used: riempimento massimo del buffer TX
+ * - rx_overrun: FIFO hardware traboccata (OERR, caratteri persi)
+ * - rx_dropped: caratteri persi con il buffer RX pieno
+ * - rx_max_used: riempimento massimo del buffer RX
+ */
+typedef struct {
+    uint32_t tx_full;
+    uint32_t tx_dropped;
+    uint16_t tx_max_used;
+    uint16_t rx_max_used;
+    uint32_t rx_overrun;
+    uint32_t rx_dropped;
+} uart_stats_t;
+
+void uart_get_stats(uart_stats_t *out);
+void uart_reset_stats(void);
+
+// non-blocking: 1 se c'era un carattere nel buffer RX
 int  uart_try_getc(char *out);
 
+// Scarta quanto ricevuto e non ancora letto (es. il '\n' di un CRLF)
+void uart_rx_flush(void);
+
 // blocking (comodo)
 char uart_getc_blocking(void);
 #endif
@@ -2,6 +2,12 @@
 #define UTILS_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "clock.h"
+
+// Core Timer: incrementa a SYSCLK/2
+#define UTILS_TICKS_PER_US   (SYSCLK_HZ / 2UL / 1000000UL)
 
 /**
  * Inizializza le utility di sistema
@@ -20,4 +26,23 @@ uint32_t utils_millis(void);
  */
 void utils_delay_ms(uint32_t ms);
 
+/**
+ * Tick grezzi del Core Timer (per timeout brevi / misure)
+ * Wrap ogni ~107 s: usare sempre differenze (now - t0)
+ */
+uint32_t utils_ticks(void);
+
+/**
+ * Delay bloccante in microsecondi
+ */
+void utils_delay_us(uint32_t us);
+
+/**
+ * CRC-16/CCITT (poly 0x1021, init 0xFFFF) per i record salvati in flash
+ */
+uint16_t utils_crc16(const void *data, size_t len);
+
+// Stesso CRC calcolato a blocchi: crc parte da 0xFFFF
+uint16_t utils_crc16_update(uint16_t crc, const void *data, size_t len);
+
 #endif // UTILS_H
@@ -5,38 +5,101 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "utils.h"
 #include "uart.h"
 #include "i2c.h"
 #include "tcs34725.h"
+#include "calib.h"
+#include "filter.h"
+#include "classify.h"
+#include "palette.h"
+#include "lab.h"
+#include "swatch.h"
+#include "target.h"
+#include "countlog.h"
+#include "recorder.h"
+#include "kv.h"
 #include "beep.h"
 #include "board.h"
 #include "lcd.h"
 #include "flash.h"
 #include "led.h"
 
-// Helper definito in tcs34725.c (non serve modificarne l'h)
-void tcs34725_raw_to_rgb8(const tcs34725_raw_t *in, uint8_t *r8, uint8_t *g8, uint8_t *b8);
-
 typedef enum {
     APP_STATE_MENU = 0,
     APP_STATE_SCAN,
     APP_STATE_SHOW_COUNT,
-    APP_STATE_RESET_FLASH
+    APP_STATE_RESET_FLASH,
+    APP_STATE_CALIB,
+    APP_STATE_TEACH,
+    APP_STATE_SWATCH,
+    APP_STATE_SETTINGS
 } app_state_t;
 
 typedef struct {
     app_state_t state;
 
     // scan
-    uint32_t last_read_ms;
+    uint32_t last_lcd_ms;
+    uint32_t last_poll_ticks;   // tick dell'ultimo poll STATUS andato a buon fine
+    uint32_t poll_wait_ticks;   // attesa prima del prossimo poll
     uint32_t scan_start_ms;
-    uint32_t red_count;
+    uint32_t class_count[CLASSIFY_COUNT];   // target per classe (0 = none)
+    uint32_t class_dwell_ms[CLASSIFY_COUNT];// permanenza totale per classe
+    target_t targets;           // fronti ingresso/uscita per classe
+    bool     log_samples;       // 'l': stampa RGB per il training della LUT
+    bool     use_palette;       // classificatore: palette HSV invece della LUT
+    uint32_t rec_last_ms;       // ultimo stato del registratore stampato
+    recorder_state_t rec_state_prev;
+    uint32_t sample_count;
+    uint32_t path_ticks_max;    // costo peggiore campione -> classe (core timer)
 
     // sensor
     bool sensor_ok;
+    bool read_pending;          // burst I2C in corso (motore asincrono)
     tcs34725_raw_t raw;
+    tcs34725_norm_t norm;       // conteggi/ms @1x (Q8), indipendenti da gain/ATIME
+    tcs34725_norm_t filt;       // norm dopo il filtro (ingresso classificazione)
+    tcs34725_norm_t cal;        // filt corretto (buio + matrice di calibrazione)
+    filter_t        filter;
+    uint8_t         filter_preset;
+    tcs34725_rgb8_t rgb;        // RGB 0..255 su C (convertito una volta per campione)
+
+    // acquisizione a eventi (pin INT del sensore)
+    bool     evt_armed;         // in attesa di INT: nessun traffico I2C
+    bool     evt_arm_request;   // ri-armo appena il bus e' libero
+    bool     evt_have_baseline;
+    uint32_t evt_baseline;      // clear normalizzato a campo vuoto
+    uint8_t  evt_quiet;         // campioni consecutivi dentro la finestra
+
+    // calibrazione
+    uint8_t cal_step;           // calib_ref_t in acquisizione
+    bool    cal_prompted;
+    bool    cal_capturing;
+
+    // insegnamento palette
+    uint8_t  teach_cls;         // CLASSIFY_NONE = scelta classe
+    bool     teach_prompted;
+    bool     teach_capturing;
+    uint8_t  teach_n;
+    uint32_t teach_sum[3];      // somma RGB8 dei campioni
+
+    // libreria campioni (Delta E)
+    bool     sw_prompted;
+    bool     sw_capturing;
+    uint8_t  sw_n;
+    uint32_t sw_sum[4];         // somma C/R/G/B corretti
+
+    // impostazioni (kv.c): copie usate sul percorso dei campioni
+    uint32_t min_clear_norm;    // clear minimo per classificare (Q8)
+    uint32_t lcd_period_ms;
+    uint32_t evt_margin_pct;
+    bool     set_prompted;
+    uint8_t  set_len;
+    char     set_line[32];      // riga in composizione da UART
 
     // menu
     bool menu_printed;
@@ -45,7 +108,7 @@ typedef struct {
     uint32_t blink_last_ms;
     uint32_t blink_remaining_toggles;
     bool     blinking;
-    uint32_t saved_count;
+    uint32_t saved_count;       // conteggio rosso salvato (lampeggi LED)
 } app_ctx_t;
 
 static app_ctx_t g_app;
@@ -53,31 +116,164 @@ static app_ctx_t g_app;
 // =====================
 // Config
 // =====================
-#define APP_READ_PERIOD_MS         200U
-#define APP_FLASH_ADDR_RED_COUNT   0x000000u   // inizio flash, settore 4KB
-
-// Threshold richiesti per "rosso"
-#define RED_R_MIN   200u
-#define RED_G_MAX    50u
-#define RED_B_MAX    50u
+#define APP_LCD_PERIOD_MS          200U    // refresh LCD (il campionamento segue il sensore)
+#define APP_SYNC_POLL_US           250U    // ripetizione poll STATUS se AINT non ancora alto
+
+// Acquisizione a eventi: a campo vuoto il sensore resta armato sulle soglie
+// del clear e il firmware non tocca il bus finche' non arriva INT (INT3).
+#define APP_EVT_ENABLE             1
+#define APP_EVT_MARGIN_PCT         15u     // finestra +/- attorno al clear a vuoto
+#define APP_EVT_MIN_DELTA          20u     // finestra minima (conteggi raw)
+#define APP_EVT_MIN_DELTA_NORM     256u    // finestra minima (1 conteggio/ms @1x)
+#define APP_EVT_PERS               TCS34725_PERS_2
+#define APP_EVT_EXIT_SAMPLES       5u      // campioni "vuoti" prima di ri-armare
+#define APP_I2C_SPEED              I2C_SPEED_400K  // max supportato dal TCS34725
+
+// Evita classificazioni su buio/rumore (raw clear molto basso)
+#define APP_MIN_CLEAR_RAW   60u
+
+// Stessa soglia in conteggi/ms @1x (Q8): era riferita a 24 ms, gain 1x
+#define APP_MIN_CLEAR_NORM(raw)  (((raw) * 2560u) / 240u)
+
+// AGC: gain/ATIME scelti a runtime dal clear (altrimenti ATIME/gain fissi)
+#define APP_AGC_ENABLE      1
+#define APP_ATIME_DEFAULT   TCS34725_IT_24MS
+#define APP_GAIN_DEFAULT    TCS34725_GAIN_1X
+
+// Filtro campioni: preset selezionabile da menu (latenza vs stabilita')
+typedef struct {
+    filter_mode_t mode;
+    uint8_t       win;
+    uint8_t       k;
+    const char   *name;
+} app_filter_preset_t;
+
+static const app_filter_preset_t k_filter_presets[] = {
+    { FILTER_NONE,   1u, 1u, "off"     },
+    { FILTER_MEDIAN, 3u, 1u, "median3" },
+    { FILTER_MEDIAN, 5u, 1u, "median5" },
+    { FILTER_MOVAVG, 4u, 1u, "avg4"    },
+    { FILTER_MOVAVG, 8u, 1u, "avg8"    },
+    { FILTER_IIR,    1u, 2u, "iir1/4"  },
+};
+#define APP_FILTER_PRESETS  (sizeof(k_filter_presets) / sizeof(k_filter_presets[0]))
+#define APP_FILTER_DEFAULT  1u      // median3: un campione isolato non conta
+
+// Conteggio a fronti: un target = classe stabile per ENTER_MS, uscita dopo
+// EXIT_MS di assenza, stessa classe ricontata solo dopo MIN_GAP_MS
+#define APP_TARGET_ENTER_MS     60u
+#define APP_TARGET_EXIT_MS      120u
+#define APP_TARGET_MIN_GAP_MS   150u
+
+// Palette: campioni mediati per insegnare una voce
+#define APP_TEACH_SAMPLES   16u
+
+// Registratore campioni grezzi ('r' durante la scansione): 1MB = ~250000
+// campioni compressi (~4 byte), ~10 min al ritmo massimo (2.4 ms)
+#define APP_REC_BYTES           0x100000u
+#define APP_REC_STATUS_MS       5000u
+#define APP_DUMP_PAGES          4u      // blocchi per lettura DMA nel dump
+
+// Libreria campioni: media per l'identificazione, timeout del caricamento
+#define APP_SWATCH_SAMPLES      16u
+#define APP_UPLOAD_TIMEOUT_MS   5000u
+
+// Cambio baud ('b'): tempo per scrivere il baud e per la conferma dell'host
+#define APP_BAUD_LINE_MS        10000u
+#define APP_BAUD_CONFIRM_MS     3000u
+
+// Impostazioni modificabili da UART (menu 's') e salvate nel KV store:
+// i #define qui sopra sono i default. Le chiavi restano fisse nel tempo
+// (una chiave non cambia mai significato).
+typedef enum {
+    APP_SET_AGC = 1,
+    APP_SET_GAIN,
+    APP_SET_ATIME,
+    APP_SET_MIN_CLEAR,
+    APP_SET_ENTER_MS,
+    APP_SET_EXIT_MS,
+    APP_SET_GAP_MS,
+    APP_SET_LCD_MS,
+    APP_SET_EVT_MARGIN,
+    APP_SET_FILTER
+} app_set_key_t;
 
-// Evita conteggi su buio/rumore (raw clear molto basso)
-#define RED_MIN_CLEAR_RAW   60u
+typedef struct {
+    uint16_t    key;
+    const char *name;
+    uint32_t    def;
+    uint32_t    min;
+    uint32_t    max;
+    const char *help;
+} app_setting_t;
+
+static const app_setting_t k_settings[] = {
+    { APP_SET_AGC,        "agc",        APP_AGC_ENABLE,        0u, 1u,      "auto gain/ATIME" },
+    { APP_SET_GAIN,       "gain",       APP_GAIN_DEFAULT,      0u, 3u,      "1/4/16/60x, agc=0" },
+    { APP_SET_ATIME,      "atime",      APP_ATIME_DEFAULT,     0u, 255u,    "(256-n)*2.4 ms, agc=0" },
+    { APP_SET_MIN_CLEAR,  "min_clear",  APP_MIN_CLEAR_RAW,     0u, 65535u,  "raw @24 ms 1x" },
+    { APP_SET_ENTER_MS,   "enter_ms",   APP_TARGET_ENTER_MS,   0u, 10000u,  "target confirm" },
+    { APP_SET_EXIT_MS,    "exit_ms",    APP_TARGET_EXIT_MS,    0u, 10000u,  "target exit" },
+    { APP_SET_GAP_MS,     "gap_ms",     APP_TARGET_MIN_GAP_MS, 0u, 10000u,  "same class recount" },
+    { APP_SET_LCD_MS,     "lcd_ms",     APP_LCD_PERIOD_MS,     50u, 5000u,  "LCD refresh" },
+    { APP_SET_EVT_MARGIN, "evt_margin", APP_EVT_MARGIN_PCT,    1u, 100u,    "INT window %" },
+    { APP_SET_FILTER,     "filter",     APP_FILTER_DEFAULT,    0u, APP_FILTER_PRESETS - 1u, "menu 6 preset" },
+};
+#define APP_SETTINGS  (sizeof(k_settings) / sizeof(k_settings[0]))
 
 // =====================
 // Prototipi locali
 // =====================
 static void app_print_menu(void);
-static int  app_uart_try_getc(char *out);     // non-blocking
 static void app_handle_menu_choice(char c);
+static void app_print_bus_stats(void);
+static void app_flash_report(void);
+static void app_filter_select(uint8_t preset);
+static uint32_t app_setting_get(uint16_t key);
+static void app_settings_apply(void);
+static void app_sensor_config(void);
+static void app_settings_print(void);
+static void app_settings_line(char *line);
+static void app_print_counts(const char *tag, const uint32_t *counts);
+static bool app_save_counts(void);
+static void app_import_legacy_counts(void);
+static void app_save_done(bool ok, uint32_t seq);
+static void app_reset_done(bool ok, uint32_t seq);
+static void app_target_events(const target_event_t *ev, uint8_t n);
+static void app_print_dwell(void);
+static void app_acquire_start(void);
+static int  app_acquire(bool allow_poll);
+static void app_calib_prompt(void);
+static void app_calib_finish(bool full);
+static void app_calib_exit(void);
+static void app_teach_prompt(void);
+static void app_teach_exit(void);
+static void app_swatch_identify(void);
+static void app_swatch_upload(void);
+static void app_rec_toggle(void);
+static void app_rec_task(void);
+static void app_rec_stop(void);
+static void app_rec_dump(void);
+static void app_rec_dump_done(bool ok, void *ctx);
+static bool app_uart_read(uint8_t *dst, uint32_t len, uint32_t timeout_ms);
+static void app_baud_report(const char *what, uint32_t baud, int32_t err_ppm);
+static void app_baud_switch(void);
+static void app_evt_reset(void);
+static void app_evt_update(const tcs34725_norm_t *norm);
+static void app_evt_try_arm(void);
+static void app_evt_track(void);
 
 static void app_state_menu_task(void);
 static void app_state_scan_task(void);
 static void app_state_show_count_task(void);
 static void app_state_reset_flash_task(void);
+static void app_state_calib_task(void);
+static void app_state_teach_task(void);
+static void app_state_swatch_task(void);
+static void app_state_settings_task(void);
 
-// classificazione per contare i rossi
-static bool app_is_red(const tcs34725_raw_t *raw);
+// classificazione (LUT) per i contatori per classe
+static uint8_t app_classify(const tcs34725_norm_t *norm, const tcs34725_rgb8_t *rgb);
 
 // =====================
 // API
@@ -85,44 +281,105 @@ static bool app_is_red(const tcs34725_raw_t *raw);
 void app_init(void)
 {
     g_app.state = APP_STATE_MENU;
-    g_app.last_read_ms = 0;
+    g_app.last_lcd_ms = 0;
+    g_app.last_poll_ticks = 0;
+    g_app.poll_wait_ticks = 0;
     g_app.scan_start_ms = 0;
-    g_app.red_count = 0;
+    memset(g_app.class_count, 0, sizeof(g_app.class_count));
+    g_app.log_samples = false;
+    g_app.use_palette = false;
+    g_app.sample_count = 0;
     g_app.sensor_ok = false;
+    g_app.read_pending = false;
     g_app.menu_printed = false;
 
     uart_init();
     uart_puts("\r\n[APP] Boot\r\n");
+    app_baud_report("UART", uart_get_baud(), uart_get_baud_error_ppm());
 
     i2c_init();
 
     flash_init();
     uart_puts("[APP] FLASH OK\r\n");
     uart_printf("[APP] FLASH SR=0x%02X\r\n", flash_read_status());
+    app_flash_report();
+
+    // Impostazioni prima di tutto il resto: filtro, target, sensore
+    if (!kv_init()) {
+        uart_puts("[APP][ERR] Settings read failed (defaults)\r\n");
+    } else if (kv_count() > 0u) {
+        uart_printf("[APP] Settings: %u saved\r\n", (unsigned)kv_count());
+    }
+    app_settings_apply();
+
+    if (calib_init()) {
+        uart_printf("[APP] Calibration loaded (%s)\r\n",
+                    (calib_get()->flags & CALIB_F_MATRIX) ? "3x3" : "white balance");
+    } else {
+        uart_puts("[APP] No calibration (raw colors)\r\n");
+    }
+
+    if (palette_init()) {
+        uart_printf("[APP] Palette loaded (%u colors)\r\n", (unsigned)palette_count());
+    }
+
+    if (!countlog_init()) {
+        uart_puts("[APP][ERR] Count log read failed\r\n");
+    } else {
+        if (countlog_seq() == 0u) {
+            app_import_legacy_counts();
+        }
+        if (countlog_seq() != 0u) {
+            uart_printf("[APP] Count log seq %lu\r\n", (unsigned long)countlog_seq());
+        }
+    }
+
+    lab_init();
+    if (swatch_init()) {
+        uart_printf("[APP] Swatch library: %u colors\r\n", (unsigned)swatch_count());
+    }
 
     led_init();
     beep_init();
 
+    // Link sensore in Fast mode; se il sensore non risponde si torna a 100 kHz
+    (void)i2c_set_speed(APP_I2C_SPEED);
     g_app.sensor_ok = tcs34725_init();
+    if (!g_app.sensor_ok && APP_I2C_SPEED != I2C_SPEED_100K) {
+        uart_puts("[APP] I2C fallback 100 kHz\r\n");
+        (void)i2c_set_speed(I2C_SPEED_100K);
+        g_app.sensor_ok = tcs34725_init();
+    }
     if (g_app.sensor_ok) {
-        tcs34725_set_integration_time(TCS34725_IT_24MS);
-        tcs34725_set_gain(TCS34725_GAIN_1X);
+        app_sensor_config();
         tcs34725_enable(true);
-        uart_puts("[APP] TCS34725 OK\r\n");
+        uart_printf("[APP] TCS34725 OK (I2C %lu kHz)\r\n",
+                    (unsigned long)(i2c_speed_hz(i2c_get_speed()) / 1000u));
     } else {
-        uart_puts("[APP][ERR] TCS34725 FAIL\r\n");
+        uart_printf("[APP][ERR] TCS34725 FAIL (I2C err=%u)\r\n", (unsigned)i2c_last_error());
     }
 
-    g_app.last_read_ms = utils_millis();
+    g_app.last_lcd_ms = utils_millis();
 }
 
 void app_task(void)
 {
+    // Watchdog transazioni I2C asincrone
+    i2c_task();
+
+    // Fine dei trasferimenti DMA della flash, poi il registratore
+    flash_task();
+    recorder_task();
+
     switch (g_app.state) {
         case APP_STATE_MENU:        app_state_menu_task(); break;
         case APP_STATE_SCAN:        app_state_scan_task(); break;
         case APP_STATE_SHOW_COUNT:  app_state_show_count_task(); break;
         case APP_STATE_RESET_FLASH: app_state_reset_flash_task(); break;
+        case APP_STATE_CALIB:       app_state_calib_task(); break;
+        case APP_STATE_TEACH:       app_state_teach_task(); break;
+        case APP_STATE_SWATCH:      app_state_swatch_task(); break;
+        case APP_STATE_SETTINGS:    app_state_settings_task(); break;
         default:
             g_app.state = APP_STATE_MENU;
             g_app.menu_printed = false;
@@ -139,19 +396,96 @@ static void app_print_menu(void)
     uart_puts(" COLORIMETER - MENU\r\n");
     uart_puts("========================\r\n");
     uart_puts("1) Start scan\r\n");
-    uart_puts("2) Show RED count\r\n");
+    uart_puts("2) Show saved counts\r\n");
     uart_puts("3) Reset saved data\r\n");
+    uart_printf("4) I2C speed (now %lu kHz)\r\n",
+                (unsigned long)(i2c_speed_hz(i2c_get_speed()) / 1000u));
+    uart_printf("5) Calibrate sensor (%s)\r\n", calib_is_active() ? "active" : "none");
+    uart_printf("6) Sample filter (now %s)\r\n", k_filter_presets[g_app.filter_preset].name);
+    uart_printf("7) Teach palette color (%u saved)\r\n", (unsigned)palette_count());
+    uart_printf("8) Classifier (now %s)\r\n", g_app.use_palette ? "HSV palette" : "RGB LUT");
+    uart_printf("9) Identify color (library: %u)\r\n", (unsigned)swatch_count());
+    uart_printf("0) Dump recording (%lu pages)\r\n", (unsigned long)recorder_stored());
+    uart_printf("s) Settings (%u saved)\r\n", (unsigned)kv_count());
+    uart_printf("b) Baud rate (%lu)\r\n", (unsigned long)uart_get_baud());
     uart_puts("------------------------\r\n");
     uart_puts("Select: ");
 }
 
-static int app_uart_try_getc(char *out)
+// Ricezione binaria (caricamenti): timeout sul singolo byte
+static bool app_uart_read(uint8_t *dst, uint32_t len, uint32_t timeout_ms)
 {
-    if (U4STAbits.URXDA) {
-        *out = (char)U4RXREG;
-        return 1;
+    for (uint32_t i = 0; i < len; i++) {
+        const uint32_t t0 = utils_millis();
+        char c;
+        while (!uart_try_getc(&c)) {
+            if ((utils_millis() - t0) >= timeout_ms) return false;
+        }
+        dst[i] = (uint8_t)c;
     }
-    return 0;
+    return true;
+}
+
+static void app_baud_report(const char *what, uint32_t baud, int32_t err_ppm)
+{
+    const uint32_t a = (uint32_t)((err_ppm < 0) ? -err_ppm : err_ppm);
+
+    uart_printf("[BAUD] %s %lu (err %c%lu.%02lu%%)\r\n", what,
+                (unsigned long)baud, (err_ppm < 0) ? '-' : '+',
+                (unsigned long)(a / 10000u), (unsigned long)((a / 100u) % 100u));
+}
+
+// Cambio baud concordato con l'host (tools/recorder/rec_dump.py --fast):
+//   host: "b", poi il baud in decimale e "\r"
+//   noi:  "[BAUD] SWITCH n (err ...)" alla velocita' attuale, poi si cambia
+//   host: passa a n e invia 'K' -> noi: "[BAUD] OK n" alla nuova velocita'
+// Senza 'K' entro APP_BAUD_CONFIRM_MS si torna al baud precedente.
+static void app_baud_switch(void)
+{
+    char line[12];
+    uint8_t n = 0;
+
+    uart_puts("Baud: ");
+    for (;;) {
+        uint8_t b;
+        if (!app_uart_read(&b, 1u, APP_BAUD_LINE_MS)) {
+            uart_puts("\r\n[BAUD][ERR] Timeout\r\n");
+            return;
+        }
+        if (b == '\r' || b == '\n') break;
+        if (n >= sizeof(line) - 1u) {
+            uart_puts("\r\n[BAUD][ERR] Bad rate\r\n");
+            return;
+        }
+        line[n++] = (char)b;
+        uart_putc((char)b);
+    }
+    line[n] = '\0';
+    uart_puts("\r\n");
+
+    const uint32_t baud = strtoul(line, NULL, 10);
+    const uint32_t prev = uart_get_baud();
+    int32_t err;
+    if (!uart_baud_calc(baud, NULL, &err)) {
+        uart_printf("[BAUD][ERR] %lu not supported\r\n", (unsigned long)baud);
+        return;
+    }
+
+    app_baud_report("SWITCH", baud, err);
+    (void)uart_set_baud(baud);
+
+    const uint32_t t0 = utils_millis();
+    while ((utils_millis() - t0) < APP_BAUD_CONFIRM_MS) {
+        char c;
+        if (uart_try_getc(&c) && c == 'K') {
+            app_baud_report("OK", baud, err);
+            return;
+        }
+    }
+
+    // Host muto alla nuova velocita': si torna dove eravamo
+    (void)uart_set_baud(prev);
+    app_baud_report("Fallback", prev, uart_get_baud_error_ppm());
 }
 
 static void app_handle_menu_choice(char c)
@@ -163,10 +497,21 @@ static void app_handle_menu_choice(char c)
         case '1':
             g_app.state = APP_STATE_SCAN;
             g_app.scan_start_ms = utils_millis();
-            g_app.last_read_ms = g_app.scan_start_ms;
-            g_app.red_count = 0;
-
-            uart_puts("[SCAN] Starting...\r\n");
+            g_app.last_lcd_ms = g_app.scan_start_ms;
+            memset(g_app.class_count, 0, sizeof(g_app.class_count));
+            memset(g_app.class_dwell_ms, 0, sizeof(g_app.class_dwell_ms));
+            target_reset(&g_app.targets);
+            g_app.sample_count = 0;
+            g_app.path_ticks_max = 0;
+            app_evt_reset();
+            filter_reset(&g_app.filter);
+            i2c_reset_stats();
+            uart_reset_stats();
+            app_acquire_start();
+
+            uart_printf("[SCAN] Starting... (1 sample / %lu us)\r\n",
+                        (unsigned long)tcs34725_integration_us());
+            uart_puts("[SCAN] l=log samples, r=record raw, q=quit\r\n");
             beep_beep_ms(400);
             break;
 
@@ -178,8 +523,88 @@ static void app_handle_menu_choice(char c)
             g_app.state = APP_STATE_RESET_FLASH;
             break;
 
+        case '4': {
+            // 100k -> 400k -> 1M -> 100k
+            i2c_speed_t sp = (i2c_speed_t)((i2c_get_speed() + 1) % (I2C_SPEED_1M + 1));
+            if (i2c_set_speed(sp)) {
+                uart_printf("[I2C] Speed = %lu kHz\r\n", (unsigned long)(i2c_speed_hz(sp) / 1000u));
+                if (sp == I2C_SPEED_1M) {
+                    uart_puts("[I2C] Warning: TCS34725 rated up to 400 kHz\r\n");
+                }
+            } else {
+                uart_puts("[I2C][ERR] Bus busy\r\n");
+            }
+            break;
+        }
+
+        case '5':
+            if (!g_app.sensor_ok) {
+                uart_puts("[CAL][ERR] Sensor not available\r\n");
+                break;
+            }
+            g_app.state = APP_STATE_CALIB;
+            g_app.cal_step = CALIB_REF_DARK;
+            g_app.cal_prompted = false;
+            g_app.cal_capturing = false;
+            app_acquire_start();
+            lcd_print_line(0, "CALIBRATION");
+            break;
+
+        case '6':
+            app_filter_select((uint8_t)((g_app.filter_preset + 1u) % APP_FILTER_PRESETS));
+            uart_printf("[FILTER] %s\r\n", k_filter_presets[g_app.filter_preset].name);
+            if (!kv_set(APP_SET_FILTER, g_app.filter_preset)) {
+                uart_puts("[FILTER][ERR] Not saved (FLASH busy)\r\n");
+            }
+            break;
+
+        case '7':
+            if (!g_app.sensor_ok) {
+                uart_puts("[PAL][ERR] Sensor not available\r\n");
+                break;
+            }
+            g_app.state = APP_STATE_TEACH;
+            g_app.teach_cls = CLASSIFY_NONE;
+            g_app.teach_prompted = false;
+            g_app.teach_capturing = false;
+            app_acquire_start();
+            lcd_print_line(0, "PALETTE");
+            break;
+
+        case '8':
+            g_app.use_palette = !g_app.use_palette;
+            uart_printf("[CLASS] %s\r\n", g_app.use_palette ? "HSV palette" : "RGB LUT");
+            if (g_app.use_palette && palette_count() == 0u) {
+                uart_puts("[CLASS] Warning: palette empty (menu 7)\r\n");
+            }
+            break;
+
+        case '9':
+            g_app.state = APP_STATE_SWATCH;
+            g_app.sw_prompted = false;
+            g_app.sw_capturing = false;
+            if (g_app.sensor_ok) app_acquire_start();
+            lcd_print_line(0, "IDENTIFY");
+            break;
+
+        case '0':
+            app_rec_dump();
+            break;
+
+        case 's':
+        case 'S':
+            g_app.state = APP_STATE_SETTINGS;
+            g_app.set_prompted = false;
+            g_app.set_len = 0;
+            break;
+
+        case 'b':
+        case 'B':
+            app_baud_switch();
+            break;
+
         default:
-            uart_puts("[MENU] Invalid choice. Press 1,2,3\r\n");
+            uart_puts("[MENU] Invalid choice. Press 0..9, s or b\r\n");
             break;
     }
 
@@ -197,11 +622,383 @@ static void app_state_menu_task(void)
     }
 
     char c;
-    if (app_uart_try_getc(&c)) {
+    if (uart_try_getc(&c)) {
         app_handle_menu_choice(c);
     }
 }
 
+// Costo I2C per campione (transazioni e byte sul bus)
+static void app_print_bus_stats(void)
+{
+    i2c_stats_t st;
+    i2c_get_stats(&st);
+
+    uart_printf("[SCAN] Samples=%lu I2C tx=%lu bytes=%lu\r\n",
+                (unsigned long)g_app.sample_count,
+                (unsigned long)st.transactions,
+                (unsigned long)st.bytes);
+
+    if (g_app.sample_count > 0u) {
+        uart_printf("[SCAN] Per sample: tx=%lu bytes=%lu\r\n",
+                    (unsigned long)(st.transactions / g_app.sample_count),
+                    (unsigned long)(st.bytes / g_app.sample_count));
+    }
+
+    // Filtro + calibrazione + RGB/HSV + classe: deve stare ben dentro
+    // il ciclo di integrazione piu' corto (2.4 ms)
+    uart_printf("[SCAN] Sample path max=%lu us (min cycle 2400 us)\r\n",
+                (unsigned long)((g_app.path_ticks_max + UTILS_TICKS_PER_US - 1u) / UTILS_TICKS_PER_US));
+
+    uart_stats_t us;
+    uart_get_stats(&us);
+    uart_printf("[SCAN] UART tx buffer max=%u/%u full=%lu dropped=%lu\r\n",
+                (unsigned)us.tx_max_used, (unsigned)UART_TX_BUF_SIZE,
+                (unsigned long)us.tx_full, (unsigned long)us.tx_dropped);
+    uart_printf("[SCAN] UART rx buffer max=%u/%u overrun=%lu dropped=%lu\r\n",
+                (unsigned)us.rx_max_used, (unsigned)UART_RX_BUF_SIZE,
+                (unsigned long)us.rx_overrun, (unsigned long)us.rx_dropped);
+}
+
+// JEDEC ID, SCK scelto e banda in lettura (4KB al clock di probe e a quello attuale)
+static void app_flash_report(void)
+{
+    static uint8_t buf[FLASH_SECTOR_SIZE_4K];
+
+    flash_info_t fi;
+    flash_get_info(&fi);
+    uart_printf("[APP] FLASH ID %02X %02X %02X: %s, SCK %lu kHz%s%s\r\n",
+                (unsigned)fi.jedec[0], (unsigned)fi.jedec[1], (unsigned)fi.jedec[2],
+                fi.known ? "known" : "unknown (safe settings)",
+                (unsigned long)(fi.sck_hz / 1000u), fi.fast_read ? ", FAST_READ" : "",
+                fi.suspend ? ", suspend" : "");
+
+    uint32_t us[2];
+    const uint32_t sck[2] = { FLASH_SCK_SAFE_HZ, fi.sck_hz };
+    for (uint8_t i = 0; i < 2u; i++) {
+        (void)flash_set_sck(sck[i]);
+        const uint32_t t0 = utils_ticks();
+        (void)flash_read(0, buf, sizeof(buf));
+        us[i] = (utils_ticks() - t0) / UTILS_TICKS_PER_US;
+    }
+
+    uart_printf("[APP] FLASH read 4KB: %lu us @ %lu kHz, %lu us now (%lu KB/s)\r\n",
+                (unsigned long)us[0], (unsigned long)(FLASH_SCK_SAFE_HZ / 1000u),
+                (unsigned long)us[1],
+                (unsigned long)((us[1] != 0u) ? (4000000u / us[1]) : 0u));
+}
+
+static void app_filter_select(uint8_t preset)
+{
+    const app_filter_preset_t *p = &k_filter_presets[preset];
+    g_app.filter_preset = preset;
+    filter_init(&g_app.filter, p->mode, p->win, p->k);
+}
+
+// Valore dal KV store (lookup in RAM), default se assente o fuori range
+static uint32_t app_setting_get(uint16_t key)
+{
+    for (uint8_t i = 0; i < APP_SETTINGS; i++) {
+        const app_setting_t *s = &k_settings[i];
+        if (s->key != key) continue;
+
+        const uint32_t v = kv_get_or(key, s->def);
+        return (v < s->min || v > s->max) ? s->def : v;
+    }
+    return 0;
+}
+
+// Copie delle impostazioni nel contesto: il percorso dei campioni non
+// cerca chiavi
+static void app_settings_apply(void)
+{
+    g_app.min_clear_norm = APP_MIN_CLEAR_NORM(app_setting_get(APP_SET_MIN_CLEAR));
+    g_app.lcd_period_ms = app_setting_get(APP_SET_LCD_MS);
+    g_app.evt_margin_pct = app_setting_get(APP_SET_EVT_MARGIN);
+
+    app_filter_select((uint8_t)app_setting_get(APP_SET_FILTER));
+
+    const target_cfg_t tcfg = {
+        (uint16_t)app_setting_get(APP_SET_ENTER_MS),
+        (uint16_t)app_setting_get(APP_SET_EXIT_MS),
+        (uint16_t)app_setting_get(APP_SET_GAP_MS)
+    };
+    target_init(&g_app.targets, &tcfg);
+}
+
+// ATIME/gain fissi, poi l'AGC (se attivo) parte dal suo passo
+static void app_sensor_config(void)
+{
+    if (!g_app.sensor_ok) return;
+
+    tcs34725_set_integration_time((tcs34725_it_t)app_setting_get(APP_SET_ATIME));
+    tcs34725_set_gain((tcs34725_gain_t)app_setting_get(APP_SET_GAIN));
+
+    if (!tcs34725_agc_enable(app_setting_get(APP_SET_AGC) != 0u)) {
+        uart_puts("[APP][ERR] AGC setup failed\r\n");
+    }
+}
+
+static void app_print_counts(const char *tag, const uint32_t *counts)
+{
+    for (uint8_t i = 1; i < CLASSIFY_COUNT; i++) {
+        uart_printf("[%s] %-7s %lu\r\n", tag, classify_name(i), (unsigned long)counts[i]);
+    }
+}
+
+static void app_print_dwell(void)
+{
+    for (uint8_t i = 1; i < CLASSIFY_COUNT; i++) {
+        if (g_app.class_count[i] == 0u) continue;
+        uart_printf("[SCAN] %-7s avg dwell %lu ms\r\n", classify_name(i),
+                    (unsigned long)(g_app.class_dwell_ms[i] / g_app.class_count[i]));
+    }
+}
+
+// Un conteggio per target (ingresso), permanenza registrata all'uscita
+static void app_target_events(const target_event_t *ev, uint8_t n)
+{
+    for (uint8_t i = 0; i < n; i++) {
+        const uint8_t cls = ev[i].cls;
+        if (ev[i].type == TARGET_EV_ENTER) {
+            g_app.class_count[cls]++;
+            uart_printf("[SCAN] +%s #%lu\r\n", classify_name(cls),
+                        (unsigned long)g_app.class_count[cls]);
+        } else {
+            g_app.class_dwell_ms[cls] += ev[i].dwell_ms;
+            uart_printf("[SCAN] -%s dwell %lu ms\r\n", classify_name(cls),
+                        (unsigned long)ev[i].dwell_ms);
+        }
+    }
+}
+
+// Salvataggio in coda flash: il superloop continua, l'esito in app_save_done()
+static bool app_save_counts(void)
+{
+    return countlog_append(g_app.class_count, CLASSIFY_COUNT, app_save_done);
+}
+
+static void app_save_done(bool ok, uint32_t seq)
+{
+    if (!ok) {
+        uart_puts("[SCAN][ERR] FLASH write failed\r\n");
+    } else {
+        uart_printf("[SCAN] Saved (record #%lu).\r\n", (unsigned long)seq);
+    }
+}
+
+/*
+ * Migrazione dal vecchio contatore a settore singolo
+ * (FLASH_REGION_LEGACY_COUNTER, senza seq ne' CRC), solo con il log vuoto:
+ *  - firmware originale: contatore dei rossi nella prima parola, resto erased
+ *  - versione successiva: uint32_t[CLASSIFY_COUNT], una parola per classe
+ * I valori vengono importati come primo record del log e il vecchio
+ * settore cancellato, cosi' al boot dopo non si importa due volte.
+ * Se la scrittura fallisce il settore resta com'e' e si riprova al boot.
+ */
+static void app_import_legacy_counts(void)
+{
+    uint32_t v[CLASSIFY_COUNT];
+    bool any = false;
+    bool tail_erased = true;
+
+    if (!flash_read(FLASH_REGION_LEGACY_COUNTER, v, sizeof(v))) return;
+
+    for (uint8_t i = 0; i < CLASSIFY_COUNT; i++) {
+        if (v[i] != 0xFFFFFFFFu) {
+            any = true;
+            if (i > 0u) tail_erased = false;
+        }
+    }
+    if (!any) return;
+
+    if (tail_erased) {
+        uint32_t red = v[0];
+        memset(v, 0, sizeof(v));
+        v[CLASSIFY_RED] = red;
+    } else {
+        for (uint8_t i = 0; i < CLASSIFY_COUNT; i++) {
+            if (v[i] == 0xFFFFFFFFu) v[i] = 0u;
+        }
+    }
+
+    // Al boot non c'e' altro in coda: si attende l'esito qui
+    if (!countlog_append(v, CLASSIFY_COUNT, NULL)) return;
+    while (countlog_busy()) {
+        flash_task();
+    }
+    if (countlog_seq() == 0u) {
+        uart_puts("[APP][ERR] Legacy counters import failed\r\n");
+        return;
+    }
+
+    (void)flash_erase_sector_4k(FLASH_REGION_LEGACY_COUNTER);
+    uart_puts("[APP] Legacy counters imported\r\n");
+}
+
+// =====================
+// Acquisizione a eventi
+// =====================
+static void app_evt_reset(void)
+{
+    g_app.evt_armed = false;
+    g_app.evt_arm_request = false;
+    g_app.evt_have_baseline = false;
+    g_app.evt_baseline = 0;
+    g_app.evt_quiet = 0;
+}
+
+// Il primo campione della scansione e' preso a campo vuoto (baseline);
+// dopo APP_EVT_EXIT_SAMPLES campioni vicini alla baseline il target e'
+// uscito e si torna ad aspettare INT.
+static void app_evt_update(const tcs34725_norm_t *norm)
+{
+    if (!g_app.evt_have_baseline) {
+        g_app.evt_baseline = norm->c;
+        g_app.evt_have_baseline = true;
+        g_app.evt_arm_request = true;
+        return;
+    }
+
+    uint32_t delta = (g_app.evt_baseline * g_app.evt_margin_pct) / 100u;
+    if (delta < APP_EVT_MIN_DELTA_NORM) delta = APP_EVT_MIN_DELTA_NORM;
+
+    const uint32_t c = norm->c;
+    const uint32_t b = g_app.evt_baseline;
+    const bool inside = (c + delta >= b) && (c <= b + delta);
+
+    if (!inside) {
+        g_app.evt_quiet = 0;
+        return;
+    }
+
+    if (++g_app.evt_quiet >= APP_EVT_EXIT_SAMPLES) {
+        g_app.evt_quiet = 0;
+        g_app.evt_arm_request = true;
+    }
+}
+
+// Soglie attorno alla baseline + persistence: il sensore integra da solo.
+// La baseline e' normalizzata: le soglie raw dipendono dal passo AGC attuale.
+static void app_evt_try_arm(void)
+{
+    const uint32_t b = tcs34725_norm_to_raw(g_app.evt_baseline);
+
+    uint32_t delta = (b * g_app.evt_margin_pct) / 100u;
+    if (delta < APP_EVT_MIN_DELTA) delta = APP_EVT_MIN_DELTA;
+
+    const uint16_t lo = (b > delta) ? (uint16_t)(b - delta) : 0u;
+    const uint16_t hi = ((b + delta) > 0xFFFFu) ? 0xFFFFu : (uint16_t)(b + delta);
+
+    g_app.evt_arm_request = false;
+
+    // Campo vuoto: i target ancora aperti escono qui (niente campioni fino a INT)
+    target_event_t ev[CLASSIFY_COUNT];
+    app_target_events(ev, target_flush(&g_app.targets, ev, CLASSIFY_COUNT));
+
+    // Soglie scritte e interrupt del sensore azzerato (threshold_enable),
+    // solo poi il flag INT3: un fronte dopo questo punto e' un evento
+    if (!tcs34725_threshold_enable(lo, hi, APP_EVT_PERS)) {
+        uart_puts("[SCAN][ERR] Sensor arm failed\r\n");
+        return;     // si resta in campionamento continuo
+    }
+    board_int3_tcs_clear();
+
+    // Evento gia' scattato fra il clear del sensore e quello del flag: il pin
+    // resta basso e non arriverebbe un altro fronte
+    if (board_int3_tcs_asserted()) {
+        app_evt_track();
+        return;
+    }
+
+    g_app.evt_armed = true;
+    lcd_print_line(1, "WAIT TARGET");
+}
+
+// Target nel campo: campionamento a ogni ciclo finche' non esce
+static void app_evt_track(void)
+{
+    g_app.evt_armed = false;
+    g_app.evt_quiet = 0;
+    filter_reset(&g_app.filter);
+
+    if (!tcs34725_sync_enable(true)) {
+        uart_puts("[SCAN][ERR] Sensor sync setup failed\r\n");
+    }
+
+    g_app.last_poll_ticks = utils_ticks();
+    g_app.poll_wait_ticks = 0;
+}
+
+// =====================
+// Acquisizione sincronizzata col sensore (scan e calibrazione)
+// =====================
+static void app_acquire_start(void)
+{
+    g_app.last_poll_ticks = utils_ticks();
+    g_app.poll_wait_ticks = 0;
+    g_app.read_pending = false;
+
+    // Un campione per ciclo di integrazione (AINT a ogni ciclo)
+    if (g_app.sensor_ok && !tcs34725_sync_enable(true)) {
+        uart_puts("[APP][ERR] Sensor sync setup failed\r\n");
+    }
+}
+
+// Poll STATUS+dati in un solo burst: il primo poll parte poco prima della
+// fine attesa del ciclo, poi si ripete ogni APP_SYNC_POLL_US finche' AINT
+// non segnala un ciclo completato. Mai campioni duplicati o persi.
+// return TCS34725_RD_NEW con g_app.raw/norm aggiornati.
+static int app_acquire(bool allow_poll)
+{
+    const uint32_t now_t = utils_ticks();
+    if (allow_poll && !g_app.read_pending &&
+        (now_t - g_app.last_poll_ticks) >= g_app.poll_wait_ticks) {
+
+        // Lettura in background: nel frattempo il superloop gestisce BTNC/UART
+        if (tcs34725_read_raw_start()) {
+            g_app.read_pending = true;
+        } else {
+            g_app.last_poll_ticks = now_t;
+            g_app.poll_wait_ticks = APP_SYNC_POLL_US * UTILS_TICKS_PER_US;
+            return TCS34725_RD_ERROR;
+        }
+    }
+
+    if (!g_app.read_pending) return TCS34725_RD_PENDING;
+
+    int rd = tcs34725_read_raw_poll(&g_app.raw);
+    if (rd == TCS34725_RD_PENDING) return rd;
+
+    g_app.read_pending = false;
+    g_app.last_poll_ticks = utils_ticks();
+    g_app.poll_wait_ticks = APP_SYNC_POLL_US * UTILS_TICKS_PER_US;
+
+    if (rd != TCS34725_RD_NEW) return rd;
+
+    // Passo AGC del ciclo appena letto: agc_process puo' cambiarlo
+    const uint8_t agc_step = tcs34725_agc_step();
+
+    // Prossimo ciclo: inutile interrogare il bus prima della sua fine
+    const uint32_t it_us = tcs34725_integration_us();
+    if (it_us > APP_SYNC_POLL_US) {
+        g_app.poll_wait_ticks = (it_us - APP_SYNC_POLL_US) * UTILS_TICKS_PER_US;
+    }
+
+    // Normalizzazione + AGC: un ciclo a cavallo di un cambio gain/ATIME
+    // viene scartato e si aspetta il ciclo successivo
+    const bool fresh = tcs34725_agc_process(&g_app.raw, &g_app.norm);
+
+    // Registratore: anche i cicli scartati, per l'analisi offline
+    if (recorder_active()) {
+        (void)recorder_add(&g_app.raw, agc_step, fresh ? 0u : RECORDER_F_STALE);
+    }
+
+    if (!fresh) return TCS34725_RD_STALE;
+
+    g_app.sample_count++;
+    return TCS34725_RD_NEW;
+}
+
 // =====================
 // STATE: SCAN
 // =====================
@@ -221,16 +1018,17 @@ static void app_state_scan_task(void)
     if (board_int4_btnc_fired()) {
         board_int4_btnc_clear();
 
-        uart_printf("\r\n[SCAN] Stopped by BTNC. RED count=%lu\r\n",
-                    (unsigned long)g_app.red_count);
+        uart_puts("\r\n[SCAN] Stopped by BTNC.\r\n");
+        app_rec_stop();
+        target_event_t ev[CLASSIFY_COUNT];
+        app_target_events(ev, target_flush(&g_app.targets, ev, CLASSIFY_COUNT));
+        app_print_counts("SCAN", g_app.class_count);
+        app_print_dwell();
+        app_print_bus_stats();
 
         uart_puts("[SCAN] Saving to FLASH...\r\n");
-        if (!flash_erase_sector_4k(APP_FLASH_ADDR_RED_COUNT)) {
-            uart_puts("[SCAN][ERR] FLASH erase failed\r\n");
-        } else if (!flash_write_u32(APP_FLASH_ADDR_RED_COUNT, (uint32_t)g_app.red_count)) {
-            uart_puts("[SCAN][ERR] FLASH write failed\r\n");
-        } else {
-            uart_puts("[SCAN] Saved.\r\n");
+        if (!app_save_counts()) {
+            uart_puts("[SCAN][ERR] FLASH busy\r\n");
         }
 
         lcd_inited_for_scan = 0;
@@ -249,28 +1047,93 @@ static void app_state_scan_task(void)
         return;
     }
 
-    const uint32_t now = utils_millis();
-    if ((now - g_app.last_read_ms) >= APP_READ_PERIOD_MS) {
-        g_app.last_read_ms = now;
+#if APP_EVT_ENABLE
+    // Campo vuoto: si aspetta il pin INT, zero traffico sul bus
+    if (g_app.evt_armed && board_int3_tcs_fired()) {
+        app_evt_track();            // sync + clear dell'interrupt del sensore
+        board_int3_tcs_clear();
+    }
+
+    if (g_app.evt_arm_request && !g_app.read_pending && !i2c_busy()) {
+        app_evt_try_arm();
+    }
+#endif
+
+    const int rd = app_acquire(!g_app.evt_armed && !g_app.evt_arm_request);
+    app_rec_task();
+
+    // Filtro fra acquisizione e classificazione: finche' la finestra non
+    // e' piena il campione non viene classificato
+    bool have_sample = false;
+    const uint32_t path_t0 = utils_ticks();
+    if (rd == TCS34725_RD_NEW) {
+#if APP_EVT_ENABLE
+        app_evt_update(&g_app.norm);
+#endif
+        have_sample = filter_push(&g_app.filter, &g_app.norm, &g_app.filt);
+    } else if (rd == TCS34725_RD_ERROR) {
+        uart_puts("[SCAN][ERR] Read failed\r\n");
+    }
 
-        if (tcs34725_read_raw(&g_app.raw)) {
+    if (have_sample) {
+        // Correzione per unita' (buio + matrice) e RGB 0..255 su C
+        g_app.cal = g_app.filt;
+        calib_apply(&g_app.cal);
+        tcs34725_norm_to_rgb8(&g_app.cal, &g_app.rgb);
 
-            // Conta rossi usando RGB scalati 0..255 + clear minimo
-            if (app_is_red(&g_app.raw)) {
-                g_app.red_count++;
-            }
+        // Una lettura di tabella per campione, qualunque sia il numero di classi
+        const uint8_t cls = app_classify(&g_app.filt, &g_app.rgb);
+
+        // Fronti per classe: il conteggio non dipende dalla frequenza di campionamento
+        target_event_t ev[CLASSIFY_COUNT];
+        const uint8_t nev = target_update(&g_app.targets, cls, utils_millis(), ev, CLASSIFY_COUNT);
+
+        const uint32_t path_dt = utils_ticks() - path_t0;
+        if (path_dt > g_app.path_ticks_max) g_app.path_ticks_max = path_dt;
 
-            // Converti RAW -> RGB 0..255 (per LCD/UART)
-            uint8_t r8, g8, b8;
-            tcs34725_raw_to_rgb8(&g_app.raw, &r8, &g8, &b8);
+        app_target_events(ev, nev);
+
+        // Log campioni: con il buffer TX pieno meglio perdere righe che campioni
+        if (g_app.log_samples) {
+            uart_set_tx_policy(UART_TX_DROP);
+            uart_printf("S,%u,%u,%u,%s\r\n", (unsigned)g_app.rgb.r, (unsigned)g_app.rgb.g,
+                        (unsigned)g_app.rgb.b, classify_name(cls));
+            uart_set_tx_policy(UART_TX_BLOCK);
+        }
+
+        // LCD lento (~1 ms/carattere): aggiornato ogni lcd_ms (impostazioni)
+        const uint32_t now = utils_millis();
+        if ((now - g_app.last_lcd_ms) >= g_app.lcd_period_ms) {
+            g_app.last_lcd_ms = now;
+
+            const uint8_t r8 = g_app.rgb.r;
+            const uint8_t g8 = g_app.rgb.g;
+            const uint8_t b8 = g_app.rgb.b;
+
+            // Lux / CCT compensati IR (interi, dal campione normalizzato)
+            tcs34725_light_t light;
+            const bool light_ok = tcs34725_calc_light(&g_app.filt, &light);
 
             // LCD Opzione A:
-            // riga 0: R fisso
-            // riga 1: alterna G/B ogni 500ms
+            // riga 0: R fisso + CCT
+            // riga 1: alterna G/B ogni 500ms + lux
             char line0[17];
             char line1[17];
 
-            (void)snprintf(line0, sizeof(line0), "R:%03u", (unsigned)r8);
+            recorder_status_t rs;
+            recorder_get_status(&rs);
+
+            if (recorder_active()) {
+                // indicatore di registrazione al posto della CCT
+                const unsigned pct = (rs.state == RECORDER_ERASING) ? 0u
+                                   : (unsigned)((rs.pages * 100u) / rs.pages_max);
+                (void)snprintf(line0, sizeof(line0), "R:%03u %s%3u%%", (unsigned)r8,
+                               (rs.state == RECORDER_ERASING) ? "ERA " : "REC ", pct);
+            } else if (light_ok) {
+                (void)snprintf(line0, sizeof(line0), "R:%03u %5uK", (unsigned)r8, (unsigned)light.cct_k);
+            } else {
+                (void)snprintf(line0, sizeof(line0), "R:%03u   ---K", (unsigned)r8);
+            }
 
             uint32_t t = utils_millis();
             if ((t - lcd_last_ms) >= 500u) {
@@ -278,10 +1141,11 @@ static void app_state_scan_task(void)
                 lcd_show_g ^= 1u;
             }
 
+            const unsigned long lux = (unsigned long)((light.lux_milli + 500u) / 1000u);
             if (lcd_show_g) {
-                (void)snprintf(line1, sizeof(line1), "G:%03u", (unsigned)g8);
+                (void)snprintf(line1, sizeof(line1), "G:%03u %6lulx", (unsigned)g8, lux);
             } else {
-                (void)snprintf(line1, sizeof(line1), "B:%03u", (unsigned)b8);
+                (void)snprintf(line1, sizeof(line1), "B:%03u %6lulx", (unsigned)b8, lux);
             }
 
             lcd_print_line(0, line0);
@@ -291,17 +1155,24 @@ static void app_state_scan_task(void)
             // uart_printf("RAW C=%u R=%u G=%u B=%u | RGB %u %u %u\r\n",
             //            (unsigned)g_app.raw.c,(unsigned)g_app.raw.r,(unsigned)g_app.raw.g,(unsigned)g_app.raw.b,
             //            (unsigned)r8,(unsigned)g8,(unsigned)b8);
-
-        } else {
-            uart_puts("[SCAN][ERR] Read failed\r\n");
         }
     }
 
-    // fallback 'q' per uscire
+    // fallback 'q' per uscire, 'l' log campioni (CSV per gen_color_lut.py)
     char c;
-    if (app_uart_try_getc(&c)) {
-        if (c == 'q' || c == 'Q') {
-            uart_printf("[SCAN] Stop. RED count=%lu\r\n", (unsigned long)g_app.red_count);
+    if (uart_try_getc(&c)) {
+        if (c == 'l' || c == 'L') {
+            g_app.log_samples = !g_app.log_samples;
+        } else if (c == 'r' || c == 'R') {
+            app_rec_toggle();
+        } else if (c == 'q' || c == 'Q') {
+            uart_puts("[SCAN] Stop.\r\n");
+            app_rec_stop();
+            target_event_t ev[CLASSIFY_COUNT];
+            app_target_events(ev, target_flush(&g_app.targets, ev, CLASSIFY_COUNT));
+            app_print_counts("SCAN", g_app.class_count);
+            app_print_dwell();
+            app_print_bus_stats();
             lcd_inited_for_scan = 0;
             g_app.state = APP_STATE_MENU;
             g_app.menu_printed = false;
@@ -309,25 +1180,146 @@ static void app_state_scan_task(void)
     }
 }
 
+// =====================
+// Registratore campioni grezzi (recorder.c)
+// =====================
+static void app_rec_toggle(void)
+{
+    if (recorder_active()) {
+        app_rec_stop();
+        return;
+    }
+
+    if (!recorder_start(APP_REC_BYTES)) {
+        uart_puts("[REC][ERR] Start failed\r\n");
+        return;
+    }
+    g_app.rec_state_prev = RECORDER_ERASING;
+    g_app.rec_last_ms = utils_millis();
+    uart_printf("[REC] Erasing %lu KB...\r\n", (unsigned long)(APP_REC_BYTES / 1024u));
+}
+
+// Cambi di stato e lunghezza della registrazione sulla UART
+static void app_rec_task(void)
+{
+    recorder_status_t st;
+    recorder_get_status(&st);
+
+    if (st.state != g_app.rec_state_prev) {
+        g_app.rec_state_prev = st.state;
+        g_app.rec_last_ms = utils_millis();
+
+        if (st.state == RECORDER_RUN) {
+            uart_printf("[REC] Recording (max %lu pages)\r\n", (unsigned long)st.pages_max);
+        } else if (st.state == RECORDER_FULL) {
+            uart_printf("[REC] Area full: %lu samples\r\n", (unsigned long)st.records);
+        } else if (st.state == RECORDER_ERROR) {
+            uart_puts("[REC][ERR] FLASH error, recording stopped\r\n");
+        }
+        return;
+    }
+
+    const uint32_t now = utils_millis();
+    if (st.state == RECORDER_RUN && (now - g_app.rec_last_ms) >= APP_REC_STATUS_MS) {
+        g_app.rec_last_ms = now;
+        uart_printf("[REC] %lu samples (%lu%%), dropped %lu\r\n",
+                    (unsigned long)st.records,
+                    (unsigned long)((st.pages * 100u) / st.pages_max),
+                    (unsigned long)st.dropped);
+    }
+}
+
+static void app_rec_stop(void)
+{
+    if (!recorder_active()) return;
+
+    const bool ok = recorder_stop();
+
+    recorder_status_t st;
+    recorder_get_status(&st);
+    g_app.rec_state_prev = st.state;
+
+    if (ok) {
+        uart_printf("[REC] Stopped: %lu samples in %lu pages, dropped %lu\r\n",
+                    (unsigned long)st.records, (unsigned long)st.pages,
+                    (unsigned long)st.dropped);
+    } else {
+        uart_puts("[REC][ERR] FLASH write failed\r\n");
+    }
+}
+
+// Dump binario (tools/recorder/rec_dump.py):
+//   "[REC] DUMP n\r\n", n blocchi compressi da FLASH_PAGE_SIZE byte,
+//   "\r\n[REC] END xxxx\r\n" con il CRC16 dei blocchi
+// La pagina successiva arriva via DMA mentre la UART invia la corrente.
+static void app_rec_dump(void)
+{
+    static uint8_t buf[2][APP_DUMP_PAGES * FLASH_PAGE_SIZE];
+
+    const uint32_t n = recorder_stored();
+    if (n == 0u) {
+        uart_puts("[REC] No recording\r\n");
+        return;
+    }
+
+    uart_printf("[REC] DUMP %lu\r\n", (unsigned long)n);
+
+    uint16_t crc = 0xFFFFu;
+    uint8_t cur = 0;
+    uint32_t k = (n > APP_DUMP_PAGES) ? APP_DUMP_PAGES : n;
+    bool ok = true;
+    bool rd_ok = recorder_read_dma(0, buf[cur], k, app_rec_dump_done, &ok);
+
+    for (uint32_t i = 0; rd_ok && i < n; ) {
+        while (flash_dma_busy()) flash_task();
+        if (!ok) break;
+
+        const uint32_t next = i + k;
+        const uint32_t k_next = ((n - next) > APP_DUMP_PAGES) ? APP_DUMP_PAGES : (n - next);
+        if (k_next > 0u) {
+            rd_ok = recorder_read_dma(next, buf[cur ^ 1u], k_next, app_rec_dump_done, &ok);
+        }
+
+        const uint8_t *p = buf[cur];
+        const uint32_t len = k * FLASH_PAGE_SIZE;
+        for (uint32_t j = 0; j < len; j++) uart_putc((char)p[j]);
+        crc = utils_crc16_update(crc, p, len);
+
+        i = next;
+        k = k_next;
+        cur ^= 1u;
+    }
+
+    while (flash_dma_busy()) flash_task();
+
+    if (!ok || !rd_ok) {
+        uart_puts("\r\n[REC][ERR] FLASH read failed\r\n");
+        return;
+    }
+    uart_printf("\r\n[REC] END %04X\r\n", (unsigned)crc);
+}
+
+static void app_rec_dump_done(bool ok, void *ctx)
+{
+    if (!ok) *(bool *)ctx = false;
+}
+
 // =====================
 // STATE: SHOW COUNT
 // =====================
 static void app_state_show_count_task(void)
 {
     if (!g_app.blinking) {
-        uint32_t saved = 0;
+        uint32_t counts[CLASSIFY_COUNT];
 
-        if (!flash_read_u32(APP_FLASH_ADDR_RED_COUNT, &saved)) {
-            uart_puts("\r\n[COUNT][ERR] FLASH read failed\r\n");
-            g_app.state = APP_STATE_MENU;
-            g_app.menu_printed = false;
-            return;
-        }
+        countlog_get(counts, CLASSIFY_COUNT);
 
-        if (saved == 0xFFFFFFFFu) saved = 0;
+        uart_printf("\r\n[COUNT] Record #%lu\r\n", (unsigned long)countlog_seq());
+        app_print_counts("COUNT", counts);
 
+        // LED: lampeggia il conteggio dei rossi
+        const uint32_t saved = counts[CLASSIFY_RED];
         g_app.saved_count = saved;
-        uart_printf("\r\n[COUNT] RED count (FLASH) = %lu\r\n", (unsigned long)saved);
 
         g_app.blink_remaining_toggles = (uint32_t)(2u * saved);
         g_app.blink_last_ms = utils_millis();
@@ -366,35 +1358,585 @@ static void app_state_show_count_task(void)
 // =====================
 static void app_state_reset_flash_task(void)
 {
-    uart_puts("\r\n[RESET] Erasing FLASH sector...\r\n");
+    // nessuna cancellazione: un record a zero diventa l'ultimo del log
+    static const uint32_t zero[CLASSIFY_COUNT] = {0};
+
+    uart_puts("\r\n[RESET] Writing zero record...\r\n");
+
+    // esito in app_reset_done(): il menu torna subito
+    if (!countlog_append(zero, CLASSIFY_COUNT, app_reset_done)) {
+        uart_puts("[RESET][ERR] FLASH busy\r\n");
+    }
+
+    g_app.state = APP_STATE_MENU;
+    g_app.menu_printed = false;
+}
+
+static void app_reset_done(bool ok, uint32_t seq)
+{
+    (void)seq;
 
-    if (!flash_erase_sector_4k(APP_FLASH_ADDR_RED_COUNT)) {
-        uart_puts("[RESET][ERR] FLASH erase failed\r\n");
+    if (!ok) {
+        uart_puts("[RESET][ERR] FLASH write failed\r\n");
     } else {
         uart_puts("[RESET] Done.\r\n");
     }
+}
+
+// =====================
+// STATE: CALIB
+// Buio, bianco e (facoltativi) primari R/G/B: ogni riferimento e' la media
+// di CALIB_CAPTURE_SAMPLES campioni normalizzati, quindi l'AGC puo' cambiare
+// passo fra un riferimento e l'altro.
+// =====================
+static void app_calib_prompt(void)
+{
+    static const char *const names[CALIB_REF_COUNT] = {
+        "DARK", "WHITE", "RED", "GREEN", "BLUE"
+    };
+
+    switch (g_app.cal_step) {
+        case CALIB_REF_DARK:
+            uart_puts("\r\n[CAL] 1/5 Cover the sensor, ENTER to capture (x=erase saved, q=abort)\r\n");
+            break;
+        case CALIB_REF_WHITE:
+            uart_puts("[CAL] 2/5 White reference, ENTER to capture\r\n");
+            break;
+        case CALIB_REF_RED:
+            uart_puts("[CAL] 3/5 Red reference, ENTER to capture (s=skip, white balance only)\r\n");
+            break;
+        default:
+            uart_printf("[CAL] %u/5 %s reference, ENTER to capture\r\n",
+                        (unsigned)(g_app.cal_step + 1u), names[g_app.cal_step]);
+            break;
+    }
+
+    lcd_print_line(1, names[g_app.cal_step]);
+}
 
+static void app_calib_finish(bool full)
+{
+    if (!calib_fit(full)) {
+        uart_puts("[CAL][ERR] Fit failed (check references)\r\n");
+        app_calib_exit();
+        return;
+    }
+
+    const calib_data_t *d = calib_get();
+    uart_printf("[CAL] Dark C=%lu R=%lu G=%lu B=%lu (Q8)\r\n",
+                (unsigned long)d->dark[0], (unsigned long)d->dark[1],
+                (unsigned long)d->dark[2], (unsigned long)d->dark[3]);
+    for (uint8_t i = 0; i < 3u; i++) {
+        uart_printf("[CAL] M %6ld %6ld %6ld (x1000)\r\n",
+                    (long)(((int64_t)d->m[i * 3u + 0u] * 1000) / CALIB_ONE),
+                    (long)(((int64_t)d->m[i * 3u + 1u] * 1000) / CALIB_ONE),
+                    (long)(((int64_t)d->m[i * 3u + 2u] * 1000) / CALIB_ONE));
+    }
+
+    if (calib_save()) {
+        uart_puts("[CAL] Saved.\r\n");
+        beep_beep_ms(200);
+    } else {
+        uart_puts("[CAL][ERR] FLASH save failed (active until reboot)\r\n");
+    }
+
+    app_calib_exit();
+}
+
+static void app_calib_exit(void)
+{
+    g_app.cal_capturing = false;
+    lcd_print_line(0, "Colorimetro");
+    lcd_print_line(1, "READY");
     g_app.state = APP_STATE_MENU;
     g_app.menu_printed = false;
 }
 
+static void app_state_calib_task(void)
+{
+    if (board_int4_btnc_fired()) {
+        board_int4_btnc_clear();
+        uart_puts("\r\n[CAL] Aborted by BTNC\r\n");
+        (void)calib_init();     // ripristina la calibrazione salvata
+        app_calib_exit();
+        return;
+    }
+
+    if (!g_app.cal_prompted) {
+        g_app.cal_prompted = true;
+        app_calib_prompt();
+    }
+
+    // Campionamento continuo anche fuori acquisizione: l'AGC converge
+    // sul riferimento prima di ENTER
+    const int rd = app_acquire(true);
+    if (rd == TCS34725_RD_ERROR) {
+        uart_puts("[CAL][ERR] Read failed\r\n");
+    }
+
+    if (rd == TCS34725_RD_NEW && g_app.cal_capturing &&
+        calib_capture_add(&g_app.norm)) {
+        g_app.cal_capturing = false;
+        // Tasti arrivati durante l'acquisizione (coda del CRLF compresa):
+        // non devono far partire il riferimento successivo
+        uart_rx_flush();
+        beep_beep_ms(100);
+        uart_puts("[CAL] Captured.\r\n");
+
+        if (g_app.cal_step == CALIB_REF_BLUE) {
+            app_calib_finish(true);
+            return;
+        }
+        g_app.cal_step++;
+        g_app.cal_prompted = false;
+    }
+
+    char c;
+    if (g_app.cal_capturing || !uart_try_getc(&c)) return;
+
+    switch (c) {
+        case '\r':
+        case '\n':
+            calib_capture_begin((calib_ref_t)g_app.cal_step);
+            g_app.cal_capturing = true;
+            uart_rx_flush();
+            break;
+
+        case 's':
+        case 'S':
+            if (g_app.cal_step == CALIB_REF_RED) app_calib_finish(false);
+            break;
+
+        case 'x':
+        case 'X':
+            if (g_app.cal_step == CALIB_REF_DARK) {
+                uart_puts(calib_erase() ? "[CAL] Calibration erased\r\n"
+                                        : "[CAL][ERR] FLASH erase failed\r\n");
+                app_calib_exit();
+            }
+            break;
+
+        case 'q':
+        case 'Q':
+            uart_puts("[CAL] Aborted\r\n");
+            (void)calib_init();
+            app_calib_exit();
+            break;
+
+        default:
+            break;
+    }
+}
+
 // =====================
-// Classificazione RED (tua richiesta)
-// - scala in RGB 0..255
-// - richiede clear minimo per evitare rumore su nero/buio
+// STATE: TEACH (palette HSV)
+// Classe scelta con l'iniziale, poi media di APP_TEACH_SAMPLES campioni
+// corretti dalla calibrazione: la voce nasce dalla hue media.
 // =====================
-static bool app_is_red(const tcs34725_raw_t *raw)
+static void app_teach_prompt(void)
 {
-    if (!raw) return false;
-    if (raw->c < (uint16_t)RED_MIN_CLEAR_RAW) return false;
+    if (g_app.teach_cls == CLASSIFY_NONE) {
+        uart_puts("\r\n[PAL] Color? ");
+        for (uint8_t i = 1; i < CLASSIFY_COUNT; i++) {
+            uart_printf("%c=%s ", classify_name(i)[0], classify_name(i));
+        }
+        uart_puts("(d=delete all, q=quit)\r\n");
+        lcd_print_line(1, "SELECT COLOR");
+    } else {
+        uart_printf("[PAL] Present %s sample, ENTER to capture (q=back)\r\n",
+                    classify_name(g_app.teach_cls));
+        lcd_print_line(1, classify_name(g_app.teach_cls));
+    }
+}
+
+static void app_teach_exit(void)
+{
+    g_app.teach_capturing = false;
+    lcd_print_line(0, "Colorimetro");
+    lcd_print_line(1, "READY");
+    g_app.state = APP_STATE_MENU;
+    g_app.menu_printed = false;
+}
+
+static void app_state_teach_task(void)
+{
+    if (board_int4_btnc_fired()) {
+        board_int4_btnc_clear();
+        uart_puts("\r\n[PAL] Stopped by BTNC\r\n");
+        app_teach_exit();
+        return;
+    }
+
+    if (!g_app.teach_prompted) {
+        g_app.teach_prompted = true;
+        app_teach_prompt();
+    }
 
-    uint8_t r8, g8, b8;
-    tcs34725_raw_to_rgb8(raw, &r8, &g8, &b8);
+    const int rd = app_acquire(true);
+    if (rd == TCS34725_RD_ERROR) {
+        uart_puts("[PAL][ERR] Read failed\r\n");
+    }
+
+    if (rd == TCS34725_RD_NEW && g_app.teach_capturing && !g_app.norm.saturated) {
+        tcs34725_norm_t n = g_app.norm;
+        tcs34725_rgb8_t rgb;
+        calib_apply(&n);
+        tcs34725_norm_to_rgb8(&n, &rgb);
+
+        g_app.teach_sum[0] += rgb.r;
+        g_app.teach_sum[1] += rgb.g;
+        g_app.teach_sum[2] += rgb.b;
+
+        if (++g_app.teach_n >= APP_TEACH_SAMPLES) {
+            const uint32_t half = APP_TEACH_SAMPLES / 2u;
+            rgb.r = (uint8_t)((g_app.teach_sum[0] + half) / APP_TEACH_SAMPLES);
+            rgb.g = (uint8_t)((g_app.teach_sum[1] + half) / APP_TEACH_SAMPLES);
+            rgb.b = (uint8_t)((g_app.teach_sum[2] + half) / APP_TEACH_SAMPLES);
+
+            tcs34725_hsv_t hsv;
+            tcs34725_rgb8_to_hsv(&rgb, &hsv);
+
+            uart_printf("[PAL] %s: RGB %u %u %u -> H=%u S=%u V=%u\r\n",
+                        classify_name(g_app.teach_cls),
+                        (unsigned)rgb.r, (unsigned)rgb.g, (unsigned)rgb.b,
+                        (unsigned)hsv.h, (unsigned)hsv.s, (unsigned)hsv.v);
+
+            if (!palette_teach(g_app.teach_cls, &hsv)) {
+                uart_puts("[PAL][ERR] Rejected (not saturated or palette full)\r\n");
+            } else if (!palette_save()) {
+                uart_puts("[PAL][ERR] FLASH save failed\r\n");
+            } else {
+                uart_puts("[PAL] Saved.\r\n");
+                beep_beep_ms(100);
+            }
+
+            g_app.teach_capturing = false;
+            g_app.teach_cls = CLASSIFY_NONE;
+            g_app.teach_prompted = false;
+        }
+    }
+
+    char c;
+    if (g_app.teach_capturing || !uart_try_getc(&c)) return;
+
+    if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+
+    if (g_app.teach_cls != CLASSIFY_NONE) {
+        if (c == '\r' || c == '\n' || c == ' ') {
+            memset(g_app.teach_sum, 0, sizeof(g_app.teach_sum));
+            g_app.teach_n = 0;
+            g_app.teach_capturing = true;
+        } else if (c == 'q') {
+            g_app.teach_cls = CLASSIFY_NONE;
+            g_app.teach_prompted = false;
+        }
+        return;
+    }
+
+    if (c == 'q') {
+        app_teach_exit();
+        return;
+    }
+
+    if (c == 'd') {
+        palette_clear();
+        uart_puts(palette_save() ? "[PAL] Palette cleared\r\n" : "[PAL][ERR] FLASH save failed\r\n");
+        g_app.teach_prompted = false;
+        return;
+    }
+
+    for (uint8_t i = 1; i < CLASSIFY_COUNT; i++) {
+        if (c == classify_name(i)[0]) {
+            g_app.teach_cls = i;
+            g_app.teach_prompted = false;
+            return;
+        }
+    }
+}
+
+// =====================
+// STATE: SWATCH (identificazione per Delta E su libreria in flash)
+// =====================
+static void app_swatch_identify(void)
+{
+    const uint32_t half = APP_SWATCH_SAMPLES / 2u;
+    tcs34725_norm_t avg;
+    avg.c = (g_app.sw_sum[0] + half) / APP_SWATCH_SAMPLES;
+    avg.r = (g_app.sw_sum[1] + half) / APP_SWATCH_SAMPLES;
+    avg.g = (g_app.sw_sum[2] + half) / APP_SWATCH_SAMPLES;
+    avg.b = (g_app.sw_sum[3] + half) / APP_SWATCH_SAMPLES;
+    avg.saturated = false;
+
+    // Riflettanza rispetto al bianco di calibrazione; senza calibrazione
+    // si usa il clear del campione (solo cromaticita' attendibile)
+    const uint32_t white = calib_is_active() ? calib_get()->white_c : avg.c;
+
+    lab_t lab;
+    lab_from_norm(&avg, white, &lab);
+    uart_printf("[SWL] Lab (x10) L=%d a=%d b=%d\r\n",
+                (int)((lab.L * 10) / 16), (int)((lab.a * 10) / 16), (int)((lab.b * 10) / 16));
+
+    swatch_match_t m;
+    const uint32_t t0 = utils_ticks();
+    const bool ok = swatch_nearest(&lab, &m);
+    const uint32_t us = (utils_ticks() - t0) / UTILS_TICKS_PER_US;
+
+    if (!ok) {
+        uart_puts("[SWL][ERR] Query failed\r\n");
+        return;
+    }
+
+    uart_printf("[SWL] Match #%u %s dE=%u.%02u (%u nodes, %lu us)\r\n",
+                (unsigned)m.id, m.code,
+                (unsigned)(m.de_x100 / 100u), (unsigned)(m.de_x100 % 100u),
+                (unsigned)m.visited, (unsigned long)us);
+    lcd_print_line(1, m.code);
+}
+
+// Handshake a pagine (tools/swatch/upload_swatch.py):
+//   host: lunghezza (4 byte LE)       fw: 'K' dopo l'erase
+//   host: blocchi da 256 byte          fw: 'K' dopo ogni scrittura
+//   fw: riga "[SWL] OK n" / "[SWL][ERR]" dopo la validazione
+static void app_swatch_upload(void)
+{
+    static uint8_t page[FLASH_PAGE_SIZE];
+
+    uart_puts("[SWL] READY\r\n");
+
+    uint8_t hdr[4];
+    if (!app_uart_read(hdr, sizeof(hdr), APP_UPLOAD_TIMEOUT_MS)) {
+        uart_puts("[SWL][ERR] Timeout\r\n");
+        return;
+    }
+    const uint32_t len = (uint32_t)hdr[0] | ((uint32_t)hdr[1] << 8) |
+                         ((uint32_t)hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+
+    if (!swatch_load_begin(len)) {
+        uart_putc('E');
+        uart_puts("\r\n[SWL][ERR] Bad size or erase failed\r\n");
+        return;
+    }
+    uart_putc('K');
+
+    for (uint32_t off = 0; off < len; ) {
+        const uint32_t n = ((len - off) > FLASH_PAGE_SIZE) ? FLASH_PAGE_SIZE : (len - off);
+
+        if (!app_uart_read(page, n, APP_UPLOAD_TIMEOUT_MS)) {
+            uart_puts("\r\n[SWL][ERR] Timeout\r\n");
+            return;
+        }
+        if (!swatch_load_write(off, page, n)) {
+            uart_putc('E');
+            uart_puts("\r\n[SWL][ERR] FLASH write failed\r\n");
+            return;
+        }
+        uart_putc('K');
+        off += n;
+    }
+
+    if (swatch_load_end()) {
+        uart_printf("\r\n[SWL] OK %u\r\n", (unsigned)swatch_count());
+    } else {
+        uart_puts("\r\n[SWL][ERR] Image invalid\r\n");
+    }
+}
+
+static void app_state_swatch_task(void)
+{
+    if (board_int4_btnc_fired()) {
+        board_int4_btnc_clear();
+        g_app.sw_capturing = false;
+        lcd_print_line(0, "Colorimetro");
+        lcd_print_line(1, "READY");
+        g_app.state = APP_STATE_MENU;
+        g_app.menu_printed = false;
+        return;
+    }
+
+    if (!g_app.sw_prompted) {
+        g_app.sw_prompted = true;
+        uart_printf("\r\n[SWL] Library: %u colors. ENTER=identify, u=upload, q=quit\r\n",
+                    (unsigned)swatch_count());
+    }
+
+    if (g_app.sensor_ok) {
+        const int rd = app_acquire(true);
+        if (rd == TCS34725_RD_ERROR) {
+            uart_puts("[SWL][ERR] Read failed\r\n");
+        }
+
+        if (rd == TCS34725_RD_NEW && g_app.sw_capturing && !g_app.norm.saturated) {
+            tcs34725_norm_t n = g_app.norm;
+            calib_apply(&n);
+            g_app.sw_sum[0] += n.c;
+            g_app.sw_sum[1] += n.r;
+            g_app.sw_sum[2] += n.g;
+            g_app.sw_sum[3] += n.b;
+
+            if (++g_app.sw_n >= APP_SWATCH_SAMPLES) {
+                g_app.sw_capturing = false;
+                uart_rx_flush();    // come nella calibrazione: niente ripartenze da CRLF
+                app_swatch_identify();
+                g_app.sw_prompted = false;
+            }
+        }
+    }
+
+    char c;
+    if (g_app.sw_capturing || !uart_try_getc(&c)) return;
+
+    switch (c) {
+        case '\r':
+        case '\n':
+            uart_rx_flush();
+            if (!g_app.sensor_ok || swatch_count() == 0u) {
+                uart_puts("[SWL][ERR] Sensor or library not available\r\n");
+                break;
+            }
+            memset(g_app.sw_sum, 0, sizeof(g_app.sw_sum));
+            g_app.sw_n = 0;
+            g_app.sw_capturing = true;
+            break;
+
+        case 'u':
+        case 'U':
+            app_swatch_upload();
+            g_app.sw_prompted = false;
+            break;
+
+        case 'q':
+        case 'Q':
+            lcd_print_line(0, "Colorimetro");
+            lcd_print_line(1, "READY");
+            g_app.state = APP_STATE_MENU;
+            g_app.menu_printed = false;
+            break;
+
+        default:
+            break;
+    }
+}
+
+// =====================
+// STATE: SETTINGS
+// Una riga "nome valore" + ENTER per voce; "default" cancella l'archivio.
+// =====================
+static void app_settings_print(void)
+{
+    uart_puts("\r\n[SET] name        value  range\r\n");
+    for (uint8_t i = 0; i < APP_SETTINGS; i++) {
+        const app_setting_t *s = &k_settings[i];
+        uint32_t v;
+        const bool saved = kv_get(s->key, &v);
+        uart_printf("[SET] %-11s %-6lu %lu..%lu %s%s\r\n", s->name,
+                    (unsigned long)app_setting_get(s->key),
+                    (unsigned long)s->min, (unsigned long)s->max, s->help,
+                    saved ? "" : " (default)");
+    }
+    uart_puts("[SET] Type \"name value\" + ENTER, \"default\" = reset all, q = back\r\n");
+}
+
+static void app_settings_line(char *line)
+{
+    char *name = strtok(line, " =");
+    char *arg = strtok(NULL, " =");
+    if (!name) return;
+
+    if (strcmp(name, "default") == 0) {
+        if (!kv_clear()) {
+            uart_puts("[SET][ERR] FLASH busy\r\n");
+            return;
+        }
+        app_settings_apply();
+        app_sensor_config();
+        app_settings_print();
+        return;
+    }
+
+    const app_setting_t *s = NULL;
+    for (uint8_t i = 0; i < APP_SETTINGS; i++) {
+        if (strcmp(name, k_settings[i].name) == 0) s = &k_settings[i];
+    }
+    if (!s) {
+        uart_printf("[SET][ERR] Unknown setting '%s'\r\n", name);
+        return;
+    }
+
+    char *end = NULL;
+    const unsigned long v = arg ? strtoul(arg, &end, 0) : 0ul;
+    if (!arg || *end != '\0' || v < s->min || v > s->max) {
+        uart_printf("[SET][ERR] %s: %lu..%lu\r\n", s->name,
+                    (unsigned long)s->min, (unsigned long)s->max);
+        return;
+    }
+
+    if (!kv_set(s->key, (uint32_t)v)) {
+        uart_puts("[SET][ERR] FLASH write failed\r\n");
+        return;
+    }
+    app_settings_apply();
+    if (s->key == APP_SET_AGC || s->key == APP_SET_GAIN || s->key == APP_SET_ATIME) {
+        app_sensor_config();
+    }
+    uart_printf("[SET] %s = %lu\r\n", s->name, v);
+}
+
+static void app_state_settings_task(void)
+{
+    if (!g_app.set_prompted) {
+        g_app.set_prompted = true;
+        app_settings_print();
+        uart_puts("> ");
+    }
+
+    char c;
+    if (!uart_try_getc(&c)) return;
+
+    if (c == '\r' || c == '\n') {
+        if (g_app.set_len == 0u) return;
+        uart_puts("\r\n");
+        g_app.set_line[g_app.set_len] = '\0';
+        g_app.set_len = 0;
+
+        if (strcmp(g_app.set_line, "q") == 0 || strcmp(g_app.set_line, "Q") == 0) {
+            g_app.state = APP_STATE_MENU;
+            g_app.menu_printed = false;
+            return;
+        }
+        app_settings_line(g_app.set_line);
+        uart_puts("> ");
+        return;
+    }
+
+    if (c == '\b' || c == 0x7F) {
+        if (g_app.set_len > 0u) {
+            g_app.set_len--;
+            uart_puts("\b \b");
+        }
+        return;
+    }
+
+    if (c >= ' ' && g_app.set_len < sizeof(g_app.set_line) - 1u) {
+        g_app.set_line[g_app.set_len++] = c;
+        uart_putc(c);
+    }
+}
+
+// =====================
+// Classificazione
+// - RGB 0..255 (gia' corretto dalla calibrazione) -> classe via LUT
+// - richiede clear minimo per evitare rumore su nero/buio
+// =====================
+static uint8_t app_classify(const tcs34725_norm_t *norm, const tcs34725_rgb8_t *rgb)
+{
+    if (!norm || !rgb) return CLASSIFY_NONE;
+    if (norm->c < g_app.min_clear_norm) return CLASSIFY_NONE;
 
-    // Threshold ?rosso non perfetto? richiesto
-    if (r8 >= (uint8_t)RED_R_MIN && g8 <= (uint8_t)RED_G_MAX && b8 <= (uint8_t)RED_B_MAX) {
-        return true;
+    if (g_app.use_palette) {
+        tcs34725_hsv_t hsv;
+        tcs34725_rgb8_to_hsv(rgb, &hsv);
+        return palette_classify(&hsv);
     }
 
-    return false;
+    return classify_rgb8(rgb);
 }
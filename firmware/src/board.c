@@ -20,6 +20,7 @@ void board_init(void)
     /* init periferiche varie... */
 
     board_int4_btnc_init();
+    board_int3_tcs_init();
 
     __builtin_enable_interrupts();
 }
@@ -70,5 +71,54 @@ void __ISR(_EXTERNAL_4_VECTOR, IPL5SOFT) isr_int4_btnc(void)
     g_btnc_int4_flag = true;
 }
 
+/* flag software settato dall'ISR INT3 */
+static volatile bool g_tcs_int3_flag = false;
 
+void board_int3_tcs_init(void)
+{
+    /* INT del TCS34725 cablato su Pmod JA9 = RG8 (ingresso digitale) */
+    TRISGbits.TRISG8 = 1;
+#ifdef ANSELG
+    ANSELGbits.ANSG8 = 0;
+#endif
+
+    /* Uscita open-drain del sensore: pull-up interno come sicurezza */
+    CNPUGbits.CNPUG8 = 1;
+
+    /* Mappa INT3 su RPG8:
+       INT3R<3:0> = 0001 -> RPG8 (verificare la tabella PPS se si cambia pin) */
+    INT3R = 0x1;
+
+    /* INT attivo basso -> INT3EP=0: fronte di discesa */
+    INTCONbits.INT3EP = 0;
+
+    /* Priorita' sotto BTNC */
+    IPC3bits.INT3IP = 4;
+    IPC3bits.INT3IS = 0;
+
+    /* Clear flag + enable */
+    IFS0CLR = _IFS0_INT3IF_MASK;
+    IEC0SET = _IEC0_INT3IE_MASK;
+}
+
+bool board_int3_tcs_fired(void)
+{
+    return g_tcs_int3_flag;
+}
+
+void board_int3_tcs_clear(void)
+{
+    g_tcs_int3_flag = false;
+}
 
+bool board_int3_tcs_asserted(void)
+{
+    return PORTGbits.RG8 == 0;
+}
+
+/* ISR INT3 */
+void __ISR(_EXTERNAL_3_VECTOR, IPL4SOFT) isr_int3_tcs(void)
+{
+    IFS0CLR = _IFS0_INT3IF_MASK;
+    g_tcs_int3_flag = true;
+}
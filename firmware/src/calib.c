@@ -0,0 +1,262 @@
+#include "calib.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "flash.h"
+#include "utils.h"
+
+/* =====================
+ * Limiti
+ * ===================== */
+#define CALIB_M_MAX     (64L * CALIB_ONE)   // |m| oltre 64x = riferimenti sbagliati
+
+/* =====================
+ * Helpers
+ * ===================== */
+static uint32_t calib_net(uint32_t x, uint32_t dark);
+static uint16_t calib_crc(const calib_data_t *d);
+static bool     calib_fit_diag(const uint32_t *w);
+static bool     calib_fit_full(const uint32_t *w);
+
+/* =====================
+ * Stato
+ * ===================== */
+static calib_data_t s_cal;
+static bool         s_active = false;
+
+// riferimenti mediati (C, R, G, B normalizzati)
+static uint32_t s_ref[CALIB_REF_COUNT][4];
+static uint8_t  s_ref_valid = 0;            // bitmask per calib_ref_t
+
+static calib_ref_t s_cap_ref = CALIB_REF_DARK;
+static uint32_t    s_cap_sum[4];
+static uint8_t     s_cap_n = 0;
+
+/* =====================
+ * API
+ * ===================== */
+bool calib_init(void)
+{
+    s_active = false;
+    s_ref_valid = 0;
+
+    calib_data_t d;
+    if (!flash_read(FLASH_REGION_CALIB, &d, sizeof(d))) return false;
+
+    if (d.magic != CALIB_MAGIC || d.version != CALIB_VERSION) return false;
+    if (d.crc != calib_crc(&d)) return false;
+
+    s_cal = d;
+    s_active = true;
+    return true;
+}
+
+bool calib_is_active(void)
+{
+    return s_active;
+}
+
+const calib_data_t *calib_get(void)
+{
+    return &s_cal;
+}
+
+void calib_apply(tcs34725_norm_t *n)
+{
+    if (!s_active || !n) return;
+
+    const int64_t r = (int64_t)calib_net(n->r, s_cal.dark[1]);
+    const int64_t g = (int64_t)calib_net(n->g, s_cal.dark[2]);
+    const int64_t b = (int64_t)calib_net(n->b, s_cal.dark[3]);
+
+    n->c = calib_net(n->c, s_cal.dark[0]);
+
+    uint32_t out[3];
+    const int32_t *m = s_cal.m;
+    for (uint8_t i = 0; i < 3u; i++, m += 3) {
+        int64_t acc = (int64_t)m[0] * r + (int64_t)m[1] * g + (int64_t)m[2] * b;
+        if (acc <= 0) {
+            out[i] = 0;
+        } else {
+            acc >>= CALIB_Q;
+            out[i] = (acc > 0xFFFFFFFFLL) ? 0xFFFFFFFFu : (uint32_t)acc;
+        }
+    }
+
+    n->r = out[0];
+    n->g = out[1];
+    n->b = out[2];
+}
+
+void calib_capture_begin(calib_ref_t ref)
+{
+    s_cap_ref = ref;
+    s_cap_n = 0;
+    memset(s_cap_sum, 0, sizeof(s_cap_sum));
+}
+
+bool calib_capture_add(const tcs34725_norm_t *n)
+{
+    if (!n || s_cap_ref >= CALIB_REF_COUNT) return false;
+    if (n->saturated) return false;
+
+    s_cap_sum[0] += n->c;
+    s_cap_sum[1] += n->r;
+    s_cap_sum[2] += n->g;
+    s_cap_sum[3] += n->b;
+
+    if (++s_cap_n < CALIB_CAPTURE_SAMPLES) return false;
+
+    for (uint8_t i = 0; i < 4u; i++) {
+        s_ref[s_cap_ref][i] = (s_cap_sum[i] + CALIB_CAPTURE_SAMPLES / 2u) / CALIB_CAPTURE_SAMPLES;
+    }
+    s_ref_valid |= (uint8_t)(1u << s_cap_ref);
+    return true;
+}
+
+bool calib_fit(bool full)
+{
+    const uint8_t need_base = (uint8_t)((1u << CALIB_REF_DARK) | (1u << CALIB_REF_WHITE));
+    const uint8_t need_prim = (uint8_t)((1u << CALIB_REF_RED) | (1u << CALIB_REF_GREEN) |
+                                        (1u << CALIB_REF_BLUE));
+
+    if ((s_ref_valid & need_base) != need_base) return false;
+    if (full && (s_ref_valid & need_prim) != need_prim) return false;
+
+    // bianco al netto del buio
+    const uint32_t *dark = s_ref[CALIB_REF_DARK];
+    uint32_t w[4];
+    for (uint8_t i = 0; i < 4u; i++) {
+        w[i] = calib_net(s_ref[CALIB_REF_WHITE][i], dark[i]);
+    }
+    if (w[0] < CALIB_MIN_WHITE_NORM) return false;
+    if (w[1] == 0u || w[2] == 0u || w[3] == 0u) return false;
+
+    const bool ok = full ? calib_fit_full(w) : calib_fit_diag(w);
+    if (!ok) return false;
+
+    s_cal.magic = CALIB_MAGIC;
+    s_cal.version = CALIB_VERSION;
+    s_cal.flags = full ? CALIB_F_MATRIX : 0u;
+    memcpy(s_cal.dark, dark, sizeof(s_cal.dark));
+    s_cal.white_c = w[0];
+    s_cal.reserved = 0;
+    s_cal.crc = calib_crc(&s_cal);
+
+    s_active = true;
+    return true;
+}
+
+bool calib_save(void)
+{
+    if (!s_active) return false;
+    return flash_sector_store(FLASH_REGION_CALIB, &s_cal, sizeof(s_cal));
+}
+
+bool calib_erase(void)
+{
+    s_active = false;
+    return flash_erase_sector_4k(FLASH_REGION_CALIB);
+}
+
+/* =====================
+ * Fit
+ * ===================== */
+static uint32_t calib_net(uint32_t x, uint32_t dark)
+{
+    return (x > dark) ? (x - dark) : 0u;
+}
+
+static uint16_t calib_crc(const calib_data_t *d)
+{
+    return utils_crc16(d, offsetof(calib_data_t, crc));
+}
+
+// Diagonale: m_ii = C_w / X_w  (bianco -> R'=G'=B'=C')
+static bool calib_fit_diag(const uint32_t *w)
+{
+    int32_t m[9] = {0};
+
+    for (uint8_t i = 0; i < 3u; i++) {
+        const uint64_t q = ((uint64_t)w[0] << CALIB_Q) / w[i + 1u];
+        if (q > (uint64_t)CALIB_M_MAX) return false;
+        m[i * 4u] = (int32_t)q;
+    }
+
+    memcpy(s_cal.m, m, sizeof(m));
+    return true;
+}
+
+/*
+ * Completa: P ha per colonne i primari misurati (al netto del buio).
+ * M = diag(s) * P^-1, con s scelto perche' M * W = (C_w, C_w, C_w):
+ *   M_ij = C_w * adj(P)_ij / sum_k adj(P)_ik * W_k
+ * det(P) si semplifica, quindi niente frazioni intermedie.
+ * M non cambia scalando tutti i riferimenti dello stesso fattore: si
+ * riportano a 16 bit e i prodotti stanno in int64
+ * (|adj| < 2^33, C_w * adj * 2^Q < 2^61).
+ */
+static bool calib_fit_full(const uint32_t *w)
+{
+    const uint32_t *dark = s_ref[CALIB_REF_DARK];
+
+    uint32_t p32[3][3];     // [canale sensore][primario]
+    uint32_t maxv = w[0];
+    for (uint8_t k = 0; k < 3u; k++) {
+        for (uint8_t i = 0; i < 3u; i++) {
+            p32[i][k] = calib_net(s_ref[CALIB_REF_RED + k][i + 1u], dark[i + 1u]);
+            if (p32[i][k] > maxv) maxv = p32[i][k];
+        }
+    }
+    for (uint8_t i = 1; i < 4u; i++) {
+        if (w[i] > maxv) maxv = w[i];
+    }
+
+    uint8_t sh = 0;
+    while ((maxv >> sh) > 0xFFFFu) sh++;
+
+    int64_t P[3][3];
+    int64_t W[3];
+    for (uint8_t i = 0; i < 3u; i++) {
+        for (uint8_t k = 0; k < 3u; k++) {
+            P[i][k] = (int64_t)(p32[i][k] >> sh);
+        }
+        W[i] = (int64_t)(w[i + 1u] >> sh);
+    }
+    const int64_t cw = (int64_t)(w[0] >> sh);
+
+    int64_t adj[3][3];
+    adj[0][0] = P[1][1] * P[2][2] - P[1][2] * P[2][1];
+    adj[0][1] = P[0][2] * P[2][1] - P[0][1] * P[2][2];
+    adj[0][2] = P[0][1] * P[1][2] - P[0][2] * P[1][1];
+    adj[1][0] = P[1][2] * P[2][0] - P[1][0] * P[2][2];
+    adj[1][1] = P[0][0] * P[2][2] - P[0][2] * P[2][0];
+    adj[1][2] = P[0][2] * P[1][0] - P[0][0] * P[1][2];
+    adj[2][0] = P[1][0] * P[2][1] - P[1][1] * P[2][0];
+    adj[2][1] = P[0][1] * P[2][0] - P[0][0] * P[2][1];
+    adj[2][2] = P[0][0] * P[1][1] - P[0][1] * P[1][0];
+
+    const int64_t det = P[0][0] * adj[0][0] + P[0][1] * adj[1][0] + P[0][2] * adj[2][0];
+    if (det == 0) return false;
+
+    int32_t m[9];
+    for (uint8_t i = 0; i < 3u; i++) {
+        const int64_t den = adj[i][0] * W[0] + adj[i][1] * W[1] + adj[i][2] * W[2];
+
+        // (P^-1 W)_i = den / det deve essere > 0: il bianco e' somma
+        // positiva dei primari, altrimenti i riferimenti non sono coerenti
+        if (den == 0 || ((den < 0) != (det < 0))) return false;
+
+        for (uint8_t j = 0; j < 3u; j++) {
+            const int64_t q = (cw * adj[i][j] * CALIB_ONE) / den;
+            if (q > CALIB_M_MAX || q < -CALIB_M_MAX) return false;
+            m[i * 3u + j] = (int32_t)q;
+        }
+    }
+
+    memcpy(s_cal.m, m, sizeof(m));
+    return true;
+}
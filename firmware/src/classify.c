@@ -0,0 +1,15 @@
+#include "classify.h"
+
+#include <stdint.h>
+
+/* =====================
+ * Nomi classi (stesso ordine di classify_class_t)
+ * ===================== */
+static const char *const k_class_names[CLASSIFY_COUNT] = {
+    "none", "red", "orange", "yellow", "green", "blue", "violet"
+};
+
+const char *classify_name(uint8_t cls)
+{
+    return (cls < CLASSIFY_COUNT) ? k_class_names[cls] : "?";
+}
@@ -0,0 +1,246 @@
+#include "countlog.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "flash.h"
+#include "utils.h"
+
+/* =====================
+ * Helpers
+ * ===================== */
+static uint32_t cl_addr(uint32_t slot);
+static bool     cl_read_seq(uint32_t slot, uint32_t *seq);
+static bool     cl_read_rec(uint32_t slot, countlog_rec_t *rec);
+static bool     cl_rec_valid(const countlog_rec_t *rec);
+static bool     cl_rebuild(const countlog_rec_t *last);
+static void     cl_append_done(flash_op_t *op);
+
+#define CL_SEQ_EMPTY    0xFFFFFFFFu
+#define CL_NO_SLOT      0xFFFFFFFFu
+
+/* =====================
+ * Stato
+ * ===================== */
+static countlog_rec_t s_last;       // ultimo record valido (seq 0 = nessuno)
+static uint32_t       s_next_slot;
+static uint32_t       s_next_seq;
+
+// salvataggio in corso: record e rilettura restano qui fino alla callback
+static countlog_rec_t s_rec;
+static countlog_rec_t s_chk;
+static flash_op_t     s_op_erase;
+static flash_op_t     s_op_write;
+static flash_op_t     s_op_check;
+static bool           s_erase_pending;
+static countlog_cb_t  s_cb;
+static bool           s_busy;
+
+/* =====================
+ * API
+ * ===================== */
+bool countlog_init(void)
+{
+    memset(&s_last, 0, sizeof(s_last));
+    s_next_slot = 0;
+    s_next_seq = 1;
+
+    // Anello: [giro corrente, seq crescenti][vuoti][giro precedente, seq < s0].
+    // Con s0 = seq dello slot 0 il predicato "seq valido e >= s0" e' vero
+    // su un prefisso: la ricerca binaria trova l'ultimo slot scritto.
+    uint32_t s0;
+    if (!cl_read_seq(0, &s0)) return false;
+
+    uint32_t head = CL_NO_SLOT;
+    if (s0 != CL_SEQ_EMPTY) {
+        uint32_t lo = 0;                // predicato vero
+        uint32_t hi = COUNTLOG_SLOTS;   // primo slot dove e' falso (o fine)
+        while ((hi - lo) > 1u) {
+            const uint32_t mid = lo + (hi - lo) / 2u;
+            uint32_t seq;
+            if (!cl_read_seq(mid, &seq)) return false;
+            if (seq != CL_SEQ_EMPTY && seq >= s0) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        head = lo;
+    } else {
+        // settore 0 appena cancellato per il giro: l'ultimo e' in fondo
+        uint32_t seq;
+        if (!cl_read_seq(COUNTLOG_SLOTS - 1u, &seq)) return false;
+        if (seq != CL_SEQ_EMPTY) head = COUNTLOG_SLOTS - 1u;
+    }
+
+    if (head == CL_NO_SLOT) return true;    // log vuoto
+
+    uint32_t head_seq;
+    if (!cl_read_seq(head, &head_seq)) return false;
+
+    // Scrittura interrotta: si torna indietro fino a un record integro
+    uint32_t slot = head;
+    for (uint32_t i = 0; i < COUNTLOG_SLOTS; i++) {
+        countlog_rec_t rec;
+        if (!cl_read_rec(slot, &rec)) return false;
+        if (rec.seq == CL_SEQ_EMPTY) break;
+        if (cl_rec_valid(&rec)) {
+            s_last = rec;
+            break;
+        }
+        slot = (slot == 0u) ? (COUNTLOG_SLOTS - 1u) : (slot - 1u);
+    }
+
+    // Testa integra: si prosegue. Testa interrotta: il suo seq non e' affidabile
+    // (i bit non programmati restano a 1). Se e' plausibile (poco oltre l'ultimo
+    // record integro) si prosegue dopo di lui e l'ordine dei seq resta valido;
+    // altrimenti confonderebbe la ricerca binaria ai giri successivi e l'anello
+    // si ricostruisce con l'ultimo record integro.
+    if (s_last.seq == head_seq ||
+        (s_last.seq != 0u && (head_seq - s_last.seq) <= COUNTLOG_SLOTS)) {
+        s_next_seq = head_seq + 1u;
+        s_next_slot = (head + 1u) % COUNTLOG_SLOTS;
+        return true;
+    }
+
+    return cl_rebuild((s_last.seq != 0u) ? &s_last : NULL);
+}
+
+void countlog_get(uint32_t *v, uint8_t n)
+{
+    if (!v) return;
+    if (n > COUNTLOG_VALUES) n = COUNTLOG_VALUES;
+    memcpy(v, s_last.v, (size_t)n * sizeof(uint32_t));
+}
+
+bool countlog_append(const uint32_t *v, uint8_t n, countlog_cb_t cb)
+{
+    if (!v || s_busy) return false;
+    if (n > COUNTLOG_VALUES) n = COUNTLOG_VALUES;
+
+    // Ingresso in un settore: l'unico erase (contiene il giro precedente)
+    const bool erase = (s_next_slot % COUNTLOG_SLOTS_PER_SEC) == 0u;
+    if (flash_queue_free() < (erase ? 3u : 2u)) return false;
+
+    memset(&s_rec, 0, sizeof(s_rec));
+    s_rec.seq = s_next_seq;
+    memcpy(s_rec.v, v, (size_t)n * sizeof(uint32_t));
+    s_rec.crc = utils_crc16(&s_rec, offsetof(countlog_rec_t, crc));
+
+    const uint32_t addr = cl_addr(s_next_slot);
+
+    // Catena in ordine di coda: la scrittura parte solo a erase riuscito,
+    // la rilettura solo a programmazione riuscita (after)
+    memset(&s_op_erase, 0, sizeof(s_op_erase));
+    s_op_erase.type = FLASH_OP_ERASE_4K;
+    s_op_erase.addr = addr;
+
+    memset(&s_op_write, 0, sizeof(s_op_write));
+    s_op_write.type = FLASH_OP_WRITE;
+    s_op_write.addr = addr;
+    s_op_write.src = &s_rec;
+    s_op_write.len = sizeof(s_rec);
+    s_op_write.after = erase ? &s_op_erase : NULL;
+
+    memset(&s_op_check, 0, sizeof(s_op_check));
+    s_op_check.type = FLASH_OP_READ;
+    s_op_check.addr = addr;
+    s_op_check.dst = &s_chk;
+    s_op_check.len = sizeof(s_chk);
+    s_op_check.after = &s_op_write;
+    s_op_check.cb = cl_append_done;
+
+    if (erase && !flash_submit(&s_op_erase)) return false;
+    (void)flash_submit(&s_op_write);        // posti verificati sopra
+    (void)flash_submit(&s_op_check);
+
+    // slot consumato anche se la scrittura fallisce: non e' piu' vuoto
+    s_next_slot = (s_next_slot + 1u) % COUNTLOG_SLOTS;
+    s_next_seq++;
+
+    s_erase_pending = erase;
+    s_cb = cb;
+    s_busy = true;
+    return true;
+}
+
+bool countlog_busy(void)
+{
+    return s_busy;
+}
+
+uint32_t countlog_seq(void)
+{
+    return s_last.seq;
+}
+
+/* =====================
+ * Helpers
+ * ===================== */
+static uint32_t cl_addr(uint32_t slot)
+{
+    return FLASH_REGION_COUNTLOG + slot * COUNTLOG_SLOT_SIZE;
+}
+
+static bool cl_read_seq(uint32_t slot, uint32_t *seq)
+{
+    return flash_read(cl_addr(slot), seq, sizeof(*seq));
+}
+
+static bool cl_read_rec(uint32_t slot, countlog_rec_t *rec)
+{
+    return flash_read(cl_addr(slot), rec, sizeof(*rec));
+}
+
+static bool cl_rec_valid(const countlog_rec_t *rec)
+{
+    return rec->seq != CL_SEQ_EMPTY &&
+           rec->crc == utils_crc16(rec, offsetof(countlog_rec_t, crc));
+}
+
+// Anello cancellato (solo al boot, bloccante) e ultimo record integro
+// riscritto nello slot 0 con seq 1. Senza record integri: log vuoto.
+static bool cl_rebuild(const countlog_rec_t *last)
+{
+    countlog_rec_t rec;
+    if (last) rec = *last;
+
+    memset(&s_last, 0, sizeof(s_last));
+    s_next_slot = 0;
+    s_next_seq = 1;
+
+    for (uint32_t i = 0; i < COUNTLOG_SECTORS; i++) {
+        if (!flash_erase_sector_4k(FLASH_REGION_COUNTLOG + i * FLASH_SECTOR_SIZE_4K)) return false;
+    }
+    if (!last) return true;
+
+    rec.seq = 1;
+    rec.crc = utils_crc16(&rec, offsetof(countlog_rec_t, crc));
+
+    countlog_rec_t chk;
+    if (!flash_write(cl_addr(0), &rec, sizeof(rec))) return false;
+    if (!cl_read_rec(0, &chk) || memcmp(&chk, &rec, sizeof(rec)) != 0) return false;
+
+    s_last = rec;
+    s_next_slot = 1;
+    s_next_seq = 2;
+    return true;
+}
+
+// Ultima operazione del salvataggio (rilettura): esito di tutta la catena.
+// Con un passo fallito la rilettura chiude in errore senza leggere.
+static void cl_append_done(flash_op_t *op)
+{
+    bool ok = (op->status == FLASH_OP_DONE) &&
+              (s_op_write.status == FLASH_OP_DONE) &&
+              (!s_erase_pending || s_op_erase.status == FLASH_OP_DONE) &&
+              (memcmp(&s_chk, &s_rec, sizeof(s_rec)) == 0);
+
+    if (ok) s_last = s_rec;
+
+    const countlog_cb_t cb = s_cb;
+    s_busy = false;
+    if (cb) cb(ok, s_rec.seq);
+}
@@ -0,0 +1,152 @@
+#include "filter.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* =====================
+ * Helpers
+ * ===================== */
+static void     filter_get(const tcs34725_norm_t *in, uint32_t *v);
+static void     filter_put(const uint32_t *v, bool sat, tcs34725_norm_t *out);
+static uint32_t filter_median3(uint32_t a, uint32_t b, uint32_t c);
+static uint32_t filter_median5(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t e);
+
+#define FILTER_CSWAP(a, b)  do { if ((a) > (b)) { uint32_t t_ = (a); (a) = (b); (b) = t_; } } while (0)
+
+/* =====================
+ * API
+ * ===================== */
+void filter_init(filter_t *f, filter_mode_t mode, uint8_t win, uint8_t k)
+{
+    if (!f) return;
+
+    if (win < 1u) win = 1u;
+    if (win > FILTER_WIN_MAX) win = FILTER_WIN_MAX;
+    if (mode == FILTER_MEDIAN) win = (win >= 5u) ? 5u : 3u;
+
+    if (k < 1u) k = 1u;
+    if (k > FILTER_IIR_K_MAX) k = FILTER_IIR_K_MAX;
+
+    f->mode = mode;
+    f->win = win;
+    f->k = k;
+    filter_reset(f);
+}
+
+void filter_reset(filter_t *f)
+{
+    if (!f) return;
+
+    f->head = 0;
+    f->count = 0;
+    f->sat_mask = 0;
+    memset(f->sum, 0, sizeof(f->sum));
+    memset(f->acc, 0, sizeof(f->acc));
+}
+
+bool filter_push(filter_t *f, const tcs34725_norm_t *in, tcs34725_norm_t *out)
+{
+    if (!f || !in || !out) return false;
+
+    uint32_t x[4];
+    uint32_t y[4];
+    filter_get(in, x);
+
+    switch (f->mode) {
+        case FILTER_MOVAVG:
+        case FILTER_MEDIAN: {
+            uint32_t *slot = f->ring[f->head];
+
+            // somma scorrevole: esce il campione piu' vecchio, entra il nuovo
+            for (uint8_t i = 0; i < 4u; i++) {
+                if (f->count >= f->win) f->sum[i] -= slot[i];
+                f->sum[i] += x[i];
+                slot[i] = x[i];
+            }
+
+            const uint8_t bit = (uint8_t)(1u << f->head);
+            f->sat_mask = in->saturated ? (uint8_t)(f->sat_mask | bit)
+                                        : (uint8_t)(f->sat_mask & ~bit);
+
+            if (++f->head >= f->win) f->head = 0;
+            if (f->count < f->win) f->count++;
+            if (f->count < f->win) return false;
+
+            for (uint8_t i = 0; i < 4u; i++) {
+                if (f->mode == FILTER_MOVAVG) {
+                    y[i] = (f->sum[i] + f->win / 2u) / f->win;
+                } else if (f->win == 3u) {
+                    y[i] = filter_median3(f->ring[0][i], f->ring[1][i], f->ring[2][i]);
+                } else {
+                    y[i] = filter_median5(f->ring[0][i], f->ring[1][i], f->ring[2][i],
+                                          f->ring[3][i], f->ring[4][i]);
+                }
+            }
+
+            filter_put(y, f->sat_mask != 0u, out);
+            return true;
+        }
+
+        case FILTER_IIR:
+            // acc = y * 2^k: nessun troncamento accumulato fra i passi
+            for (uint8_t i = 0; i < 4u; i++) {
+                if (f->count == 0u) {
+                    f->acc[i] = x[i] << f->k;
+                } else {
+                    f->acc[i] = f->acc[i] - (f->acc[i] >> f->k) + x[i];
+                }
+                y[i] = (f->acc[i] + (1u << (f->k - 1u))) >> f->k;
+            }
+            f->count = 1;
+            filter_put(y, in->saturated, out);
+            return true;
+
+        case FILTER_NONE:
+        default:
+            *out = *in;
+            return true;
+    }
+}
+
+/* =====================
+ * Helpers
+ * ===================== */
+static void filter_get(const tcs34725_norm_t *in, uint32_t *v)
+{
+    v[0] = in->c;
+    v[1] = in->r;
+    v[2] = in->g;
+    v[3] = in->b;
+}
+
+static void filter_put(const uint32_t *v, bool sat, tcs34725_norm_t *out)
+{
+    out->c = v[0];
+    out->r = v[1];
+    out->g = v[2];
+    out->b = v[3];
+    out->saturated = sat;
+}
+
+// Reti di ordinamento: numero fisso di confronti, nessun ciclo
+static uint32_t filter_median3(uint32_t a, uint32_t b, uint32_t c)
+{
+    FILTER_CSWAP(a, b);
+    FILTER_CSWAP(b, c);
+    FILTER_CSWAP(a, b);
+    return b;
+}
+
+// 7 confronti (Paeth): c e' la mediana alla fine
+static uint32_t filter_median5(uint32_t a, uint32_t b, uint32_t c, uint32_t d, uint32_t e)
+{
+    FILTER_CSWAP(a, b);
+    FILTER_CSWAP(d, e);
+    FILTER_CSWAP(a, d);     // a = min dei 4: escluso
+    FILTER_CSWAP(b, e);     // e = max dei 4: escluso
+    FILTER_CSWAP(b, c);
+    FILTER_CSWAP(c, d);
+    FILTER_CSWAP(b, c);
+    return c;
+}
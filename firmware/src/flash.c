@@ -1,6 +1,7 @@
 #include "flash.h"
 
 #include <xc.h>
+#include <sys/kmem.h>   // KVA_TO_PA per i registri DMA
 #include <string.h>
 
 #include "utils.h"   // per utils_millis() / delay 
@@ -19,16 +20,111 @@ static inline void flash_cs_high(void) { FLASH_CS_LAT = 1; }
 #define FLASH_SPI1_BRG  19u
 #endif
 
+// ENHBUF: FIFO TX/RX da 128 bit = 16 byte in modo 8 bit
+#define FLASH_SPI_FIFO  16u
+
+// Chip noti: SCK massimo sulla scheda (tutti supportano FAST_READ)
+typedef struct {
+    uint8_t  id[3];
+    uint32_t sck_max_hz;
+    bool     suspend;
+} flash_part_t;
+
+static const flash_part_t k_flash_parts[] = {
+    { { 0x01u, 0x40u, 0x16u }, FLASH_SCK_MAX_HZ, true },    // S25FL132K (Basys MX3)
+    { { 0x01u, 0x40u, 0x17u }, FLASH_SCK_MAX_HZ, true },    // S25FL164K
+};
+#define FLASH_PARTS  (sizeof(k_flash_parts) / sizeof(k_flash_parts[0]))
+
+static flash_info_t s_info;
+
+// Trasferimento DMA in corso
+typedef struct {
+    volatile bool  active;
+    uint8_t       *dst;         // lettura: prossimo blocco
+    size_t         left;        // byte ancora da trasferire dopo il blocco attuale
+    uint32_t       t0_ms;
+    flash_dma_cb_t cb;
+    void          *ctx;
+} flash_dma_t;
+
+static flash_dma_t s_dma;
+static bool        s_dma_ok;                       // esito dell'ultimo trasferimento
+static uint8_t     s_dma_sink[FLASH_PAGE_SIZE];    // RX scartati durante il program
+
+static void flash_dma_init(void);
+static void flash_dma_block(const uint8_t *tx, uint8_t *rx, size_t len);
+static void flash_dma_finish(bool ok);
+static void flash_dma_read_start(uint32_t addr, uint8_t *dst, size_t len,
+                                 flash_dma_cb_t cb, void *ctx);
+static void flash_dma_program_start(uint32_t addr, const uint8_t *src, size_t len,
+                                    flash_dma_cb_t cb, void *ctx);
+
+// Coda delle operazioni asincrone (flash_submit)
+typedef enum {
+    FLASH_PH_START = 0,         // prossimo passo da lanciare
+    FLASH_PH_DMA,               // trasferimento DMA in corso
+    FLASH_PH_WIP                // attesa fine program/erase interno al chip
+} flash_phase_t;
+
+static flash_op_t   *s_q[FLASH_QUEUE_LEN];
+static uint8_t       s_q_head;
+static uint8_t       s_q_count;
+static flash_op_t   *s_op;      // in esecuzione
+static flash_phase_t s_op_phase;
+static size_t        s_op_off;  // byte gia' scritti/letti
+static size_t        s_op_step; // byte del passo in corso
+static uint32_t      s_op_t0_ms;
+static uint32_t      s_op_timeout_ms;
+static bool          s_in_task; // dentro flash_task() (callback)
+
+static bool flash_locked(void);
+static void flash_cmd_addr(uint8_t cmd, uint32_t addr);
+static void flash_pp_open(uint32_t addr);
+static void flash_op_step(void);
+static void flash_op_finish(bool ok);
+static bool flash_drain(bool queue);
+
+// Ultimo program/erase lanciato: area da non leggere se sospeso
+static uint32_t s_wip_addr;
+static uint32_t s_wip_len;          // 0 = non sospendibile (chip erase)
+static uint32_t s_resume_ticks;
+
+static bool    flash_suspend(uint32_t addr, size_t len, bool *resume);
+static void    flash_resume(void);
+static uint8_t flash_read_status2(void);
+
+// In modo ENHBUF SPIRBF significa "FIFO RX piena": si aspetta !SPIRBE
 static uint8_t spi1_xfer(uint8_t b)
 {
-    // wait TX buffer empty
+    // wait TX buffer not full
     while (SPI1STATbits.SPITBF) {;}
     SPI1BUF = b;
-    // wait RX full
-    while (!SPI1STATbits.SPIRBF) {;}
+    // wait RX not empty
+    while (SPI1STATbits.SPIRBE) {;}
     return (uint8_t)SPI1BUF;
 }
 
+// Trasferimento a FIFO piena: mai piu' di FLASH_SPI_FIFO byte in volo,
+// cosi' la FIFO RX non va in overflow. tx NULL = 0xFF, rx NULL = scarta.
+static void spi1_bulk(const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    size_t nt = 0;
+    size_t nr = 0;
+
+    while (nr < len) {
+        while (nt < len && (nt - nr) < FLASH_SPI_FIFO && !SPI1STATbits.SPITBF) {
+            SPI1BUF = tx ? tx[nt] : 0xFFu;
+            nt++;
+        }
+        while (nr < nt && !SPI1STATbits.SPIRBE) {
+            const uint8_t b = (uint8_t)SPI1BUF;
+            if (rx) rx[nr] = b;
+            nr++;
+        }
+    }
+}
+
 static void flash_write_enable(void)
 {
     flash_cs_low();
@@ -38,6 +134,9 @@ static void flash_write_enable(void)
 
 uint8_t flash_read_status(void)
 {
+    // CE occupato dal DMA: per il chiamante la flash e' occupata
+    if (s_dma.active) return FLASH_SR_WIP;
+
     uint8_t sr;
     flash_cs_low();
     spi1_xfer(FLASH_CMD_RDSR);
@@ -94,11 +193,63 @@ void flash_init(void)
     SPI1CONbits.SMP   = 1; // sample end
     SPI1CONbits.MODE16 = 0;
     SPI1CONbits.MODE32 = 0;
+    SPI1CONbits.ENHBUF = 1; // FIFO 16 byte (spi1_bulk)
+    SPI1CONbits.STXISEL = 3; // TX IF: FIFO non piena  -> richiesta DMA TX
+    SPI1CONbits.SRXISEL = 1; // RX IF: FIFO non vuota  -> richiesta DMA RX
 
     SPI1CONbits.ON = 1;
 
     // assicurati che non stia gi "busy"
     (void)flash_wait_ready(100);
+
+    flash_dma_init();
+
+    // Probe JEDEC a clock basso: solo un chip riconosciuto sale di SCK
+    memset(&s_info, 0, sizeof(s_info));
+    s_info.sck_hz = PBCLK_HZ / (2u * (FLASH_SPI1_BRG + 1u));
+    flash_read_jedec(s_info.jedec);
+
+    for (uint8_t i = 0; i < FLASH_PARTS; i++) {
+        if (memcmp(s_info.jedec, k_flash_parts[i].id, 3) == 0) {
+            s_info.known = true;
+            s_info.fast_read = true;
+            s_info.suspend = k_flash_parts[i].suspend;
+            (void)flash_set_sck(k_flash_parts[i].sck_max_hz);
+            break;
+        }
+    }
+}
+
+void flash_read_jedec(uint8_t id[3])
+{
+    flash_cs_low();
+    spi1_xfer(FLASH_CMD_RDID);
+    spi1_bulk(NULL, id, 3);
+    flash_cs_high();
+}
+
+uint32_t flash_set_sck(uint32_t hz)
+{
+    if (hz > FLASH_SCK_MAX_HZ) hz = FLASH_SCK_MAX_HZ;
+    if (hz == 0u) hz = FLASH_SCK_SAFE_HZ;
+
+    // BRG per eccesso: SCK mai sopra la richiesta
+    uint32_t brg = (PBCLK_HZ + 2u * hz - 1u) / (2u * hz);
+    brg = (brg > 0u) ? brg - 1u : 0u;
+    if (brg > 0x1FFu) brg = 0x1FFu;
+
+    // BRG si cambia solo a modulo spento
+    SPI1CONbits.ON = 0;
+    SPI1BRG = brg;
+    SPI1CONbits.ON = 1;
+
+    s_info.sck_hz = PBCLK_HZ / (2u * (brg + 1u));
+    return s_info.sck_hz;
+}
+
+void flash_get_info(flash_info_t *info)
+{
+    if (info) *info = s_info;
 }
 
 static bool flash_addr_ok(uint32_t addr, size_t len)
@@ -113,57 +264,83 @@ bool flash_read(uint32_t addr, void *dst, size_t len)
 {
     if (!flash_addr_ok(addr, len)) return false;
     if (len == 0) return true;
+    if (!flash_drain(false)) return false;
+
+    // Program/erase in corso: sospeso per la durata della lettura
+    bool resume = false;
+    if ((flash_read_status() & FLASH_SR_WIP) && !flash_suspend(addr, (uint32_t)len, &resume)) {
+        return false;
+    }
 
     uint8_t *p = (uint8_t*)dst;
 
     flash_cs_low();
-    spi1_xfer(FLASH_CMD_READ);
+    spi1_xfer(s_info.fast_read ? FLASH_CMD_FAST_READ : FLASH_CMD_READ);
     spi1_xfer((uint8_t)(addr >> 16));
     spi1_xfer((uint8_t)(addr >> 8));
     spi1_xfer((uint8_t)(addr >> 0));
+    if (s_info.fast_read) spi1_xfer(0xFF);     // dummy
 
-    for (size_t i = 0; i < len; i++) {
-        p[i] = spi1_xfer(0xFF);
-    }
+    spi1_bulk(NULL, p, len);
     flash_cs_high();
+
+    if (resume) flash_resume();
     return true;
 }
 
 bool flash_erase_sector_4k(uint32_t addr)
 {
     if (addr >= FLASH_SIZE_BYTES) return false;
+    if (!flash_drain(true)) return false;
 
     // allinea a 4KB
-    uint32_t a = addr & ~(FLASH_SECTOR_SIZE_4K - 1u);
-
-    flash_write_enable();
-
-    flash_cs_low();
-    spi1_xfer(FLASH_CMD_SE_4K);
-    spi1_xfer((uint8_t)(a >> 16));
-    spi1_xfer((uint8_t)(a >> 8));
-    spi1_xfer((uint8_t)(a >> 0));
-    flash_cs_high();
+    flash_cmd_addr(FLASH_CMD_SE_4K, addr & ~(FLASH_SECTOR_SIZE_4K - 1u));
 
     // Sector erase pu metterci decine/centinaia di ms: timeout conservativo
     return flash_wait_ready(2000);
 }
 
-static bool flash_page_program(uint32_t addr, const uint8_t *src, size_t len)
+bool flash_erase_block_64k_start(uint32_t addr)
 {
-    // len MUST be <= 256 and must not cross page boundary
-    flash_write_enable();
+    if (addr >= FLASH_SIZE_BYTES) return false;
+    if (flash_locked()) return false;
 
-    flash_cs_low();
-    spi1_xfer(FLASH_CMD_PP);
-    spi1_xfer((uint8_t)(addr >> 16));
-    spi1_xfer((uint8_t)(addr >> 8));
-    spi1_xfer((uint8_t)(addr >> 0));
+    flash_cmd_addr(FLASH_CMD_BE_64K, addr & ~(FLASH_BLOCK_SIZE_64K - 1u));
+    return true;
+}
 
-    for (size_t i = 0; i < len; i++) {
-        spi1_xfer(src[i]);
-    }
+bool flash_busy(void)
+{
+    if (flash_locked()) return true;
+    return (flash_read_status() & FLASH_SR_WIP) != 0u;
+}
+
+bool flash_pp_begin(uint32_t addr)
+{
+    if (addr >= FLASH_SIZE_BYTES) return false;
+    if (flash_locked()) return false;
+
+    flash_pp_open(addr);
+    return true;
+}
+
+void flash_pp_data(const uint8_t *src, size_t len)
+{
+    spi1_bulk(src, NULL, len);
+}
+
+void flash_pp_end(void)
+{
     flash_cs_high();
+}
+
+static bool flash_page_program(uint32_t addr, const uint8_t *src, size_t len)
+{
+    // len MUST be <= 256 and must not cross page boundary
+    if (!flash_drain(true)) return false;
+    if (!flash_pp_begin(addr)) return false;
+    flash_pp_data(src, len);
+    flash_pp_end();
 
     // Program page tipicamente pochi ms: timeout conservativo
     return flash_wait_ready(200);
@@ -190,13 +367,39 @@ bool flash_write(uint32_t addr, const void *src, size_t len)
     return true;
 }
 
+bool flash_sector_store(uint32_t addr, const void *src, size_t len)
+{
+    if (!src) return false;
+    if ((addr & (FLASH_SECTOR_SIZE_4K - 1u)) != 0u) return false;
+    if (len > FLASH_SECTOR_SIZE_4K) return false;
+
+    if (!flash_erase_sector_4k(addr)) return false;
+    if (!flash_write(addr, src, len)) return false;
+
+    // verifica a blocchi: niente buffer da 4KB in RAM
+    const uint8_t *p = (const uint8_t*)src;
+    uint8_t chk[32];
+    while (len > 0) {
+        size_t n = (len > sizeof(chk)) ? sizeof(chk) : len;
+        if (!flash_read(addr, chk, n)) return false;
+        if (memcmp(chk, p, n) != 0) return false;
+        addr += (uint32_t)n;
+        p    += n;
+        len  -= n;
+    }
+    return true;
+}
+
 bool flash_chip_erase(void)
 {
+    if (!flash_drain(true)) return false;
+
     flash_write_enable();
 
     flash_cs_low();
     spi1_xfer(FLASH_CMD_CE);
     flash_cs_high();
+    s_wip_len = 0;
 
     // Chip erase pu durare molti secondi: timeout molto largo
     return flash_wait_ready(120000);
@@ -225,3 +428,428 @@ bool flash_read_u32(uint32_t addr, uint32_t *value)
             | ((uint32_t)b[3] << 24);
     return true;
 }
+
+// =====================
+// DMA
+// Per ogni blocco: RX (canale 0, priorita' piu' alta) svuota la FIFO RX in
+// dst (o nel sink), TX (canale 1) riempie la FIFO TX finche' non e' piena.
+// Il blocco e' finito quando RX ha ricevuto l'ultimo byte.
+// =====================
+static void flash_dma_init(void)
+{
+    memset(&s_dma, 0, sizeof(s_dma));
+
+    DMACONSET = _DMACON_ON_MASK;
+
+    DCH0CON = 0;
+    DCH0CONbits.CHPRI = 3;
+    DCH0ECON = 0;
+    DCH0ECONbits.CHSIRQ = _SPI1_RX_IRQ;
+    DCH0ECONbits.SIRQEN = 1;
+
+    DCH1CON = 0;
+    DCH1CONbits.CHPRI = 2;
+    DCH1ECON = 0;
+    DCH1ECONbits.CHSIRQ = _SPI1_TX_IRQ;
+    DCH1ECONbits.SIRQEN = 1;
+}
+
+// tx NULL: la lettura rimanda in uscita il buffer di destinazione stesso
+// (in fase dati la flash ignora SI), cosi' non serve un buffer di 0xFF
+static void flash_dma_block(const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    if (!tx) tx = rx;
+
+    DCH0INTCLR = 0xFFu;
+    DCH0SSA = KVA_TO_PA((const void *)&SPI1BUF);
+    DCH0DSA = KVA_TO_PA(rx);
+    DCH0SSIZ = 1;
+    DCH0DSIZ = (uint32_t)len;
+    DCH0CSIZ = 1;
+
+    DCH1INTCLR = 0xFFu;
+    DCH1SSA = KVA_TO_PA(tx);
+    DCH1DSA = KVA_TO_PA((const void *)&SPI1BUF);
+    DCH1SSIZ = (uint32_t)len;
+    DCH1DSIZ = 1;
+    DCH1CSIZ = 1;
+
+    // FIFO RX vuota (comando gia' letto da spi1_xfer): niente richieste vecchie
+    IFS1CLR = _IFS1_SPI1RXIF_MASK | _IFS1_SPI1TXIF_MASK;
+
+    DCH0CONSET = _DCH0CON_CHEN_MASK;
+    DCH1CONSET = _DCH1CON_CHEN_MASK;
+}
+
+static void flash_dma_finish(bool ok)
+{
+    DCH1CONCLR = _DCH1CON_CHEN_MASK;
+    DCH0CONCLR = _DCH0CON_CHEN_MASK;
+
+    if (!ok) {
+        // trasferimento interrotto: FIFO svuotata, il resto va perso
+        while (!SPI1STATbits.SPIRBE) (void)SPI1BUF;
+        SPI1STATCLR = _SPI1STAT_SPIROV_MASK;
+    }
+    flash_cs_high();    // program: parte il tPP
+
+    const flash_dma_cb_t cb = s_dma.cb;
+    void *ctx = s_dma.ctx;
+    s_dma_ok = ok;
+    s_dma.active = false;
+
+    if (cb) cb(ok, ctx);
+}
+
+static void flash_dma_read_start(uint32_t addr, uint8_t *dst, size_t len,
+                                 flash_dma_cb_t cb, void *ctx)
+{
+    flash_cs_low();
+    spi1_xfer(s_info.fast_read ? FLASH_CMD_FAST_READ : FLASH_CMD_READ);
+    spi1_xfer((uint8_t)(addr >> 16));
+    spi1_xfer((uint8_t)(addr >> 8));
+    spi1_xfer((uint8_t)(addr >> 0));
+    if (s_info.fast_read) spi1_xfer(0xFF);     // dummy
+
+    const size_t n = (len > FLASH_DMA_CHUNK) ? FLASH_DMA_CHUNK : len;
+
+    s_dma.dst = dst + n;
+    s_dma.left = len - n;
+    s_dma.cb = cb;
+    s_dma.ctx = ctx;
+    s_dma.t0_ms = utils_millis();
+    s_dma.active = true;
+
+    flash_dma_block(NULL, dst, n);
+}
+
+static void flash_dma_program_start(uint32_t addr, const uint8_t *src, size_t len,
+                                    flash_dma_cb_t cb, void *ctx)
+{
+    flash_pp_open(addr);
+
+    s_dma.dst = NULL;
+    s_dma.left = 0;
+    s_dma.cb = cb;
+    s_dma.ctx = ctx;
+    s_dma.t0_ms = utils_millis();
+    s_dma.active = true;
+
+    flash_dma_block(src, s_dma_sink, len);
+}
+
+bool flash_read_dma(uint32_t addr, void *dst, size_t len, flash_dma_cb_t cb, void *ctx)
+{
+    if (!dst || len == 0u || !flash_addr_ok(addr, len)) return false;
+    if (flash_busy()) return false;
+
+    flash_dma_read_start(addr, (uint8_t *)dst, len, cb, ctx);
+    return true;
+}
+
+bool flash_page_program_dma(uint32_t addr, const void *src, size_t len,
+                            flash_dma_cb_t cb, void *ctx)
+{
+    if (!src || len == 0u || len > FLASH_PAGE_SIZE) return false;
+    if ((addr & (FLASH_PAGE_SIZE - 1u)) + len > FLASH_PAGE_SIZE) return false;
+    if (addr >= FLASH_SIZE_BYTES) return false;
+    if (flash_busy()) return false;
+
+    flash_dma_program_start(addr, (const uint8_t *)src, len, cb, ctx);
+    return true;
+}
+
+bool flash_dma_busy(void)
+{
+    return s_dma.active;
+}
+
+void flash_task(void)
+{
+    const bool nested = s_in_task;
+    s_in_task = true;
+
+    if (s_dma.active) {
+        if (!DCH0INTbits.CHBCIF) {
+            // Watchdog: richieste DMA perse o SPI fermo
+            if ((utils_millis() - s_dma.t0_ms) >= FLASH_DMA_TIMEOUT_MS) {
+                flash_dma_finish(false);
+            }
+        } else if (s_dma.left > 0u) {
+            // Lettura lunga: blocco successivo, CE sempre basso (lettura sequenziale)
+            const size_t n = (s_dma.left > FLASH_DMA_CHUNK) ? FLASH_DMA_CHUNK : s_dma.left;
+            uint8_t *dst = s_dma.dst;
+            s_dma.dst += n;
+            s_dma.left -= n;
+            s_dma.t0_ms = utils_millis();
+            flash_dma_block(NULL, dst, n);
+        } else {
+            flash_dma_finish(true);
+        }
+    }
+
+    flash_op_step();
+    s_in_task = nested;
+}
+
+// =====================
+// Operazioni asincrone
+// Una alla volta, in ordine di coda: un'operazione che dipende da un'altra
+// (program dopo erase) si accoda dopo, con after. Ogni passo lancia un
+// comando e ritorna; WIP viene riletto a ogni flash_task().
+// =====================
+bool flash_submit(flash_op_t *op)
+{
+    if (!op || s_q_count >= FLASH_QUEUE_LEN) return false;
+
+    switch (op->type) {
+        case FLASH_OP_WRITE:
+            if (!op->src || !flash_addr_ok(op->addr, op->len)) return false;
+            break;
+        case FLASH_OP_READ:
+            if (!op->dst || !flash_addr_ok(op->addr, op->len)) return false;
+            break;
+        case FLASH_OP_ERASE_4K:
+        case FLASH_OP_ERASE_64K:
+            if (op->addr >= FLASH_SIZE_BYTES) return false;
+            break;
+        case FLASH_OP_CHIP_ERASE:
+            break;
+        default:
+            return false;
+    }
+    if (op->after && (op->after == op || op->after->status == FLASH_OP_IDLE)) return false;
+
+    op->status = FLASH_OP_QUEUED;
+    s_q[(uint8_t)((s_q_head + s_q_count) % FLASH_QUEUE_LEN)] = op;
+    s_q_count++;
+    return true;
+}
+
+uint8_t flash_queue_free(void)
+{
+    return (uint8_t)(FLASH_QUEUE_LEN - s_q_count);
+}
+
+bool flash_idle(void)
+{
+    return s_op == NULL && s_q_count == 0u && !s_dma.active;
+}
+
+static bool flash_locked(void)
+{
+    return s_dma.active || s_op != NULL || s_q_count > 0u;
+}
+
+// Funzioni bloccanti: prima il DMA (queue: anche la coda) va a termine.
+// Ogni operazione ha il suo timeout, quindi l'attesa e' limitata. Dalle
+// callback di flash_task() niente attesa: si fallisce come prima.
+static bool flash_drain(bool queue)
+{
+    if (s_in_task) return !(queue ? flash_locked() : s_dma.active);
+
+    while (queue ? flash_locked() : s_dma.active) {
+        flash_task();
+    }
+    return true;
+}
+
+// WREN + comando con indirizzo (erase): CE alto = parte l'operazione
+static void flash_cmd_addr(uint8_t cmd, uint32_t addr)
+{
+    flash_write_enable();
+
+    flash_cs_low();
+    spi1_xfer(cmd);
+    spi1_xfer((uint8_t)(addr >> 16));
+    spi1_xfer((uint8_t)(addr >> 8));
+    spi1_xfer((uint8_t)(addr >> 0));
+    flash_cs_high();
+
+    s_wip_addr = addr;
+    s_wip_len = (cmd == FLASH_CMD_BE_64K) ? FLASH_BLOCK_SIZE_64K : FLASH_SECTOR_SIZE_4K;
+}
+
+// WREN + PP + indirizzo, CE lasciato basso per i dati
+static void flash_pp_open(uint32_t addr)
+{
+    flash_write_enable();
+
+    s_wip_addr = addr & ~(FLASH_PAGE_SIZE - 1u);
+    s_wip_len = FLASH_PAGE_SIZE;
+
+    flash_cs_low();
+    spi1_xfer(FLASH_CMD_PP);
+    spi1_xfer((uint8_t)(addr >> 16));
+    spi1_xfer((uint8_t)(addr >> 8));
+    spi1_xfer((uint8_t)(addr >> 0));
+}
+
+static void flash_op_step(void)
+{
+    if (s_dma.active) return;   // DMA esterno alla coda o passo in corso
+
+    if (!s_op) {
+        // Dipendenza non riuscita: chiusa in errore senza toccare la flash
+        while (s_q_count > 0u && s_q[s_q_head]->after &&
+               s_q[s_q_head]->after->status != FLASH_OP_DONE) {
+            s_op = s_q[s_q_head];
+            s_q_head = (uint8_t)((s_q_head + 1u) % FLASH_QUEUE_LEN);
+            s_q_count--;
+            flash_op_finish(false);
+        }
+
+        if (s_q_count == 0u) return;
+        // chi usa l'API diretta (registratore) finisce prima il suo program/erase
+        if (flash_read_status() & FLASH_SR_WIP) return;
+
+        s_op = s_q[s_q_head];
+        s_q_head = (uint8_t)((s_q_head + 1u) % FLASH_QUEUE_LEN);
+        s_q_count--;
+
+        s_op->status = FLASH_OP_BUSY;
+        s_op_phase = FLASH_PH_START;
+        s_op_off = 0;
+    }
+
+    flash_op_t *op = s_op;
+
+    switch (s_op_phase) {
+        case FLASH_PH_START: {
+            s_op_t0_ms = utils_millis();
+            s_op_phase = FLASH_PH_WIP;
+
+            switch (op->type) {
+                case FLASH_OP_ERASE_4K:
+                    flash_cmd_addr(FLASH_CMD_SE_4K, op->addr & ~(FLASH_SECTOR_SIZE_4K - 1u));
+                    s_op_timeout_ms = 2000u;
+                    return;
+
+                case FLASH_OP_ERASE_64K:
+                    flash_cmd_addr(FLASH_CMD_BE_64K, op->addr & ~(FLASH_BLOCK_SIZE_64K - 1u));
+                    s_op_timeout_ms = 3000u;
+                    return;
+
+                case FLASH_OP_CHIP_ERASE:
+                    flash_write_enable();
+                    flash_cs_low();
+                    spi1_xfer(FLASH_CMD_CE);
+                    flash_cs_high();
+                    s_wip_len = 0;
+                    s_op_timeout_ms = 120000u;
+                    return;
+
+                case FLASH_OP_READ:
+                    s_op_step = op->len;
+                    s_op_phase = FLASH_PH_DMA;
+                    flash_dma_read_start(op->addr, (uint8_t *)op->dst, op->len, NULL, NULL);
+                    return;
+
+                case FLASH_OP_WRITE:
+                default: {
+                    // un passo = il resto della pagina corrente
+                    const uint32_t a = op->addr + (uint32_t)s_op_off;
+                    size_t n = FLASH_PAGE_SIZE - (a & (FLASH_PAGE_SIZE - 1u));
+                    if (n > op->len - s_op_off) n = op->len - s_op_off;
+
+                    s_op_step = n;
+                    s_op_phase = FLASH_PH_DMA;
+                    flash_dma_program_start(a, (const uint8_t *)op->src + s_op_off, n, NULL, NULL);
+                    return;
+                }
+            }
+        }
+
+        case FLASH_PH_DMA:
+            // qui il DMA e' gia' chiuso (s_dma.active == false)
+            if (!s_dma_ok) {
+                flash_op_finish(false);
+                return;
+            }
+            s_op_off += s_op_step;
+            if (op->type == FLASH_OP_READ) {
+                flash_op_finish(true);
+                return;
+            }
+            s_op_t0_ms = utils_millis();
+            s_op_timeout_ms = 200u;
+            s_op_phase = FLASH_PH_WIP;
+            return;
+
+        case FLASH_PH_WIP:
+        default:
+            if (flash_read_status() & FLASH_SR_WIP) {
+                if ((utils_millis() - s_op_t0_ms) >= s_op_timeout_ms) {
+                    flash_op_finish(false);
+                }
+                return;
+            }
+            if (op->type == FLASH_OP_WRITE && s_op_off < op->len) {
+                s_op_phase = FLASH_PH_START;
+                return;
+            }
+            flash_op_finish(true);
+            return;
+    }
+}
+
+static void flash_op_finish(bool ok)
+{
+    flash_op_t *op = s_op;
+    s_op = NULL;
+
+    op->status = ok ? FLASH_OP_DONE : FLASH_OP_ERROR;
+    if (op->cb) op->cb(op);
+}
+
+// =====================
+// Erase/program suspend
+// Solo dalla lettura bloccante: l'operazione viene ripresa prima di
+// tornare, quindi flash_task() non vede mai la flash sospesa.
+// =====================
+static bool flash_suspend(uint32_t addr, size_t len, bool *resume)
+{
+    *resume = false;
+
+    if (!s_info.suspend || s_wip_len == 0u) return false;
+    // dati in cancellazione/programmazione: non leggibili da sospesi
+    if (addr < s_wip_addr + s_wip_len && s_wip_addr < addr + (uint32_t)len) return false;
+
+    // letture ravvicinate: l'erase deve comunque poter avanzare
+    while ((utils_ticks() - s_resume_ticks) < FLASH_RESUME_GAP_US * UTILS_TICKS_PER_US) {;}
+
+    flash_cs_low();
+    spi1_xfer(FLASH_CMD_SUSPEND);
+    flash_cs_high();
+
+    const uint32_t t0 = utils_ticks();
+    while (flash_read_status() & FLASH_SR_WIP) {
+        if ((utils_ticks() - t0) >= FLASH_SUSPEND_MAX_US * UTILS_TICKS_PER_US) {
+            flash_resume();     // ignorato se la sospensione non e' avvenuta
+            return false;
+        }
+    }
+
+    // WIP a zero anche se l'operazione e' finita proprio ora: decide SUS
+    *resume = (flash_read_status2() & FLASH_SR2_SUS) != 0u;
+    return true;
+}
+
+static void flash_resume(void)
+{
+    flash_cs_low();
+    spi1_xfer(FLASH_CMD_RESUME);
+    flash_cs_high();
+
+    s_resume_ticks = utils_ticks();
+}
+
+static uint8_t flash_read_status2(void)
+{
+    uint8_t sr;
+    flash_cs_low();
+    spi1_xfer(FLASH_CMD_RDSR2);
+    sr = spi1_xfer(0xFF);
+    flash_cs_high();
+    return sr;
+}
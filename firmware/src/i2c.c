@@ -3,23 +3,80 @@
 #include <xc.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/attribs.h>
 
 //#include "config_bits.h"
 #include "i2c.h"
 #include "clock.h"
+#include "utils.h"
 
 // =====================
 // Config I2C
 // =====================
-#define I2C_BAUDRATE   100000UL   // 100 kHz
+#define I2C_BAUDRATE   100000UL   // 100 kHz (default al boot)
 
 // I2CxBRG = (PBCLK / (2 * Fsck)) - 2
-#define I2C_BRG_VALUE  ((PBCLK_HZ / (2UL * I2C_BAUDRATE)) - 2UL)
+#define I2C_BRG_FOR(hz) ((PBCLK_HZ / (2UL * (hz))) - 2UL)
+
+// Timeout di ogni singola attesa (START/byte/ACK/STOP): un byte a 100 kHz
+// dura ~90 us, 1 ms e' ampiamente sufficiente anche con clock stretching.
+#define I2C_WAIT_TIMEOUT_US     1000UL
+
+// Timeout di una transazione asincrona intera (watchdog in i2c_task)
+#define I2C_XFER_TIMEOUT_US     10000UL
+
+// Pin I2C1 (PIC32MX370, 100 pin): SCL1 = RG2, SDA1 = RG3
+#define I2C_SCL_MASK    (1u << 2)
+#define I2C_SDA_MASK    (1u << 3)
+
+// Mezzo periodo SCL durante il bus clear (~100 kHz)
+#define I2C_RECOVER_HALF_US     5u
+
+// Bus bloccato: nuovo bus clear da i2c_task() al massimo ogni 10 ms
+#define I2C_RECOVER_RETRY_US    10000UL
+
+// Priorita' interrupt master I2C1 (sotto INT4/BTNC)
+#define I2C_INT_PRIORITY    3
 
 // =====================
 // Helper locali
 // =====================
 static bool i2c_wait_idle(void);
+static bool i2c_wait_reg(volatile uint32_t *reg, uint32_t mask, uint32_t want);
+static void i2c_apply_speed(void);
+static void i2c_async_begin(void);
+static void i2c_async_finish(void);
+
+// =====================
+// Stato
+// =====================
+static i2c_stats_t s_stats;
+static i2c_speed_t s_speed = I2C_SPEED_100K;
+static i2c_err_t   s_last_err = I2C_OK;
+
+// Fasi della macchina a stati in ISR: ognuna termina con un evento
+// che genera I2C1MIF (START/RESTART/STOP completati, byte tx/rx, ACK).
+typedef enum {
+    I2C_ST_IDLE = 0,
+    I2C_ST_START,
+    I2C_ST_ADDR_W,
+    I2C_ST_WRITE,
+    I2C_ST_RESTART,
+    I2C_ST_ADDR_R,
+    I2C_ST_READ,
+    I2C_ST_ACK,
+    I2C_ST_STOP
+} i2c_async_state_t;
+
+static i2c_xfer_t * volatile s_queue[I2C_QUEUE_LEN];
+static volatile uint8_t s_q_head = 0;   // prossimo da eseguire
+static volatile uint8_t s_q_count = 0;
+
+static volatile i2c_async_state_t s_state = I2C_ST_IDLE;
+static volatile uint8_t s_idx = 0;      // indice byte nel buffer corrente
+static volatile i2c_err_t s_xfer_err = I2C_OK;
+static volatile uint32_t  s_xfer_t0 = 0;  // tick di inizio (watchdog)
+static uint32_t s_recover_t0 = 0;          // ultimo bus clear da i2c_task
 
 // =====================
 // API
@@ -29,26 +86,166 @@ void i2c_init(void)
     // Disabilita I2C durante setup
     I2C1CONbits.ON = 0;
 
-    // Baud rate
-    I2C1BRG = I2C_BRG_VALUE;
-
-    // Slew rate control OFF (100 kHz standard mode)
-    I2C1CONbits.DISSLW = 1;
+    // Baud rate + slew rate secondo la velocita' corrente (default 100 kHz)
+    i2c_apply_speed();
 
     // Clear flags
     I2C1STAT = 0;
 
+    // Interrupt master: configurato qui, abilitato solo con coda non vuota
+    IEC1CLR = _IEC1_I2C1MIE_MASK;
+    IFS1CLR = _IFS1_I2C1MIF_MASK;
+    IPC6bits.I2C1IP = I2C_INT_PRIORITY;
+    IPC6bits.I2C1IS = 0;
+
+    s_q_head = 0;
+    s_q_count = 0;
+    s_state = I2C_ST_IDLE;
+    s_last_err = I2C_OK;
+
     // Abilita I2C
     I2C1CONbits.ON = 1;
+
+    // Uno slave rimasto a meta' byte (reset durante un trasferimento)
+    // puo' tenere SDA basso: libera il bus prima di iniziare.
+    if ((PORTG & I2C_SDA_MASK) == 0u) {
+        (void)i2c_bus_recover();
+    }
+}
+
+bool i2c_set_speed(i2c_speed_t speed)
+{
+    if (speed > I2C_SPEED_1M) return false;
+    if (i2c_busy()) return false;
+
+    s_speed = speed;
+
+    I2C1CONbits.ON = 0;
+    i2c_apply_speed();
+    I2C1CONbits.ON = 1;
+
+    return true;
+}
+
+i2c_speed_t i2c_get_speed(void)
+{
+    return s_speed;
+}
+
+uint32_t i2c_speed_hz(i2c_speed_t speed)
+{
+    switch (speed) {
+        case I2C_SPEED_400K: return 400000UL;
+        case I2C_SPEED_1M:   return 1000000UL;
+        case I2C_SPEED_100K:
+        default:             return I2C_BAUDRATE;
+    }
+}
+
+i2c_err_t i2c_last_error(void)
+{
+    return s_last_err;
+}
+
+bool i2c_bus_recover(void)
+{
+    // Il modulo deve essere spento per pilotare i pin come GPIO
+    I2C1CONbits.ON = 0;
+
+    // Open-drain emulato: LAT=0, TRIS=1 -> linea rilasciata (pull-up),
+    // TRIS=0 -> linea tirata bassa
+    LATGCLR  = I2C_SCL_MASK | I2C_SDA_MASK;
+    TRISGSET = I2C_SCL_MASK | I2C_SDA_MASK;
+    utils_delay_us(I2C_RECOVER_HALF_US);
+
+    // Fino a 9 clock: lo slave completa il byte e rilascia SDA
+    for (uint8_t i = 0; i < 9u && (PORTG & I2C_SDA_MASK) == 0u; i++) {
+        TRISGCLR = I2C_SCL_MASK;
+        utils_delay_us(I2C_RECOVER_HALF_US);
+        TRISGSET = I2C_SCL_MASK;
+        utils_delay_us(I2C_RECOVER_HALF_US);
+    }
+
+    // STOP manuale: SDA basso -> alto mentre SCL e' alto
+    TRISGCLR = I2C_SCL_MASK;
+    utils_delay_us(I2C_RECOVER_HALF_US);
+    TRISGCLR = I2C_SDA_MASK;
+    utils_delay_us(I2C_RECOVER_HALF_US);
+    TRISGSET = I2C_SCL_MASK;
+    utils_delay_us(I2C_RECOVER_HALF_US);
+    TRISGSET = I2C_SDA_MASK;
+    utils_delay_us(I2C_RECOVER_HALF_US);
+
+    const bool ok = ((PORTG & (I2C_SCL_MASK | I2C_SDA_MASK)) ==
+                     (I2C_SCL_MASK | I2C_SDA_MASK));
+
+    // Riprende il modulo (riacquisisce i pin)
+    I2C1STAT = 0;
+    I2C1CONbits.ON = 1;
+
+    if (!ok) s_last_err = I2C_ERR_BUS_STUCK;
+    return ok;
+}
+
+void i2c_task(void)
+{
+    // Bus bloccato: il bus clear spegne il modulo, quindi solo qui (mai
+    // dall'ISR) e solo a coda vuota, con i2c_submit() che rifiuta
+    if (s_last_err == I2C_ERR_BUS_STUCK && s_q_count == 0u) {
+        if ((utils_ticks() - s_recover_t0) >= (I2C_RECOVER_RETRY_US * UTILS_TICKS_PER_US)) {
+            s_recover_t0 = utils_ticks();
+            if (i2c_bus_recover()) s_last_err = I2C_OK;
+        }
+        return;
+    }
+
+    if (s_state == I2C_ST_IDLE) return;
+
+    // Watchdog: se l'ISR non riceve piu' eventi la transazione si e'
+    // piantata (slave bloccato, glitch sul bus)
+    if ((utils_ticks() - s_xfer_t0) < (I2C_XFER_TIMEOUT_US * UTILS_TICKS_PER_US)) {
+        return;
+    }
+
+    IEC1CLR = _IEC1_I2C1MIE_MASK;
+
+    // Ricontrolla a IE spento: l'ISR potrebbe averla appena chiusa
+    if (s_state != I2C_ST_IDLE) {
+        const bool freed = i2c_bus_recover();
+        s_xfer_err = I2C_ERR_TIMEOUT;
+        i2c_async_finish();             // passa alla successiva in coda
+        // Bus ancora bloccato: prevale sul timeout, i2c_submit() rifiuta
+        if (!freed) s_last_err = I2C_ERR_BUS_STUCK;
+    }
+
+    if (s_q_count > 0u) {
+        IEC1SET = _IEC1_I2C1MIE_MASK;
+    }
 }
 
 bool i2c_start(void)
 {
+    // Bus in uso dal motore asincrono
+    if (i2c_busy()) {
+        s_last_err = I2C_ERR_BUSY;
+        return false;
+    }
+
+    s_last_err = I2C_OK;
+
     if (!i2c_wait_idle()) return false;
 
     I2C1CONbits.SEN = 1;
-    while (I2C1CONbits.SEN);
+    if (!i2c_wait_reg(&I2C1CON, _I2C1CON_SEN_MASK, 0u)) return false;
+
+    // Collisione: un altro master (o SDA bloccato) ha impedito lo START
+    if (I2C1STATbits.BCL) {
+        I2C1STATCLR = _I2C1STAT_BCL_MASK;
+        s_last_err = I2C_ERR_COLLISION;
+        return false;
+    }
 
+    s_stats.transactions++;
     return true;
 }
 
@@ -57,7 +254,7 @@ bool i2c_restart(void)
     if (!i2c_wait_idle()) return false;
 
     I2C1CONbits.RSEN = 1;
-    while (I2C1CONbits.RSEN);
+    if (!i2c_wait_reg(&I2C1CON, _I2C1CON_RSEN_MASK, 0u)) return false;
 
     return true;
 }
@@ -67,7 +264,7 @@ void i2c_stop(void)
     if (!i2c_wait_idle()) return;
 
     I2C1CONbits.PEN = 1;
-    while (I2C1CONbits.PEN);
+    (void)i2c_wait_reg(&I2C1CON, _I2C1CON_PEN_MASK, 0u);
 }
 
 bool i2c_write(uint8_t data)
@@ -75,10 +272,16 @@ bool i2c_write(uint8_t data)
     if (!i2c_wait_idle()) return false;
 
     I2C1TRN = data;
-    while (I2C1STATbits.TRSTAT);
+    if (!i2c_wait_reg(&I2C1STAT, _I2C1STAT_TRSTAT_MASK, 0u)) return false;
+
+    s_stats.bytes++;
 
     // ACK ricevuto?
-    return (I2C1STATbits.ACKSTAT == 0);
+    if (I2C1STATbits.ACKSTAT) {
+        s_last_err = I2C_ERR_NACK;
+        return false;
+    }
+    return true;
 }
 
 uint8_t i2c_read(bool ack)
@@ -89,26 +292,255 @@ uint8_t i2c_read(bool ack)
 
     // Abilita ricezione
     I2C1CONbits.RCEN = 1;
-    while (!I2C1STATbits.RBF);
+    if (!i2c_wait_reg(&I2C1STAT, _I2C1STAT_RBF_MASK, _I2C1STAT_RBF_MASK)) return 0;
 
     data = I2C1RCV;
+    s_stats.bytes++;
 
     // ACK / NACK
     I2C1CONbits.ACKDT = ack ? 0 : 1;
     I2C1CONbits.ACKEN = 1;
-    while (I2C1CONbits.ACKEN);
+    (void)i2c_wait_reg(&I2C1CON, _I2C1CON_ACKEN_MASK, 0u);
 
     return data;
 }
 
+void i2c_get_stats(i2c_stats_t *out)
+{
+    if (!out) return;
+    *out = s_stats;
+}
+
+void i2c_reset_stats(void)
+{
+    s_stats.transactions = 0;
+    s_stats.bytes = 0;
+}
+
+bool i2c_submit(i2c_xfer_t *x)
+{
+    if (!x) return false;
+    if (x->wlen == 0u && x->rlen == 0u) return false;
+    if ((x->wlen && !x->wbuf) || (x->rlen && !x->rbuf)) return false;
+    // Bus bloccato: lo sblocca i2c_task(), qui si puo' essere in una callback
+    if (s_last_err == I2C_ERR_BUS_STUCK) return false;
+
+    bool ok = false;
+
+    // Sezione critica breve: la coda e' condivisa con l'ISR
+    IEC1CLR = _IEC1_I2C1MIE_MASK;
+
+    if (s_q_count < I2C_QUEUE_LEN) {
+        uint8_t tail = (uint8_t)((s_q_head + s_q_count) % I2C_QUEUE_LEN);
+        x->status = I2C_XFER_PENDING;
+        x->err = I2C_OK;
+        s_queue[tail] = x;
+        s_q_count++;
+        ok = true;
+
+        if (s_state == I2C_ST_IDLE) {
+            i2c_async_begin();
+        }
+    }
+
+    if (s_q_count > 0u) {
+        IEC1SET = _IEC1_I2C1MIE_MASK;
+    }
+
+    return ok;
+}
+
+bool i2c_busy(void)
+{
+    return (s_q_count > 0u);
+}
+
+uint8_t i2c_queue_free(void)
+{
+    return (uint8_t)(I2C_QUEUE_LEN - s_q_count);
+}
+
 // =====================
 // Helper
 // =====================
 static bool i2c_wait_idle(void)
 {
     // Attendi che il bus sia idle
-    while (I2C1CON & 0x1F);       // SEN, RSEN, PEN, RCEN, ACKEN
-    while (I2C1STATbits.TRSTAT); // trasmissione in corso
+    if (!i2c_wait_reg(&I2C1CON, 0x1Fu, 0u)) return false;              // SEN, RSEN, PEN, RCEN, ACKEN
+    if (!i2c_wait_reg(&I2C1STAT, _I2C1STAT_TRSTAT_MASK, 0u)) return false; // trasmissione in corso
+
+    return true;
+}
+
+// Attesa limitata in tick: (reg & mask) == want entro I2C_WAIT_TIMEOUT_US.
+// Al timeout il bus viene ripulito (bus clear + STOP) e l'errore registrato.
+static bool i2c_wait_reg(volatile uint32_t *reg, uint32_t mask, uint32_t want)
+{
+    const uint32_t t0 = utils_ticks();
+    const uint32_t limit = I2C_WAIT_TIMEOUT_US * UTILS_TICKS_PER_US;
 
+    while ((*reg & mask) != want) {
+        if ((utils_ticks() - t0) >= limit) {
+            s_last_err = i2c_bus_recover() ? I2C_ERR_TIMEOUT : I2C_ERR_BUS_STUCK;
+            return false;
+        }
+    }
     return true;
 }
+
+// BRG + slew rate per s_speed (modulo spento)
+static void i2c_apply_speed(void)
+{
+    I2C1BRG = I2C_BRG_FOR(i2c_speed_hz(s_speed));
+
+    // Slew rate control solo in Fast mode (400 kHz); OFF a 100 kHz e 1 MHz
+    I2C1CONbits.DISSLW = (s_speed == I2C_SPEED_400K) ? 0 : 1;
+}
+
+// =====================
+// Motore asincrono
+// =====================
+
+// Avvia la transazione in testa alla coda (ISR disabilitata o in ISR)
+static void i2c_async_begin(void)
+{
+    s_idx = 0;
+    s_xfer_err = I2C_OK;
+    s_xfer_t0 = utils_ticks();
+    s_state = I2C_ST_START;
+
+    IFS1CLR = _IFS1_I2C1MIF_MASK;
+    I2C1CONbits.SEN = 1;
+    s_stats.transactions++;
+}
+
+// Chiude la transazione corrente e passa alla successiva
+static void i2c_async_finish(void)
+{
+    i2c_xfer_t *x = s_queue[s_q_head];
+    const bool ok = (s_xfer_err == I2C_OK);
+
+    s_q_head = (uint8_t)((s_q_head + 1u) % I2C_QUEUE_LEN);
+    s_q_count--;
+    s_state = I2C_ST_IDLE;
+
+    x->err = s_xfer_err;
+    x->status = ok ? I2C_XFER_DONE : I2C_XFER_ERROR;
+    if (!ok) s_last_err = x->err;
+
+    // La callback puo' accodare altre transazioni (i2c_submit la avvia
+    // subito se il motore e' fermo): in quel caso non ripartire qui.
+    if (x->cb) x->cb(x);
+
+    if (s_state != I2C_ST_IDLE) return;
+
+    if (s_q_count > 0u) {
+        i2c_async_begin();
+    } else {
+        IEC1CLR = _IEC1_I2C1MIE_MASK;
+    }
+}
+
+static void i2c_async_send_stop(i2c_err_t err)
+{
+    if (s_xfer_err == I2C_OK) s_xfer_err = err;
+    s_state = I2C_ST_STOP;
+    I2C1CONbits.PEN = 1;
+}
+
+static void i2c_async_send(uint8_t b, i2c_async_state_t next)
+{
+    s_state = next;
+    I2C1TRN = b;
+    s_stats.bytes++;
+}
+
+// Dopo addr+W o un byte dati: prossimo byte, RESTART per la lettura, o STOP
+static void i2c_async_after_write(const i2c_xfer_t *x)
+{
+    if (s_idx < x->wlen) {
+        i2c_async_send(x->wbuf[s_idx++], I2C_ST_WRITE);
+    } else if (x->rlen > 0u) {
+        s_state = I2C_ST_RESTART;
+        I2C1CONbits.RSEN = 1;
+    } else {
+        i2c_async_send_stop(I2C_OK);
+    }
+}
+
+void __ISR(_I2C_1_VECTOR, IPL3SOFT) isr_i2c1(void)
+{
+    IFS1CLR = _IFS1_I2C1MIF_MASK;
+
+    // Interrupt generati dalle primitive bloccanti: nessuna transazione attiva
+    if (s_state == I2C_ST_IDLE || s_q_count == 0u) return;
+
+    i2c_xfer_t *x = s_queue[s_q_head];
+
+    // Collisione sul bus: la transazione e' persa
+    if (I2C1STATbits.BCL) {
+        I2C1STATCLR = _I2C1STAT_BCL_MASK;
+        s_xfer_err = I2C_ERR_COLLISION;
+        i2c_async_finish();
+        return;
+    }
+
+    switch (s_state) {
+        case I2C_ST_START:
+            s_idx = 0;
+            if (x->wlen > 0u) {
+                i2c_async_send((uint8_t)(x->addr << 1) | 0u, I2C_ST_ADDR_W);
+            } else {
+                i2c_async_send((uint8_t)(x->addr << 1) | 1u, I2C_ST_ADDR_R);
+            }
+            break;
+
+        case I2C_ST_ADDR_W:
+        case I2C_ST_WRITE:
+            if (I2C1STATbits.ACKSTAT) {         // NACK
+                i2c_async_send_stop(I2C_ERR_NACK);
+            } else {
+                i2c_async_after_write(x);
+            }
+            break;
+
+        case I2C_ST_RESTART:
+            i2c_async_send((uint8_t)(x->addr << 1) | 1u, I2C_ST_ADDR_R);
+            break;
+
+        case I2C_ST_ADDR_R:
+            if (I2C1STATbits.ACKSTAT) {
+                i2c_async_send_stop(I2C_ERR_NACK);
+            } else {
+                s_idx = 0;
+                s_state = I2C_ST_READ;
+                I2C1CONbits.RCEN = 1;
+            }
+            break;
+
+        case I2C_ST_READ:
+            x->rbuf[s_idx++] = (uint8_t)I2C1RCV;
+            s_stats.bytes++;
+            // ACK su tutti tranne l'ultimo byte
+            I2C1CONbits.ACKDT = (s_idx >= x->rlen) ? 1 : 0;
+            s_state = I2C_ST_ACK;
+            I2C1CONbits.ACKEN = 1;
+            break;
+
+        case I2C_ST_ACK:
+            if (s_idx < x->rlen) {
+                s_state = I2C_ST_READ;
+                I2C1CONbits.RCEN = 1;
+            } else {
+                i2c_async_send_stop(I2C_OK);
+            }
+            break;
+
+        case I2C_ST_STOP:
+            i2c_async_finish();
+            break;
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,254 @@
+#include "kv.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "flash.h"
+#include "utils.h"
+
+/*
+ * Settore: slot da 8 byte, slot 0 = header {magic, generazione}, poi i
+ * record in ordine di scrittura fino al primo slot tutto a 0xFF.
+ */
+#define KV_MAGIC        0x5453564Bu     // "KVST"
+#define KV_SLOT_SIZE    8u
+#define KV_SLOTS        (FLASH_SECTOR_SIZE_4K / KV_SLOT_SIZE)
+
+#define KV_INDEX_BITS   6u
+#define KV_INDEX_SIZE   (1u << KV_INDEX_BITS)   // carico <= 50% con KV_MAX_KEYS
+
+typedef struct {
+    uint32_t magic;
+    uint32_t gen;
+} kv_hdr_t;
+
+typedef struct {
+    uint16_t key;
+    uint16_t crc;               // di key e value
+    uint32_t value;
+} kv_rec_t;
+
+typedef struct {
+    uint16_t key;               // KV_KEY_NONE = libero
+    uint32_t value;
+} kv_entry_t;
+
+/* =====================
+ * Helpers
+ * ===================== */
+static uint32_t kv_sector(uint8_t i);
+static uint16_t kv_rec_crc(const kv_rec_t *rec);
+static bool     kv_rec_empty(const kv_rec_t *rec);
+static uint8_t  kv_find(uint16_t key);
+static bool     kv_put(uint16_t key, uint32_t value);
+static bool     kv_load(uint8_t sector);
+static bool     kv_compact(void);
+
+/* =====================
+ * Stato
+ * ===================== */
+static kv_entry_t s_index[KV_INDEX_SIZE];
+static uint8_t    s_count;
+
+static uint8_t    s_active;     // settore attivo (0/1)
+static uint32_t   s_gen;        // 0 = archivio mai scritto
+static uint32_t   s_next;       // prossimo slot libero del settore attivo
+
+/* =====================
+ * API
+ * ===================== */
+bool kv_init(void)
+{
+    for (uint8_t i = 0; i < KV_INDEX_SIZE; i++) s_index[i].key = KV_KEY_NONE;
+    s_count = 0;
+
+    // nessun settore valido: il primo kv_set() compatta nel settore 0
+    s_active = 1;
+    s_gen = 0;
+    s_next = KV_SLOTS;
+
+    kv_hdr_t h[2];
+    for (uint8_t i = 0; i < 2u; i++) {
+        if (!flash_read(kv_sector(i), &h[i], sizeof(h[i]))) return false;
+        if (h[i].magic != KV_MAGIC || h[i].gen == 0xFFFFFFFFu) continue;
+        if (s_gen == 0u || (int32_t)(h[i].gen - s_gen) > 0) {
+            s_active = i;
+            s_gen = h[i].gen;
+        }
+    }
+
+    if (s_gen == 0u) return true;
+    return kv_load(s_active);
+}
+
+bool kv_get(uint16_t key, uint32_t *value)
+{
+    if (key == KV_KEY_NONE) return false;
+
+    const kv_entry_t *e = &s_index[kv_find(key)];
+    if (e->key != key) return false;
+    if (value) *value = e->value;
+    return true;
+}
+
+uint32_t kv_get_or(uint16_t key, uint32_t def)
+{
+    uint32_t v;
+    return kv_get(key, &v) ? v : def;
+}
+
+bool kv_set(uint16_t key, uint32_t value)
+{
+    if (key == KV_KEY_NONE) return false;
+
+    const kv_entry_t *e = &s_index[kv_find(key)];
+    if (e->key == key && e->value == value) return true;
+    if (e->key != key && s_count >= KV_MAX_KEYS) return false;
+
+    // Coda o DMA in corso: flash_write() rifiuterebbe senza programmare
+    if (!flash_idle()) return false;
+
+    if (s_next >= KV_SLOTS && !kv_compact()) return false;
+
+    kv_rec_t rec;
+    rec.key = key;
+    rec.value = value;
+    rec.crc = kv_rec_crc(&rec);
+
+    const uint32_t addr = kv_sector(s_active) + s_next * KV_SLOT_SIZE;
+
+    const bool ok = flash_write(addr, &rec, sizeof(rec));
+
+    kv_rec_t chk;
+    if (!flash_read(addr, &chk, sizeof(chk))) return false;
+
+    // Slot usato solo se qualcosa e' stato programmato: un buco vuoto
+    // fermerebbe kv_load() e perderebbe i record successivi; un program
+    // fallito a meta' lascia un record che kv_load() scarta per CRC
+    if (!kv_rec_empty(&chk)) s_next++;
+
+    if (!ok) return false;
+    if (memcmp(&chk, &rec, sizeof(rec)) != 0) return false;
+
+    return kv_put(key, value);
+}
+
+uint8_t kv_count(void)
+{
+    return s_count;
+}
+
+bool kv_clear(void)
+{
+    if (!flash_erase_sector_4k(kv_sector(0))) return false;
+    if (!flash_erase_sector_4k(kv_sector(1))) return false;
+
+    for (uint8_t i = 0; i < KV_INDEX_SIZE; i++) s_index[i].key = KV_KEY_NONE;
+    s_count = 0;
+    s_active = 1;
+    s_gen = 0;
+    s_next = KV_SLOTS;
+    return true;
+}
+
+/* =====================
+ * Helpers
+ * ===================== */
+static uint32_t kv_sector(uint8_t i)
+{
+    return FLASH_REGION_KV + (uint32_t)i * FLASH_SECTOR_SIZE_4K;
+}
+
+static uint16_t kv_rec_crc(const kv_rec_t *rec)
+{
+    const uint16_t crc = utils_crc16(&rec->key, sizeof(rec->key));
+    return utils_crc16_update(crc, &rec->value, sizeof(rec->value));
+}
+
+static bool kv_rec_empty(const kv_rec_t *rec)
+{
+    return rec->key == KV_KEY_NONE && rec->crc == 0xFFFFu && rec->value == 0xFFFFFFFFu;
+}
+
+// Hash di Fibonacci + scansione lineare: posizione della chiave o del
+// primo libero (l'indice non e' mai pieno: carico <= 50%)
+static uint8_t kv_find(uint16_t key)
+{
+    uint8_t i = (uint8_t)((uint16_t)(key * 40503u) >> (16u - KV_INDEX_BITS));
+    while (s_index[i].key != KV_KEY_NONE && s_index[i].key != key) {
+        i = (uint8_t)((i + 1u) & (KV_INDEX_SIZE - 1u));
+    }
+    return i;
+}
+
+static bool kv_put(uint16_t key, uint32_t value)
+{
+    kv_entry_t *e = &s_index[kv_find(key)];
+    if (e->key != key) {
+        if (s_count >= KV_MAX_KEYS) return false;
+        e->key = key;
+        s_count++;
+    }
+    e->value = value;
+    return true;
+}
+
+// Record del settore in ordine: l'ultimo per chiave vince
+static bool kv_load(uint8_t sector)
+{
+    static kv_rec_t buf[FLASH_PAGE_SIZE / KV_SLOT_SIZE];
+
+    const uint32_t base = kv_sector(sector);
+    s_next = KV_SLOTS;
+
+    for (uint32_t slot = 0; slot < KV_SLOTS; slot += FLASH_PAGE_SIZE / KV_SLOT_SIZE) {
+        if (!flash_read(base + slot * KV_SLOT_SIZE, buf, sizeof(buf))) return false;
+
+        for (uint32_t j = 0; j < FLASH_PAGE_SIZE / KV_SLOT_SIZE; j++) {
+            if (slot + j == 0u) continue;       // header
+            const kv_rec_t *r = &buf[j];
+
+            if (kv_rec_empty(r)) {
+                s_next = slot + j;
+                return true;
+            }
+            // record interrotto (CRC errato): saltato, lo slot resta usato
+            if (r->key != KV_KEY_NONE && r->crc == kv_rec_crc(r)) {
+                (void)kv_put(r->key, r->value);
+            }
+        }
+    }
+    return true;
+}
+
+// Voci vive nell'altro settore, header per ultimo: un reset a meta'
+// lascia attivo il settore vecchio, ancora intatto
+static bool kv_compact(void)
+{
+    static kv_rec_t buf[KV_MAX_KEYS];
+
+    const uint8_t dst = (uint8_t)(s_active ^ 1u);
+    const uint32_t base = kv_sector(dst);
+
+    if (!flash_erase_sector_4k(base)) return false;
+
+    uint32_t n = 0;
+    for (uint8_t i = 0; i < KV_INDEX_SIZE; i++) {
+        if (s_index[i].key == KV_KEY_NONE) continue;
+        buf[n].key = s_index[i].key;
+        buf[n].value = s_index[i].value;
+        buf[n].crc = kv_rec_crc(&buf[n]);
+        n++;
+    }
+    if (n > 0u && !flash_write(base + KV_SLOT_SIZE, buf, n * sizeof(kv_rec_t))) return false;
+
+    const kv_hdr_t h = { KV_MAGIC, s_gen + 1u };
+    if (!flash_write(base, &h, sizeof(h))) return false;
+
+    s_active = dst;
+    s_gen = h.gen;
+    s_next = 1u + n;
+    return true;
+}
@@ -0,0 +1,141 @@
+#include "lab.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* =====================
+ * Costanti (Q12)
+ * ===================== */
+// sRGB lineare -> XYZ (D65), righe divise per il bianco: (1,1,1) -> (1,1,1)
+static const int32_t k_m[9] = {
+    1777, 1541,  778,   // X / Xn
+     871, 2929,  296,   // Y / Yn
+      73,  448, 3575    // Z / Zn
+};
+
+#define LAB_T_KNEE      36u         // (6/29)^3 in Q12
+#define LAB_F_OFFSET    565u        // 4/29 in Q12
+
+/* =====================
+ * Helpers
+ * ===================== */
+static uint32_t lab_icbrt(uint64_t x);
+static uint32_t lab_isqrt(uint32_t x);
+static int32_t  lab_f(uint32_t t);
+
+/* =====================
+ * Stato
+ * ===================== */
+static uint16_t s_f_lut[LAB_LUT_SIZE];
+
+/* =====================
+ * API
+ * ===================== */
+void lab_init(void)
+{
+    for (uint32_t i = 0; i < LAB_LUT_SIZE; i++) {
+        const uint32_t t = i << LAB_LUT_SHIFT;
+        uint32_t f;
+        if (t > LAB_T_KNEE) {
+            // cbrt(t / 2^12) * 2^12 = cbrt(t * 2^24)
+            f = lab_icbrt((uint64_t)t << 24);
+        } else {
+            // t / (3 (6/29)^2) + 4/29
+            f = (t * 7787u) / 1000u + LAB_F_OFFSET;
+        }
+        s_f_lut[i] = (uint16_t)f;
+    }
+}
+
+void lab_from_linear(uint32_t r_q12, uint32_t g_q12, uint32_t b_q12, lab_t *out)
+{
+    if (!out) return;
+
+    if (r_q12 > LAB_ONE) r_q12 = LAB_ONE;
+    if (g_q12 > LAB_ONE) g_q12 = LAB_ONE;
+    if (b_q12 > LAB_ONE) b_q12 = LAB_ONE;
+
+    const int32_t r = (int32_t)r_q12;
+    const int32_t g = (int32_t)g_q12;
+    const int32_t b = (int32_t)b_q12;
+
+    // XYZ in Q16: 4 bit in piu' per l'interpolazione (colori scuri)
+    const int32_t fx = lab_f((uint32_t)((k_m[0] * r + k_m[1] * g + k_m[2] * b) >> 8));
+    const int32_t fy = lab_f((uint32_t)((k_m[3] * r + k_m[4] * g + k_m[5] * b) >> 8));
+    const int32_t fz = lab_f((uint32_t)((k_m[6] * r + k_m[7] * g + k_m[8] * b) >> 8));
+
+    // 116 * 16 = 1856, 500 * 16 = 8000, 200 * 16 = 3200
+    out->L = (int16_t)(((1856 * fy) >> 12) - (16 << LAB_Q));
+    out->a = (int16_t)((8000 * (fx - fy)) / LAB_ONE);
+    out->b = (int16_t)((3200 * (fy - fz)) / LAB_ONE);
+}
+
+void lab_from_norm(const tcs34725_norm_t *n, uint32_t white, lab_t *out)
+{
+    if (!n || !out) return;
+    if (white == 0u) white = 1u;
+
+    lab_from_linear((uint32_t)(((uint64_t)n->r << 12) / white),
+                    (uint32_t)(((uint64_t)n->g << 12) / white),
+                    (uint32_t)(((uint64_t)n->b << 12) / white),
+                    out);
+}
+
+uint16_t lab_de76_x100(uint32_t dist2)
+{
+    // sqrt(d2) / 16 * 100 = sqrt(d2 * 10000 / 256) = sqrt(d2 * 39.0625)
+    // d2 <= 3 * 4096^2 < 2^26: d2 * 39 sta in 32 bit
+    const uint32_t de = lab_isqrt(dist2 * 39u + dist2 / 16u);
+    return (de > 0xFFFFu) ? 0xFFFFu : (uint16_t)de;
+}
+
+/* =====================
+ * Helpers
+ * ===================== */
+// t in Q16, f in Q12
+static int32_t lab_f(uint32_t t)
+{
+    const uint32_t sh = LAB_LUT_SHIFT + 4u;
+
+    if (t >= ((uint32_t)LAB_ONE << 4)) return s_f_lut[LAB_LUT_SIZE - 1];
+
+    const uint32_t i = t >> sh;
+    const uint32_t fr = t & ((1u << sh) - 1u);
+    const int32_t f0 = s_f_lut[i];
+    const int32_t f1 = s_f_lut[i + 1u];
+    return f0 + (((f1 - f0) * (int32_t)fr) >> sh);
+}
+
+// Radice cubica intera (bit a bit, floor)
+static uint32_t lab_icbrt(uint64_t x)
+{
+    uint64_t y = 0;
+    for (int s = 63; s >= 0; s -= 3) {
+        y <<= 1;
+        const uint64_t b = 3u * y * (y + 1u) + 1u;
+        if ((x >> s) >= b) {
+            x -= b << s;
+            y++;
+        }
+    }
+    return (uint32_t)y;
+}
+
+// Radice quadrata intera (bit a bit, floor)
+static uint32_t lab_isqrt(uint32_t x)
+{
+    uint32_t r = 0;
+    uint32_t bit = 1u << 30;
+
+    while (bit > x) bit >>= 2;
+    while (bit != 0u) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
@@ -0,0 +1,120 @@
+#include "palette.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "classify.h"
+#include "flash.h"
+#include "utils.h"
+
+/* =====================
+ * Helpers
+ * ===================== */
+static uint16_t palette_hue_dist(uint16_t a, uint16_t b);
+static uint16_t palette_crc(const palette_data_t *d);
+
+/* =====================
+ * Stato
+ * ===================== */
+static palette_data_t s_pal;
+
+/* =====================
+ * API
+ * ===================== */
+bool palette_init(void)
+{
+    palette_clear();
+
+    palette_data_t d;
+    if (!flash_read(FLASH_REGION_PALETTE, &d, sizeof(d))) return false;
+
+    if (d.magic != PALETTE_MAGIC || d.version != PALETTE_VERSION) return false;
+    if (d.count > PALETTE_MAX) return false;
+    if (d.crc != palette_crc(&d)) return false;
+
+    s_pal = d;
+    return true;
+}
+
+uint8_t palette_count(void)
+{
+    return (uint8_t)s_pal.count;
+}
+
+const palette_entry_t *palette_get(uint8_t i)
+{
+    return (i < s_pal.count) ? &s_pal.e[i] : NULL;
+}
+
+uint8_t palette_classify(const tcs34725_hsv_t *hsv)
+{
+    if (!hsv || hsv->s < PALETTE_S_MIN_FLOOR) return CLASSIFY_NONE;
+
+    uint8_t  best = CLASSIFY_NONE;
+    uint16_t best_d = 0xFFFFu;
+
+    for (uint8_t i = 0; i < s_pal.count; i++) {
+        const palette_entry_t *e = &s_pal.e[i];
+        if (hsv->s < e->s_min || hsv->v < e->v_min) continue;
+
+        const uint16_t d = palette_hue_dist(hsv->h, e->hue);
+        if (d <= e->hue_tol && d < best_d) {
+            best_d = d;
+            best = e->cls;
+        }
+    }
+    return best;
+}
+
+bool palette_teach(uint8_t cls, const tcs34725_hsv_t *hsv)
+{
+    if (!hsv || cls == CLASSIFY_NONE || cls >= CLASSIFY_COUNT) return false;
+    if (hsv->s < PALETTE_S_MIN_FLOOR) return false;
+
+    uint8_t i = 0;
+    while (i < s_pal.count && s_pal.e[i].cls != cls) i++;
+    if (i >= PALETTE_MAX) return false;
+
+    palette_entry_t *e = &s_pal.e[i];
+    e->hue = hsv->h;
+    e->hue_tol = PALETTE_HUE_TOL_DEF;
+    e->s_min = (uint8_t)(hsv->s / 2u);
+    if (e->s_min < PALETTE_S_MIN_FLOOR) e->s_min = PALETTE_S_MIN_FLOOR;
+    e->v_min = (uint8_t)(hsv->v / 2u);
+    e->cls = cls;
+    e->reserved = 0;
+
+    if (i == s_pal.count) s_pal.count++;
+    return true;
+}
+
+void palette_clear(void)
+{
+    memset(&s_pal, 0, sizeof(s_pal));
+}
+
+bool palette_save(void)
+{
+    s_pal.magic = PALETTE_MAGIC;
+    s_pal.version = PALETTE_VERSION;
+    s_pal.reserved = 0;
+    s_pal.crc = palette_crc(&s_pal);
+    return flash_sector_store(FLASH_REGION_PALETTE, &s_pal, sizeof(s_pal));
+}
+
+/* =====================
+ * Helpers
+ * ===================== */
+// distanza circolare sulla ruota delle hue
+static uint16_t palette_hue_dist(uint16_t a, uint16_t b)
+{
+    const uint16_t d = (a > b) ? (uint16_t)(a - b) : (uint16_t)(b - a);
+    return (d > TCS34725_HUE_RANGE / 2u) ? (uint16_t)(TCS34725_HUE_RANGE - d) : d;
+}
+
+static uint16_t palette_crc(const palette_data_t *d)
+{
+    return utils_crc16(d, offsetof(palette_data_t, crc));
+}
@@ -0,0 +1,445 @@
+#include "recorder.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "flash.h"
+#include "utils.h"
+
+/*
+ * Layout dell'area:
+ *   pagina 0   header (scritto a fine cancellazione): fine dell'area usata
+ *   pagina 1.. blocchi compressi, in ordine; la prima pagina vuota chiude i dati
+ * Tutto cio' che sta fra pagina 1 e 'end' e' stato cancellato alla partenza,
+ * quindi dopo un reset (anche a registrazione in corso) i blocchi validi
+ * sono un prefisso e bastano O(log n) letture per contarli.
+ */
+#define REC_MAGIC       0x43455252u     // "RREC"
+#define REC_FORMAT      1u              // blocchi delta + varint
+#define REC_DATA_ADDR   (FLASH_REGION_RECORDER + FLASH_PAGE_SIZE)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t end;               // indirizzo fine area cancellata
+    uint32_t ticks_per_us;      // risoluzione di t_us (informativo)
+    uint16_t format;            // REC_FORMAT
+    uint16_t crc;
+} rec_header_t;
+
+/* =====================
+ * Helpers
+ * ===================== */
+static void    rec_clock(void);
+static void    rec_page_open(const recorder_rec_t *rec);
+static void    rec_page_close(void);
+static uint8_t rec_encode(const recorder_rec_t *rec, uint8_t *out);
+static uint8_t rec_varint(uint32_t v, uint8_t *out);
+static void    rec_program_step(void);
+static void    rec_program_done(bool ok, void *ctx);
+static bool    rec_header_write(void);
+static bool    rec_header_read(rec_header_t *h);
+static bool    rec_page_empty(uint32_t page);
+
+static inline uint32_t rec_zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+/* =====================
+ * Stato
+ * ===================== */
+static recorder_state_t s_state;
+
+static uint8_t  s_buf[2][FLASH_PAGE_SIZE];
+static bool     s_ready[2];     // pagina piena in attesa di programmazione
+static uint8_t  s_fill;         // buffer in riempimento
+static uint8_t  s_fill_n;       // record nel buffer in riempimento
+static uint8_t  s_used;         // byte di payload nel buffer in riempimento
+static uint8_t  s_prog;         // prossimo buffer da programmare
+static bool     s_open;         // DMA della pagina in corso
+
+// riferimento dei delta: ultimo record codificato nel blocco
+static recorder_rec_t s_prev;
+static uint32_t       s_prev_dt;
+
+static uint32_t s_addr;         // prossima pagina da programmare
+static uint32_t s_end;
+static uint32_t s_erase_addr;
+
+static uint32_t s_records;
+static uint32_t s_pages;        // blocchi chiusi
+static uint32_t s_pages_max;
+static uint32_t s_dropped;
+static uint16_t s_seq;
+
+static uint32_t s_us;           // tempo dall'inizio (us)
+static uint32_t s_last_ticks;   // core timer gia' contato in s_us
+
+/* =====================
+ * API
+ * ===================== */
+bool recorder_start(uint32_t max_bytes)
+{
+    if (recorder_active()) return false;
+
+    if (max_bytes > FLASH_REGION_RECORDER_SIZE) max_bytes = FLASH_REGION_RECORDER_SIZE;
+    max_bytes = (max_bytes + FLASH_BLOCK_SIZE_64K - 1u) & ~(FLASH_BLOCK_SIZE_64K - 1u);
+    if (max_bytes == 0u) max_bytes = FLASH_BLOCK_SIZE_64K;
+
+    s_end = FLASH_REGION_RECORDER + max_bytes;
+    s_erase_addr = FLASH_REGION_RECORDER;
+    s_addr = REC_DATA_ADDR;
+
+    s_ready[0] = false;
+    s_ready[1] = false;
+    s_fill = 0;
+    s_fill_n = 0;
+    s_used = 0;
+    s_prog = 0;
+    s_open = false;
+
+    s_records = 0;
+    s_pages = 0;
+    s_pages_max = (s_end - REC_DATA_ADDR) / FLASH_PAGE_SIZE;
+    s_dropped = 0;
+    s_seq = 0;
+
+    s_state = RECORDER_ERASING;
+    return true;
+}
+
+bool recorder_stop(void)
+{
+    if (!recorder_active()) return true;
+
+    bool ok = true;
+
+    if (s_state == RECORDER_ERASING) {
+        // header non ancora scritto: l'area risulta vuota
+        ok = flash_wait_ready(2000);
+        s_state = RECORDER_IDLE;
+        return ok;
+    }
+
+    // Blocco parziale chiuso come gli altri (il resto resta a 0xFF);
+    // l'altro buffer e' libero: s_fill non e' mai in coda
+    if (s_fill_n > 0u && s_pages < s_pages_max) rec_page_close();
+
+    // Pagine piene ancora in coda
+    const uint32_t t0 = utils_millis();
+    while (s_ready[s_prog] && s_state != RECORDER_ERROR) {
+        if ((utils_millis() - t0) >= 200u) {
+            ok = false;
+            break;
+        }
+        flash_task();
+        rec_program_step();
+    }
+    while (flash_dma_busy()) flash_task();
+
+    if (s_state == RECORDER_ERROR) ok = false;
+    if (!flash_wait_ready(200)) ok = false;
+
+    s_state = RECORDER_IDLE;
+    return ok;
+}
+
+bool recorder_active(void)
+{
+    return s_state == RECORDER_ERASING || s_state == RECORDER_RUN ||
+           s_state == RECORDER_FULL;
+}
+
+bool recorder_add(const tcs34725_raw_t *raw, uint8_t agc_step, uint8_t flags)
+{
+    if (s_state != RECORDER_RUN || !raw) return false;
+
+    // Buffer in riempimento ancora in coda: entrambi pieni
+    if (s_ready[s_fill]) {
+        s_dropped++;
+        s_seq++;
+        return false;
+    }
+
+    rec_clock();
+
+    recorder_rec_t rec;
+    rec.t_us = s_us;
+    rec.raw = *raw;
+    rec.agc_step = agc_step;
+    rec.flags = flags;
+    rec.seq = s_seq++;
+
+    if (s_fill_n == 0u) {
+        rec_page_open(&rec);
+    } else {
+        uint8_t enc[RECORDER_ENC_MAX];
+        const uint8_t n = rec_encode(&rec, enc);
+
+        if (n == 0u || (uint32_t)s_used + n > RECORDER_PAYLOAD) {
+            // blocco pieno: il campione apre il successivo
+            rec_page_close();
+            if (s_pages >= s_pages_max) {
+                s_state = RECORDER_FULL;
+                return false;
+            }
+            if (s_ready[s_fill]) {
+                s_dropped++;
+                return false;
+            }
+            rec_page_open(&rec);
+        } else {
+            memcpy(&s_buf[s_fill][RECORDER_PAGE_HDR + s_used], enc, n);
+            s_used = (uint8_t)(s_used + n);
+            s_fill_n++;
+            s_prev = rec;
+        }
+    }
+
+    s_records++;
+    return true;
+}
+
+void recorder_task(void)
+{
+    switch (s_state) {
+        case RECORDER_ERASING:
+            if (flash_busy()) return;
+
+            if (s_erase_addr < s_end) {
+                if (!flash_erase_block_64k_start(s_erase_addr)) {
+                    s_state = RECORDER_ERROR;
+                    return;
+                }
+                s_erase_addr += FLASH_BLOCK_SIZE_64K;
+                return;
+            }
+
+            if (!rec_header_write()) {
+                s_state = RECORDER_ERROR;
+                return;
+            }
+            s_us = 0;
+            s_last_ticks = utils_ticks();
+            s_state = RECORDER_RUN;
+            return;
+
+        case RECORDER_RUN:
+        case RECORDER_FULL:
+            // orologio aggiornato anche senza campioni (wrap core timer)
+            rec_clock();
+            if (s_ready[s_prog]) rec_program_step();
+            return;
+
+        default:
+            return;
+    }
+}
+
+void recorder_get_status(recorder_status_t *st)
+{
+    if (!st) return;
+
+    st->state = s_state;
+    st->records = s_records;
+    st->pages = s_pages;
+    st->pages_max = s_pages_max;
+    st->dropped = s_dropped;
+
+    const uint32_t span = s_end - FLASH_REGION_RECORDER;
+    st->erase_pct = (span != 0u)
+                  ? (((s_erase_addr - FLASH_REGION_RECORDER) / FLASH_BLOCK_SIZE_64K) * 100u) /
+                    (span / FLASH_BLOCK_SIZE_64K)
+                  : 0u;
+}
+
+uint32_t recorder_stored(void)
+{
+    if (recorder_active()) return s_records;
+
+    rec_header_t h;
+    if (!rec_header_read(&h)) return 0;
+
+    // prima pagina vuota in [0, n]
+    uint32_t lo = 0;
+    uint32_t hi = (h.end - REC_DATA_ADDR) / FLASH_PAGE_SIZE;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2u;
+        if (rec_page_empty(mid)) {
+            hi = mid;
+        } else {
+            lo = mid + 1u;
+        }
+    }
+    return lo;
+}
+
+bool recorder_read_dma(uint32_t page, uint8_t *dst, uint32_t n,
+                       flash_dma_cb_t cb, void *ctx)
+{
+    if (!dst || n == 0u) return false;
+
+    const uint32_t addr = REC_DATA_ADDR + page * FLASH_PAGE_SIZE;
+    const uint32_t len = n * FLASH_PAGE_SIZE;
+    if (addr + len > FLASH_REGION_RECORDER + FLASH_REGION_RECORDER_SIZE) return false;
+
+    return flash_read_dma(addr, dst, len, cb, ctx);
+}
+
+/* =====================
+ * Helpers
+ * ===================== */
+// Solo i microsecondi interi passano in s_us: il resto resta nei tick
+static void rec_clock(void)
+{
+    const uint32_t us = (utils_ticks() - s_last_ticks) / UTILS_TICKS_PER_US;
+    s_last_ticks += us * UTILS_TICKS_PER_US;
+    s_us += us;
+}
+
+// Primo record del blocco intero: riferimento dei delta successivi
+static void rec_page_open(const recorder_rec_t *rec)
+{
+    uint8_t *p = s_buf[s_fill];
+    memset(p, 0xFF, FLASH_PAGE_SIZE);
+    memcpy(&p[RECORDER_PAGE_HDR], rec, sizeof(*rec));
+
+    s_used = (uint8_t)sizeof(*rec);
+    s_fill_n = 1;
+    s_prev = *rec;
+    s_prev_dt = 0;
+}
+
+static void rec_page_close(void)
+{
+    uint8_t *p = s_buf[s_fill];
+    p[0] = s_fill_n;
+    p[1] = s_used;
+
+    uint16_t crc = utils_crc16(p, 2u);
+    crc = utils_crc16_update(crc, &p[RECORDER_PAGE_HDR], s_used);
+    p[2] = (uint8_t)(crc & 0xFFu);
+    p[3] = (uint8_t)(crc >> 8);
+
+    s_ready[s_fill] = true;
+    s_fill ^= 1u;
+    s_fill_n = 0;
+    s_used = 0;
+    s_pages++;
+}
+
+// Delta rispetto a s_prev. return byte scritti, 0 se non rappresentabile
+// (salto di tempo enorme): il record apre un nuovo blocco
+static uint8_t rec_encode(const recorder_rec_t *rec, uint8_t *out)
+{
+    const uint32_t dt = rec->t_us - s_prev.t_us;
+    const uint32_t zdt = rec_zigzag((int32_t)(dt - s_prev_dt));
+    if (zdt >= 0x40000000u) return 0;
+
+    const uint16_t gap = (uint16_t)(rec->seq - s_prev.seq - 1u);
+    const bool chg = rec->agc_step != s_prev.agc_step || rec->flags != s_prev.flags;
+    const bool ext = gap != 0u || chg;
+
+    const uint32_t zc = rec_zigzag((int32_t)rec->raw.c - (int32_t)s_prev.raw.c);
+    const uint32_t zr = rec_zigzag((int32_t)rec->raw.r - (int32_t)s_prev.raw.r);
+    const uint32_t zg = rec_zigzag((int32_t)rec->raw.g - (int32_t)s_prev.raw.g);
+    const uint32_t zb = rec_zigzag((int32_t)rec->raw.b - (int32_t)s_prev.raw.b);
+    const bool packed = (zc | zr | zg | zb) < 16u;   // solo rumore: un nibble per canale
+
+    uint8_t n = rec_varint((zdt << 2) | (packed ? 2u : 0u) | (ext ? 1u : 0u), out);
+    if (ext) {
+        n += rec_varint(((uint32_t)gap << 1) | (chg ? 1u : 0u), &out[n]);
+        if (chg) {
+            out[n++] = rec->agc_step;
+            out[n++] = rec->flags;
+        }
+    }
+    if (packed) {
+        out[n++] = (uint8_t)((zc << 4) | zr);
+        out[n++] = (uint8_t)((zg << 4) | zb);
+    } else {
+        n += rec_varint(zc, &out[n]);
+        n += rec_varint(zr, &out[n]);
+        n += rec_varint(zg, &out[n]);
+        n += rec_varint(zb, &out[n]);
+    }
+
+    s_prev_dt = dt;
+    return n;
+}
+
+// LEB128: 7 bit per byte, bit 7 = continua
+static uint8_t rec_varint(uint32_t v, uint8_t *out)
+{
+    uint8_t n = 0;
+    while (v >= 0x80u) {
+        out[n++] = (uint8_t)(v | 0x80u);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+// Pagina via DMA: la CPU torna subito al superloop
+static void rec_program_step(void)
+{
+    if (s_open) return;                 // DMA in corso (rec_program_done)
+    if (!s_ready[s_prog]) return;       // gia' programmata: mai due volte
+    if (flash_busy()) return;           // tPP della pagina precedente
+
+    if (s_addr >= s_end ||
+        !flash_page_program_dma(s_addr, s_buf[s_prog], FLASH_PAGE_SIZE,
+                                rec_program_done, NULL)) {
+        s_state = RECORDER_ERROR;
+        return;
+    }
+    s_open = true;
+}
+
+// Da flash_task(): il buffer e' di nuovo libero (il tPP continua in flash)
+static void rec_program_done(bool ok, void *ctx)
+{
+    (void)ctx;
+
+    s_open = false;
+    if (!ok) {
+        s_state = RECORDER_ERROR;
+        return;
+    }
+    s_ready[s_prog] = false;
+    s_prog ^= 1u;
+    s_addr += FLASH_PAGE_SIZE;
+}
+
+static bool rec_header_write(void)
+{
+    rec_header_t h;
+    h.magic = REC_MAGIC;
+    h.end = s_end;
+    h.ticks_per_us = UTILS_TICKS_PER_US;
+    h.format = REC_FORMAT;
+    h.crc = utils_crc16(&h, offsetof(rec_header_t, crc));
+
+    return flash_write(FLASH_REGION_RECORDER, &h, sizeof(h));
+}
+
+static bool rec_header_read(rec_header_t *h)
+{
+    if (!flash_read(FLASH_REGION_RECORDER, h, sizeof(*h))) return false;
+
+    if (h->magic != REC_MAGIC || h->format != REC_FORMAT) return false;
+    if (h->crc != utils_crc16(h, offsetof(rec_header_t, crc))) return false;
+    if (h->end <= REC_DATA_ADDR ||
+        h->end > FLASH_REGION_RECORDER + FLASH_REGION_RECORDER_SIZE) return false;
+    return true;
+}
+
+// Conteggio record 0xFF = pagina mai programmata
+static bool rec_page_empty(uint32_t page)
+{
+    uint8_t n;
+    if (!flash_read(REC_DATA_ADDR + page * FLASH_PAGE_SIZE, &n, 1u)) return true;
+    return n == 0xFFu;
+}
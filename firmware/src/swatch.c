@@ -0,0 +1,188 @@
+#include "swatch.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "flash.h"
+#include "utils.h"
+
+/* =====================
+ * Helpers
+ * ===================== */
+static bool sw_node(uint16_t idx, swatch_node_t *out);
+static void sw_search(uint16_t lo, uint16_t hi, uint8_t depth);
+static int16_t sw_axis(const lab_t *l, uint8_t axis);
+
+#define SW_NODES_ADDR   (FLASH_REGION_SWATCH + (uint32_t)sizeof(swatch_header_t))
+
+/* =====================
+ * Stato
+ * ===================== */
+static bool     s_ok = false;
+static uint16_t s_count = 0;
+static uint32_t s_load_len = 0;
+
+// cache nodi: indice + copia (0xFFFF = vuoto)
+static uint16_t      s_cache_idx[SWATCH_CACHE_SIZE];
+static swatch_node_t s_cache[SWATCH_CACHE_SIZE];
+
+// stato della query corrente
+static lab_t    s_q;
+static uint32_t s_best_d2;
+static uint16_t s_best_idx;
+static uint16_t s_visited;
+static bool     s_err;
+
+/* =====================
+ * API
+ * ===================== */
+bool swatch_init(void)
+{
+    s_ok = false;
+    s_count = 0;
+    memset(s_cache_idx, 0xFF, sizeof(s_cache_idx));
+
+    swatch_header_t h;
+    if (!flash_read(FLASH_REGION_SWATCH, &h, sizeof(h))) return false;
+
+    if (h.magic != SWATCH_MAGIC || h.version != SWATCH_VERSION) return false;
+    if (h.node_size != sizeof(swatch_node_t) || h.count == 0u) return false;
+    if (h.crc_hdr != utils_crc16(&h, offsetof(swatch_header_t, crc_hdr))) return false;
+    if (sizeof(h) + (uint32_t)h.count * sizeof(swatch_node_t) > FLASH_REGION_SWATCH_SIZE) return false;
+
+    // CRC dei nodi a blocchi (una volta al boot / dopo il caricamento)
+    uint16_t crc = 0xFFFFu;
+    uint8_t buf[64];
+    uint32_t addr = SW_NODES_ADDR;
+    uint32_t left = (uint32_t)h.count * sizeof(swatch_node_t);
+    while (left > 0u) {
+        const uint32_t n = (left > sizeof(buf)) ? (uint32_t)sizeof(buf) : left;
+        if (!flash_read(addr, buf, n)) return false;
+        crc = utils_crc16_update(crc, buf, n);
+        addr += n;
+        left -= n;
+    }
+    if (crc != h.crc_nodes) return false;
+
+    s_count = h.count;
+    s_ok = true;
+    return true;
+}
+
+uint16_t swatch_count(void)
+{
+    return s_ok ? s_count : 0u;
+}
+
+bool swatch_nearest(const lab_t *q, swatch_match_t *out)
+{
+    if (!s_ok || !q || !out) return false;
+
+    s_q = *q;
+    s_best_d2 = 0xFFFFFFFFu;
+    s_best_idx = 0;
+    s_visited = 0;
+    s_err = false;
+
+    sw_search(0, s_count, 0);
+    if (s_err) return false;
+
+    swatch_node_t n;
+    if (!sw_node(s_best_idx, &n)) return false;
+
+    out->id = n.id;
+    memcpy(out->code, n.code, SWATCH_CODE_LEN);
+    out->code[SWATCH_CODE_LEN] = '\0';
+    out->de_x100 = lab_de76_x100(s_best_d2);
+    out->visited = s_visited;
+    return true;
+}
+
+bool swatch_load_begin(uint32_t len)
+{
+    s_ok = false;
+    s_load_len = 0;
+
+    if (len < sizeof(swatch_header_t) || len > FLASH_REGION_SWATCH_SIZE) return false;
+
+    for (uint32_t off = 0; off < len; off += FLASH_SECTOR_SIZE_4K) {
+        if (!flash_erase_sector_4k(FLASH_REGION_SWATCH + off)) return false;
+    }
+
+    s_load_len = len;
+    return true;
+}
+
+bool swatch_load_write(uint32_t off, const void *src, uint32_t len)
+{
+    if (!src || (off + len) > s_load_len) return false;
+    return flash_write(FLASH_REGION_SWATCH + off, src, len);
+}
+
+bool swatch_load_end(void)
+{
+    s_load_len = 0;
+    return swatch_init();
+}
+
+/* =====================
+ * k-d tree
+ * ===================== */
+// Sottoalbero vicino in ricorsione, lontano in iterazione solo se la
+// sfera attorno alla query attraversa il piano di taglio.
+static void sw_search(uint16_t lo, uint16_t hi, uint8_t depth)
+{
+    while (lo < hi && !s_err) {
+        const uint16_t mid = (uint16_t)((lo + hi) / 2u);
+
+        swatch_node_t n;
+        if (!sw_node(mid, &n)) {
+            s_err = true;
+            return;
+        }
+        s_visited++;
+
+        const uint32_t d2 = lab_dist2(&s_q, &n.lab);
+        if (d2 < s_best_d2) {
+            s_best_d2 = d2;
+            s_best_idx = mid;
+        }
+
+        const uint8_t axis = (uint8_t)(depth % 3u);
+        const int32_t diff = (int32_t)sw_axis(&s_q, axis) - sw_axis(&n.lab, axis);
+        depth++;
+
+        if (diff < 0) {
+            sw_search(lo, mid, depth);
+            lo = (uint16_t)(mid + 1u);
+        } else {
+            sw_search((uint16_t)(mid + 1u), hi, depth);
+            hi = mid;
+        }
+
+        if ((uint32_t)(diff * diff) >= s_best_d2) return;
+    }
+}
+
+static int16_t sw_axis(const lab_t *l, uint8_t axis)
+{
+    return (axis == 0u) ? l->L : ((axis == 1u) ? l->a : l->b);
+}
+
+static bool sw_node(uint16_t idx, swatch_node_t *out)
+{
+    const uint16_t slot = (uint16_t)(idx & (SWATCH_CACHE_SIZE - 1u));
+    if (s_cache_idx[slot] == idx) {
+        *out = s_cache[slot];
+        return true;
+    }
+
+    const uint32_t addr = SW_NODES_ADDR + (uint32_t)idx * sizeof(swatch_node_t);
+    if (!flash_read(addr, out, sizeof(*out))) return false;
+
+    s_cache_idx[slot] = idx;
+    s_cache[slot] = *out;
+    return true;
+}
@@ -0,0 +1,108 @@
+#include "target.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* =====================
+ * Helpers
+ * ===================== */
+static void target_exit(target_track_t *t, uint8_t cls, target_event_t *ev);
+
+/* =====================
+ * API
+ * ===================== */
+void target_init(target_t *tg, const target_cfg_t *cfg)
+{
+    if (!tg || !cfg) return;
+
+    tg->cfg = *cfg;
+    target_reset(tg);
+}
+
+void target_reset(target_t *tg)
+{
+    if (!tg) return;
+    memset(tg->t, 0, sizeof(tg->t));
+}
+
+uint8_t target_update(target_t *tg, uint8_t cls, uint32_t now_ms,
+                      target_event_t *ev, uint8_t max_ev)
+{
+    if (!tg || !ev) return 0;
+
+    uint8_t n = 0;
+
+    // CLASSIFY_NONE non e' un target: solo assenza per tutte le classi
+    for (uint8_t c = 1; c < CLASSIFY_COUNT; c++) {
+        target_track_t *t = &tg->t[c];
+
+        if (c == cls) {
+            if (!t->candidate && !t->present) {
+                t->candidate = true;
+                t->first_ms = now_ms;
+            }
+            t->last_ms = now_ms;
+
+            if (t->candidate &&
+                (now_ms - t->first_ms) >= tg->cfg.enter_ms &&
+                (!t->exited || (now_ms - t->exit_at) >= tg->cfg.min_gap_ms)) {
+                t->candidate = false;
+                t->present = true;
+                if (n < max_ev) {
+                    ev[n].type = TARGET_EV_ENTER;
+                    ev[n].cls = c;
+                    ev[n].dwell_ms = 0;
+                    n++;
+                }
+            }
+            continue;
+        }
+
+        // sequenza interrotta prima della conferma: rumore
+        t->candidate = false;
+
+        if (t->present && (now_ms - t->last_ms) >= tg->cfg.exit_ms) {
+            if (n < max_ev) {
+                target_exit(t, c, &ev[n]);
+                n++;
+            } else {
+                target_exit(t, c, NULL);
+            }
+        }
+    }
+
+    return n;
+}
+
+uint8_t target_flush(target_t *tg, target_event_t *ev, uint8_t max_ev)
+{
+    if (!tg || !ev) return 0;
+
+    uint8_t n = 0;
+    for (uint8_t c = 1; c < CLASSIFY_COUNT; c++) {
+        target_track_t *t = &tg->t[c];
+        t->candidate = false;
+        if (!t->present) continue;
+
+        target_exit(t, c, (n < max_ev) ? &ev[n] : NULL);
+        if (n < max_ev) n++;
+    }
+    return n;
+}
+
+/* =====================
+ * Helpers
+ * ===================== */
+static void target_exit(target_track_t *t, uint8_t cls, target_event_t *ev)
+{
+    t->present = false;
+    t->exited = true;
+    t->exit_at = t->last_ms;
+
+    if (ev) {
+        ev->type = TARGET_EV_EXIT;
+        ev->cls = cls;
+        ev->dwell_ms = t->last_ms - t->first_ms;
+    }
+}
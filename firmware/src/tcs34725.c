@@ -11,7 +11,66 @@
  * I2C helpers
  * ===================== */
 static bool tcs_write8(uint8_t reg, uint8_t value);
-static bool tcs_read16(uint8_t reg, uint16_t *value);
+static bool tcs_read_block(uint8_t reg, uint8_t *buf, uint8_t len);
+static bool tcs_write_cmd(uint8_t cmd);
+static void tcs_unpack_raw(const uint8_t *buf, tcs34725_raw_t *out);
+static void tcs_rd_done(i2c_xfer_t *x);
+static uint32_t tcs_gain_mult(uint8_t gain);
+static void tcs_update_norm(void);
+static bool tcs_agc_apply_async(uint8_t step);
+
+/* =====================
+ * Stato
+ * ===================== */
+static uint8_t s_atime = TCS34725_IT_2_4MS;   // valore di reset del sensore
+static bool    s_sync = false;                // PERS=0 + AIEN attivi
+static bool    s_aien = false;                // pin INT abilitato (sync o soglie)
+static uint8_t s_gain = TCS34725_GAIN_1X;
+
+// Normalizzazione: norm_q8 = (raw * s_norm_k) >> 16
+// s_norm_k = (256 * 10 << 16) / (gain * cicli * 24)   [24 = 2.4 ms x10]
+static uint32_t s_norm_k;
+static uint32_t s_norm_div_x10;               // gain * cicli * 24
+
+/* =====================
+ * AGC
+ * Sensibilita' (gain * cicli) crescente, rapporto <= 4 fra passi vicini
+ * ===================== */
+typedef struct {
+    tcs34725_gain_t gain;
+    uint16_t        cycles;     // ATIME = 256 - cycles (2.4 ms ciascuno)
+} tcs_agc_step_t;
+
+static const tcs_agc_step_t k_agc_steps[TCS34725_AGC_STEPS] = {
+    { TCS34725_GAIN_1X,    1u },    //     1  (2.4 ms)
+    { TCS34725_GAIN_4X,    1u },    //     4
+    { TCS34725_GAIN_16X,   1u },    //    16
+    { TCS34725_GAIN_60X,   1u },    //    60
+    { TCS34725_GAIN_60X,   4u },    //   240  (9.6 ms)
+    { TCS34725_GAIN_60X,  16u },    //   960  (38.4 ms)
+    { TCS34725_GAIN_60X,  64u },    //  3840  (153.6 ms)
+    { TCS34725_GAIN_60X, 256u }     // 15360  (614 ms)
+};
+
+static bool    s_agc_en = false;
+static uint8_t s_agc_step = TCS34725_AGC_START_STEP;
+static uint8_t s_agc_skip = 0;          // campioni da scartare dopo un cambio
+
+static i2c_xfer_t s_agc_xfer[2];        // ATIME, CONTROL
+static uint8_t    s_agc_wr[2][2];
+
+/* =====================
+ * Stato lettura asincrona
+ * ===================== */
+static i2c_xfer_t s_rd_xfer;
+static uint8_t    s_rd_cmd;
+static uint8_t    s_rd_buf[9];                // STATUS + C/R/G/B
+static volatile bool s_rd_fresh;
+static uint32_t   s_rd_new_t;                 // tick dell'ultimo campione nuovo (no sync)
+static bool       s_rd_new_ok = false;
+
+static i2c_xfer_t s_clr_xfer;
+static uint8_t    s_clr_cmd;
 
 /* =====================
  * API
@@ -36,7 +95,8 @@ void tcs34725_enable(bool en)
 {
     if (en) {
         tcs_write8(TCS34725_REG_ENABLE,
-                   TCS34725_ENABLE_PON | TCS34725_ENABLE_AEN);
+                   TCS34725_ENABLE_PON | TCS34725_ENABLE_AEN |
+                   (s_aien ? TCS34725_ENABLE_AIEN : 0x00));
     } else {
         tcs_write8(TCS34725_REG_ENABLE, 0x00);
     }
@@ -44,26 +104,337 @@ void tcs34725_enable(bool en)
 
 void tcs34725_set_integration_time(tcs34725_it_t it)
 {
-    tcs_write8(TCS34725_REG_ATIME, (uint8_t)it);
+    if (tcs_write8(TCS34725_REG_ATIME, (uint8_t)it)) {
+        s_atime = (uint8_t)it;
+        tcs_update_norm();
+    }
+}
+
+uint32_t tcs34725_integration_us(void)
+{
+    return (256u - (uint32_t)s_atime) * 2400u;
+}
+
+bool tcs34725_read_status(uint8_t *status)
+{
+    if (!status) return false;
+    return tcs_read_block(TCS34725_REG_STATUS, status, 1);
+}
+
+bool tcs34725_clear_int(void)
+{
+    return tcs_write_cmd(TCS34725_CMD_BIT | TCS34725_CMD_SPECIAL | TCS34725_SF_INT_CLEAR);
+}
+
+bool tcs34725_sync_enable(bool en)
+{
+    // PERS=0: interrupt a ogni ciclo, indipendentemente dalle soglie
+    if (!tcs_write8(TCS34725_REG_PERS, 0x00)) return false;
+
+    s_sync = en;
+    s_aien = en;
+    tcs34725_enable(true);
+
+    return tcs34725_clear_int();
+}
+
+bool tcs34725_threshold_enable(uint16_t lo, uint16_t hi, tcs34725_pers_t pers)
+{
+    if (!tcs_write8(TCS34725_REG_AILTL,     (uint8_t)(lo & 0xFFu))) return false;
+    if (!tcs_write8(TCS34725_REG_AILTL + 1, (uint8_t)(lo >> 8)))    return false;
+    if (!tcs_write8(TCS34725_REG_AIHTL,     (uint8_t)(hi & 0xFFu))) return false;
+    if (!tcs_write8(TCS34725_REG_AIHTL + 1, (uint8_t)(hi >> 8)))    return false;
+    if (!tcs_write8(TCS34725_REG_PERS, (uint8_t)pers))              return false;
+
+    // AINT ora significa "scena cambiata", non "ciclo completato"
+    s_sync = false;
+    s_aien = true;
+    tcs34725_enable(true);
+
+    return tcs34725_clear_int();
 }
 
 void tcs34725_set_gain(tcs34725_gain_t gain)
 {
-    tcs_write8(TCS34725_REG_CONTROL, (uint8_t)gain);
+    if (tcs_write8(TCS34725_REG_CONTROL, (uint8_t)gain)) {
+        s_gain = (uint8_t)gain;
+        tcs_update_norm();
+    }
 }
 
 bool tcs34725_read_raw(tcs34725_raw_t *out)
 {
+    uint8_t buf[8];
+
     if (!out) return false;
 
-    if (!tcs_read16(TCS34725_REG_CDATAL, &out->c)) return false;
-    if (!tcs_read16(TCS34725_REG_RDATAL, &out->r)) return false;
-    if (!tcs_read16(TCS34725_REG_GDATAL, &out->g)) return false;
-    if (!tcs_read16(TCS34725_REG_BDATAL, &out->b)) return false;
+    // CDATAL..BDATAH sono contigui (0x14..0x1B): un solo burst da 8 byte.
+    // Il sensore aggiorna i registri dati solo a fine ciclo e la lettura
+    // del byte basso "congela" il resto, quindi C/R/G/B sono coerenti.
+    if (!tcs_read_block(TCS34725_REG_CDATAL, buf, sizeof(buf))) return false;
+
+    tcs_unpack_raw(buf, out);
+    return true;
+}
+
+bool tcs34725_read_raw_start(void)
+{
+    if (s_rd_xfer.status == I2C_XFER_PENDING) return false;
+
+    s_rd_cmd = TCS34725_CMD_BIT | TCS34725_CMD_AUTOINC | TCS34725_REG_STATUS;
+    s_rd_fresh = false;
+
+    s_rd_xfer.addr = TCS34725_I2C_ADDR;
+    s_rd_xfer.wbuf = &s_rd_cmd;
+    s_rd_xfer.wlen = 1;
+    s_rd_xfer.rbuf = s_rd_buf;
+    s_rd_xfer.rlen = sizeof(s_rd_buf);
+    s_rd_xfer.cb   = tcs_rd_done;
+    s_rd_xfer.ctx  = 0;
+
+    return i2c_submit(&s_rd_xfer);
+}
+
+int tcs34725_read_raw_poll(tcs34725_raw_t *out)
+{
+    switch (s_rd_xfer.status) {
+        case I2C_XFER_PENDING:
+            return TCS34725_RD_PENDING;
+
+        case I2C_XFER_DONE:
+            s_rd_xfer.status = I2C_XFER_IDLE;
+            if (!out) return TCS34725_RD_ERROR;
+            if (!s_rd_fresh) return TCS34725_RD_STALE;
+            tcs_unpack_raw(&s_rd_buf[1], out);
+            return TCS34725_RD_NEW;
+
+        case I2C_XFER_ERROR:
+        default:
+            s_rd_xfer.status = I2C_XFER_IDLE;
+            return TCS34725_RD_ERROR;
+    }
+}
+
+// Completamento burst (in ISR I2C): decide se il campione e' nuovo e, in
+// modalita' sync, accoda subito il clear di AINT, prima che possa
+// terminare il ciclo successivo.
+static void tcs_rd_done(i2c_xfer_t *x)
+{
+    if (x->status != I2C_XFER_DONE) return;
+
+    const uint8_t st = s_rd_buf[0];
+
+    if (!s_sync) {
+        // Senza AINT per ciclo AVALID resta alto dal primo ciclo in poi. In
+        // ogni intervallo lungo un'integrazione finisce un ciclo: il dato e'
+        // nuovo se dalla lettura nuova precedente e' passata un'integrazione
+        // (+1/8 per la tolleranza dell'oscillatore). Si puo' scartare un
+        // campione, mai restituirlo due volte.
+        const uint32_t now = utils_ticks();
+        const uint32_t t_int = tcs34725_integration_us() * UTILS_TICKS_PER_US;
+
+        s_rd_fresh = (st & TCS34725_STATUS_AVALID) != 0u &&
+                     (!s_rd_new_ok || (now - s_rd_new_t) >= t_int + t_int / 8u);
+        if (s_rd_fresh) {
+            s_rd_new_t = now;
+            s_rd_new_ok = true;
+        }
+        return;
+    }
+
+    s_rd_fresh = (st & TCS34725_STATUS_AINT) != 0u;
+    if (s_rd_fresh) {
+        s_clr_cmd = TCS34725_CMD_BIT | TCS34725_CMD_SPECIAL | TCS34725_SF_INT_CLEAR;
+        s_clr_xfer.addr = TCS34725_I2C_ADDR;
+        s_clr_xfer.wbuf = &s_clr_cmd;
+        s_clr_xfer.wlen = 1;
+        s_clr_xfer.rbuf = 0;
+        s_clr_xfer.rlen = 0;
+        s_clr_xfer.cb   = 0;
+        (void)i2c_submit(&s_clr_xfer);
+    }
+}
+
+/* =====================
+ * Normalizzazione
+ * ===================== */
+void tcs34725_normalize(const tcs34725_raw_t *raw, tcs34725_norm_t *out)
+{
+    if (!raw || !out) return;
+
+    if (s_norm_k == 0u) tcs_update_norm();
+
+    out->c = (uint32_t)(((uint64_t)raw->c * s_norm_k) >> 16);
+    out->r = (uint32_t)(((uint64_t)raw->r * s_norm_k) >> 16);
+    out->g = (uint32_t)(((uint64_t)raw->g * s_norm_k) >> 16);
+    out->b = (uint32_t)(((uint64_t)raw->b * s_norm_k) >> 16);
+
+    // Fondo scala: 1024 conteggi per ciclo (max 65535); sotto i 150 ms
+    // di integrazione il ripple riduce la saturazione utile al 75% (DN40)
+    const uint32_t cycles = 256u - (uint32_t)s_atime;
+    uint32_t sat = cycles * 1024u;
+    if (sat > 0xFFFFu) sat = 0xFFFFu;
+    if (cycles * 24u < 1500u) sat -= sat / 4u;
+
+    out->saturated = ((uint32_t)raw->c >= sat);
+}
+
+bool tcs34725_calc_light(const tcs34725_norm_t *norm, tcs34725_light_t *out)
+{
+    if (!norm || !out) return false;
+
+    // Stima IR e rimozione dai canali colore (clamp a 0).
+    // Si lavora sui valori raddoppiati: 2*IR = R + G + B - C esatto,
+    // niente troncamento della divisione per 2.
+    const int32_t sum = (int32_t)norm->r + (int32_t)norm->g + (int32_t)norm->b;
+    int32_t ir2 = sum - (int32_t)norm->c;
+    if (ir2 < 0) ir2 = 0;
+
+    int32_t r = 2 * (int32_t)norm->r - ir2;
+    int32_t g = 2 * (int32_t)norm->g - ir2;
+    int32_t b = 2 * (int32_t)norm->b - ir2;
+    if (r < 0) r = 0;
+    if (g < 0) g = 0;
+    if (b < 0) b = 0;
+
+    // 2*G'' in Q8 x1000; i conteggi normalizzati valgono gia' per ms @1x,
+    // quindi lux = G'' * DF e millilux = 2*G''(x1000) * DF / 512
+    const int64_t g2 = (int64_t)TCS34725_LUX_R_COEF_M * r
+                     + (int64_t)TCS34725_LUX_G_COEF_M * g
+                     + (int64_t)TCS34725_LUX_B_COEF_M * b;
+
+    out->lux_milli = (g2 > 0) ? (uint32_t)((g2 * TCS34725_LUX_DF + 256) >> 9) : 0u;
+
+    if (r == 0) {
+        out->cct_k = 0;
+        return false;
+    }
+
+    // B'/R' e' un rapporto: il fattore 2 si semplifica
+    uint32_t cct = (uint32_t)(((uint64_t)TCS34725_CT_COEF * (uint32_t)b + (uint32_t)r / 2u) / (uint32_t)r)
+                 + TCS34725_CT_OFFSET;
+    out->cct_k = (cct > 0xFFFFu) ? 0xFFFFu : (uint16_t)cct;
+
+    return !norm->saturated;
+}
+
+uint32_t tcs34725_norm_to_raw(uint32_t norm_q8)
+{
+    if (s_norm_div_x10 == 0u) tcs_update_norm();
+
+    uint64_t raw = ((uint64_t)norm_q8 * s_norm_div_x10) / 2560u;
+    return (raw > 0xFFFFu) ? 0xFFFFu : (uint32_t)raw;
+}
+
+/* =====================
+ * AGC
+ * ===================== */
+bool tcs34725_agc_enable(bool en)
+{
+    s_agc_en = en;
+    s_agc_skip = 0;
+    if (!en) return true;
+
+    const tcs_agc_step_t *st = &k_agc_steps[s_agc_step];
+
+    if (!tcs_write8(TCS34725_REG_ATIME, (uint8_t)(256u - st->cycles))) return false;
+    if (!tcs_write8(TCS34725_REG_CONTROL, (uint8_t)st->gain)) return false;
+
+    s_atime = (uint8_t)(256u - st->cycles);
+    s_gain  = (uint8_t)st->gain;
+    tcs_update_norm();
+
+    // Il ciclo in corso e' stato avviato con la configurazione precedente
+    s_agc_skip = 1;
+    return true;
+}
+
+uint8_t tcs34725_agc_step(void)
+{
+    return s_agc_step;
+}
+
+bool tcs34725_agc_process(const tcs34725_raw_t *raw, tcs34725_norm_t *norm)
+{
+    if (!raw) return false;
+
+    if (s_agc_skip > 0u) {
+        s_agc_skip--;
+        return false;
+    }
+
+    if (norm) tcs34725_normalize(raw, norm);
+
+    if (!s_agc_en) return true;
+
+    const tcs_agc_step_t *cur = &k_agc_steps[s_agc_step];
+    uint32_t sat = (uint32_t)cur->cycles * 1024u;
+    if (sat > 0xFFFFu) sat = 0xFFFFu;
+
+    const uint32_t c = raw->c;
+    uint8_t next = s_agc_step;
+
+    if (c >= (sat * TCS34725_AGC_HIGH_PCT) / 100u) {
+        // Vicino alla saturazione: meno sensibile
+        if (next > 0u) next--;
+    } else if ((uint8_t)(next + 1u) < TCS34725_AGC_STEPS) {
+        const tcs_agc_step_t *up = &k_agc_steps[next + 1u];
+        uint32_t sat_up = (uint32_t)up->cycles * 1024u;
+        if (sat_up > 0xFFFFu) sat_up = 0xFFFFu;
+
+        // Clear previsto al passo successivo (scala con gain*cicli)
+        const uint32_t s_cur = tcs_gain_mult(cur->gain) * cur->cycles;
+        const uint32_t s_up  = tcs_gain_mult(up->gain) * up->cycles;
+        const uint32_t pred  = (uint32_t)(((uint64_t)c * s_up) / s_cur);
+
+        if (pred < (sat_up * TCS34725_AGC_LOW_PCT) / 100u) next++;
+    }
+
+    if (next != s_agc_step) {
+        (void)tcs_agc_apply_async(next);
+    }
 
     return true;
 }
 
+/* ============================================================
+ * Kernel di conversione senza divisioni per canale
+ *
+ * x8 = (x * 255 + C/2) / C con n = x * 255 + C/2 < 2^24.
+ * Con inv = floor((2^32 - 1) / C) la stima q = (n * inv) >> 32 vale
+ * floor(n / C) oppure floor(n / C) - 1: una sola correzione con
+ * il resto rende il risultato identico alla divisione (verificato
+ * su tutti i C = 1..65535 e x = 0..C).
+ * Costo per campione: 1 divisione 32-bit (il reciproco) invece di 3.
+ * ============================================================ */
+static inline uint32_t tcs_div_by_recip(uint32_t n, uint32_t c, uint32_t inv)
+{
+    uint32_t q = (uint32_t)(((uint64_t)n * inv) >> 32);
+    if ((n - q * c) >= c) q++;
+    return q;
+}
+
+static inline void tcs_rgb8_kernel(const tcs34725_raw_t *in, tcs34725_rgb8_t *out)
+{
+    if (in->c == 0u) {
+        out->r = 0; out->g = 0; out->b = 0;
+        return;
+    }
+
+    const uint32_t c    = (uint32_t)in->c;
+    const uint32_t inv  = 0xFFFFFFFFu / c;
+    const uint32_t half = c / 2u;
+
+    // clamp a C: con x <= C il risultato e' gia' <= 255
+    const uint32_t r = (in->r > in->c) ? c : (uint32_t)in->r;
+    const uint32_t g = (in->g > in->c) ? c : (uint32_t)in->g;
+    const uint32_t b = (in->b > in->c) ? c : (uint32_t)in->b;
+
+    out->r = (uint8_t)tcs_div_by_recip(r * 255u + half, c, inv);
+    out->g = (uint8_t)tcs_div_by_recip(g * 255u + half, c, inv);
+    out->b = (uint8_t)tcs_div_by_recip(b * 255u + half, c, inv);
+}
+
 /* ============================================================
  * RAW (0..65535) -> RGB 8-bit (0..255)
  *
@@ -79,34 +450,155 @@ void tcs34725_raw_to_rgb8(const tcs34725_raw_t *in, uint8_t *r8, uint8_t *g8, ui
 {
     if (!in || !r8 || !g8 || !b8) return;
 
-    if (in->c == 0u) {
-        *r8 = 0; *g8 = 0; *b8 = 0;
+    tcs34725_rgb8_t rgb;
+    tcs_rgb8_kernel(in, &rgb);
+
+    *r8 = rgb.r;
+    *g8 = rgb.g;
+    *b8 = rgb.b;
+}
+
+void tcs34725_raw_to_rgb8_batch(const tcs34725_raw_t *in, tcs34725_rgb8_t *out, size_t n)
+{
+    if (!in || !out) return;
+
+    for (size_t i = 0; i < n; i++) {
+        tcs_rgb8_kernel(&in[i], &out[i]);
+    }
+}
+
+void tcs34725_norm_to_rgb8(const tcs34725_norm_t *in, tcs34725_rgb8_t *out)
+{
+    if (!in || !out) return;
+
+    // clamp a C prima dello shift: poi basta che C stia in 16 bit
+    const uint32_t c = in->c;
+    uint32_t r = (in->r > c) ? c : in->r;
+    uint32_t g = (in->g > c) ? c : in->g;
+    uint32_t b = (in->b > c) ? c : in->b;
+
+    uint8_t sh = 0;
+    while ((c >> sh) > 0xFFFFu) sh++;
+
+    tcs34725_raw_t raw;
+    raw.c = (uint16_t)(c >> sh);
+    raw.r = (uint16_t)(r >> sh);
+    raw.g = (uint16_t)(g >> sh);
+    raw.b = (uint16_t)(b >> sh);
+
+    tcs_rgb8_kernel(&raw, out);
+}
+
+void tcs34725_rgb8_to_hsv(const tcs34725_rgb8_t *in, tcs34725_hsv_t *out)
+{
+    if (!in || !out) return;
+
+    const int32_t r = in->r;
+    const int32_t g = in->g;
+    const int32_t b = in->b;
+
+    int32_t max = (r > g) ? r : g;
+    if (b > max) max = b;
+    int32_t min = (r < g) ? r : g;
+    if (b < min) min = b;
+
+    const int32_t d = max - min;
+    out->v = (uint8_t)max;
+
+    if (d == 0) {
+        out->h = 0;
+        out->s = 0;
         return;
     }
 
-    // (opzionale) evita valori > C (pu succedere per rumore/aritmetica)
-    uint32_t c = (uint32_t)in->c;
-    uint32_t r = (in->r > in->c) ? c : (uint32_t)in->r;
-    uint32_t g = (in->g > in->c) ? c : (uint32_t)in->g;
-    uint32_t b = (in->b > in->c) ? c : (uint32_t)in->b;
+    out->s = (uint8_t)((d * 255 + max / 2) / max);
 
-    // rounding: +c/2
-    uint32_t rr = (r * 255u + (c / 2u)) / c;
-    uint32_t gg = (g * 255u + (c / 2u)) / c;
-    uint32_t bb = (b * 255u + (c / 2u)) / c;
+    // sestante del canale massimo + frazione (-256..256) fra i due vicini
+    const int32_t sec = (int32_t)TCS34725_HUE_SECTOR;
+    int32_t h;
+    if (max == r) {
+        h = ((g - b) * sec) / d;
+    } else if (max == g) {
+        h = 2 * sec + ((b - r) * sec) / d;
+    } else {
+        h = 4 * sec + ((r - g) * sec) / d;
+    }
+    if (h < 0) h += (int32_t)TCS34725_HUE_RANGE;
+
+    out->h = (uint16_t)h;
+}
+
+/* =====================
+ * Helpers AGC / normalizzazione
+ * ===================== */
+static uint32_t tcs_gain_mult(uint8_t gain)
+{
+    switch (gain) {
+        case TCS34725_GAIN_4X:  return 4u;
+        case TCS34725_GAIN_16X: return 16u;
+        case TCS34725_GAIN_60X: return 60u;
+        case TCS34725_GAIN_1X:
+        default:                return 1u;
+    }
+}
 
-    if (rr > 255u) rr = 255u;
-    if (gg > 255u) gg = 255u;
-    if (bb > 255u) bb = 255u;
+static void tcs_update_norm(void)
+{
+    const uint32_t cycles = 256u - (uint32_t)s_atime;
 
-    *r8 = (uint8_t)rr;
-    *g8 = (uint8_t)gg;
-    *b8 = (uint8_t)bb;
+    s_norm_div_x10 = tcs_gain_mult(s_gain) * cycles * 24u;
+    s_norm_k = (2560u << 16) / s_norm_div_x10;
+}
+
+// Cambio passo senza bloccare: due scritture accodate al motore I2C
+static bool tcs_agc_apply_async(uint8_t step)
+{
+    if (s_agc_xfer[0].status == I2C_XFER_PENDING ||
+        s_agc_xfer[1].status == I2C_XFER_PENDING) {
+        return false;   // cambio precedente non ancora sul bus
+    }
+
+    // Le due scritture vanno accodate insieme (mai ATIME senza gain)
+    if (i2c_queue_free() < 2u) return false;
+
+    const tcs_agc_step_t *st = &k_agc_steps[step];
+
+    s_agc_wr[0][0] = TCS34725_CMD_BIT | TCS34725_REG_ATIME;
+    s_agc_wr[0][1] = (uint8_t)(256u - st->cycles);
+    s_agc_wr[1][0] = TCS34725_CMD_BIT | TCS34725_REG_CONTROL;
+    s_agc_wr[1][1] = (uint8_t)st->gain;
+
+    for (uint8_t i = 0; i < 2u; i++) {
+        s_agc_xfer[i].addr = TCS34725_I2C_ADDR;
+        s_agc_xfer[i].wbuf = s_agc_wr[i];
+        s_agc_xfer[i].wlen = 2;
+        s_agc_xfer[i].rbuf = 0;
+        s_agc_xfer[i].rlen = 0;
+        s_agc_xfer[i].cb   = 0;
+        (void)i2c_submit(&s_agc_xfer[i]);
+    }
+
+    s_agc_step = step;
+    s_atime = s_agc_wr[0][1];
+    s_gain  = s_agc_wr[1][1];
+    tcs_update_norm();
+
+    // Il ciclo che sta integrando ora mescola le due configurazioni
+    s_agc_skip = 1;
+    return true;
 }
 
 /* =====================
  * I2C low-level
  * ===================== */
+static void tcs_unpack_raw(const uint8_t *buf, tcs34725_raw_t *out)
+{
+    out->c = ((uint16_t)buf[1] << 8) | buf[0];
+    out->r = ((uint16_t)buf[3] << 8) | buf[2];
+    out->g = ((uint16_t)buf[5] << 8) | buf[4];
+    out->b = ((uint16_t)buf[7] << 8) | buf[6];
+}
+
 static bool tcs_write8(uint8_t reg, uint8_t value)
 {
     if (!i2c_start()) return false;
@@ -130,9 +622,27 @@ static bool tcs_write8(uint8_t reg, uint8_t value)
     return true;
 }
 
-static bool tcs_read16(uint8_t reg, uint16_t *value)
+static bool tcs_write_cmd(uint8_t cmd)
 {
-    uint8_t low, high;
+    if (!i2c_start()) return false;
+
+    if (!i2c_write((TCS34725_I2C_ADDR << 1) | 0)) {
+        i2c_stop();
+        return false;
+    }
+
+    if (!i2c_write(cmd)) {
+        i2c_stop();
+        return false;
+    }
+
+    i2c_stop();
+    return true;
+}
+
+static bool tcs_read_block(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+    if (!buf || len == 0u) return false;
 
     if (!i2c_start()) return false;
 
@@ -141,7 +651,8 @@ static bool tcs_read16(uint8_t reg, uint16_t *value)
         return false;
     }
 
-    if (!i2c_write(TCS34725_CMD_BIT | reg)) {
+    // Auto-increment: il sensore avanza l'indirizzo a ogni byte letto
+    if (!i2c_write(TCS34725_CMD_BIT | TCS34725_CMD_AUTOINC | reg)) {
         i2c_stop();
         return false;
     }
@@ -153,11 +664,14 @@ static bool tcs_read16(uint8_t reg, uint16_t *value)
         return false;
     }
 
-    low  = i2c_read(true);
-    high = i2c_read(false);
+    // ACK su tutti i byte tranne l'ultimo (NACK -> fine lettura)
+    for (uint8_t i = 0; i < len; i++) {
+        buf[i] = i2c_read(i < (uint8_t)(len - 1u));
+    }
 
-    i2c_stop();
+    // i2c_read() segnala i timeout solo tramite l'ultimo errore
+    if (i2c_last_error() != I2C_OK) return false;
 
-    *value = ((uint16_t)high << 8) | low;
+    i2c_stop();
     return true;
 }
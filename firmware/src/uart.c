@@ -1,6 +1,7 @@
 #include "uart.h"
 
 #include <xc.h>
+#include <sys/attribs.h>
 #include <stdint.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -10,8 +11,8 @@
 // =====================
 // Config
 // =====================
-#define UART_BAUDRATE   115200UL
-#define UART_BRG_VALUE  ((PBCLK_HZ / (16UL * UART_BAUDRATE)) - 1UL)
+// High speed (BRGH=1): baud = PBCLK / (4 * (BRG + 1))
+#define UART_BRG_DIV    4UL
 
 // Basys MX3 UART4 pins:
 //  TX = RF12 (RPF12R = 0x02 -> U4TX)
@@ -19,23 +20,53 @@
 #define UART4_TX_PPS    0x02u
 #define UART4_RX_PPS    0x09u
 
+#define UART_INT_PRIORITY   2
+#define UART_TX_MASK        (UART_TX_BUF_SIZE - 1u)
+#define UART_RX_MASK        (UART_RX_BUF_SIZE - 1u)
+
+#if (UART_TX_BUF_SIZE & UART_TX_MASK) != 0 || UART_TX_BUF_SIZE > 32768u
+#error "UART_TX_BUF_SIZE deve essere una potenza di 2 <= 32768"
+#endif
+#if (UART_RX_BUF_SIZE & UART_RX_MASK) != 0 || UART_RX_BUF_SIZE > 32768u
+#error "UART_RX_BUF_SIZE deve essere una potenza di 2 <= 32768"
+#endif
+
+// =====================
+// Stato TX
+// =====================
+// Indici liberi a 16 bit (head - tail = byte in coda): head scritto solo
+// da uart_putc(), tail solo dall'ISR o da uart_tx_pump() con l'ISR spenta
+static volatile uint8_t  s_tx_buf[UART_TX_BUF_SIZE];
+static volatile uint16_t s_tx_head = 0;
+static volatile uint16_t s_tx_tail = 0;
+
+// =====================
+// Stato RX
+// =====================
+// Produttore unico l'ISR (head), consumatore unico uart_try_getc() (tail)
+static volatile uint8_t  s_rx_buf[UART_RX_BUF_SIZE];
+static volatile uint16_t s_rx_head = 0;
+static volatile uint16_t s_rx_tail = 0;
+
+static uart_tx_policy_t s_tx_policy = UART_TX_BLOCK;
+static uint32_t         s_baud = 0;
+static int32_t          s_baud_err_ppm = 0;
+static uart_stats_t     s_stats;
+
 // =====================
 // Internal helpers
 // =====================
-static inline void uart4_clear_oerr(void)
-{
-    if (U4STAbits.OERR) {
-        // Clear overrun error (otherwise RX can stall)
-        U4STACLR = _U4STA_OERR_MASK;
-    }
-}
+static void uart_tx_fill(void);
+static void uart_tx_pump(void);
+static void uart_rx_drain(void);
 
 // =====================
 // Public API
 // =====================
 void uart_init(void)
 {
-    // Pin directions
+    // Pin directions (TX a riposo alto anche con il modulo spento)
+    LATFbits.LATF12 = 1;
     TRISFbits.TRISF12 = 0; // TX out
     TRISFbits.TRISF13 = 1; // RX in
 
@@ -50,13 +81,21 @@ void uart_init(void)
     // IMPORTANT: for Basys MX3 mapping this is 0x09
     U4RXRbits.U4RXR = UART4_RX_PPS;
 
-    // UART mode: 8N1, standard speed
-    U4MODEbits.BRGH  = 0; // Standard speed mode (16x)
+    // UART mode: 8N1, high speed
+    U4MODEbits.BRGH  = 1; // High speed mode (4x): passi di baud fini fino a PBCLK/4
     U4MODEbits.PDSEL = 0; // 8-bit, no parity
     U4MODEbits.STSEL = 0; // 1 stop bit
 
+    // Interrupt TX finche' la FIFO ha almeno un posto libero
+    U4STAbits.UTXISEL = 0;
+    // Interrupt RX a ogni carattere ricevuto
+    U4STAbits.URXISEL = 0;
+
     // Baud rate
-    U4BRG = (uint16_t)UART_BRG_VALUE;
+    uint16_t brg = 0;
+    (void)uart_baud_calc(UART_BAUD_DEFAULT, &brg, &s_baud_err_ppm);
+    U4BRG = brg;
+    s_baud = UART_BAUD_DEFAULT;
 
     // Clear status errors
     U4STACLR = _U4STA_OERR_MASK;
@@ -66,13 +105,101 @@ void uart_init(void)
 
     U4STAbits.UTXEN = 1;
     U4STAbits.URXEN = 1;
+
+    // Interrupt TX: configurato qui, abilitato solo con buffer non vuoto
+    s_tx_head = 0;
+    s_tx_tail = 0;
+    IEC2CLR = _IEC2_U4TXIE_MASK;
+    IFS2CLR = _IFS2_U4TXIF_MASK;
+
+    // Interrupt RX ed errori (overrun) sempre attivi
+    s_rx_head = 0;
+    s_rx_tail = 0;
+    IFS2CLR = _IFS2_U4RXIF_MASK | _IFS2_U4EIF_MASK;
+    IEC2SET = _IEC2_U4RXIE_MASK | _IEC2_U4EIE_MASK;
+
+    IPC9bits.U4IP = UART_INT_PRIORITY;
+    IPC9bits.U4IS = 0;
+}
+
+bool uart_baud_calc(uint32_t baud, uint16_t *brg, int32_t *err_ppm)
+{
+    if (baud == 0u || baud > PBCLK_HZ / UART_BRG_DIV) return false;
+
+    // Divisore arrotondato al piu' vicino
+    const uint32_t div = (PBCLK_HZ + (UART_BRG_DIV * baud) / 2u) / (UART_BRG_DIV * baud);
+    if (div == 0u || div > 65536u) return false;
+
+    const uint32_t actual = PBCLK_HZ / (UART_BRG_DIV * div);
+    const int32_t err = (int32_t)(((int64_t)actual - (int64_t)baud) * 1000000LL / (int64_t)baud);
+    if (err > UART_BAUD_ERR_MAX_PPM || err < -UART_BAUD_ERR_MAX_PPM) return false;
+
+    if (brg) *brg = (uint16_t)(div - 1u);
+    if (err_ppm) *err_ppm = err;
+    return true;
+}
+
+bool uart_set_baud(uint32_t baud)
+{
+    uint16_t brg;
+    int32_t err;
+    if (!uart_baud_calc(baud, &brg, &err)) return false;
+
+    // Niente a meta' strada: prima esce tutto alla velocita' vecchia
+    uart_flush();
+
+    U4MODEbits.ON = 0;
+    U4BRG = brg;
+    U4STACLR = _U4STA_OERR_MASK;
+    U4MODEbits.ON = 1;
+    U4STAbits.UTXEN = 1;
+    U4STAbits.URXEN = 1;
+
+    // Quanto ricevuto durante il cambio e' rumore
+    uart_rx_flush();
+
+    s_baud = baud;
+    s_baud_err_ppm = err;
+    return true;
+}
+
+uint32_t uart_get_baud(void)
+{
+    return s_baud;
+}
+
+int32_t uart_get_baud_error_ppm(void)
+{
+    return s_baud_err_ppm;
+}
+
+void uart_set_tx_policy(uart_tx_policy_t p)
+{
+    s_tx_policy = p;
 }
 
 void uart_putc(char c)
 {
-    // Wait until TX buffer has space
-    while (U4STAbits.UTXBF) {;}
-    U4TXREG = c;
+    uint16_t used = (uint16_t)(s_tx_head - s_tx_tail);
+
+    if (used >= UART_TX_BUF_SIZE) {
+        s_stats.tx_full++;
+        if (s_tx_policy == UART_TX_DROP) {
+            s_stats.tx_dropped++;
+            return;
+        }
+        // Svuota a mano: funziona anche a interrupt disabilitati
+        do {
+            uart_tx_pump();
+            used = (uint16_t)(s_tx_head - s_tx_tail);
+        } while (used >= UART_TX_BUF_SIZE);
+    }
+
+    s_tx_buf[s_tx_head & UART_TX_MASK] = (uint8_t)c;
+    s_tx_head++;
+    IEC2SET = _IEC2_U4TXIE_MASK;
+
+    if (used >= s_stats.tx_max_used) s_stats.tx_max_used = (uint16_t)(used + 1u);
 }
 
 void uart_puts(const char *s)
@@ -87,13 +214,39 @@ int uart_try_getc(char *out)
 {
     if (!out) return 0;
 
-    uart4_clear_oerr();
+    const uint16_t tail = s_rx_tail;
+    if (tail == s_rx_head) return 0;
 
-    if (U4STAbits.URXDA) {
-        *out = (char)U4RXREG;
-        return 1;
-    }
-    return 0;
+    *out = (char)s_rx_buf[tail & UART_RX_MASK];
+    s_rx_tail = (uint16_t)(tail + 1u);
+    return 1;
+}
+
+void uart_flush(void)
+{
+    while (s_tx_head != s_tx_tail) uart_tx_pump();
+    while (!U4STAbits.TRMT) {;}
+}
+
+void uart_get_stats(uart_stats_t *out)
+{
+    if (out) *out = s_stats;
+}
+
+void uart_reset_stats(void)
+{
+    s_stats.tx_full = 0;
+    s_stats.tx_dropped = 0;
+    s_stats.tx_max_used = 0;
+    s_stats.rx_overrun = 0;
+    s_stats.rx_dropped = 0;
+    s_stats.rx_max_used = 0;
+}
+
+// Solo il consumatore muove tail: nessun conflitto con l'ISR
+void uart_rx_flush(void)
+{
+    s_rx_tail = s_rx_head;
 }
 
 char uart_getc_blocking(void)
@@ -116,3 +269,72 @@ void uart_printf(const char *fmt, ...)
 
     uart_puts(buf);
 }
+
+// =====================
+// TX a interrupt
+// =====================
+// Dal buffer alla FIFO hardware finche' c'e' posto
+static void uart_tx_fill(void)
+{
+    uint16_t tail = s_tx_tail;
+
+    while (tail != s_tx_head && !U4STAbits.UTXBF) {
+        U4TXREG = s_tx_buf[tail & UART_TX_MASK];
+        tail++;
+    }
+    s_tx_tail = tail;
+}
+
+// Svuotamento dal superloop (buffer pieno / flush): ISR spenta nel frattempo
+static void uart_tx_pump(void)
+{
+    IEC2CLR = _IEC2_U4TXIE_MASK;
+    uart_tx_fill();
+    if (s_tx_head != s_tx_tail) IEC2SET = _IEC2_U4TXIE_MASK;
+}
+
+// =====================
+// RX a interrupt
+// =====================
+// Dalla FIFO hardware al buffer: a buffer pieno il carattere si conta e si perde
+static void uart_rx_drain(void)
+{
+    uint16_t head = s_rx_head;
+
+    while (U4STAbits.URXDA) {
+        const uint8_t b = (uint8_t)U4RXREG;
+        const uint16_t used = (uint16_t)(head - s_rx_tail);
+
+        if (used >= UART_RX_BUF_SIZE) {
+            s_stats.rx_dropped++;
+            continue;
+        }
+        s_rx_buf[head & UART_RX_MASK] = b;
+        head++;
+        if (used >= s_stats.rx_max_used) s_stats.rx_max_used = (uint16_t)(used + 1u);
+    }
+    s_rx_head = head;
+
+    // FIFO hardware traboccata: OERR ferma la ricezione finche' non si azzera
+    if (U4STAbits.OERR) {
+        s_stats.rx_overrun++;
+        U4STACLR = _U4STA_OERR_MASK;
+    }
+}
+
+void __ISR(_UART_4_VECTOR, IPL2SOFT) isr_uart4(void)
+{
+    if (IFS2bits.U4RXIF || IFS2bits.U4EIF) {
+        uart_rx_drain();
+        IFS2CLR = _IFS2_U4RXIF_MASK | _IFS2_U4EIF_MASK;
+    }
+
+    // Vettore condiviso con l'RX: U4TXIF resta alto finche' la FIFO ha posto,
+    // quindi il TX si serve solo se abilitato (uart_tx_pump() lo spegne)
+    if (IEC2bits.U4TXIE && IFS2bits.U4TXIF) {
+        uart_tx_fill();
+        // Buffer vuoto: niente piu' interrupt fino al prossimo uart_putc()
+        if (s_tx_head == s_tx_tail) IEC2CLR = _IEC2_U4TXIE_MASK;
+        IFS2CLR = _IFS2_U4TXIF_MASK;
+    }
+}
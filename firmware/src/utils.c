@@ -50,3 +50,36 @@ void utils_delay_ms(uint32_t ms)
         // busy wait
     }
 }
+
+uint32_t utils_ticks(void)
+{
+    return _CP0_GET_COUNT();
+}
+
+void utils_delay_us(uint32_t us)
+{
+    const uint32_t start = _CP0_GET_COUNT();
+    const uint32_t wait_ticks = us * UTILS_TICKS_PER_US;
+
+    while ((_CP0_GET_COUNT() - start) < wait_ticks) {
+        // busy wait
+    }
+}
+
+uint16_t utils_crc16(const void *data, size_t len)
+{
+    return utils_crc16_update(0xFFFFu, data, len);
+}
+
+uint16_t utils_crc16_update(uint16_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)data;
+
+    while (len--) {
+        crc ^= (uint16_t)((uint16_t)*p++ << 8);
+        for (uint8_t i = 0; i < 8u; i++) {
+            crc = (crc & 0x8000u) ? (uint16_t)((crc << 1) ^ 0x1021u) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
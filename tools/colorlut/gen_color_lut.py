@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Genera firmware/src/classify_lut.c da campioni RGB etichettati.
+
+Ogni cella della griglia quantizzata (CLASSIFY_BITS per canale) prende la
+classe a maggioranza dei K campioni piu' vicini al suo centro; se il piu'
+vicino dista piu' di --max-dist la cella resta "none".
+
+Uso:
+    python3 gen_color_lut.py [train.csv] [-o ../../firmware/src/classify_lut.c]
+"""
+import argparse
+import csv
+import os
+import sys
+
+# Stesso ordine di classify_class_t (classify.h)
+CLASSES = ["none", "red", "orange", "yellow", "green", "blue", "violet"]
+BITS = 5
+K = 3
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def load(path):
+    samples = []
+    with open(path, newline="") as f:
+        rows = (l for l in f if l.strip() and not l.lstrip().startswith("#"))
+        for row in csv.DictReader(rows):
+            label = row["label"].strip().lower()
+            if label not in CLASSES:
+                sys.exit("classe sconosciuta: %r" % label)
+            rgb = tuple(int(row[c]) for c in "rgb")
+            if any(v < 0 or v > 255 for v in rgb):
+                sys.exit("valore fuori range: %r" % (rgb,))
+            samples.append((rgb, CLASSES.index(label)))
+    if not samples:
+        sys.exit("nessun campione in %s" % path)
+    return samples
+
+
+def classify(cell, samples, max_d2):
+    near = sorted(((sum((a - b) ** 2 for a, b in zip(cell, rgb)), cls)
+                   for rgb, cls in samples))[:K]
+    if near[0][0] > max_d2:
+        return 0
+    votes = {}
+    for _, cls in near:
+        votes[cls] = votes.get(cls, 0) + 1
+    best = max(votes.values())
+    # parita': vince la classe del campione piu' vicino
+    for _, cls in near:
+        if votes[cls] == best:
+            return cls
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("csv", nargs="?", default=os.path.join(HERE, "train.csv"))
+    ap.add_argument("-o", "--out",
+                    default=os.path.join(HERE, "..", "..", "firmware", "src", "classify_lut.c"))
+    ap.add_argument("--max-dist", type=int, default=80,
+                    help="distanza RGB massima dal campione piu' vicino")
+    args = ap.parse_args()
+
+    samples = load(args.csv)
+    levels = 1 << BITS
+    step = 256 // levels
+    max_d2 = args.max_dist * args.max_dist
+
+    lut = []
+    for r in range(levels):
+        for g in range(levels):
+            for b in range(levels):
+                cell = (r * step + step // 2, g * step + step // 2, b * step + step // 2)
+                lut.append(classify(cell, samples, max_d2))
+
+    packed = [lut[i] | (lut[i + 1] << 4) for i in range(0, len(lut), 2)]
+
+    counts = [lut.count(i) for i in range(len(CLASSES))]
+    out = []
+    out.append("// classify_lut.c - GENERATO da tools/colorlut/gen_color_lut.py, non modificare")
+    out.append("// %d campioni, %d bit/canale, K=%d, max-dist=%d"
+               % (len(samples), BITS, K, args.max_dist))
+    out.append("// celle per classe: " + ", ".join(
+        "%s=%d" % (n, c) for n, c in zip(CLASSES, counts)))
+    out.append('#include "classify.h"')
+    out.append("")
+    out.append("const uint8_t classify_lut[CLASSIFY_LUT_BYTES] = {")
+    for i in range(0, len(packed), 16):
+        out.append("    " + ", ".join("0x%02X" % v for v in packed[i:i + 16]) + ",")
+    out.append("};")
+    out.append("")
+
+    with open(args.out, "w", newline="\r\n") as f:
+        f.write("\n".join(out))
+
+    print("%s: %d celle, %s" % (args.out, len(lut),
+                                ", ".join("%s=%d" % (n, c) for n, c in zip(CLASSES, counts))))
+
+
+if __name__ == "__main__":
+    main()
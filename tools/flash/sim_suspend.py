@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""
+Modello sul PC della latenza di flash_read() (firmware/src/flash.c) mentre
+la flash e' occupata in manutenzione: una sequenza di erase di settori e
+blocchi e di page program, e letture brevi (calibrazione, palette) che
+arrivano a caso nel frattempo, sempre fuori dall'area in modifica.
+
+Confronto fra:
+  wait     la lettura aspetta la fine dell'operazione in corso (WIP)
+  suspend  0x75 / lettura / 0x7A: la lettura paga tSUS e l'eventuale
+           attesa FLASH_RESUME_GAP_US dall'ultimo resume; l'operazione
+           sospesa si allunga della durata della lettura
+
+Uso:
+    python3 sim_suspend.py [--reads-per-s 50] [--read-bytes 64]
+                           [--tse-ms 450] [--tbe-ms 2000] [--tpp-ms 3]
+"""
+import argparse
+import random
+
+SCK_HZ = 20_000_000
+T_SUS_US = 20.0             # datasheet (max)
+RESUME_GAP_US = 100.0       # FLASH_RESUME_GAP_US
+
+
+def read_us(n):
+    """FAST_READ: comando + 3 indirizzo + dummy + dati, piu' CS e setup."""
+    return (5 + n) * 8 * 1e6 / SCK_HZ + 2.0
+
+
+def workload(args):
+    """Operazioni di manutenzione in sequenza: (nome, durata us)."""
+    ops = []
+    for _ in range(args.sectors):
+        ops.append(("SE 4K", args.tse_ms * 1000.0))
+        ops += [("PP", args.tpp_ms * 1000.0)] * args.pages
+    for _ in range(args.blocks):
+        ops.append(("BE 64K", args.tbe_ms * 1000.0))
+    return ops
+
+
+def arrivals(rate, span_us, rng):
+    t = 0.0
+    out = []
+    while True:
+        t += rng.expovariate(rate) * 1e6
+        if t >= span_us:
+            return out
+        out.append(t)
+
+
+def simulate(ops, reads, n, suspend):
+    """Ritorna (latenze us, durata totale della manutenzione us)."""
+    lat = []
+    ri = 0
+    now = 0.0
+    last_resume = -1e9
+    for _, dur in ops:
+        left = dur
+        while left > 0.0:
+            # prossima lettura durante questa operazione?
+            if ri < len(reads) and reads[ri] < now + left:
+                t = max(reads[ri], now)
+                left -= t - now
+                now = t
+                if suspend:
+                    gap = max(0.0, last_resume + RESUME_GAP_US - now)
+                    cost = gap + T_SUS_US + read_us(n)
+                    lat.append(t - reads[ri] + cost)
+                    left -= gap             # la flash lavora durante l'attesa
+                    now += cost
+                    last_resume = now
+                    ri += 1
+                else:
+                    # tutte le letture arrivate nel frattempo aspettano la fine
+                    end = now + left
+                    while ri < len(reads) and reads[ri] < end:
+                        end += read_us(n)
+                        lat.append(end - reads[ri])
+                        ri += 1
+                    now = end
+                    left = 0.0
+                continue
+            now += left
+            left = 0.0
+    return lat, now
+
+
+def pct(v, p):
+    v = sorted(v)
+    return v[min(len(v) - 1, int(len(v) * p))] if v else 0.0
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--reads-per-s", type=float, default=50.0)
+    ap.add_argument("--read-bytes", type=int, default=64)
+    ap.add_argument("--tse-ms", type=float, default=450.0)
+    ap.add_argument("--tbe-ms", type=float, default=2000.0)
+    ap.add_argument("--tpp-ms", type=float, default=3.0)
+    ap.add_argument("--sectors", type=int, default=8)
+    ap.add_argument("--pages", type=int, default=4)
+    ap.add_argument("--blocks", type=int, default=4)
+    ap.add_argument("--seed", type=int, default=1)
+    args = ap.parse_args()
+
+    ops = workload(args)
+    span = sum(d for _, d in ops)
+    reads = arrivals(args.reads_per_s, span, random.Random(args.seed))
+
+    print(f"manutenzione {span / 1e6:.2f} s, {len(reads)} letture da "
+          f"{args.read_bytes} B ({read_us(args.read_bytes):.0f} us di SPI)")
+    print(f"{'modo':8} {'medio':>12} {'p99':>12} {'peggiore':>12} {'durata':>9}")
+    for name, sus in (("wait", False), ("suspend", True)):
+        lat, end = simulate(ops, reads, args.read_bytes, sus)
+        mean = sum(lat) / len(lat) if lat else 0.0
+        print(f"{name:8} {mean:10.0f}us {pct(lat, 0.99):10.0f}us "
+              f"{max(lat, default=0.0):10.0f}us {end / 1e6:8.2f}s")
+
+
+if __name__ == "__main__":
+    main()
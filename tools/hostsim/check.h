@@ -0,0 +1,26 @@
+/*
+ * Controlli comuni dei test host in tools/hostsim: CHECK() stampa e conta
+ * gli errori senza fermare il test, check_report() chiude main() con
+ * "OK/FAIL (n errori)" e il codice di uscita per make.
+ */
+#ifndef HOSTSIM_CHECK_H
+#define HOSTSIM_CHECK_H
+
+#include <stdio.h>
+
+static int s_fail;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            s_fail++; \
+        } \
+    } while (0)
+
+static inline int check_report(void)
+{
+    printf("%s (%d errori)\n", s_fail ? "FAIL" : "OK", s_fail);
+    return s_fail ? 1 : 0;
+}
+
+#endif
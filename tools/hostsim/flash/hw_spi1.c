@@ -0,0 +1,589 @@
+#include "hw_spi1.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "xc.h"
+#include <sys/kmem.h>
+
+hw_trisf_t   TRISFbits;
+hw_spi1con_t SPI1CONbits;
+hw_dchcon_t  DCH0CONbits, DCH1CONbits;
+hw_dchecon_t DCH0ECONbits, DCH1ECONbits;
+uint32_t SPI1CON, SPI1BRG, RPF2R, SDI1R;
+uint32_t DCH0CON, DCH0ECON, DCH0SSA, DCH0DSA, DCH0SSIZ, DCH0DSIZ, DCH0CSIZ;
+uint32_t DCH1CON, DCH1ECON, DCH1SSA, DCH1DSA, DCH1SSIZ, DCH1DSIZ, DCH1CSIZ;
+
+#define HW_BUF_GUARD    0xA5A50000u     // latch SPI1BUF non scritto = lettura
+#define HW_PA_SPI1BUF   0x1F805820u
+#define HW_PA_BASE      0x40000000u
+#define HW_PA_SLOTS     16u
+#define HW_ERR_PRINT    10u
+
+// Flash: S25FL132K
+#define FL_T_SUS        800u            // 20 us
+#define FL_CMD_WREN     0x06u
+#define FL_CMD_WRDI     0x04u
+#define FL_CMD_RDSR     0x05u
+#define FL_CMD_RDSR2    0x35u
+#define FL_CMD_RDID     0x9Fu
+#define FL_CMD_READ     0x03u
+#define FL_CMD_FAST     0x0Bu
+#define FL_CMD_PP       0x02u
+#define FL_CMD_SE       0x20u
+#define FL_CMD_BE       0xD8u
+#define FL_CMD_CE       0xC7u
+#define FL_CMD_SUSPEND  0x75u
+#define FL_CMD_RESUME   0x7Au
+
+static const uint8_t k_jedec[3] = { 0x01u, 0x40u, 0x16u };
+
+typedef struct {
+    bool        en;
+    bool        bcif;
+    uint8_t    *ptr;            // memoria (lato non SPI1BUF)
+    uint32_t    n;              // celle del blocco
+    uint32_t    cnt;
+} hw_ch_t;
+
+typedef enum { FL_IDLE = 0, FL_PP, FL_SE, FL_BE, FL_CE } fl_op_t;
+
+typedef struct {
+    bool     sel;
+    bool     trunc;             // CE alzato a meta' byte
+    bool     ignore;            // comando rifiutato: resto ignorato
+    bool     bad_read;
+    uint32_t n;
+    uint8_t  cmd;
+    uint32_t addr;
+    bool     wel;
+    uint8_t  pp_buf[256];
+    uint32_t pp_n;
+
+    fl_op_t  op;
+    uint64_t done_at;
+    uint32_t op_addr;
+    uint32_t op_len;
+    bool     sus;
+    uint64_t sus_at;            // suspend richiesto (0 = no)
+    uint64_t left;              // durata residua da sospesa
+} hw_fl_t;
+
+static uint64_t s_now;
+static uint32_t s_core_off;
+static uint32_t s_errors;
+
+static int               s_latch_reg = -1;
+static volatile uint32_t s_latch_val;
+static bool              s_buf_pending;
+static volatile uint32_t s_buf_val;
+
+static hw_latf_t s_latf;
+static unsigned  s_cs_seen;
+
+static uint8_t  s_txf[HW_SPI_FIFO];
+static uint32_t s_txn;
+static uint8_t  s_rxf[HW_SPI_FIFO];
+static uint32_t s_rxn;
+static uint32_t s_shift_left;
+static uint8_t  s_shift_byte;
+static bool     s_rov;
+
+static bool     s_dma_on;
+static bool     s_dma_stall;
+static hw_ch_t  s_ch[2];
+static uint32_t s_dma_blocks;
+static const volatile void *s_pa[HW_PA_SLOTS];
+static uint32_t s_pa_next;
+
+static uint8_t  s_mem[HW_FLASH_SIZE];
+static hw_fl_t  s_fl;
+static uint32_t s_t_pp, s_t_se, s_t_be;
+static uint32_t s_suspends;
+
+static void hw_access(void);
+static void hw_apply(void);
+static void hw_advance(uint32_t n);
+static void hw_err(const char *fmt, ...);
+static void ch_start(int i);
+static void ch_service(void);
+static void spi_tick(void);
+static void fl_update(void);
+static bool fl_wip(void);
+static void fl_select(void);
+static void fl_deselect(void);
+static uint8_t fl_xfer(uint8_t mosi);
+
+void hw_reset(void)
+{
+    s_now = 0;
+    s_core_off = 0;
+    s_errors = 0;
+    s_latch_reg = -1;
+    s_buf_pending = false;
+    s_latf.LATF8 = 1;
+    s_cs_seen = 1;
+    s_txn = 0;
+    s_rxn = 0;
+    s_shift_left = 0;
+    s_rov = false;
+    s_dma_on = false;
+    s_dma_stall = false;
+    memset(s_ch, 0, sizeof(s_ch));
+    s_dma_blocks = 0;
+    memset(s_mem, 0xFF, sizeof(s_mem));
+    memset(&s_fl, 0, sizeof(s_fl));
+    s_suspends = 0;
+    hw_set_timing(28000u, 1800000u, 6000000u);     // 0.7 ms, 45 ms, 150 ms
+}
+
+void hw_step(uint32_t n)
+{
+    hw_apply();
+    hw_advance(n);
+}
+
+uint64_t hw_now(void)
+{
+    return s_now;
+}
+
+void hw_set_timing(uint32_t t_pp, uint32_t t_se, uint32_t t_be)
+{
+    s_t_pp = t_pp;
+    s_t_se = t_se;
+    s_t_be = t_be;
+}
+
+void hw_dma_stall(bool on)
+{
+    s_dma_stall = on;
+}
+
+uint8_t *hw_flash_mem(void)
+{
+    return s_mem;
+}
+
+bool hw_cs_high(void)
+{
+    hw_access();
+    return s_cs_seen != 0u;
+}
+
+uint32_t hw_dma_blocks(void)
+{
+    return s_dma_blocks;
+}
+
+uint32_t hw_suspends(void)
+{
+    return s_suspends;
+}
+
+uint32_t hw_errors(void)
+{
+    return s_errors;
+}
+
+// =====================
+// Registri (xc.h, sys/kmem.h)
+// =====================
+volatile uint32_t *hw_latch(int reg)
+{
+    hw_access();
+    s_latch_reg = reg;
+    s_latch_val = 0;
+    return &s_latch_val;
+}
+
+volatile uint32_t *hw_spi1buf(void)
+{
+    hw_access();
+    s_buf_pending = true;
+    s_buf_val = HW_BUF_GUARD | (s_rxn ? s_rxf[0] : 0u);
+    return &s_buf_val;
+}
+
+hw_latf_t *hw_latf(void)
+{
+    hw_access();
+    return &s_latf;
+}
+
+hw_spi1stat_t hw_spi1stat(void)
+{
+    hw_access();
+    return (hw_spi1stat_t){
+        .SPITBF = s_txn >= HW_SPI_FIFO,
+        .SPIRBE = s_rxn == 0u,
+        .SPIROV = s_rov,
+    };
+}
+
+hw_dchint_t hw_dch0int(void)
+{
+    hw_access();
+    return (hw_dchint_t){ .CHBCIF = s_ch[0].bcif };
+}
+
+uint32_t hw_core_count(void)
+{
+    hw_access();
+    return (uint32_t)s_now + s_core_off;
+}
+
+void hw_core_set(uint32_t v)
+{
+    hw_access();
+    s_core_off = v - (uint32_t)s_now;
+}
+
+uint32_t hw_kva_to_pa(const volatile void *p)
+{
+    // &SPI1BUF non e' una lettura
+    if (p == &s_buf_val) {
+        s_buf_pending = false;
+        return HW_PA_SPI1BUF;
+    }
+    const uint32_t slot = s_pa_next++ % HW_PA_SLOTS;
+    s_pa[slot] = p;
+    return HW_PA_BASE + slot;
+}
+
+static uint8_t *hw_pa_ptr(uint32_t pa)
+{
+    if (pa < HW_PA_BASE || pa >= HW_PA_BASE + HW_PA_SLOTS) return NULL;
+    return (uint8_t *)(uintptr_t)s_pa[pa - HW_PA_BASE];
+}
+
+// =====================
+// Modello
+// =====================
+static void hw_err(const char *fmt, ...)
+{
+    if (s_errors++ < HW_ERR_PRINT) {
+        va_list ap;
+        va_start(ap, fmt);
+        printf("  HW @%.3f ms: ", (double)s_now / HW_TICKS_PER_MS);
+        vprintf(fmt, ap);
+        printf("\n");
+        va_end(ap);
+    }
+}
+
+static void hw_access(void)
+{
+    hw_apply();
+    hw_advance(HW_ACCESS_TICKS);
+}
+
+static void hw_apply(void)
+{
+    if (s_buf_pending) {
+        s_buf_pending = false;
+        if ((s_buf_val & 0xFFFF0000u) == HW_BUF_GUARD) {
+            if (s_rxn) memmove(s_rxf, s_rxf + 1, --s_rxn);
+        } else if (s_txn >= HW_SPI_FIFO) {
+            hw_err("SPI1BUF scritto a FIFO TX piena");
+        } else {
+            s_txf[s_txn++] = (uint8_t)s_buf_val;
+        }
+    }
+
+    const int reg = s_latch_reg;
+    const uint32_t v = s_latch_val;
+    s_latch_reg = -1;
+    switch (reg) {
+    case HW_SPI1STATCLR:
+        if (v & _SPI1STAT_SPIROV_MASK) s_rov = false;
+        break;
+    case HW_DMACONSET:
+        if (v & _DMACON_ON_MASK) s_dma_on = true;
+        break;
+    case HW_DCH0CONSET: if (v & _DCH0CON_CHEN_MASK) ch_start(0); break;
+    case HW_DCH1CONSET: if (v & _DCH1CON_CHEN_MASK) ch_start(1); break;
+    case HW_DCH0CONCLR: if (v & _DCH0CON_CHEN_MASK) s_ch[0].en = false; break;
+    case HW_DCH1CONCLR: if (v & _DCH1CON_CHEN_MASK) s_ch[1].en = false; break;
+    case HW_DCH0INTCLR: if (v & _DCH_INT_CHBCIF_MASK) s_ch[0].bcif = false; break;
+    case HW_DCH1INTCLR: if (v & _DCH_INT_CHBCIF_MASK) s_ch[1].bcif = false; break;
+    default: break;
+    }
+
+    // CE: fronti dall'ultima scrittura di LATF
+    if (s_latf.LATF8 != s_cs_seen) {
+        s_cs_seen = s_latf.LATF8;
+        if (s_cs_seen) {
+            if (s_shift_left) s_fl.trunc = true;
+            fl_deselect();
+        } else {
+            fl_select();
+        }
+    }
+}
+
+static void hw_advance(uint32_t n)
+{
+    while (n--) {
+        s_now++;
+        // niente in corso sull'SPI: salto diretto
+        if (!s_shift_left && !s_txn && !s_ch[0].en && !s_ch[1].en) {
+            s_now += n;
+            return;
+        }
+        ch_service();
+        spi_tick();
+    }
+}
+
+// Dimensione di blocco a 16 bit: 0 = 65536
+static uint32_t ch_size(uint32_t v)
+{
+    if (v > 0xFFFFu) hw_err("DCHxSIZ oltre 16 bit (%lu)", (unsigned long)v);
+    v &= 0xFFFFu;
+    return v ? v : 65536u;
+}
+
+static void ch_start(int i)
+{
+    hw_ch_t *ch = &s_ch[i];
+    const hw_dchecon_t *econ = i ? &DCH1ECONbits : &DCH0ECONbits;
+    const uint32_t ssa = i ? DCH1SSA : DCH0SSA;
+    const uint32_t dsa = i ? DCH1DSA : DCH0DSA;
+    const uint32_t ssiz = ch_size(i ? DCH1SSIZ : DCH0SSIZ);
+    const uint32_t dsiz = ch_size(i ? DCH1DSIZ : DCH0DSIZ);
+    const uint32_t csiz = i ? DCH1CSIZ : DCH0CSIZ;
+
+    if (!s_dma_on) hw_err("DMA%d avviato con DMACON.ON = 0", i);
+    if (!econ->SIRQEN || econ->CHSIRQ != (unsigned)(i ? _SPI1_TX_IRQ : _SPI1_RX_IRQ)) {
+        hw_err("DMA%d: richiesta non collegata a SPI1 %s", i, i ? "TX" : "RX");
+    }
+    if (csiz != 1u) hw_err("DMA%d: CSIZ %lu invece di 1", i, (unsigned long)csiz);
+
+    if (i == 0) {
+        if (ssa != HW_PA_SPI1BUF || ssiz != 1u) hw_err("DMA0: sorgente diversa da SPI1BUF");
+        ch->ptr = hw_pa_ptr(dsa);
+        ch->n = dsiz;
+        s_dma_blocks++;
+    } else {
+        if (dsa != HW_PA_SPI1BUF || dsiz != 1u) hw_err("DMA1: destinazione diversa da SPI1BUF");
+        ch->ptr = hw_pa_ptr(ssa);
+        ch->n = ssiz;
+    }
+    if (!ch->ptr) hw_err("DMA%d: indirizzo fisico sconosciuto", i);
+    ch->cnt = 0;
+    ch->en = ch->ptr != NULL;
+}
+
+// Il DMA e' molto piu' veloce dell'SPI: serve tutte le richieste pendenti
+static void ch_service(void)
+{
+    if (!s_dma_on || s_dma_stall) return;
+
+    hw_ch_t *rx = &s_ch[0];
+    hw_ch_t *tx = &s_ch[1];
+
+    while (rx->en && s_rxn) {
+        rx->ptr[rx->cnt++] = s_rxf[0];
+        memmove(s_rxf, s_rxf + 1, --s_rxn);
+        if (rx->cnt == rx->n) {
+            rx->en = false;
+            rx->bcif = true;
+        }
+    }
+    while (tx->en && s_txn < HW_SPI_FIFO) {
+        s_txf[s_txn++] = tx->ptr[tx->cnt++];
+        if (tx->cnt == tx->n) {
+            tx->en = false;
+            tx->bcif = true;
+        }
+    }
+}
+
+static void spi_tick(void)
+{
+    if (s_shift_left && --s_shift_left == 0u) {
+        const uint8_t miso = s_cs_seen ? 0xFFu : fl_xfer(s_shift_byte);
+        if (s_rxn >= HW_SPI_FIFO) {
+            s_rov = true;
+            hw_err("FIFO RX SPI1 traboccata");
+        } else {
+            s_rxf[s_rxn++] = miso;
+        }
+    }
+    if (!s_shift_left && s_txn && SPI1CONbits.ON) {
+        s_shift_byte = s_txf[0];
+        memmove(s_txf, s_txf + 1, --s_txn);
+        s_shift_left = 16u * (SPI1BRG + 1u);
+    }
+}
+
+// =====================
+// Flash
+// =====================
+static void fl_update(void)
+{
+    if (s_fl.op == FL_IDLE || s_fl.sus) return;
+
+    if (s_now >= s_fl.done_at && (!s_fl.sus_at || s_fl.done_at <= s_fl.sus_at)) {
+        s_fl.op = FL_IDLE;
+        s_fl.sus_at = 0;
+    } else if (s_fl.sus_at && s_now >= s_fl.sus_at) {
+        s_fl.sus = true;
+        s_fl.left = s_fl.done_at - s_fl.sus_at;
+        s_fl.sus_at = 0;
+        s_suspends++;
+    }
+}
+
+static bool fl_wip(void)
+{
+    fl_update();
+    return s_fl.op != FL_IDLE && !s_fl.sus;
+}
+
+static void fl_select(void)
+{
+    fl_update();
+    s_fl.sel = true;
+    s_fl.trunc = false;
+    s_fl.ignore = false;
+    s_fl.bad_read = false;
+    s_fl.n = 0;
+    s_fl.addr = 0;
+    s_fl.pp_n = 0;
+}
+
+static bool fl_is_write(uint8_t cmd)
+{
+    return cmd == FL_CMD_PP || cmd == FL_CMD_SE || cmd == FL_CMD_BE || cmd == FL_CMD_CE;
+}
+
+static uint8_t fl_xfer(uint8_t mosi)
+{
+    const uint32_t k = s_fl.n++;
+
+    fl_update();
+    if (k == 0u) {
+        s_fl.cmd = mosi;
+        const bool status = mosi == FL_CMD_RDSR || mosi == FL_CMD_RDSR2 || mosi == FL_CMD_SUSPEND;
+        if (fl_wip() && !status) {
+            hw_err("comando 0x%02X a flash occupata", mosi);
+            s_fl.ignore = true;
+        } else if (fl_is_write(mosi) && s_fl.sus) {
+            hw_err("comando 0x%02X con program/erase sospeso", mosi);
+            s_fl.ignore = true;
+        } else if (fl_is_write(mosi) && !s_fl.wel) {
+            hw_err("comando 0x%02X senza WREN", mosi);
+            s_fl.ignore = true;
+        }
+        return 0xFFu;
+    }
+    if (s_fl.ignore) return 0xFFu;
+
+    if (k <= 3u && s_fl.cmd != FL_CMD_RDSR && s_fl.cmd != FL_CMD_RDSR2 && s_fl.cmd != FL_CMD_RDID) {
+        s_fl.addr = (s_fl.addr << 8) | mosi;
+        return 0xFFu;
+    }
+
+    switch (s_fl.cmd) {
+    case FL_CMD_RDSR:
+        return (uint8_t)((fl_wip() ? 0x01u : 0u) | (s_fl.wel ? 0x02u : 0u));
+    case FL_CMD_RDSR2:
+        return s_fl.sus ? 0x80u : 0u;
+    case FL_CMD_RDID:
+        return k_jedec[(k - 1u) % 3u];
+    case FL_CMD_READ:
+    case FL_CMD_FAST: {
+        const uint32_t hdr = (s_fl.cmd == FL_CMD_FAST) ? 5u : 4u;
+        if (k < hdr) return 0xFFu;      // dummy
+        const uint32_t a = (s_fl.addr + (k - hdr)) & (HW_FLASH_SIZE - 1u);
+        if (s_fl.sus && !s_fl.bad_read && a - s_fl.op_addr < s_fl.op_len) {
+            hw_err("lettura di 0x%06lX, area sospesa", (unsigned long)a);
+            s_fl.bad_read = true;
+        }
+        return s_mem[a];
+    }
+    case FL_CMD_PP:
+        if ((s_fl.addr & 0xFFu) + s_fl.pp_n == 256u) {
+            hw_err("page program a cavallo di pagina (0x%06lX)", (unsigned long)s_fl.addr);
+        }
+        s_fl.pp_buf[s_fl.pp_n++ & 0xFFu] = mosi;
+        return 0xFFu;
+    default:
+        return 0xFFu;
+    }
+}
+
+static void fl_start(fl_op_t op, uint32_t addr, uint32_t len, uint32_t t)
+{
+    s_fl.op = op;
+    s_fl.op_addr = addr;
+    s_fl.op_len = len;
+    s_fl.done_at = s_now + t;
+    s_fl.wel = false;
+}
+
+static void fl_deselect(void)
+{
+    fl_update();
+    s_fl.sel = false;
+    if (s_fl.ignore) return;
+    if (s_fl.trunc && fl_is_write(s_fl.cmd)) {
+        hw_err("comando 0x%02X interrotto a meta' byte", s_fl.cmd);
+        return;
+    }
+
+    switch (s_fl.cmd) {
+    case FL_CMD_WREN:
+        if (s_fl.n == 1u) s_fl.wel = true;
+        break;
+    case FL_CMD_WRDI:
+        s_fl.wel = false;
+        break;
+    case FL_CMD_PP: {
+        if (s_fl.n < 5u) {
+            hw_err("page program senza dati");
+            break;
+        }
+        const uint32_t page = s_fl.addr & ~0xFFu;
+        const uint32_t n = (s_fl.pp_n > 256u) ? 256u : s_fl.pp_n;
+        for (uint32_t i = 0; i < n; i++) {
+            s_mem[page | ((s_fl.addr + i) & 0xFFu)] &= s_fl.pp_buf[i];
+        }
+        fl_start(FL_PP, page, 256u, s_t_pp);
+        break;
+    }
+    case FL_CMD_SE:
+    case FL_CMD_BE: {
+        if (s_fl.n != 4u) {
+            hw_err("erase con %lu byte", (unsigned long)s_fl.n);
+            break;
+        }
+        const uint32_t len = (s_fl.cmd == FL_CMD_SE) ? 4096u : 65536u;
+        const uint32_t a = (s_fl.addr & (HW_FLASH_SIZE - 1u)) & ~(len - 1u);
+        memset(&s_mem[a], 0xFF, len);
+        fl_start(s_fl.cmd == FL_CMD_SE ? FL_SE : FL_BE, a, len,
+                 s_fl.cmd == FL_CMD_SE ? s_t_se : s_t_be);
+        break;
+    }
+    case FL_CMD_CE:
+        memset(s_mem, 0xFF, sizeof(s_mem));
+        fl_start(FL_CE, 0, HW_FLASH_SIZE, s_t_be * 64u);
+        break;
+    case FL_CMD_SUSPEND:
+        if (s_fl.op != FL_IDLE && s_fl.op != FL_CE && !s_fl.sus && !s_fl.sus_at) {
+            s_fl.sus_at = s_now + FL_T_SUS;
+        }
+        break;
+    case FL_CMD_RESUME:
+        if (s_fl.sus) {
+            s_fl.sus = false;
+            s_fl.done_at = s_now + s_fl.left;
+        }
+        break;
+    default:
+        break;
+    }
+}
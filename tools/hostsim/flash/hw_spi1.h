@@ -0,0 +1,50 @@
+/*
+ * Modello host di SPI1 + canali DMA 0/1 + flash S25FL132K per i test di
+ * firmware/src/flash.c e dei suoi utenti (recorder.c).
+ *
+ * SPI1 in modo ENHBUF: FIFO TX e RX da HW_SPI_FIFO byte, un byte ogni
+ * 16 * (SPI1BRG + 1) tick; FIFO RX piena = SPIROV e byte perso.
+ * DMA: canale avviato da CHEN, una cella per richiesta (SPI1 RX: FIFO non
+ * vuota, SPI1 TX: FIFO non piena), CHBCIF e CHEN a zero a fine blocco.
+ * Flash: comandi usati dal driver (WREN, RDSR, RDSR2, RDID, READ,
+ * FAST_READ, PP, SE, BE, CE, suspend/resume) con WIP, WEL e SUS.
+ *
+ * Il tempo e' in tick del core timer (40 MHz): HW_ACCESS_TICKS per ogni
+ * accesso ai registri, piu' hw_step(). Gli usi scorretti (comandi a flash
+ * occupata, program senza WREN o a cavallo di pagina, lettura dell'area
+ * sospesa, FIFO traboccate, DMA mal configurato) si contano in
+ * hw_errors() e si descrivono su stdout.
+ */
+#ifndef HW_SPI1_H
+#define HW_SPI1_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HW_SPI_FIFO         16u
+#define HW_ACCESS_TICKS     2u
+#define HW_FLASH_SIZE       (4u * 1024u * 1024u)
+#define HW_TICKS_PER_MS     40000u
+
+void hw_reset(void);
+
+// Avanza di n tick
+void hw_step(uint32_t n);
+uint64_t hw_now(void);
+
+// Tempi interni della flash (tick)
+void hw_set_timing(uint32_t t_pp, uint32_t t_se, uint32_t t_be);
+
+// DMA fermo (richieste ignorate): per il watchdog del driver
+void hw_dma_stall(bool on);
+
+// Contenuto della flash
+uint8_t *hw_flash_mem(void);
+
+bool hw_cs_high(void);
+uint32_t hw_dma_blocks(void);       // blocchi avviati sul canale RX
+uint32_t hw_suspends(void);         // suspend eseguiti
+uint32_t hw_errors(void);
+
+#endif // HW_SPI1_H
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+"""
+Confronto fra le pagine scritte da firmware/src/recorder.c sul modello
+(test_reclog) e la decodifica di tools/recorder/reclog.py: stessi record,
+campo per campo, nessun blocco scartato.
+
+Uso (da tools/hostsim, lo lancia make test_reclog):
+    python3 flash/reclog_check.py pagine.bin attesi.csv
+"""
+import csv
+import os
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "..", "..", "recorder"))
+from reclog import decode  # noqa: E402
+
+FIELDS = ("t_us", "c", "r", "g", "b", "agc_step", "flags", "seq")
+
+
+def main():
+    data = open(sys.argv[1], "rb").read()
+    with open(sys.argv[2], newline="") as f:
+        want = [tuple(int(row[k]) for k in FIELDS) for row in csv.DictReader(f)]
+
+    recs, bad = decode(data)
+    errors = 0
+    if bad:
+        print("  FAIL %d blocchi scartati da reclog.py" % bad)
+        errors += 1
+    if len(recs) != len(want):
+        print("  FAIL %d record decodificati, attesi %d" % (len(recs), len(want)))
+        errors += 1
+
+    for i, (got, exp) in enumerate(zip(recs, want)):
+        if got != exp:
+            diff = ", ".join("%s %d invece di %d" % (k, g, e)
+                             for k, g, e in zip(FIELDS, got, exp) if g != e)
+            print("  FAIL record %d: %s" % (i, diff))
+            errors += 1
+            break
+
+    print("reclog.py: %d blocchi, %d record" % (len(data) // 256, len(recs)))
+    print("%s (%d errori)" % ("FAIL" if errors else "OK", errors))
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
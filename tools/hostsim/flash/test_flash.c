@@ -0,0 +1,348 @@
+/*
+ * Test host di firmware/src/flash.c (DMA, coda con dipendenze, attesa
+ * delle funzioni bloccanti, suspend) e del registratore
+ * (firmware/src/recorder.c) sul modello SPI1/DMA/flash (hw_spi1.c).
+ *
+ * Uso (da tools/hostsim): make test_flash, oppure make per tutti i test.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "hw_spi1.h"
+#include "flash.h"
+#include "recorder.h"
+
+#define LONG_ADDR   0x012345u
+#define LONG_LEN    70000u          // tre blocchi DMA
+#define REC_SAMPLES 20000u
+#define REC_PERIOD  (24u * HW_TICKS_PER_MS / 10u)   // 2.4 ms
+#define LOOP_TICKS  400u            // resto del superloop: 10 us
+
+static uint8_t s_buf[LONG_LEN];
+
+static int  s_cb_n;
+static bool s_cb_ok;
+
+static void dma_cb(bool ok, void *ctx)
+{
+    (void)ctx;
+    s_cb_n++;
+    s_cb_ok = ok;
+}
+
+static void setup(void)
+{
+    hw_reset();
+    flash_init();
+    s_cb_n = 0;
+    s_cb_ok = false;
+}
+
+static void fill_random(uint32_t addr, uint32_t len, unsigned seed)
+{
+    uint8_t *mem = hw_flash_mem();
+    srand(seed);
+    for (uint32_t i = 0; i < len; i++) {
+        mem[addr + i] = (uint8_t)rand();
+    }
+}
+
+static void test_init(void)
+{
+    flash_info_t info;
+
+    printf("init e probe JEDEC\n");
+    setup();
+    flash_get_info(&info);
+
+    CHECK(info.known && info.fast_read && info.suspend);
+    CHECK(info.sck_hz == FLASH_SCK_MAX_HZ);
+    CHECK(hw_cs_high());
+    CHECK(hw_errors() == 0u);
+}
+
+// Lettura lunga: blocchi DMA in sequenza con CE sempre basso; una
+// lettura bloccante nel frattempo aspetta la fine del DMA
+static void test_dma_read(void)
+{
+    uint8_t tmp[4];
+
+    printf("lettura DMA di %u byte\n", LONG_LEN);
+    setup();
+    fill_random(LONG_ADDR, LONG_LEN, 2);
+    memset(s_buf, 0, sizeof(s_buf));
+
+    CHECK(flash_read_dma(LONG_ADDR, s_buf, LONG_LEN, dma_cb, NULL));
+    CHECK(flash_busy() && flash_dma_busy());
+    CHECK(!flash_page_program_dma(0x1000u, tmp, sizeof(tmp), NULL, NULL));
+
+    // La lettura bloccante lascia finire il DMA (callback compresa)
+    CHECK(flash_read(0, tmp, sizeof(tmp)));
+    CHECK(!flash_dma_busy());
+    CHECK(memcmp(tmp, hw_flash_mem(), sizeof(tmp)) == 0);
+
+    CHECK(s_cb_n == 1 && s_cb_ok);
+    CHECK(memcmp(s_buf, hw_flash_mem() + LONG_ADDR, LONG_LEN) == 0);
+    CHECK(hw_dma_blocks() == (LONG_LEN + FLASH_DMA_CHUNK - 1u) / FLASH_DMA_CHUNK);
+    CHECK(hw_cs_high());
+    CHECK(hw_errors() == 0u);
+}
+
+// DMA fermo: il watchdog chiude il trasferimento e l'SPI resta pulito
+static void test_dma_stall(void)
+{
+    uint8_t tmp[64];
+
+    printf("watchdog DMA\n");
+    setup();
+    fill_random(0x2000u, sizeof(tmp), 3);
+    hw_dma_stall(true);
+
+    CHECK(flash_read_dma(0x10000u, s_buf, 1000u, dma_cb, NULL));
+    const uint64_t t0 = hw_now();
+    while (flash_dma_busy()) {
+        flash_task();
+    }
+    hw_dma_stall(false);
+
+    CHECK(s_cb_n == 1 && !s_cb_ok);
+    CHECK(hw_now() - t0 >= (uint64_t)(FLASH_DMA_TIMEOUT_MS - 1u) * HW_TICKS_PER_MS);
+    CHECK(hw_cs_high());
+    CHECK(flash_read(0x2000u, tmp, sizeof(tmp)));
+    CHECK(memcmp(tmp, hw_flash_mem() + 0x2000u, sizeof(tmp)) == 0);
+    CHECK(hw_errors() == 0u);
+}
+
+static void test_dma_program(void)
+{
+    uint8_t page[FLASH_PAGE_SIZE + 1u];
+
+    printf("page program DMA\n");
+    setup();
+    for (uint32_t i = 0; i < sizeof(page); i++) {
+        page[i] = (uint8_t)(i * 13u + 1u);
+    }
+
+    CHECK(flash_page_program_dma(0x20000u, page, FLASH_PAGE_SIZE, dma_cb, NULL));
+    while (flash_dma_busy()) {
+        flash_task();
+    }
+    CHECK(s_cb_n == 1 && s_cb_ok);
+    CHECK(flash_busy());        // tPP in corso
+    while (flash_busy()) {;}
+    CHECK(memcmp(hw_flash_mem() + 0x20000u, page, FLASH_PAGE_SIZE) == 0);
+
+    // Richieste non valide rifiutate prima di toccare l'SPI
+    CHECK(!flash_page_program_dma(0x20080u, page, FLASH_PAGE_SIZE, NULL, NULL));
+    CHECK(!flash_page_program_dma(0x20100u, page, FLASH_PAGE_SIZE + 1u, NULL, NULL));
+    CHECK(hw_cs_high());
+    CHECK(hw_errors() == 0u);
+}
+
+static int s_order[3];
+static int s_order_n;
+
+static void op_cb(flash_op_t *op)
+{
+    if (s_order_n < 3) s_order[s_order_n] = (int)op->type;
+    s_order_n++;
+}
+
+// Coda: erase + write a cavallo di pagina + rilettura; nel frattempo una
+// lettura bloccante fuori dall'area sospende l'erase, dentro fallisce
+static void test_queue(void)
+{
+    static uint8_t src[300];
+    static uint8_t rd[300];
+    uint8_t tmp[32];
+    flash_op_t e = { 0 };
+    flash_op_t w = { 0 };
+    flash_op_t r = { 0 };
+
+    printf("coda erase/write/read e suspend\n");
+    setup();
+    fill_random(0x8000u, FLASH_SECTOR_SIZE_4K, 4);
+    fill_random(0x1000u, sizeof(tmp), 5);
+    for (uint32_t i = 0; i < sizeof(src); i++) {
+        src[i] = (uint8_t)(i ^ 0x5Au);
+    }
+    s_order_n = 0;
+
+    e.type = FLASH_OP_ERASE_4K; e.addr = 0x8000u; e.cb = op_cb;
+    w.type = FLASH_OP_WRITE; w.addr = 0x80F0u; w.src = src; w.len = sizeof(src); w.cb = op_cb;
+    r.type = FLASH_OP_READ; r.addr = 0x80F0u; r.dst = rd; r.len = sizeof(rd); r.cb = op_cb;
+    CHECK(flash_submit(&e) && flash_submit(&w) && flash_submit(&r));
+    CHECK(flash_queue_free() == FLASH_QUEUE_LEN - 3u);
+
+    flash_task();               // parte l'erase
+    CHECK(e.status == FLASH_OP_BUSY);
+    CHECK(!flash_read(0x8000u, tmp, sizeof(tmp)));
+    CHECK(flash_read(0x1000u, tmp, sizeof(tmp)));
+    CHECK(memcmp(tmp, hw_flash_mem() + 0x1000u, sizeof(tmp)) == 0);
+    CHECK(hw_suspends() == 1u);
+
+    while (!flash_idle()) {
+        flash_task();
+    }
+    CHECK(e.status == FLASH_OP_DONE && w.status == FLASH_OP_DONE && r.status == FLASH_OP_DONE);
+    CHECK(s_order_n == 3 && s_order[0] == FLASH_OP_ERASE_4K &&
+          s_order[1] == FLASH_OP_WRITE && s_order[2] == FLASH_OP_READ);
+    CHECK(memcmp(rd, src, sizeof(src)) == 0);
+    CHECK(hw_flash_mem()[0x80EFu] == 0xFFu && hw_flash_mem()[0x80F0u + sizeof(src)] == 0xFFu);
+    CHECK(hw_errors() == 0u);
+}
+
+// Catena erase -> write -> rilettura con erase in timeout: write e
+// rilettura chiudono in errore senza toccare la flash
+static void test_chain_error(void)
+{
+    static uint8_t src[64];
+    static uint8_t rd[64];
+    flash_op_t e = { 0 };
+    flash_op_t w = { 0 };
+    flash_op_t r = { 0 };
+
+    printf("catena interrotta da un erase fallito\n");
+    setup();
+    hw_set_timing(28000u, 3000u * HW_TICKS_PER_MS, 6000000u);   // oltre i 2 s del driver
+    memset(src, 0x00, sizeof(src));
+    memset(rd, 0xEE, sizeof(rd));
+    s_order_n = 0;
+
+    e.type = FLASH_OP_ERASE_4K; e.addr = 0x9000u; e.cb = op_cb;
+    w.type = FLASH_OP_WRITE; w.addr = 0x9000u; w.src = src; w.len = sizeof(src); w.cb = op_cb;
+    w.after = &e;
+    r.type = FLASH_OP_READ; r.addr = 0x9000u; r.dst = rd; r.len = sizeof(rd); r.cb = op_cb;
+    r.after = &w;
+
+    CHECK(!flash_submit(&w));   // after mai accodata
+    CHECK(flash_submit(&e) && flash_submit(&w) && flash_submit(&r));
+    while (!flash_idle()) {
+        flash_task();
+        hw_step(LOOP_TICKS);
+    }
+    CHECK(e.status == FLASH_OP_ERROR && w.status == FLASH_OP_ERROR && r.status == FLASH_OP_ERROR);
+    CHECK(s_order_n == 3);
+
+    // A erase finito nel chip il settore resta cancellato, mai programmato
+    while (flash_busy()) hw_step(HW_TICKS_PER_MS);
+    for (uint32_t i = 0; i < sizeof(src); i++) {
+        CHECK(hw_flash_mem()[0x9000u + i] == 0xFFu);
+        CHECK(rd[i] == 0xEEu);
+    }
+    CHECK(hw_errors() == 0u);
+}
+
+// Con una funzione bloccante chiamata dalla callback di un'operazione
+static bool s_cb_blocking;
+
+static void blocking_cb(flash_op_t *op)
+{
+    static const uint8_t b = 0x00u;
+    (void)op;
+    s_cb_blocking = flash_write(0xA800u, &b, 1);
+}
+
+// Le funzioni bloccanti completano prima coda e DMA invece di fallire;
+// dalle callback di flash_task() falliscono senza attendere
+static void test_drain(void)
+{
+    static uint8_t src[300];
+    static uint8_t rd[300];
+    uint8_t rec[64], chk[64];
+    flash_op_t w = { 0 };
+    flash_op_t r = { 0 };
+
+    printf("funzioni bloccanti con la coda piena\n");
+    setup();
+    fill_random(0xB000u, sizeof(rec), 6);
+    for (uint32_t i = 0; i < sizeof(src); i++) src[i] = (uint8_t)(i * 7u);
+    for (uint32_t i = 0; i < sizeof(rec); i++) rec[i] = (uint8_t)(i + 1u);
+
+    w.type = FLASH_OP_WRITE; w.addr = 0xA000u; w.src = src; w.len = sizeof(src); w.cb = blocking_cb;
+    r.type = FLASH_OP_READ; r.addr = 0xA000u; r.dst = rd; r.len = sizeof(rd); r.after = &w;
+    s_cb_blocking = true;
+    CHECK(flash_submit(&w) && flash_submit(&r));
+
+    CHECK(flash_sector_store(0xC000u, rec, sizeof(rec)));
+    CHECK(w.status == FLASH_OP_DONE && r.status == FLASH_OP_DONE);
+    CHECK(!s_cb_blocking);      // la rilettura era ancora in coda
+    CHECK(memcmp(rd, src, sizeof(src)) == 0);
+    CHECK(hw_flash_mem()[0xA800u] == 0xFFu);
+    CHECK(memcmp(hw_flash_mem() + 0xC000u, rec, sizeof(rec)) == 0);
+
+    // Lettura bloccante con una lettura DMA della coda in corso
+    memset(&r, 0, sizeof(r));
+    r.type = FLASH_OP_READ; r.addr = 0xC000u; r.dst = rd; r.len = sizeof(rd);
+    CHECK(flash_submit(&r));
+    flash_task();
+    CHECK(flash_dma_busy());
+    CHECK(flash_read(0xB000u, chk, sizeof(chk)));
+    CHECK(memcmp(chk, hw_flash_mem() + 0xB000u, sizeof(chk)) == 0);
+    CHECK(r.status == FLASH_OP_DONE);
+    CHECK(memcmp(rd, rec, sizeof(rec)) == 0);
+    CHECK(hw_errors() == 0u);
+}
+
+// Registratore a 2.4 ms: pagine programmate via DMA senza fermare i campioni
+static void test_recorder(void)
+{
+    recorder_status_t st;
+    tcs34725_raw_t raw = { 1000u, 400u, 300u, 200u };
+    uint32_t added = 0;
+
+    printf("registratore, %u campioni a 2.4 ms\n", REC_SAMPLES);
+    setup();
+    hw_set_timing(28000u, 1800000u, 400000u);   // erase dei blocchi accorciato
+    srand(6);
+
+    CHECK(recorder_start(256u * 1024u));
+    while (recorder_active()) {
+        recorder_get_status(&st);
+        if (st.state != RECORDER_ERASING) break;
+        recorder_task();
+        flash_task();
+        hw_step(LOOP_TICKS);
+    }
+
+    uint64_t next = hw_now();
+    while (added < REC_SAMPLES) {
+        if (hw_now() >= next) {
+            next += REC_PERIOD;
+            raw.c = (uint16_t)(raw.c + rand() % 9 - 4);
+            raw.r = (uint16_t)(raw.r + rand() % 5 - 2);
+            raw.g = (uint16_t)(raw.g + rand() % 5 - 2);
+            raw.b = (uint16_t)(raw.b + rand() % 5 - 2);
+            (void)recorder_add(&raw, 3u, 0u);
+            added++;
+        }
+        recorder_task();
+        flash_task();
+        hw_step(LOOP_TICKS);
+    }
+    CHECK(recorder_stop());
+    recorder_get_status(&st);
+
+    CHECK(st.state == RECORDER_IDLE);
+    CHECK(st.records == REC_SAMPLES);
+    CHECK(st.dropped == 0u);
+    CHECK(recorder_stored() == st.pages);
+    CHECK(hw_errors() == 0u);
+    printf("  %lu pagine\n", (unsigned long)st.pages);
+}
+
+int main(void)
+{
+    test_init();
+    test_dma_read();
+    test_dma_stall();
+    test_dma_program();
+    test_queue();
+    test_chain_error();
+    test_drain();
+    test_recorder();
+
+    return check_report();
+}
@@ -0,0 +1,409 @@
+/*
+ * Test host del formato dei blocchi del registratore: rec_encode() in
+ * firmware/src/recorder.c contro la decodifica di tools/recorder/reclog.py.
+ *
+ * Registrazione sul modello SPI1/DMA/flash (hw_spi1.c) con cambi di passo
+ * AGC e di flags, raffiche senza superloop (buffer pieni: buchi di seq),
+ * salti grandi dei canali (record non compressi) e pause di 60 s (dt
+ * ancora codificabile) e 600 s (zdt >= 0x40000000: nuovo blocco).
+ * L'area si rilegge con recorder_read_dma() e si decodifica con le regole
+ * di reclog.py, confrontando campo per campo con i campioni accettati;
+ * ogni ramo del formato deve comparire almeno una volta. I campioni persi
+ * chiudono il blocco in corso: il buco di seq si vede fra un blocco e
+ * l'altro, il campo dell'estensione resta a 0.
+ *
+ * Con due argomenti salva anche le pagine e i record attesi (CSV), che
+ * reclog_check.py confronta con la decodifica di reclog.py.
+ *
+ * Uso (da tools/hostsim): make test_reclog, oppure make per tutti i test.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "hw_spi1.h"
+#include "flash.h"
+#include "recorder.h"
+#include "utils.h"
+
+#define ATTEMPTS    6000u
+#define REC_MAX     (ATTEMPTS + 8u * 300u)
+#define REC_BYTES   (256u * 1024u)
+#define REC_PAGES   (REC_BYTES / FLASH_PAGE_SIZE)
+#define REC_PERIOD  (24u * HW_TICKS_PER_MS / 10u)   // 2.4 ms
+#define US_TICKS    (HW_TICKS_PER_MS / 1000u)
+#define LOOP_TICKS  400u            // resto del superloop: 10 us
+#define BURST       300u            // campioni senza superloop: due pagine e oltre
+
+// Campioni accettati da recorder_add(); t_us relativo al primo tentativo
+static recorder_rec_t s_exp[REC_MAX];
+static uint32_t       s_exp_n;
+static uint64_t       s_t0;
+static uint16_t       s_seq;
+
+static recorder_rec_t s_dec[REC_MAX];
+static uint32_t       s_dec_n;
+static uint8_t        s_pages[REC_PAGES * FLASH_PAGE_SIZE];
+
+// Rami del formato visti dalla decodifica
+typedef struct {
+    uint32_t ext;           // record con estensione
+    uint32_t gap;           // ... con buco di seq (oggi sempre 0, vedi sotto)
+    uint32_t gap_page;      // buchi di seq fra un blocco e il successivo
+    uint32_t chg;           // ... con agc_step / flags
+    uint32_t packed;        // canali a nibble
+    uint32_t full;          // canali a varint
+    uint32_t long_dt;       // header varint da 5 byte (dt di decine di s)
+    uint32_t breaks;        // blocchi aperti per zdt >= 0x40000000
+} dec_stats_t;
+
+static int s_cb_n;
+static bool s_cb_ok;
+
+static void dma_cb(bool ok, void *ctx)
+{
+    (void)ctx;
+    s_cb_n++;
+    s_cb_ok = ok;
+}
+
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1u);
+}
+
+static void loop_once(void)
+{
+    recorder_task();
+    flash_task();
+    hw_step(LOOP_TICKS);
+}
+
+/*
+ * Un tentativo: il campione parte a un multiplo di 1 us da s_t0, cosi'
+ * t_us del registratore (us interi del core timer) e' noto a meno di una
+ * costante uguale per tutti i record.
+ */
+static void add(const tcs34725_raw_t *raw, uint8_t step, uint8_t flags)
+{
+    hw_step((uint32_t)((US_TICKS - (hw_now() - s_t0) % US_TICKS) % US_TICKS));
+
+    const uint64_t now = hw_now();
+    const uint16_t seq = s_seq++;
+    if (!recorder_add(raw, step, flags)) return;
+
+    if (s_exp_n < REC_MAX) {
+        recorder_rec_t *e = &s_exp[s_exp_n];
+        e->t_us = (uint32_t)((now - s_t0) / US_TICKS);
+        e->raw = *raw;
+        e->agc_step = step;
+        e->flags = flags;
+        e->seq = seq;
+    }
+    s_exp_n++;
+}
+
+static void walk(uint16_t *v, int amp)
+{
+    *v = (uint16_t)(*v + rand() % (2 * amp + 1) - amp);
+}
+
+// Pausa lunga con il superloop vivo (rec_clock() prima del wrap del core timer)
+static void pause_s(uint32_t s)
+{
+    for (uint32_t i = 0; i < s; i++) {
+        recorder_task();
+        flash_task();
+        hw_step(1000u * HW_TICKS_PER_MS);
+    }
+}
+
+static void record(void)
+{
+    recorder_status_t st;
+    tcs34725_raw_t raw = { 1000u, 400u, 300u, 200u };
+    uint8_t step = 3u;
+
+    hw_reset();
+    flash_init();
+    hw_set_timing(28000u, 1800000u, 400000u);   // erase dei blocchi accorciato
+    srand(21);
+
+    CHECK(recorder_start(REC_BYTES));
+    do {
+        loop_once();
+        recorder_get_status(&st);
+    } while (st.state == RECORDER_ERASING);
+    CHECK(st.state == RECORDER_RUN);
+
+    s_t0 = hw_now();
+    s_seq = 0;
+    s_exp_n = 0;
+
+    uint64_t next = hw_now();
+    for (uint32_t k = 0; k < ATTEMPTS; ) {
+        if (hw_now() < next) {
+            loop_once();
+            continue;
+        }
+        next += REC_PERIOD;
+
+        uint8_t flags = 0u;
+        if (rand() % 50 == 0) {
+            step = (uint8_t)(rand() % TCS34725_AGC_STEPS);
+            flags = RECORDER_F_STALE;       // ciclo a cavallo del cambio
+        } else if (rand() % 200 == 0) {
+            flags = (uint8_t)(0x80u | (rand() & 0x7Fu));
+        }
+
+        if (rand() % 40 == 0) {
+            raw.c = (uint16_t)rand();
+            raw.r = (uint16_t)rand();
+            raw.g = (uint16_t)rand();
+            raw.b = (uint16_t)rand();
+        } else {
+            // rumore, a volte appena oltre il nibble (zigzag fino a 24)
+            const int amp = (rand() % 8 == 0) ? 12 : 2;
+            walk(&raw.c, amp + 2);
+            walk(&raw.r, amp);
+            walk(&raw.g, amp);
+            walk(&raw.b, amp);
+        }
+        add(&raw, step, flags);
+        k++;
+
+        if (k % 997u == 500u) {
+            for (uint32_t j = 0; j < BURST; j++) {
+                walk(&raw.c, 3);
+                add(&raw, step, 0u);
+            }
+            next = hw_now();
+        }
+        if (k == 2000u) {
+            pause_s(60u);
+            next = hw_now();
+        }
+        if (k == 4000u) {
+            pause_s(600u);
+            next = hw_now();
+        }
+    }
+
+    CHECK(recorder_stop());
+    recorder_get_status(&st);
+    CHECK(st.state == RECORDER_IDLE);
+    CHECK(st.records == s_exp_n);
+    CHECK(st.dropped > 0u);
+    CHECK(s_exp_n <= REC_MAX);
+    printf("  %lu record, %lu persi, %lu pagine\n", (unsigned long)st.records,
+           (unsigned long)st.dropped, (unsigned long)st.pages);
+}
+
+// Varint LEB128 dentro il payload; false se esce dal blocco
+static bool get_varint(const uint8_t *p, uint32_t used, uint32_t *i, uint32_t *v)
+{
+    *v = 0;
+    for (uint32_t shift = 0; shift < 35u; shift += 7u) {
+        if (*i >= used) return false;
+        const uint8_t b = p[(*i)++];
+        *v |= (uint32_t)(b & 0x7Fu) << shift;
+        if (!(b & 0x80u)) return true;
+    }
+    return false;
+}
+
+/*
+ * Un blocco, con le regole di reclog.py decode_page(). return record
+ * aggiunti a s_dec, -1 se il blocco non e' valido.
+ */
+static int decode_page(const uint8_t *pg, dec_stats_t *ds)
+{
+    const uint8_t n = pg[0], used = pg[1];
+    if (n == 0xFFu) return 0;
+    if (used > RECORDER_PAYLOAD || used < RECORDER_REC_SIZE || n == 0u) return -1;
+
+    uint16_t crc = utils_crc16(pg, 2u);
+    crc = utils_crc16_update(crc, &pg[RECORDER_PAGE_HDR], used);
+    if (crc != (uint16_t)(pg[2] | (pg[3] << 8))) return -1;
+    if (s_dec_n + n > REC_MAX) return -1;
+
+    const uint8_t *p = &pg[RECORDER_PAGE_HDR];
+    recorder_rec_t r;
+    memcpy(&r, p, sizeof(r));
+    s_dec[s_dec_n++] = r;
+
+    uint32_t i = RECORDER_REC_SIZE;
+    uint32_t dt = 0;
+    for (uint32_t k = 1; k < n; k++) {
+        uint32_t v, e, z[4];
+
+        if (!get_varint(p, used, &i, &v)) return -1;
+        if (v >= (1u << 28)) ds->long_dt++;
+        dt += (uint32_t)unzigzag(v >> 2);
+
+        uint32_t gap = 0;
+        if (v & 1u) {
+            ds->ext++;
+            if (!get_varint(p, used, &i, &e)) return -1;
+            gap = e >> 1;
+            if (gap) ds->gap++;
+            if (e & 1u) {
+                ds->chg++;
+                if (i + 2u > used) return -1;
+                r.agc_step = p[i];
+                r.flags = p[i + 1u];
+                i += 2u;
+            }
+        }
+        if (v & 2u) {
+            ds->packed++;
+            if (i + 2u > used) return -1;
+            z[0] = p[i] >> 4;
+            z[1] = p[i] & 15u;
+            z[2] = p[i + 1u] >> 4;
+            z[3] = p[i + 1u] & 15u;
+            i += 2u;
+        } else {
+            ds->full++;
+            for (uint32_t c = 0; c < 4u; c++) {
+                if (!get_varint(p, used, &i, &z[c])) return -1;
+            }
+        }
+
+        r.t_us += dt;
+        r.raw.c = (uint16_t)(r.raw.c + unzigzag(z[0]));
+        r.raw.r = (uint16_t)(r.raw.r + unzigzag(z[1]));
+        r.raw.g = (uint16_t)(r.raw.g + unzigzag(z[2]));
+        r.raw.b = (uint16_t)(r.raw.b + unzigzag(z[3]));
+        r.seq = (uint16_t)(r.seq + 1u + gap);
+        s_dec[s_dec_n++] = r;
+    }
+    return (i == used) ? (int)n : -1;
+}
+
+// Rilettura dell'area come app_rec_dump() e decodifica di ogni blocco
+static uint32_t read_back(dec_stats_t *ds)
+{
+    const uint32_t pages = recorder_stored();
+    uint32_t bad = 0;
+
+    CHECK(pages > 0u && pages <= REC_PAGES);
+    if (pages == 0u || pages > REC_PAGES) return 0;
+
+    s_cb_n = 0;
+    CHECK(recorder_read_dma(0, s_pages, pages, dma_cb, NULL));
+    while (s_cb_n == 0) {
+        flash_task();
+        hw_step(LOOP_TICKS);
+    }
+    CHECK(s_cb_ok);
+
+    memset(ds, 0, sizeof(*ds));
+    s_dec_n = 0;
+    uint32_t prev_first = 0;
+    for (uint32_t pg = 0; pg < pages; pg++) {
+        const uint32_t first = s_dec_n;
+        if (decode_page(&s_pages[pg * FLASH_PAGE_SIZE], ds) <= 0) {
+            bad++;
+            continue;
+        }
+
+        // Blocco aperto dal salto di tempo: dt non codificabile rispetto
+        // al dt dell'ultimo record del blocco prima (0 se ne aveva uno)
+        if (pg > 0u) {
+            const uint32_t last = first - 1u;
+            const uint32_t prev_dt = (last > prev_first) ? s_dec[last].t_us - s_dec[last - 1u].t_us : 0u;
+            const uint32_t dt = s_dec[first].t_us - s_dec[last].t_us;
+            if (zigzag((int32_t)(dt - prev_dt)) >= 0x40000000u) ds->breaks++;
+            if (s_dec[first].seq != (uint16_t)(s_dec[last].seq + 1u)) ds->gap_page++;
+        }
+        prev_first = first;
+    }
+    CHECK(bad == 0u);
+    return pages;
+}
+
+static void test_format(void)
+{
+    dec_stats_t ds;
+
+    printf("formato dei blocchi, %u tentativi con buchi, cambi AGC e pause\n", ATTEMPTS);
+    record();
+    const uint32_t pages = read_back(&ds);
+
+    // Stessi record, campo per campo; t_us a meno della costante del primo
+    CHECK(s_dec_n == s_exp_n);
+    const uint32_t t_off = (s_dec_n > 0u) ? s_dec[0].t_us - s_exp[0].t_us : 0u;
+    CHECK(t_off < 1000u);
+
+    uint32_t diff = 0;
+    for (uint32_t i = 0; i < s_dec_n && i < s_exp_n; i++) {
+        s_exp[i].t_us += t_off;
+        const recorder_rec_t *d = &s_dec[i], *e = &s_exp[i];
+        if (d->t_us != e->t_us || d->raw.c != e->raw.c || d->raw.r != e->raw.r ||
+            d->raw.g != e->raw.g || d->raw.b != e->raw.b || d->agc_step != e->agc_step ||
+            d->flags != e->flags || d->seq != e->seq) {
+            if (!diff) {
+                printf("  record %lu: t %lu C %u R %u G %u B %u step %u flags %u seq %u,"
+                       " atteso t %lu C %u R %u G %u B %u step %u flags %u seq %u\n",
+                       (unsigned long)i, (unsigned long)d->t_us, d->raw.c, d->raw.r, d->raw.g,
+                       d->raw.b, d->agc_step, d->flags, d->seq, (unsigned long)e->t_us,
+                       e->raw.c, e->raw.r, e->raw.g, e->raw.b, e->agc_step, e->flags, e->seq);
+            }
+            diff++;
+        }
+    }
+    CHECK(diff == 0u);
+
+    printf("  rami: ext %lu (buco %lu, cambio %lu), buchi fra blocchi %lu, nibble %lu,"
+           " varint %lu, dt lungo %lu, blocchi per zdt %lu\n",
+           (unsigned long)ds.ext, (unsigned long)ds.gap, (unsigned long)ds.chg,
+           (unsigned long)ds.gap_page,
+           (unsigned long)ds.packed, (unsigned long)ds.full, (unsigned long)ds.long_dt,
+           (unsigned long)ds.breaks);
+    // Un campione perso chiude sempre il blocco (buffer in coda o pieno):
+    // il buco arriva nel primo record del blocco dopo, non nell'estensione
+    CHECK(ds.chg > 0u && ds.gap_page > 0u);
+    CHECK(ds.packed > 0u && ds.full > 0u);
+    CHECK(ds.long_dt > 0u);
+    CHECK(ds.breaks > 0u);
+    CHECK(pages > 0u);
+    CHECK(hw_errors() == 0u);
+}
+
+// Pagine e record attesi per reclog_check.py
+static void dump(const char *bin, const char *csv)
+{
+    const uint32_t pages = recorder_stored();
+    FILE *f = fopen(bin, "wb");
+    CHECK(f != NULL);
+    if (f) {
+        CHECK(fwrite(s_pages, FLASH_PAGE_SIZE, pages, f) == pages);
+        fclose(f);
+    }
+
+    f = fopen(csv, "w");
+    CHECK(f != NULL);
+    if (!f) return;
+    fprintf(f, "t_us,c,r,g,b,agc_step,flags,seq\n");
+    for (uint32_t i = 0; i < s_exp_n && i < REC_MAX; i++) {
+        const recorder_rec_t *e = &s_exp[i];
+        fprintf(f, "%lu,%u,%u,%u,%u,%u,%u,%u\n", (unsigned long)e->t_us, e->raw.c, e->raw.r,
+                e->raw.g, e->raw.b, e->agc_step, e->flags, e->seq);
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    test_format();
+    if (argc > 2) dump(argv[1], argv[2]);
+
+    return check_report();
+}
@@ -0,0 +1,76 @@
+/*
+ * xc.h per il build host di firmware/src/flash.c (e di chi lo usa):
+ * SPI1, pin CE, canali DMA 0/1 e core timer, collegati al modello in
+ * hw_spi1.c.
+ *
+ * Come in tools/hostsim/uart: le scritture con effetti (SPI1BUF, SET/CLR)
+ * passano da un latch applicato al primo accesso successivo al modello, e
+ * ogni accesso fa avanzare il tempo. Una lettura di SPI1BUF si riconosce
+ * perche' il latch conserva il valore di guardia.
+ */
+#ifndef HOSTSIM_FLASH_XC_H
+#define HOSTSIM_FLASH_XC_H
+
+#include <stdint.h>
+
+typedef struct { unsigned TRISF2, TRISF6, TRISF7, TRISF8; } hw_trisf_t;
+typedef struct { unsigned LATF8; } hw_latf_t;
+typedef struct {
+    unsigned MSTEN, CKP, CKE, SMP, MODE16, MODE32, ENHBUF, STXISEL, SRXISEL, ON;
+} hw_spi1con_t;
+typedef struct { unsigned SPITBF, SPIRBE, SPIROV; } hw_spi1stat_t;
+typedef struct { unsigned CHPRI; } hw_dchcon_t;
+typedef struct { unsigned CHSIRQ, SIRQEN; } hw_dchecon_t;
+typedef struct { unsigned CHBCIF; } hw_dchint_t;
+
+enum {
+    HW_SPI1STATCLR, HW_DMACONSET,
+    HW_DCH0CONSET, HW_DCH0CONCLR, HW_DCH0INTCLR,
+    HW_DCH1CONSET, HW_DCH1CONCLR, HW_DCH1INTCLR,
+    HW_IFS1CLR
+};
+
+volatile uint32_t *hw_latch(int reg);
+volatile uint32_t *hw_spi1buf(void);
+hw_latf_t *hw_latf(void);
+hw_spi1stat_t hw_spi1stat(void);
+hw_dchint_t hw_dch0int(void);
+uint32_t hw_core_count(void);
+void hw_core_set(uint32_t v);
+
+extern hw_trisf_t   TRISFbits;
+extern hw_spi1con_t SPI1CONbits;
+extern hw_dchcon_t  DCH0CONbits, DCH1CONbits;
+extern hw_dchecon_t DCH0ECONbits, DCH1ECONbits;
+extern uint32_t SPI1CON, SPI1BRG, RPF2R, SDI1R;
+extern uint32_t DCH0CON, DCH0ECON, DCH0SSA, DCH0DSA, DCH0SSIZ, DCH0DSIZ, DCH0CSIZ;
+extern uint32_t DCH1CON, DCH1ECON, DCH1SSA, DCH1DSA, DCH1SSIZ, DCH1DSIZ, DCH1CSIZ;
+
+#define LATFbits        (*hw_latf())
+#define SPI1BUF         (*hw_spi1buf())
+#define SPI1STATbits    (hw_spi1stat())
+#define DCH0INTbits     (hw_dch0int())
+#define SPI1STATCLR     (*hw_latch(HW_SPI1STATCLR))
+#define DMACONSET       (*hw_latch(HW_DMACONSET))
+#define DCH0CONSET      (*hw_latch(HW_DCH0CONSET))
+#define DCH0CONCLR      (*hw_latch(HW_DCH0CONCLR))
+#define DCH0INTCLR      (*hw_latch(HW_DCH0INTCLR))
+#define DCH1CONSET      (*hw_latch(HW_DCH1CONSET))
+#define DCH1CONCLR      (*hw_latch(HW_DCH1CONCLR))
+#define DCH1INTCLR      (*hw_latch(HW_DCH1INTCLR))
+#define IFS1CLR         (*hw_latch(HW_IFS1CLR))
+
+#define _SPI1STAT_SPIROV_MASK   0x40u
+#define _DMACON_ON_MASK         0x8000u
+#define _DCH0CON_CHEN_MASK      0x80u
+#define _DCH1CON_CHEN_MASK      0x80u
+#define _DCH_INT_CHBCIF_MASK    0x08u
+#define _IFS1_SPI1RXIF_MASK     0x20u
+#define _IFS1_SPI1TXIF_MASK     0x40u
+#define _SPI1_RX_IRQ            37
+#define _SPI1_TX_IRQ            38
+
+#define _CP0_GET_COUNT()        hw_core_count()
+#define _CP0_SET_COUNT(v)       hw_core_set(v)
+
+#endif // HOSTSIM_FLASH_XC_H
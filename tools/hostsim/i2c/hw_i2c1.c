@@ -0,0 +1,364 @@
+#include "hw_i2c1.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "xc.h"
+
+// ISR del driver (firmware/src/i2c.c)
+void isr_i2c1(void);
+
+volatile hw_i2ccon_t  hw_i2c1con;
+volatile hw_i2cstat_t hw_i2c1stat;
+hw_ipc6_t IPC6bits;
+uint32_t  I2C1BRG;
+
+#define HW_REQ_MASK     0x1Fu       // SEN, RSEN, PEN, RCEN, ACKEN
+#define HW_SCL          (1u << 2)
+#define HW_SDA          (1u << 3)
+#define HW_ERR_PRINT    10u
+
+typedef enum { EV_NONE = 0, EV_START, EV_RESTART, EV_STOP, EV_TX, EV_RX, EV_ACK } hw_ev_t;
+typedef enum { SL_IDLE = 0, SL_ADDR, SL_CMD, SL_WRITE, SL_READ, SL_OFF } hw_sl_t;
+
+static uint64_t s_now;
+static uint32_t s_core_off;
+static uint32_t s_errors;
+static bool     s_in_isr;
+static uint32_t s_iec;
+static uint32_t s_ifs;
+
+static int               s_latch_reg = -1;
+static volatile uint32_t s_latch_val;
+
+static bool     s_on;
+static hw_ev_t  s_ev;
+static uint32_t s_ev_req;           // bit di I2C1CON dell'evento in corso
+static uint64_t s_ev_done;
+static uint8_t  s_trn;
+static uint8_t  s_rcv;
+static bool     s_hang_next;
+static bool     s_hang;
+
+static uint32_t s_trisg;
+static uint32_t s_sda_hold;
+static uint32_t s_scl_pulses;
+
+static uint8_t  s_regs[32];
+static hw_sl_t  s_sl;
+static uint8_t  s_ptr;
+static bool     s_autoinc;
+
+static void hw_access(void);
+static void hw_apply(void);
+static void hw_advance(uint32_t n);
+static void hw_irq(void);
+static void hw_err(const char *fmt, ...);
+static void ev_start(hw_ev_t ev, uint32_t req, uint32_t bits);
+static void ev_done(void);
+
+void hw_reset(void)
+{
+    s_now = 0;
+    s_core_off = 0;
+    s_errors = 0;
+    s_in_isr = false;
+    s_iec = 0;
+    s_ifs = 0;
+    s_latch_reg = -1;
+    hw_i2c1con.w = 0;
+    hw_i2c1stat.w = 0;
+    s_on = false;
+    s_ev = EV_NONE;
+    s_hang_next = false;
+    s_hang = false;
+    s_trisg = HW_SCL | HW_SDA;
+    s_sda_hold = 0;
+    s_scl_pulses = 0;
+    s_sl = SL_IDLE;
+    s_ptr = 0;
+    s_autoinc = false;
+    for (uint32_t i = 0; i < sizeof(s_regs); i++) {
+        s_regs[i] = (uint8_t)(0x40u + i);
+    }
+}
+
+void hw_step(uint32_t n)
+{
+    hw_apply();
+    hw_advance(n);
+    hw_irq();
+}
+
+uint64_t hw_now(void)
+{
+    return s_now;
+}
+
+uint8_t *hw_slave_regs(void)
+{
+    return s_regs;
+}
+
+void hw_hang(void)
+{
+    s_hang_next = true;
+}
+
+void hw_sda_hold(uint32_t clocks)
+{
+    s_sda_hold = clocks;
+}
+
+uint32_t hw_scl_pulses(void)
+{
+    return s_scl_pulses;
+}
+
+uint32_t hw_errors(void)
+{
+    return s_errors;
+}
+
+// =====================
+// Registri (xc.h)
+// =====================
+volatile uint32_t *hw_latch(int reg)
+{
+    hw_access();
+    s_latch_reg = reg;
+    s_latch_val = 0;
+    return &s_latch_val;
+}
+
+uint32_t hw_i2c1rcv(void)
+{
+    hw_access();
+    hw_i2c1stat.RBF = 0;
+    return s_rcv;
+}
+
+// Con il modulo acceso le linee sono sue (alte a riposo)
+uint32_t hw_portg(void)
+{
+    hw_access();
+    uint32_t v = s_on ? (HW_SCL | HW_SDA) : (s_trisg & (HW_SCL | HW_SDA));
+    if (s_sda_hold) v &= ~HW_SDA;
+    return v;
+}
+
+uint32_t hw_core_count(void)
+{
+    hw_access();
+    return (uint32_t)s_now + s_core_off;
+}
+
+void hw_core_set(uint32_t v)
+{
+    hw_access();
+    s_core_off = v - (uint32_t)s_now;
+}
+
+// =====================
+// Modello
+// =====================
+static void hw_err(const char *fmt, ...)
+{
+    if (s_errors++ < HW_ERR_PRINT) {
+        va_list ap;
+        va_start(ap, fmt);
+        printf("  HW @%.1f us: ", (double)s_now / HW_TICKS_PER_US);
+        vprintf(fmt, ap);
+        printf("\n");
+        va_end(ap);
+    }
+}
+
+static void hw_access(void)
+{
+    hw_apply();
+    hw_advance(HW_ACCESS_TICKS);
+    hw_irq();
+}
+
+static uint32_t bit_ticks(void)
+{
+    return 2u * (I2C1BRG + 2u);
+}
+
+static void ev_start(hw_ev_t ev, uint32_t req, uint32_t bits)
+{
+    s_ev = ev;
+    s_ev_req = req;
+    s_ev_done = s_now + (uint64_t)bits * bit_ticks();
+    s_hang = s_hang_next;
+    s_hang_next = false;
+}
+
+static void hw_apply(void)
+{
+    const int reg = s_latch_reg;
+    const uint32_t v = s_latch_val;
+
+    s_latch_reg = -1;
+    switch (reg) {
+    case HW_I2C1TRN:
+        if (s_ev != EV_NONE || !s_on) {
+            hw_i2c1stat.IWCOL = 1;
+            hw_err("I2C1TRN scritto a bus occupato");
+        } else {
+            s_trn = (uint8_t)v;
+            hw_i2c1stat.TRSTAT = 1;
+            ev_start(EV_TX, 0, 9);
+        }
+        break;
+    case HW_I2C1STATCLR: hw_i2c1stat.w &= ~v; break;
+    case HW_IEC1SET:     s_iec |= v;  break;
+    case HW_IEC1CLR:     s_iec &= ~v; break;
+    case HW_IFS1CLR:     s_ifs &= ~v; break;
+    case HW_LATGCLR:     break;     // LAT sempre 0: TRIS decide la linea
+    case HW_TRISGSET:
+        // Fronte di salita di SCL generato a mano: un clock per lo slave
+        if ((v & HW_SCL) && !(s_trisg & HW_SCL) && !s_on) {
+            s_scl_pulses++;
+            if (s_sda_hold && s_sda_hold != HW_HOLD_FOREVER) s_sda_hold--;
+        }
+        s_trisg |= v;
+        break;
+    case HW_TRISGCLR:    s_trisg &= ~v; break;
+    default: break;
+    }
+
+    // ON: spegnere il modulo annulla l'evento in corso e libera lo slave
+    if (hw_i2c1con.ON != s_on) {
+        s_on = hw_i2c1con.ON;
+        if (!s_on) {
+            s_ev = EV_NONE;
+            s_hang = false;
+            s_sl = SL_IDLE;
+            hw_i2c1con.w &= ~HW_REQ_MASK;
+            hw_i2c1stat.TRSTAT = 0;
+        }
+    }
+    if (!s_on) return;
+
+    // Richieste nei bit di I2C1CON
+    const uint32_t req = hw_i2c1con.w & HW_REQ_MASK;
+    if (s_ev != EV_NONE) {
+        if (req & ~s_ev_req) {
+            hw_err("I2C1CON 0x%02lX a bus occupato", (unsigned long)req);
+            hw_i2c1con.w &= ~(req & ~s_ev_req);
+        }
+        return;
+    }
+    switch (req) {
+    case 0: break;
+    case _I2C1CON_SEN_MASK:   ev_start(EV_START, req, 1);   break;
+    case _I2C1CON_RSEN_MASK:  ev_start(EV_RESTART, req, 1); break;
+    case _I2C1CON_PEN_MASK:   ev_start(EV_STOP, req, 1);    break;
+    case _I2C1CON_RCEN_MASK:  ev_start(EV_RX, req, 8);      break;
+    case _I2C1CON_ACKEN_MASK: ev_start(EV_ACK, req, 1);     break;
+    default:
+        hw_err("I2C1CON 0x%02lX: piu' richieste insieme", (unsigned long)req);
+        hw_i2c1con.w &= ~HW_REQ_MASK;
+        break;
+    }
+}
+
+static void hw_advance(uint32_t n)
+{
+    const uint64_t end = s_now + n;
+
+    if (s_ev != EV_NONE && !s_hang && s_ev_done <= end) {
+        s_now = s_ev_done;
+        ev_done();
+    }
+    s_now = end;
+}
+
+static void hw_irq(void)
+{
+    if (s_in_isr || (s_iec & s_ifs & _IEC1_I2C1MIE_MASK) == 0u) return;
+
+    s_in_isr = true;
+    isr_i2c1();
+    hw_apply();
+    s_in_isr = false;
+}
+
+// Slave: byte ricevuto dal master, return ACK
+static bool slave_write(uint8_t b)
+{
+    switch (s_sl) {
+    case SL_ADDR:
+        if ((b >> 1) != HW_SLAVE_ADDR) {
+            s_sl = SL_OFF;
+            return false;
+        }
+        s_sl = (b & 1u) ? SL_READ : SL_CMD;
+        return true;
+    case SL_CMD:
+        if (b & 0x80u) {
+            s_ptr = b & 0x1Fu;
+            s_autoinc = ((b >> 5) & 3u) == 1u;
+        }
+        s_sl = SL_WRITE;
+        return true;
+    case SL_WRITE:
+        s_regs[s_ptr & 0x1Fu] = b;
+        if (s_autoinc) s_ptr++;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static uint8_t slave_read(void)
+{
+    if (s_sl != SL_READ) return 0xFFu;
+    const uint8_t b = s_regs[s_ptr & 0x1Fu];
+    if (s_autoinc) s_ptr++;
+    return b;
+}
+
+static void ev_done(void)
+{
+    const hw_ev_t ev = s_ev;
+
+    s_ev = EV_NONE;
+    hw_i2c1con.w &= ~s_ev_req;
+
+    switch (ev) {
+    case EV_START:
+    case EV_RESTART:
+        if (s_sda_hold) {
+            hw_i2c1stat.BCL = 1;
+            s_sl = SL_IDLE;
+        } else {
+            s_sl = SL_ADDR;
+        }
+        break;
+    case EV_STOP:
+        s_sl = SL_IDLE;
+        break;
+    case EV_TX:
+        hw_i2c1stat.ACKSTAT = !slave_write(s_trn);
+        hw_i2c1stat.TRSTAT = 0;
+        break;
+    case EV_RX:
+        if (hw_i2c1stat.RBF) {
+            hw_i2c1stat.I2COV = 1;
+            hw_err("byte ricevuto con I2C1RCV non letto");
+        }
+        s_rcv = slave_read();
+        hw_i2c1stat.RBF = 1;
+        break;
+    case EV_ACK:
+        if (hw_i2c1con.ACKDT) s_sl = SL_OFF;
+        break;
+    default:
+        break;
+    }
+    s_ifs |= _IFS1_I2C1MIF_MASK;
+}
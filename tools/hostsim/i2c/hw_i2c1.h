@@ -0,0 +1,43 @@
+/*
+ * Modello host di I2C1 master (PIC32MX370) e di uno slave a registri
+ * (indirizzo HW_SLAVE_ADDR, comando come il TCS34725: 0x80 | 0x20
+ * auto-incremento | registro) per i test di firmware/src/i2c.c.
+ *
+ * Ogni evento master (START, RESTART, STOP, byte + ACK, ricezione, ACK
+ * inviato) dura in bit 2 * (I2C1BRG + 2) tick e alla fine alza I2C1MIF;
+ * l'ISR del driver entra al primo accesso successivo se abilitata.
+ * Guasti: slave che tiene SCL (evento mai concluso, fino al bus clear) e
+ * SDA tenuto basso per un numero di clock dati con il bus clear.
+ *
+ * Tempo in tick del core timer (40 MHz): HW_ACCESS_TICKS per accesso ai
+ * registri, piu' hw_step(). Gli usi scorretti (richieste a bus occupato,
+ * I2C1TRN durante una trasmissione) si contano in hw_errors().
+ */
+#ifndef HW_I2C1_H
+#define HW_I2C1_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HW_SLAVE_ADDR       0x29u
+#define HW_ACCESS_TICKS     2u
+#define HW_TICKS_PER_US     40u
+#define HW_HOLD_FOREVER     0xFFFFFFFFu
+
+void hw_reset(void);
+void hw_step(uint32_t n);
+uint64_t hw_now(void);
+
+// Registri dello slave
+uint8_t *hw_slave_regs(void);
+
+// Prossimo evento master senza fine (SCL tenuto), fino al bus clear
+void hw_hang(void);
+
+// SDA tenuto basso per n clock (HW_HOLD_FOREVER: sempre, 0: rilasciato)
+void hw_sda_hold(uint32_t clocks);
+
+uint32_t hw_scl_pulses(void);       // clock generati a mano (bus clear)
+uint32_t hw_errors(void);
+
+#endif // HW_I2C1_H
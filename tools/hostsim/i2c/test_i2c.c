@@ -0,0 +1,246 @@
+/*
+ * Test host di firmware/src/i2c.c sul modello di I2C1 (hw_i2c1.c): coda
+ * di transazioni eseguita dall'ISR, callback che accodano, NACK, rifiuto
+ * delle primitive bloccanti a coda piena, watchdog, bus bloccato e bus
+ * clear all'avvio.
+ *
+ * Uso (da tools/hostsim): make test_i2c, oppure make per tutti i test.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "hw_i2c1.h"
+#include "i2c.h"
+
+#define CMD_AUTOINC     0xA0u       // TCS34725: comando + auto-incremento
+#define REG_DATA        0x14u       // CDATAL..BDATAH
+#define LOOP_TICKS      200u        // resto del superloop: 5 us
+
+static void setup(void)
+{
+    hw_reset();
+    i2c_init();
+    i2c_reset_stats();
+}
+
+static void xfer_rd(i2c_xfer_t *x, uint8_t addr, const uint8_t *cmd, uint8_t *rbuf, uint8_t rlen)
+{
+    memset(x, 0, sizeof(*x));
+    x->addr = addr;
+    x->wbuf = cmd;
+    x->wlen = 1;
+    x->rbuf = rbuf;
+    x->rlen = rlen;
+}
+
+// Superloop: i2c_task() e il resto del giro, finche' la coda non si svuota
+static void run_until_idle(uint32_t max_us)
+{
+    const uint64_t end = hw_now() + (uint64_t)max_us * HW_TICKS_PER_US;
+    while (i2c_busy() && hw_now() < end) {
+        i2c_task();
+        hw_step(LOOP_TICKS);
+    }
+}
+
+// Burst CDATAL..BDATAH: tutto in ISR, il superloop non aspetta il bus
+static void test_read_burst(void)
+{
+    static const uint8_t cmd = CMD_AUTOINC | REG_DATA;
+    uint8_t rbuf[8];
+    i2c_xfer_t x;
+    i2c_stats_t st;
+
+    printf("lettura burst in ISR\n");
+    setup();
+    xfer_rd(&x, HW_SLAVE_ADDR, &cmd, rbuf, sizeof(rbuf));
+
+    const uint64_t t0 = hw_now();
+    CHECK(i2c_submit(&x));
+    CHECK(hw_now() - t0 < 20u * HW_TICKS_PER_US);      // meno di un bit a 100 kHz
+    CHECK(x.status == I2C_XFER_PENDING && i2c_busy());
+    run_until_idle(5000);
+    i2c_get_stats(&st);
+
+    CHECK(x.status == I2C_XFER_DONE && x.err == I2C_OK);
+    CHECK(memcmp(rbuf, hw_slave_regs() + REG_DATA, sizeof(rbuf)) == 0);
+    CHECK(st.transactions == 1u && st.bytes == 3u + sizeof(rbuf));
+    CHECK(hw_errors() == 0u);
+}
+
+static i2c_xfer_t s_chain;
+static uint8_t    s_chain_buf[2];
+static int        s_cb_order[8];
+static int        s_cb_n;
+
+static void order_cb(i2c_xfer_t *x)
+{
+    if (s_cb_n < 8) s_cb_order[s_cb_n] = (int)(intptr_t)x->ctx;
+    s_cb_n++;
+}
+
+// Callback in ISR che accoda la transazione successiva
+static void chain_cb(i2c_xfer_t *x)
+{
+    static const uint8_t cmd = CMD_AUTOINC | 0x00u;
+    order_cb(x);
+    xfer_rd(&s_chain, HW_SLAVE_ADDR, &cmd, s_chain_buf, sizeof(s_chain_buf));
+    s_chain.cb = order_cb;
+    s_chain.ctx = (void *)(intptr_t)9;
+    (void)i2c_submit(&s_chain);
+}
+
+// Coda piena, ordine delle callback, NACK che non ferma la coda
+static void test_queue(void)
+{
+    static const uint8_t cmd = CMD_AUTOINC | REG_DATA;
+    uint8_t rbuf[I2C_QUEUE_LEN][2];
+    i2c_xfer_t x[I2C_QUEUE_LEN];
+    i2c_xfer_t extra;
+
+    printf("coda, callback e NACK\n");
+    setup();
+    s_cb_n = 0;
+    for (uint8_t i = 0; i < I2C_QUEUE_LEN; i++) {
+        // la seconda a un indirizzo assente
+        xfer_rd(&x[i], (i == 1u) ? 0x30u : HW_SLAVE_ADDR, &cmd, rbuf[i], sizeof(rbuf[i]));
+        x[i].cb = (i == I2C_QUEUE_LEN - 1u) ? chain_cb : order_cb;
+        x[i].ctx = (void *)(intptr_t)i;
+        CHECK(i2c_submit(&x[i]));
+    }
+    xfer_rd(&extra, HW_SLAVE_ADDR, &cmd, rbuf[0], 1);
+    CHECK(!i2c_submit(&extra));
+    CHECK(i2c_queue_free() == 0u);
+
+    // Primitive bloccanti rifiutate con la coda occupata
+    CHECK(!i2c_start());
+    CHECK(i2c_last_error() == I2C_ERR_BUSY);
+
+    run_until_idle(20000);
+
+    CHECK(x[0].status == I2C_XFER_DONE && x[2].status == I2C_XFER_DONE);
+    CHECK(x[1].status == I2C_XFER_ERROR && x[1].err == I2C_ERR_NACK);
+    CHECK(s_chain.status == I2C_XFER_DONE);
+    CHECK(s_cb_n == 5 && s_cb_order[0] == 0 && s_cb_order[1] == 1 && s_cb_order[2] == 2 &&
+          s_cb_order[3] == 3 && s_cb_order[4] == 9);
+    CHECK(memcmp(s_chain_buf, hw_slave_regs(), sizeof(s_chain_buf)) == 0);
+    CHECK(hw_errors() == 0u);
+}
+
+// A coda vuota le primitive bloccanti funzionano come prima
+static void test_blocking(void)
+{
+    uint8_t b[2];
+
+    printf("primitive bloccanti\n");
+    setup();
+    CHECK(i2c_start());
+    CHECK(i2c_write((uint8_t)(HW_SLAVE_ADDR << 1)));
+    CHECK(i2c_write(CMD_AUTOINC | 0x03u));
+    CHECK(i2c_write(0x5Au));
+    CHECK(i2c_restart());
+    CHECK(i2c_write((uint8_t)(HW_SLAVE_ADDR << 1) | 1u));
+    b[0] = i2c_read(true);
+    b[1] = i2c_read(false);
+    i2c_stop();
+
+    CHECK(hw_slave_regs()[3] == 0x5Au);
+    CHECK(b[0] == hw_slave_regs()[4] && b[1] == hw_slave_regs()[5]);
+    CHECK(i2c_last_error() == I2C_OK);
+    CHECK(hw_errors() == 0u);
+}
+
+// Slave che tiene SCL: il watchdog chiude la transazione, la coda riparte
+static void test_watchdog(void)
+{
+    static const uint8_t cmd = CMD_AUTOINC | REG_DATA;
+    uint8_t r1[2], r2[2];
+    i2c_xfer_t a, b;
+
+    printf("watchdog transazione\n");
+    setup();
+    xfer_rd(&a, HW_SLAVE_ADDR, &cmd, r1, sizeof(r1));
+    xfer_rd(&b, HW_SLAVE_ADDR, &cmd, r2, sizeof(r2));
+    hw_hang();
+    const uint64_t t0 = hw_now();
+    CHECK(i2c_submit(&a) && i2c_submit(&b));
+    while (a.status == I2C_XFER_PENDING && hw_now() - t0 < 50000u * HW_TICKS_PER_US) {
+        i2c_task();
+        hw_step(LOOP_TICKS);
+    }
+    const uint64_t dt = hw_now() - t0;
+    run_until_idle(5000);
+
+    CHECK(a.status == I2C_XFER_ERROR && a.err == I2C_ERR_TIMEOUT);
+    CHECK(dt >= 10000u * HW_TICKS_PER_US && dt < 12000u * HW_TICKS_PER_US);
+    CHECK(b.status == I2C_XFER_DONE);
+    CHECK(memcmp(r2, hw_slave_regs() + REG_DATA, sizeof(r2)) == 0);
+    CHECK(hw_errors() == 0u);
+}
+
+// SDA bloccato: niente nuove transazioni finche' il bus clear di
+// i2c_task() non riesce
+static void test_bus_stuck(void)
+{
+    static const uint8_t cmd = CMD_AUTOINC | REG_DATA;
+    uint8_t r[2];
+    i2c_xfer_t a;
+
+    printf("bus bloccato\n");
+    setup();
+    xfer_rd(&a, HW_SLAVE_ADDR, &cmd, r, sizeof(r));
+    hw_hang();
+    hw_sda_hold(HW_HOLD_FOREVER);
+    CHECK(i2c_submit(&a));
+    run_until_idle(20000);
+
+    CHECK(a.status == I2C_XFER_ERROR && a.err == I2C_ERR_TIMEOUT);
+    CHECK(i2c_last_error() == I2C_ERR_BUS_STUCK);
+    CHECK(!i2c_submit(&a));
+
+    // Nuovi bus clear al massimo ogni 10 ms
+    const uint32_t p0 = hw_scl_pulses();
+    for (uint32_t i = 0; i < 25000u / 5u; i++) {
+        i2c_task();
+        hw_step(LOOP_TICKS);
+    }
+    const uint32_t tries = (hw_scl_pulses() - p0) / 10u;
+    CHECK(tries >= 2u && tries <= 3u);
+
+    hw_sda_hold(0);
+    for (uint32_t i = 0; i < 12000u / 5u; i++) {
+        i2c_task();
+        hw_step(LOOP_TICKS);
+    }
+    CHECK(i2c_last_error() == I2C_OK);
+    CHECK(i2c_submit(&a));
+    run_until_idle(5000);
+    CHECK(a.status == I2C_XFER_DONE);
+    CHECK(hw_errors() == 0u);
+}
+
+// Slave rimasto a meta' byte al reset: i2c_init() libera SDA
+static void test_init_recover(void)
+{
+    printf("bus clear all'avvio\n");
+    hw_reset();
+    hw_sda_hold(5);
+    i2c_init();
+
+    CHECK(hw_scl_pulses() >= 5u);
+    CHECK(i2c_last_error() == I2C_OK);
+    CHECK(hw_errors() == 0u);
+}
+
+int main(void)
+{
+    test_read_burst();
+    test_queue();
+    test_blocking();
+    test_watchdog();
+    test_bus_stuck();
+    test_init_recover();
+
+    return check_report();
+}
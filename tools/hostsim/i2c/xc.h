@@ -0,0 +1,79 @@
+/*
+ * xc.h per il build host di firmware/src/i2c.c: I2C1 master, pin RG2/RG3,
+ * interrupt I2C1M e core timer, collegati al modello in hw_i2c1.c.
+ *
+ * I2C1CON e I2C1STAT sono memoria vera (il driver li legge anche via
+ * puntatore): il modello li aggiorna a ogni accesso e vede le richieste
+ * (SEN, RSEN, PEN, RCEN, ACKEN) scritte nei bit. Le altre scritture con
+ * effetti passano da un latch, come in tools/hostsim/uart.
+ */
+#ifndef HOSTSIM_I2C_XC_H
+#define HOSTSIM_I2C_XC_H
+
+#include <stdint.h>
+
+typedef union {
+    struct {
+        unsigned SEN:1, RSEN:1, PEN:1, RCEN:1, ACKEN:1, ACKDT:1, STREN:1, GCEN:1;
+        unsigned SMEN:1, DISSLW:1, A10M:1, STRICT:1, SCLREL:1, SIDL:1, :1, ON:1;
+    };
+    uint32_t w;
+} hw_i2ccon_t;
+
+typedef union {
+    struct {
+        unsigned TBF:1, RBF:1, R_W:1, S:1, P:1, D_A:1, I2COV:1, IWCOL:1;
+        unsigned ADD10:1, GCSTAT:1, BCL:1, :3, TRSTAT:1, ACKSTAT:1;
+    };
+    uint32_t w;
+} hw_i2cstat_t;
+
+typedef struct { unsigned I2C1IP, I2C1IS; } hw_ipc6_t;
+
+enum { HW_I2C1TRN, HW_I2C1STATCLR, HW_IEC1SET, HW_IEC1CLR, HW_IFS1CLR,
+       HW_LATGCLR, HW_TRISGSET, HW_TRISGCLR };
+
+volatile uint32_t *hw_latch(int reg);
+uint32_t hw_i2c1rcv(void);
+uint32_t hw_portg(void);
+uint32_t hw_core_count(void);
+void hw_core_set(uint32_t v);
+
+extern volatile hw_i2ccon_t  hw_i2c1con;
+extern volatile hw_i2cstat_t hw_i2c1stat;
+extern hw_ipc6_t IPC6bits;
+extern uint32_t  I2C1BRG;
+
+#define I2C1CON         (hw_i2c1con.w)
+#define I2C1CONbits     (hw_i2c1con)
+#define I2C1STAT        (hw_i2c1stat.w)
+#define I2C1STATbits    (hw_i2c1stat)
+#define I2C1RCV         (hw_i2c1rcv())
+#define PORTG           (hw_portg())
+#define I2C1TRN         (*hw_latch(HW_I2C1TRN))
+#define I2C1STATCLR     (*hw_latch(HW_I2C1STATCLR))
+#define IEC1SET         (*hw_latch(HW_IEC1SET))
+#define IEC1CLR         (*hw_latch(HW_IEC1CLR))
+#define IFS1CLR         (*hw_latch(HW_IFS1CLR))
+#define LATGCLR         (*hw_latch(HW_LATGCLR))
+#define TRISGSET        (*hw_latch(HW_TRISGSET))
+#define TRISGCLR        (*hw_latch(HW_TRISGCLR))
+
+#define _I2C1CON_SEN_MASK       0x0001u
+#define _I2C1CON_RSEN_MASK      0x0002u
+#define _I2C1CON_PEN_MASK       0x0004u
+#define _I2C1CON_RCEN_MASK      0x0008u
+#define _I2C1CON_ACKEN_MASK     0x0010u
+#define _I2C1STAT_RBF_MASK      0x0002u
+#define _I2C1STAT_BCL_MASK      0x0400u
+#define _I2C1STAT_TRSTAT_MASK   0x4000u
+#define _I2C1STAT_ACKSTAT_MASK  0x8000u
+#define _IEC1_I2C1MIE_MASK      0x1000u
+#define _IFS1_I2C1MIF_MASK      0x1000u
+
+#define _I2C_1_VECTOR           25
+
+#define _CP0_GET_COUNT()        hw_core_count()
+#define _CP0_SET_COUNT(v)       hw_core_set(v)
+
+#endif // HOSTSIM_I2C_XC_H
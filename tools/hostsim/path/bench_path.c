@@ -0,0 +1,243 @@
+/*
+ * Benchmark host del percorso campione -> classe della scansione (come
+ * app_scan_task() in app.c): filter_push(), calib_apply() con matrice
+ * completa, tcs34725_norm_to_rgb8(), classificazione (LUT oppure HSV +
+ * palette con tutte le classi insegnate) e target_update().
+ *
+ * Per ogni preset di filtro e ogni classificatore stampa ns per campione
+ * (media e massimo) e li confronta con il ciclo di integrazione piu'
+ * corto (2.4 ms). I tempi sono dell'host: sul target la stessa misura e'
+ * "[SCAN] Sample path max" allo stop della scansione.
+ *
+ * La flash non e' nel percorso: calibrazione e palette si costruiscono in
+ * RAM e flash_*() sono stub.
+ *
+ * Uso (da tools/hostsim): make bench_path, oppure make per tutti i test.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "check.h"
+#include "tcs34725.h"
+#include "filter.h"
+#include "calib.h"
+#include "palette.h"
+#include "classify.h"
+#include "target.h"
+#include "flash.h"
+
+#define SAMPLES         4096u
+#define RUNS            20u
+#define CYCLE_NS        2400000.0   // integrazione piu' corta: 2.4 ms
+#define MIN_CLEAR_NORM  ((16u * 2560u) / 240u)  // 16 conteggi @24 ms 1x
+
+/* =====================
+ * Stub flash: calibrazione e palette restano in RAM
+ * ===================== */
+bool flash_read(uint32_t addr, void *dst, size_t len)
+{
+    (void)addr; (void)dst; (void)len;
+    return false;
+}
+
+bool flash_erase_sector_4k(uint32_t addr)
+{
+    (void)addr;
+    return false;
+}
+
+bool flash_sector_store(uint32_t addr, const void *src, size_t len)
+{
+    (void)addr; (void)src; (void)len;
+    return false;
+}
+
+static const struct {
+    filter_mode_t mode;
+    uint8_t       win;
+    uint8_t       k;
+    const char   *name;
+} k_presets[] = {
+    { FILTER_NONE,   1u, 1u, "off"     },
+    { FILTER_MEDIAN, 3u, 1u, "median3" },
+    { FILTER_MEDIAN, 5u, 1u, "median5" },
+    { FILTER_MOVAVG, 4u, 1u, "avg4"    },
+    { FILTER_MOVAVG, 8u, 1u, "avg8"    },
+    { FILTER_IIR,    1u, 2u, "iir1/4"  },
+};
+
+// Primari (Q8, conteggi/ms @1x) per la calibrazione e la palette
+static const tcs34725_norm_t k_ref[CALIB_REF_COUNT] = {
+    {    200u,    80u,    70u,    60u, false },     // buio
+    { 100000u, 40000u, 38000u, 30000u, false },     // bianco
+    {  40000u, 30000u,  6000u,  4000u, false },     // rosso
+    {  40000u,  8000u, 25000u,  7000u, false },     // verde
+    {  35000u,  5000u,  9000u, 22000u, false },     // blu
+};
+
+static const struct {
+    uint8_t         cls;
+    tcs34725_norm_t n;
+} k_teach[] = {
+    { CLASSIFY_RED,    {  40000u, 30000u,  6000u,  4000u, false } },
+    { CLASSIFY_ORANGE, {  50000u, 32000u, 14000u,  4500u, false } },
+    { CLASSIFY_YELLOW, {  70000u, 33000u, 28000u,  6000u, false } },
+    { CLASSIFY_GREEN,  {  40000u,  8000u, 25000u,  7000u, false } },
+    { CLASSIFY_BLUE,   {  35000u,  5000u,  9000u, 22000u, false } },
+    { CLASSIFY_VIOLET, {  38000u, 16000u,  7000u, 20000u, false } },
+};
+
+static tcs34725_norm_t s_in[SAMPLES];
+static uint32_t        s_rng = 0x2468ACE1u;
+
+static uint32_t rnd(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static tcs34725_hsv_t norm_to_hsv(tcs34725_norm_t n)
+{
+    tcs34725_rgb8_t rgb;
+    tcs34725_hsv_t hsv;
+
+    calib_apply(&n);
+    tcs34725_norm_to_rgb8(&n, &rgb);
+    tcs34725_rgb8_to_hsv(&rgb, &hsv);
+    return hsv;
+}
+
+static void setup(void)
+{
+    printf("calibrazione a matrice e palette completa\n");
+
+    for (uint8_t r = 0; r < CALIB_REF_COUNT; r++) {
+        calib_capture_begin((calib_ref_t)r);
+        for (uint32_t i = 0; i < CALIB_CAPTURE_SAMPLES; i++) (void)calib_capture_add(&k_ref[r]);
+    }
+    CHECK(calib_fit(true));
+    CHECK(calib_is_active());
+
+    palette_clear();
+    for (uint32_t i = 0; i < sizeof(k_teach) / sizeof(k_teach[0]); i++) {
+        const tcs34725_hsv_t hsv = norm_to_hsv(k_teach[i].n);
+        CHECK(palette_teach(k_teach[i].cls, &hsv));
+    }
+    CHECK(palette_count() == CLASSIFY_COUNT - 1u);
+
+    // Il colore insegnato torna nella sua classe
+    for (uint32_t i = 0; i < sizeof(k_teach) / sizeof(k_teach[0]); i++) {
+        const tcs34725_hsv_t hsv = norm_to_hsv(k_teach[i].n);
+        CHECK(palette_classify(&hsv) == k_teach[i].cls);
+    }
+
+    // Ingressi: colori casuali su tutta la dinamica, qualche buio e saturo
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        const uint32_t c = 500u + rnd() % 400000u;
+        s_in[i].c = c;
+        s_in[i].r = (uint32_t)(((uint64_t)c * (rnd() % 700u)) / 1000u);
+        s_in[i].g = (uint32_t)(((uint64_t)c * (rnd() % 700u)) / 1000u);
+        s_in[i].b = (uint32_t)(((uint64_t)c * (rnd() % 700u)) / 1000u);
+        s_in[i].saturated = (rnd() % 64u) == 0u;
+    }
+}
+
+// Percorso di app_scan_task(): campione normalizzato -> classe -> fronti
+static uint8_t path(filter_t *f, target_t *tg, const tcs34725_norm_t *in, bool use_palette, uint32_t now_ms)
+{
+    tcs34725_norm_t filt, cal;
+    tcs34725_rgb8_t rgb;
+    target_event_t ev[CLASSIFY_COUNT];
+    uint8_t cls;
+
+    if (!filter_push(f, in, &filt)) return CLASSIFY_NONE;
+
+    cal = filt;
+    calib_apply(&cal);
+    tcs34725_norm_to_rgb8(&cal, &rgb);
+
+    if (filt.c < MIN_CLEAR_NORM) {
+        cls = CLASSIFY_NONE;
+    } else if (use_palette) {
+        tcs34725_hsv_t hsv;
+        tcs34725_rgb8_to_hsv(&rgb, &hsv);
+        cls = palette_classify(&hsv);
+    } else {
+        cls = classify_rgb8(&rgb);
+    }
+
+    (void)target_update(tg, cls, now_ms, ev, CLASSIFY_COUNT);
+    return cls;
+}
+
+static void bench(bool use_palette)
+{
+    static const target_cfg_t cfg = { 60u, 120u, 150u };
+
+    // Costo della sola coppia di letture del tempo, tolto da ogni misura
+    double t_ovh = CYCLE_NS;
+    for (uint32_t i = 0; i < SAMPLES; i++) {
+        const double t0 = now_ns();
+        const double dt = now_ns() - t0;
+        if (dt < t_ovh) t_ovh = dt;
+    }
+
+    printf("classificazione %s\n", use_palette ? "HSV + palette" : "LUT RGB");
+
+    for (uint32_t p = 0; p < sizeof(k_presets) / sizeof(k_presets[0]); p++) {
+        filter_t f;
+        target_t tg;
+        double sum = 0.0;
+        double worst = CYCLE_NS;
+        uint32_t hits[CLASSIFY_COUNT] = { 0 };
+
+        // Massimo per giro, poi il minimo fra i giri: toglie le
+        // interruzioni del sistema operativo, non i casi lenti del codice
+        for (uint32_t run = 0; run < RUNS; run++) {
+            double run_max = 0.0;
+
+            filter_init(&f, k_presets[p].mode, k_presets[p].win, k_presets[p].k);
+            target_init(&tg, &cfg);
+
+            for (uint32_t i = 0; i < SAMPLES; i++) {
+                const double t0 = now_ns();
+                const uint8_t cls = path(&f, &tg, &s_in[i], use_palette, i * 3u);
+                const double dt = now_ns() - t0 - t_ovh;
+                hits[cls]++;
+                sum += dt;
+                if (dt > run_max) run_max = dt;
+            }
+            if (run_max < worst) worst = run_max;
+        }
+
+        const double avg = sum / ((double)RUNS * SAMPLES);
+        printf("  %-8s %7.1f ns/campione, max %7.1f ns (%.4f%% di 2.4 ms)\n",
+               k_presets[p].name, avg, worst, 100.0 * worst / CYCLE_NS);
+        CHECK(worst < CYCLE_NS / 100.0);
+
+        // Ingressi casuali: almeno meta' delle classi deve comparire
+        uint32_t seen = 0;
+        for (uint8_t c = 1; c < CLASSIFY_COUNT; c++) seen += (hits[c] != 0u);
+        CHECK(seen >= (CLASSIFY_COUNT - 1u) / 2u);
+    }
+}
+
+int main(void)
+{
+    setup();
+    bench(false);
+    bench(true);
+
+    return check_report();
+}
@@ -0,0 +1,10 @@
+/*
+ * sys/attribs.h per i build host in tools/hostsim: le ISR diventano
+ * funzioni normali, chiamate dai modelli dei periferici.
+ */
+#ifndef HOSTSIM_SYS_ATTRIBS_H
+#define HOSTSIM_SYS_ATTRIBS_H
+
+#define __ISR(vector, ipl)
+
+#endif
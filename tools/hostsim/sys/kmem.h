@@ -0,0 +1,15 @@
+/*
+ * sys/kmem.h per i build host in tools/hostsim: gli indirizzi fisici
+ * dei registri DMA sono maniglie del modello, che le riconverte in
+ * puntatori (i puntatori host non entrano in 32 bit).
+ */
+#ifndef HOSTSIM_SYS_KMEM_H
+#define HOSTSIM_SYS_KMEM_H
+
+#include <stdint.h>
+
+uint32_t hw_kva_to_pa(const volatile void *p);
+
+#define KVA_TO_PA(v)    hw_kva_to_pa((const volatile void *)(v))
+
+#endif
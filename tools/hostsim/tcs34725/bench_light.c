@@ -0,0 +1,263 @@
+/*
+ * Precisione e throughput host di tcs34725_calc_light() (lux e CCT
+ * compensati IR, DN40, in interi) contro un riferimento in double.
+ *
+ * Per ogni gain e ATIME (impostati sul modello I2C1, come sul target)
+ * campioni grezzi C/R/G/B casuali sotto la saturazione:
+ * - kernel: calc_light() sul campione normalizzato contro le stesse
+ *   formule in double sugli stessi valori normalizzati (solo l'aritmetica
+ *   intera);
+ * - da grezzo: normalize() + calc_light() contro DN40 in double sui
+ *   conteggi grezzi, Lux = G'' / CPL con CPL = ATIME_ms * gain / DF.
+ *   Qui domina la risoluzione del campione normalizzato (1/256 di
+ *   conteggio/ms @1x, cioe' DF/256 lux su G''): ogni campione deve
+ *   restare entro il limite che ne deriva.
+ * Errore massimo e medio in millilux / K, poi ns per chiamata.
+ *
+ * Uso (da tools/hostsim): make bench_light, oppure make per tutti i test.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "check.h"
+#include "hw_i2c1.h"
+#include "i2c.h"
+#include "tcs34725.h"
+
+#define SAMPLES     4096u
+#define BENCH_RUNS  2000u
+
+static const struct {
+    tcs34725_gain_t gain;
+    uint32_t        mult;
+} k_gains[] = {
+    { TCS34725_GAIN_1X, 1u }, { TCS34725_GAIN_4X, 4u },
+    { TCS34725_GAIN_16X, 16u }, { TCS34725_GAIN_60X, 60u },
+};
+
+static const tcs34725_it_t k_atimes[] = {
+    TCS34725_IT_2_4MS, TCS34725_IT_24MS, TCS34725_IT_50MS,
+    TCS34725_IT_154MS, TCS34725_IT_700MS,
+};
+
+typedef struct {
+    double   max;
+    double   sum;
+    uint32_t n;
+} err_t;
+
+static tcs34725_norm_t s_norm[SAMPLES];
+
+static uint32_t s_rng = 0x1F2E3D4Cu;
+
+static uint32_t rnd(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static void err_add(err_t *e, double d)
+{
+    if (d < 0) d = -d;
+    if (d > e->max) e->max = d;
+    e->sum += d;
+    e->n++;
+}
+
+/*
+ * DN40 in double. Ingressi nella stessa unita' (conteggi o normalizzati):
+ * lux_scale converte G'' in lux. cct = 0 se R' <= 0.
+ */
+static void ref_light(double c, double r, double g, double b, double lux_scale,
+                      double *lux_milli, double *cct)
+{
+    double ir = (r + g + b - c) / 2.0;
+    if (ir < 0) ir = 0;
+
+    double rp = r - ir, gp = g - ir, bp = b - ir;
+    if (rp < 0) rp = 0;
+    if (gp < 0) gp = 0;
+    if (bp < 0) bp = 0;
+
+    const double g2 = 0.136 * rp + 1.000 * gp - 0.444 * bp;
+    *lux_milli = (g2 > 0) ? g2 * lux_scale * 1000.0 : 0.0;
+    *cct = (rp > 0) ? 3810.0 * bp / rp + 1391.0 : 0.0;
+}
+
+static __attribute__((noinline)) double ref_batch(const tcs34725_norm_t *n, size_t len)
+{
+    double acc = 0.0;
+    for (size_t i = 0; i < len; i++) {
+        double lux, cct;
+        ref_light(n[i].c / 256.0, n[i].r / 256.0, n[i].g / 256.0, n[i].b / 256.0,
+                  TCS34725_LUX_DF, &lux, &cct);
+        acc += lux + cct;
+    }
+    return acc;
+}
+
+static __attribute__((noinline)) uint32_t int_batch(const tcs34725_norm_t *n, size_t len)
+{
+    uint32_t acc = 0;
+    for (size_t i = 0; i < len; i++) {
+        tcs34725_light_t l;
+        (void)tcs34725_calc_light(&n[i], &l);
+        acc += l.lux_milli + l.cct_k;
+    }
+    return acc;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Limite dell'errore da grezzo dovuto alla normalizzazione (in LSB Q8):
+ * ogni canale x_n = floor(x * k / 2^16), con k = floor(2560 * 2^16 / div),
+ * sbaglia al massimo di x_esatto * eps + 1 (eps = errore relativo di k);
+ * IR, X' e G'' li propagano con i moduli dei loro coefficienti.
+ */
+typedef struct {
+    double rp, gp, bp;          // R', G', B' esatti (LSB Q8)
+    double er, eg, eb;          // limiti su |dR'|, |dG'|, |dB'|
+} q8_bound_t;
+
+static void q8_bound(const tcs34725_raw_t *raw, double div, q8_bound_t *q)
+{
+    const double k_exact = 2560.0 * 65536.0 / div;
+    const double eps = (k_exact - (double)(uint32_t)k_exact) / k_exact;
+    const double c = raw->c * 2560.0 / div, r = raw->r * 2560.0 / div;
+    const double g = raw->g * 2560.0 / div, b = raw->b * 2560.0 / div;
+    const double ec = c * eps + 1.0, er = r * eps + 1.0, eg = g * eps + 1.0, eb = b * eps + 1.0;
+    const double eir = (ec + er + eg + eb) / 2.0;
+
+    double ir = (r + g + b - c) / 2.0;
+    if (ir < 0) ir = 0;
+    q->rp = (r > ir) ? r - ir : 0.0;
+    q->gp = (g > ir) ? g - ir : 0.0;
+    q->bp = (b > ir) ? b - ir : 0.0;
+    q->er = er + eir;
+    q->eg = eg + eir;
+    q->eb = eb + eir;
+}
+
+static void test_sweep(void)
+{
+    err_t k_lux = { 0 }, k_cct = { 0 };     // kernel
+    err_t r_lux = { 0 }, r_cct = { 0 };     // da grezzo (mlux, %)
+    double r_lux_rel = 0.0, r_cct_rel = 0.0;    // errore / limite Q8
+    uint32_t over = 0;
+
+    printf("sweep gain x ATIME, %u campioni per configurazione\n", SAMPLES);
+    hw_reset();
+    i2c_init();
+
+    for (uint32_t gi = 0; gi < sizeof(k_gains) / sizeof(k_gains[0]); gi++) {
+        for (uint32_t ai = 0; ai < sizeof(k_atimes) / sizeof(k_atimes[0]); ai++) {
+            tcs34725_set_gain(k_gains[gi].gain);
+            tcs34725_set_integration_time(k_atimes[ai]);
+
+            const uint32_t cycles = 256u - (uint32_t)k_atimes[ai];
+            uint32_t full = cycles * 1024u;
+            if (full > 0xFFFFu) full = 0xFFFFu;
+            const double div = (double)k_gains[gi].mult * cycles * 24.0;
+
+            for (uint32_t i = 0; i < SAMPLES; i++) {
+                tcs34725_raw_t raw;
+                tcs34725_light_t l;
+                q8_bound_t q;
+                double lux, cct;
+
+                // C su tutta la scala, R/G/B fino al 60% di C (IR tipico)
+                raw.c = (uint16_t)(1u + rnd() % full);
+                raw.r = (uint16_t)(rnd() % (raw.c * 6u / 10u + 1u));
+                raw.g = (uint16_t)(rnd() % (raw.c * 6u / 10u + 1u));
+                raw.b = (uint16_t)(rnd() % (raw.c * 6u / 10u + 1u));
+
+                tcs34725_normalize(&raw, &s_norm[i]);
+                const tcs34725_norm_t *n = &s_norm[i];
+                (void)tcs34725_calc_light(n, &l);
+
+                // Solo aritmetica intera: stessi valori normalizzati
+                ref_light(n->c / 256.0, n->r / 256.0, n->g / 256.0, n->b / 256.0,
+                          TCS34725_LUX_DF, &lux, &cct);
+                err_add(&k_lux, (double)l.lux_milli - lux);
+                if (l.cct_k != 0u && cct < 65535.0) err_add(&k_cct, (double)l.cct_k - cct);
+
+                // Da grezzo: DN40 sui conteggi, Lux = G'' * DF / (ATIME_ms * gain)
+                ref_light(raw.c, raw.r, raw.g, raw.b, TCS34725_LUX_DF * 10.0 / div, &lux, &cct);
+                q8_bound(&raw, div, &q);
+
+                const double lux_err = (double)l.lux_milli - lux;
+                const double lux_lim = (0.136 * q.er + q.eg + 0.444 * q.eb) / 256.0
+                                     * TCS34725_LUX_DF * 1000.0 + 0.5;
+                err_add(&r_lux, lux_err);
+                if (lux_err / lux_lim > r_lux_rel) r_lux_rel = lux_err / lux_lim;
+                if (-lux_err / lux_lim > r_lux_rel) r_lux_rel = -lux_err / lux_lim;
+                if (lux_err > lux_lim || -lux_err > lux_lim) over++;
+
+                // CCT relativa con R' >= 1 conteggio/ms @1x
+                if (q.rp >= 256.0 && q.rp > q.er && l.cct_k != 0u && cct < 65535.0) {
+                    const double cct_err = (double)l.cct_k - cct;
+                    const double cct_lim = TCS34725_CT_COEF * (q.eb * q.rp + q.bp * q.er)
+                                         / (q.rp * (q.rp - q.er)) + 0.5;
+                    err_add(&r_cct, 100.0 * cct_err / cct);
+                    if (cct_err / cct_lim > r_cct_rel) r_cct_rel = cct_err / cct_lim;
+                    if (-cct_err / cct_lim > r_cct_rel) r_cct_rel = -cct_err / cct_lim;
+                    if (cct_err > cct_lim || -cct_err > cct_lim) over++;
+                }
+            }
+        }
+    }
+
+    printf("  kernel:    lux max %.3f mlux, media %.3f mlux; CCT max %.3f K, media %.3f K\n",
+           k_lux.max, k_lux.sum / k_lux.n, k_cct.max, k_cct.sum / k_cct.n);
+    printf("  da grezzo: lux max %.1f mlux, media %.1f mlux (1 LSB Q8 di G'' = %.0f mlux)\n",
+           r_lux.max, r_lux.sum / r_lux.n, TCS34725_LUX_DF * 1000.0 / 256.0);
+    printf("             CCT max %.3f%%, media %.4f%% (R' >= 1 conteggio/ms)\n",
+           r_cct.max, r_cct.sum / r_cct.n);
+    printf("             errore / limite Q8: lux %.2f, CCT %.2f\n", r_lux_rel, r_cct_rel);
+
+    // Kernel: solo arrotondamento all'unita'. Da grezzo: entro il limite
+    // della normalizzazione Q8, niente di aggiunto dal calcolo
+    CHECK(k_lux.n > 0u && k_lux.max <= 0.5 + 1e-6);
+    CHECK(k_cct.n > 0u && k_cct.max <= 0.5 + 1e-6);
+    CHECK(r_lux.n > 0u && r_cct.n > 0u);
+    CHECK(over == 0u);
+    CHECK(hw_errors() == 0u);
+}
+
+// ns per chiamata sugli ultimi campioni normalizzati (60x, 700 ms)
+static void bench(void)
+{
+    static volatile double s_ref_sink;
+    static volatile uint32_t s_int_sink;
+
+    double t0 = now_ns();
+    for (uint32_t k = 0; k < BENCH_RUNS; k++) s_ref_sink = ref_batch(s_norm, SAMPLES);
+    const double t_ref = (now_ns() - t0) / ((double)BENCH_RUNS * SAMPLES);
+
+    t0 = now_ns();
+    for (uint32_t k = 0; k < BENCH_RUNS; k++) s_int_sink = int_batch(s_norm, SAMPLES);
+    const double t_int = (now_ns() - t0) / ((double)BENCH_RUNS * SAMPLES);
+
+    (void)s_ref_sink;
+    (void)s_int_sink;
+    printf("riferimento double: %6.2f ns/chiamata\n", t_ref);
+    printf("calc_light intero:  %6.2f ns/chiamata\n", t_int);
+}
+
+int main(void)
+{
+    test_sweep();
+    bench();
+
+    return check_report();
+}
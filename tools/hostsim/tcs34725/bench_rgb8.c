@@ -0,0 +1,173 @@
+/*
+ * Verifica e benchmark host di tcs34725_raw_to_rgb8() / _batch() (kernel
+ * con reciproco di C) contro la divisione di riferimento
+ * x8 = min(255, (x * 255 + C/2) / C).
+ *
+ * - bit-exact su tutti i C = 1..65535 e x = 0..C (tre canali per
+ *   campione), piu' x > C casuali (clamp) e C = 0;
+ * - ns per campione delle due versioni sullo stesso buffer.
+ * I tempi sono dell'host, con divisore hardware veloce: indicano solo che
+ * il kernel non costa di piu'. Sul PIC32 (DIV iterativo, fino a 35 cicli)
+ * conta il numero di divisioni per campione: 1 invece di 3.
+ *
+ * Uso (da tools/hostsim): make bench_rgb8, oppure make per tutti i test.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "check.h"
+#include "tcs34725.h"
+
+#define BATCH       4096u
+#define BENCH_RUNS  2000u
+
+static tcs34725_raw_t  s_in[BATCH];
+static tcs34725_rgb8_t s_out[BATCH];
+static tcs34725_rgb8_t s_ref[BATCH];
+
+// Conversione originale: una divisione per canale
+static uint8_t ref_chan(uint32_t x, uint32_t c)
+{
+    uint32_t v = (x * 255u + c / 2u) / c;
+    return (v > 255u) ? 255u : (uint8_t)v;
+}
+
+static __attribute__((noinline)) void ref_batch(const tcs34725_raw_t *in, tcs34725_rgb8_t *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (in[i].c == 0u) {
+            out[i].r = 0; out[i].g = 0; out[i].b = 0;
+            continue;
+        }
+        out[i].r = ref_chan(in[i].r, in[i].c);
+        out[i].g = ref_chan(in[i].g, in[i].c);
+        out[i].b = ref_chan(in[i].b, in[i].c);
+    }
+}
+
+static uint32_t s_rng = 0x12345678u;
+
+static uint32_t rnd(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+// Confronta s_out con s_ref sui primi n campioni, stampa il primo errore
+static uint32_t compare(size_t n)
+{
+    static bool s_shown;
+    uint32_t bad = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (s_out[i].r != s_ref[i].r || s_out[i].g != s_ref[i].g || s_out[i].b != s_ref[i].b) {
+            if (!s_shown) {
+                s_shown = true;
+                printf("  C=%u R=%u G=%u B=%u: %u/%u/%u invece di %u/%u/%u\n",
+                       s_in[i].c, s_in[i].r, s_in[i].g, s_in[i].b,
+                       s_out[i].r, s_out[i].g, s_out[i].b,
+                       s_ref[i].r, s_ref[i].g, s_ref[i].b);
+            }
+            bad++;
+        }
+    }
+    return bad;
+}
+
+static void flush(size_t n, uint32_t *bad)
+{
+    tcs34725_raw_to_rgb8_batch(s_in, s_out, n);
+    ref_batch(s_in, s_ref, n);
+    *bad += compare(n);
+}
+
+// Tutti i C e tutti gli x = 0..C, a gruppi di tre canali
+static void test_exhaustive(void)
+{
+    uint32_t bad = 0;
+    size_t n = 0;
+
+    printf("bit-exact su C = 1..65535, x = 0..C\n");
+    for (uint32_t c = 1; c <= 0xFFFFu; c++) {
+        for (uint32_t x = 0; x <= c; x += 3u) {
+            s_in[n].c = (uint16_t)c;
+            s_in[n].r = (uint16_t)x;
+            s_in[n].g = (uint16_t)((x + 1u <= c) ? x + 1u : c);
+            s_in[n].b = (uint16_t)((x + 2u <= c) ? x + 2u : c);
+            if (++n == BATCH) {
+                flush(n, &bad);
+                n = 0;
+            }
+        }
+    }
+    flush(n, &bad);
+    CHECK(bad == 0u);
+}
+
+// Canali oltre C (clamp a 255), C = 0 e API a tre puntatori
+static void test_clamp(void)
+{
+    uint32_t bad = 0;
+
+    printf("clamp x > C, C = 0, API singola\n");
+    for (uint32_t k = 0; k < 1000u; k++) {
+        for (size_t i = 0; i < BATCH; i++) {
+            s_in[i].c = (uint16_t)(rnd() >> ((k & 3u) * 4u));
+            s_in[i].r = (uint16_t)rnd();
+            s_in[i].g = (uint16_t)rnd();
+            s_in[i].b = (uint16_t)(s_in[i].c + (rnd() & 0xFFu));
+        }
+        flush(BATCH, &bad);
+    }
+    CHECK(bad == 0u);
+
+    for (size_t i = 0; i < BATCH; i++) {
+        uint8_t r8, g8, b8;
+        tcs34725_raw_to_rgb8(&s_in[i], &r8, &g8, &b8);
+        CHECK(r8 == s_ref[i].r && g8 == s_ref[i].g && b8 == s_ref[i].b);
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Campioni realistici: C su tutta la dinamica, R/G/B frazioni di C
+static void bench(void)
+{
+    for (size_t i = 0; i < BATCH; i++) {
+        const uint32_t c = 1u + (rnd() & 0xFFFFu) % 0xFFFFu;
+        s_in[i].c = (uint16_t)c;
+        s_in[i].r = (uint16_t)(rnd() % (c + 1u));
+        s_in[i].g = (uint16_t)(rnd() % (c + 1u));
+        s_in[i].b = (uint16_t)(rnd() % (c + 1u));
+    }
+
+    double t0 = now_ns();
+    for (uint32_t k = 0; k < BENCH_RUNS; k++) ref_batch(s_in, s_ref, BATCH);
+    const double t_ref = (now_ns() - t0) / ((double)BENCH_RUNS * BATCH);
+
+    t0 = now_ns();
+    for (uint32_t k = 0; k < BENCH_RUNS; k++) tcs34725_raw_to_rgb8_batch(s_in, s_out, BATCH);
+    const double t_new = (now_ns() - t0) / ((double)BENCH_RUNS * BATCH);
+
+    CHECK(compare(BATCH) == 0u);
+    printf("divisione per canale: %6.2f ns/campione\n", t_ref);
+    printf("reciproco di C:       %6.2f ns/campione (x%.2f)\n", t_new, t_ref / t_new);
+}
+
+int main(void)
+{
+    test_exhaustive();
+    test_clamp();
+    bench();
+
+    return check_report();
+}
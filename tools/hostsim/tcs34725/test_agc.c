@@ -0,0 +1,245 @@
+/*
+ * Test host dell'AGC di firmware/src/tcs34725.c con un sensore sintetico
+ * sopra il modello di I2C1 (../i2c/hw_i2c1.c): a ogni fine ciclo il test
+ * scrive nei registri dati dello slave C/R/G/B = irradianza * gain * cicli
+ * * 2.4 ms, saturati a min(65535, 1024 * cicli), con ATIME/CONTROL letti
+ * dallo slave all'inizio del ciclo (come il sensore vero).
+ *
+ * Verifica: convergenza su tutta la dinamica e nei salti di luce, nessuna
+ * oscillazione a regime anche con ripple, clear a regime nella banda
+ * LOW_PCT..HIGH_PCT, scarto del campione a cavallo di un cambio e
+ * normalizzazione coerente fra passi diversi.
+ *
+ * Uso (da tools/hostsim): make test_agc, oppure make per tutti i test.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "hw_i2c1.h"
+#include "i2c.h"
+#include "tcs34725.h"
+
+#define REG_ATIME       0x01u
+#define REG_CONTROL     0x0Fu
+#define REG_CDATAL      0x14u
+#define LOOP_TICKS      200u        // resto del superloop: 5 us
+#define SETTLE_SAMPLES  20u         // 7 passi, 2 campioni ciascuno, + margine
+
+// Passi AGC come in tcs34725.c (sensibilita' = gain * cicli)
+static const uint32_t k_gain[4] = { 1u, 4u, 16u, 60u };
+static const uint32_t k_step_gain[TCS34725_AGC_STEPS]   = { 1u, 4u, 16u, 60u, 60u, 60u, 60u, 60u };
+static const uint32_t k_step_cycles[TCS34725_AGC_STEPS] = { 1u, 1u, 1u, 1u, 4u, 16u, 64u, 256u };
+
+// Sensore sintetico: irradianza in conteggi clear per ms a 1x, colore
+// fisso (R/G/B in millesimi del clear)
+static double   s_lux;
+static uint32_t s_cfg_cycles;       // configurazione del ciclo in corso
+static uint32_t s_cfg_gain;
+
+static uint32_t step_sat(uint8_t step)
+{
+    const uint32_t sat = k_step_cycles[step] * 1024u;
+    return (sat > 0xFFFFu) ? 0xFFFFu : sat;
+}
+
+static uint16_t sensor_count(double lux, uint32_t permille)
+{
+    double sat = (double)s_cfg_cycles * 1024.0;
+    if (sat > 65535.0) sat = 65535.0;
+
+    double v = lux * permille / 1000.0 * s_cfg_gain * s_cfg_cycles * 2.4 + 0.5;
+    if (v > sat) v = sat;
+    return (uint16_t)v;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+// Inizio ciclo: il sensore usa ATIME/CONTROL presenti in questo momento
+static void sensor_latch_cfg(void)
+{
+    const uint8_t *r = hw_slave_regs();
+    s_cfg_cycles = 256u - r[REG_ATIME];
+    s_cfg_gain = k_gain[r[REG_CONTROL] & 3u];
+}
+
+// Fine ciclo: registri dati aggiornati, parte il ciclo successivo
+static void sensor_cycle_end(void)
+{
+    uint8_t *r = hw_slave_regs() + REG_CDATAL;
+
+    put16(&r[0], sensor_count(s_lux, 1000u));
+    put16(&r[2], sensor_count(s_lux, 420u));
+    put16(&r[4], sensor_count(s_lux, 380u));
+    put16(&r[6], sensor_count(s_lux, 290u));
+    sensor_latch_cfg();
+}
+
+static void run_until_idle(uint32_t max_us)
+{
+    const uint64_t end = hw_now() + (uint64_t)max_us * HW_TICKS_PER_US;
+    while (i2c_busy() && hw_now() < end) {
+        i2c_task();
+        hw_step(LOOP_TICKS);
+    }
+}
+
+static void setup(void)
+{
+    hw_reset();
+    i2c_init();
+    CHECK(tcs34725_agc_enable(true));
+    sensor_latch_cfg();
+}
+
+typedef struct {
+    uint32_t accepted;
+    uint32_t changes;
+    uint32_t last_change;           // indice dell'ultimo cambio di passo
+    uint32_t bad_norm;              // campioni accettati fuori tolleranza
+    uint32_t bad_skip;              // campioni a cavallo non scartati
+} run_stats_t;
+
+/*
+ * Un campione: fine ciclo, lettura, AGC e superloop fino a bus libero.
+ * Controlla che ogni campione accettato e non saturo sia normalizzato
+ * come l'irradianza vera (Q8), qualunque sia il passo.
+ */
+static void sample(uint32_t idx, run_stats_t *rs)
+{
+    tcs34725_raw_t raw;
+    tcs34725_norm_t norm;
+    static bool s_pending_skip;
+
+    sensor_cycle_end();
+    CHECK(tcs34725_read_raw(&raw));
+
+    const uint8_t before = tcs34725_agc_step();
+    const bool ok = tcs34725_agc_process(&raw, &norm);
+
+    if (ok) {
+        rs->accepted++;
+        if (s_pending_skip) rs->bad_skip++;
+
+        const uint32_t sat = step_sat(before);
+        if (raw.c >= 64u && raw.c < sat) {
+            const double want = s_lux * 256.0;
+            double err = (double)norm.c - want;
+            if (err < 0) err = -err;
+            if (err > want * 0.02 + 2.0) rs->bad_norm++;
+        }
+    }
+    s_pending_skip = false;
+
+    if (tcs34725_agc_step() != before) {
+        rs->changes++;
+        rs->last_change = idx;
+        s_pending_skip = true;
+    }
+
+    run_until_idle(5000);
+}
+
+// Clear a regime nella banda dell'isteresi del passo corrente
+static bool in_band(void)
+{
+    const uint8_t st = tcs34725_agc_step();
+    const uint16_t c = sensor_count(s_lux, 1000u);
+    const uint32_t sat = step_sat(st);
+
+    if (st > 0u && c >= sat * TCS34725_AGC_HIGH_PCT / 100u) return false;
+    if ((uint8_t)(st + 1u) < TCS34725_AGC_STEPS) {
+        const uint64_t pred = (uint64_t)c * k_step_gain[st + 1u] * k_step_cycles[st + 1u]
+                            / (k_step_gain[st] * k_step_cycles[st]);
+        if (pred < step_sat(st + 1u) * TCS34725_AGC_LOW_PCT / 100u) return false;
+    }
+    return true;
+}
+
+// Dinamica completa, dal buio al pieno sole e ritorno
+static void test_sweep(void)
+{
+    static const double k_lux[] = {
+        0.01, 0.05, 0.2, 0.8, 3.0, 12.0, 50.0, 200.0, 400.0,
+        120.0, 25.0, 6.0, 1.5, 0.4, 0.1, 0.02
+    };
+    run_stats_t rs;
+
+    printf("convergenza su tutta la dinamica\n");
+    setup();
+
+    for (uint32_t i = 0; i < sizeof(k_lux) / sizeof(k_lux[0]); i++) {
+        memset(&rs, 0, sizeof(rs));
+        s_lux = k_lux[i];
+        for (uint32_t n = 0; n < 2u * SETTLE_SAMPLES; n++) sample(n, &rs);
+
+        if (rs.changes) CHECK(rs.last_change < SETTLE_SAMPLES);
+        CHECK(in_band());
+        CHECK(rs.bad_norm == 0u);
+        CHECK(rs.bad_skip == 0u);
+        CHECK(rs.accepted >= SETTLE_SAMPLES);
+    }
+    CHECK(hw_errors() == 0u);
+}
+
+// Salti di luce fra gli estremi: al massimo un passo ogni due campioni
+static void test_jump(void)
+{
+    run_stats_t rs;
+
+    printf("salti buio / pieno sole\n");
+    setup();
+
+    for (uint32_t k = 0; k < 4u; k++) {
+        memset(&rs, 0, sizeof(rs));
+        s_lux = (k & 1u) ? 0.01 : 400.0;
+        for (uint32_t n = 0; n < 2u * SETTLE_SAMPLES; n++) sample(n, &rs);
+
+        CHECK(tcs34725_agc_step() == ((k & 1u) ? TCS34725_AGC_STEPS - 1u : 0u));
+        CHECK(rs.changes <= TCS34725_AGC_STEPS - 1u);
+        CHECK(rs.last_change < SETTLE_SAMPLES);
+        CHECK(rs.bad_norm == 0u && rs.bad_skip == 0u);
+    }
+    CHECK(hw_errors() == 0u);
+}
+
+// Ripple +-15% (es. lampade a 100 Hz) attorno alle soglie: un solo cambio
+static void test_ripple(void)
+{
+    run_stats_t rs;
+
+    printf("isteresi con ripple\n");
+    setup();
+
+    for (uint8_t st = 0; st + 1u < TCS34725_AGC_STEPS; st++) {
+        // Irradianza che porta il clear all'80% del fondo scala del passo st+1
+        const double base = step_sat(st + 1u) * 0.8
+                          / (k_step_gain[st + 1u] * k_step_cycles[st + 1u] * 2.4);
+
+        memset(&rs, 0, sizeof(rs));
+        s_lux = base;
+        for (uint32_t n = 0; n < 2u * SETTLE_SAMPLES; n++) sample(n, &rs);
+
+        memset(&rs, 0, sizeof(rs));
+        for (uint32_t n = 0; n < 60u; n++) {
+            s_lux = base * ((n & 1u) ? 1.15 : 0.85);
+            sample(n, &rs);
+        }
+        CHECK(rs.changes <= 1u);
+        CHECK(rs.bad_norm == 0u && rs.bad_skip == 0u);
+    }
+    CHECK(hw_errors() == 0u);
+}
+
+int main(void)
+{
+    test_sweep();
+    test_jump();
+    test_ripple();
+
+    return check_report();
+}
@@ -0,0 +1,279 @@
+#include "hw_uart4.h"
+
+#include <string.h>
+
+#include "xc.h"
+
+// ISR del driver (firmware/src/uart.c)
+void isr_uart4(void);
+
+hw_u4mode_t U4MODEbits;
+hw_ipc9_t   IPC9bits;
+hw_trisf_t  TRISFbits;
+hw_latf_t   LATFbits;
+hw_u4rxr_t  U4RXRbits;
+uint32_t    U4BRG;
+uint32_t    RPF12R;
+
+#define HW_TX_OUT_MAX   65536u
+
+static hw_u4sta_t s_sta;
+static uint32_t   s_iec;
+static uint32_t   s_ifs;
+static bool       s_irq_on;
+static bool       s_in_isr;
+static uint32_t   s_errors;
+
+// Scrittura in sospeso (vedi xc.h)
+static int               s_latch_reg = -1;
+static volatile uint32_t s_latch_val;
+
+// TX: FIFO + shift register
+static uint8_t  s_txf[HW_FIFO_DEPTH];
+static uint32_t s_txf_n;
+static bool     s_shifting;
+static uint32_t s_tx_period;
+static uint32_t s_tx_t;
+static uint8_t  s_out[HW_TX_OUT_MAX];
+static size_t   s_out_n;
+
+// RX: sorgente, FIFO
+static const uint8_t *s_src;
+static size_t   s_src_n;
+static uint32_t s_rx_period;
+static uint32_t s_rx_t;
+static uint8_t  s_rxf[HW_FIFO_DEPTH];
+static uint32_t s_rxf_n;
+static uint32_t s_rx_lost;
+
+static void hw_apply(void);
+static void hw_update(void);
+static void hw_tick(void);
+static void hw_irq(void);
+
+void hw_reset(void)
+{
+    memset(&s_sta, 0, sizeof(s_sta));
+    s_sta.TRMT = 1;
+    s_iec = 0;
+    s_ifs = 0;
+    s_irq_on = true;
+    s_in_isr = false;
+    s_errors = 0;
+    s_latch_reg = -1;
+    s_txf_n = 0;
+    s_shifting = false;
+    s_tx_period = 10;
+    s_tx_t = 0;
+    s_out_n = 0;
+    s_src = NULL;
+    s_src_n = 0;
+    s_rxf_n = 0;
+    s_rx_lost = 0;
+}
+
+void hw_step(uint32_t n)
+{
+    while (n--) {
+        hw_apply();
+        hw_tick();
+        hw_irq();
+    }
+    hw_apply();
+}
+
+void hw_set_irq(bool on)
+{
+    s_irq_on = on;
+}
+
+void hw_set_tx_period(uint32_t ticks)
+{
+    s_tx_period = ticks ? ticks : 1u;
+}
+
+void hw_rx_feed(const uint8_t *p, size_t n, uint32_t period)
+{
+    s_src = p;
+    s_src_n = n;
+    s_rx_period = period ? period : 1u;
+    s_rx_t = 0;
+}
+
+bool hw_rx_pending(void)
+{
+    return s_src_n != 0u;
+}
+
+size_t hw_tx_out(const uint8_t **p)
+{
+    if (p) *p = s_out;
+    return s_out_n;
+}
+
+void hw_tx_clear(void)
+{
+    s_out_n = 0;
+}
+
+uint32_t hw_rx_lost(void)
+{
+    return s_rx_lost;
+}
+
+bool hw_oerr(void)
+{
+    hw_apply();
+    return s_sta.OERR != 0u;
+}
+
+bool hw_txie(void)
+{
+    hw_apply();
+    return (s_iec & _IEC2_U4TXIE_MASK) != 0u;
+}
+
+uint32_t hw_errors(void)
+{
+    return s_errors;
+}
+
+// =====================
+// Registri (xc.h)
+// =====================
+hw_u4sta_t *hw_u4sta(void)
+{
+    hw_apply();
+    if (!s_in_isr) {
+        hw_tick();
+        hw_irq();
+    }
+    hw_update();
+    return &s_sta;
+}
+
+uint32_t hw_u4rxreg(void)
+{
+    hw_apply();
+    if (s_rxf_n == 0u) {
+        s_errors++;
+        return 0;
+    }
+    const uint8_t b = s_rxf[0];
+    memmove(s_rxf, s_rxf + 1, --s_rxf_n);
+    hw_update();
+    return b;
+}
+
+volatile uint32_t *hw_latch(int reg)
+{
+    hw_apply();
+    s_latch_reg = reg;
+    s_latch_val = 0;
+    return &s_latch_val;
+}
+
+hw_ifs2_t hw_ifs2(void)
+{
+    hw_apply();
+    hw_update();
+    return (hw_ifs2_t){
+        .U4TXIF = (s_ifs & _IFS2_U4TXIF_MASK) != 0u,
+        .U4RXIF = (s_ifs & _IFS2_U4RXIF_MASK) != 0u,
+        .U4EIF  = (s_ifs & _IFS2_U4EIF_MASK) != 0u,
+    };
+}
+
+hw_iec2_t hw_iec2(void)
+{
+    hw_apply();
+    return (hw_iec2_t){
+        .U4TXIE = (s_iec & _IEC2_U4TXIE_MASK) != 0u,
+        .U4RXIE = (s_iec & _IEC2_U4RXIE_MASK) != 0u,
+        .U4EIE  = (s_iec & _IEC2_U4EIE_MASK) != 0u,
+    };
+}
+
+// =====================
+// Modello
+// =====================
+static void hw_apply(void)
+{
+    const int reg = s_latch_reg;
+    const uint32_t v = s_latch_val;
+
+    s_latch_reg = -1;
+    switch (reg) {
+    case HW_U4TXREG:
+        if (s_txf_n >= HW_FIFO_DEPTH) {
+            s_errors++;
+        } else {
+            s_txf[s_txf_n++] = (uint8_t)v;
+        }
+        break;
+    case HW_U4STACLR:
+        // Azzerare OERR svuota la FIFO RX
+        if ((v & _U4STA_OERR_MASK) && s_sta.OERR) {
+            s_sta.OERR = 0;
+            s_rxf_n = 0;
+        }
+        break;
+    case HW_IEC2SET: s_iec |= v;  break;
+    case HW_IEC2CLR: s_iec &= ~v; break;
+    case HW_IFS2CLR: s_ifs &= ~v; break;
+    default: break;
+    }
+    if (reg >= 0) hw_update();
+}
+
+// UTXISEL = 0: U4TXIF si rialza finche' la FIFO TX ha posto
+static void hw_update(void)
+{
+    s_sta.UTXBF = s_txf_n >= HW_FIFO_DEPTH;
+    s_sta.TRMT = (s_txf_n == 0u) && !s_shifting;
+    s_sta.URXDA = s_rxf_n != 0u;
+    if (s_txf_n < HW_FIFO_DEPTH) s_ifs |= _IFS2_U4TXIF_MASK;
+}
+
+static void hw_tick(void)
+{
+    // TX: un carattere ogni s_tx_period tick
+    if (++s_tx_t >= s_tx_period) {
+        s_tx_t = 0;
+        s_shifting = false;
+        if (s_txf_n) {
+            if (s_out_n < HW_TX_OUT_MAX) s_out[s_out_n++] = s_txf[0];
+            memmove(s_txf, s_txf + 1, --s_txf_n);
+            s_shifting = true;
+        }
+    }
+
+    // RX: con OERR attivo la ricezione e' ferma
+    if (s_src_n && ++s_rx_t >= s_rx_period) {
+        s_rx_t = 0;
+        const uint8_t b = *s_src++;
+        s_src_n--;
+        if (s_sta.OERR) {
+            s_rx_lost++;
+        } else if (s_rxf_n >= HW_FIFO_DEPTH) {
+            s_sta.OERR = 1;
+            s_ifs |= _IFS2_U4EIF_MASK;
+            s_rx_lost++;
+        } else {
+            s_rxf[s_rxf_n++] = b;
+            s_ifs |= _IFS2_U4RXIF_MASK;
+        }
+    }
+    hw_update();
+}
+
+static void hw_irq(void)
+{
+    if (s_in_isr || !s_irq_on || (s_iec & s_ifs) == 0u) return;
+
+    s_in_isr = true;
+    isr_uart4();
+    hw_apply();
+    s_in_isr = false;
+    hw_update();
+}
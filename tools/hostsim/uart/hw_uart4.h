@@ -0,0 +1,46 @@
+/*
+ * Modello host di UART4 (PIC32MX370) per i test di firmware/src/uart.c:
+ * FIFO TX e RX hardware da HW_FIFO_DEPTH livelli, shift register,
+ * UTXBF/TRMT/URXDA/OERR, flag e abilitazioni TX/RX/errori sul vettore
+ * unico, interrupt CPU globali.
+ *
+ * Il tempo e' in tick: uno per ogni lettura di U4STA dal superloop e
+ * per ogni passo di hw_step(). Dentro l'ISR il tempo non avanza.
+ */
+#ifndef HW_UART4_H
+#define HW_UART4_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HW_FIFO_DEPTH   4u
+
+void hw_reset(void);
+
+// Avanza di n tick (interrupt compresi)
+void hw_step(uint32_t n);
+
+// Interrupt CPU globali (di/ei)
+void hw_set_irq(bool on);
+
+// Tick per carattere in uscita
+void hw_set_tx_period(uint32_t ticks);
+
+// Caratteri in arrivo, uno ogni period tick (n = 0 ferma la sorgente)
+void hw_rx_feed(const uint8_t *p, size_t n, uint32_t period);
+bool hw_rx_pending(void);
+
+// Caratteri usciti dal pin TX da hw_tx_clear()
+size_t hw_tx_out(const uint8_t **p);
+void hw_tx_clear(void);
+
+// Caratteri persi in hardware (FIFO RX piena o OERR attivo)
+uint32_t hw_rx_lost(void);
+bool hw_oerr(void);
+bool hw_txie(void);
+
+// Errori d'uso: scrittura a FIFO TX piena, lettura a FIFO RX vuota
+uint32_t hw_errors(void);
+
+#endif // HW_UART4_H
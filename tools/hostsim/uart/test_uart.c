@@ -0,0 +1,223 @@
+/*
+ * Test host di firmware/src/uart.c sul modello di UART4 (hw_uart4.c):
+ * buffer TX a interrupt (policy BLOCK e DROP, con e senza interrupt),
+ * buffer RX (burst senza consumatore, buffer pieno, overrun hardware) e
+ * RX durante lo svuotamento a mano del TX.
+ *
+ * Uso (da tools/hostsim): make test_uart, oppure make per tutti i test.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+#include "hw_uart4.h"
+#include "uart.h"
+
+#define N_CHARS     3000u
+#define N_RX        2000u
+
+static uint8_t s_ref[N_CHARS];
+static uint8_t s_rx_src[N_RX];
+static uint8_t s_rx_got[N_RX];
+
+static void setup(uart_tx_policy_t policy)
+{
+    hw_reset();
+    uart_init();
+    uart_reset_stats();
+    uart_set_tx_policy(policy);
+    hw_step(1);
+}
+
+static bool tx_equals(const uint8_t *ref, size_t n)
+{
+    const uint8_t *out;
+    return hw_tx_out(&out) == n && memcmp(out, ref, n) == 0;
+}
+
+// Il superloop scrive piu' in fretta della linea: niente perso, ordine intatto
+static void test_tx_block(void)
+{
+    uart_stats_t st;
+
+    printf("tx block\n");
+    setup(UART_TX_BLOCK);
+    srand(1);
+    for (uint32_t i = 0; i < N_CHARS; i++) {
+        s_ref[i] = (uint8_t)rand();
+        uart_putc((char)s_ref[i]);
+        if (rand() % 4 == 0) hw_step((uint32_t)rand() % 20u);
+    }
+    uart_flush();
+    uart_get_stats(&st);
+
+    CHECK(tx_equals(s_ref, N_CHARS));
+    CHECK(st.tx_full > 0u);
+    CHECK(st.tx_dropped == 0u);
+    CHECK(st.tx_max_used == UART_TX_BUF_SIZE);
+    CHECK(!hw_txie());
+    CHECK(hw_errors() == 0u);
+}
+
+// Interrupt spenti (prima di ei o in una sezione critica): BLOCK svuota a mano
+static void test_tx_noirq(void)
+{
+    printf("tx block, interrupt disabilitati\n");
+    setup(UART_TX_BLOCK);
+    hw_set_irq(false);
+    for (uint32_t i = 0; i < N_CHARS; i++) {
+        s_ref[i] = (uint8_t)('a' + i % 26u);
+        uart_putc((char)s_ref[i]);
+    }
+    uart_flush();
+
+    CHECK(tx_equals(s_ref, N_CHARS));
+    CHECK(hw_errors() == 0u);
+}
+
+// Buffer pieno con DROP: ogni carattere o esce o e' contato come perso
+static void test_tx_drop(void)
+{
+    uart_stats_t st;
+    const uint8_t *out;
+
+    printf("tx drop\n");
+    setup(UART_TX_DROP);
+    for (uint32_t i = 0; i < N_CHARS; i++) {
+        uart_putc('x');
+    }
+    hw_step(100000);
+    uart_get_stats(&st);
+
+    const size_t n = hw_tx_out(&out);
+    CHECK(st.tx_dropped > 0u);
+    CHECK(n + st.tx_dropped == N_CHARS);
+    CHECK(st.tx_full == st.tx_dropped);
+    CHECK(!hw_txie());
+    CHECK(hw_errors() == 0u);
+}
+
+static size_t rx_drain(size_t n)
+{
+    char c;
+    while (n < N_RX && uart_try_getc(&c)) {
+        s_rx_got[n++] = (uint8_t)c;
+    }
+    return n;
+}
+
+static void rx_source(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        s_rx_src[i] = (uint8_t)(i * 7u + 3u);
+    }
+}
+
+// Superloop fermo (erase, dump) mentre arriva un burst piu' corto del buffer
+static void test_rx_burst(void)
+{
+    uart_stats_t st;
+
+    printf("rx burst senza consumatore\n");
+    setup(UART_TX_BLOCK);
+    rx_source(200);
+    hw_rx_feed(s_rx_src, 200, 40);
+    while (hw_rx_pending()) hw_step(100);
+    hw_step(100);
+    const size_t n = rx_drain(0);
+    uart_get_stats(&st);
+
+    CHECK(n == 200u && memcmp(s_rx_got, s_rx_src, n) == 0);
+    CHECK(st.rx_max_used == 200u);
+    CHECK(st.rx_overrun == 0u && st.rx_dropped == 0u);
+    CHECK(hw_errors() == 0u);
+}
+
+// Buffer RX pieno: i caratteri in piu' si contano, quelli in buffer restano
+static void test_rx_full(void)
+{
+    uart_stats_t st;
+
+    printf("rx buffer pieno\n");
+    setup(UART_TX_BLOCK);
+    rx_source(300);
+    hw_rx_feed(s_rx_src, 300, 40);
+    while (hw_rx_pending()) hw_step(100);
+    hw_step(100);
+    const size_t n = rx_drain(0);
+    uart_get_stats(&st);
+
+    CHECK(n == UART_RX_BUF_SIZE && memcmp(s_rx_got, s_rx_src, n) == 0);
+    CHECK(st.rx_dropped == 300u - UART_RX_BUF_SIZE);
+    CHECK(st.rx_overrun == 0u);
+    CHECK(hw_errors() == 0u);
+}
+
+// Interrupt fermi troppo a lungo: OERR contato e azzerato dall'ISR
+static void test_rx_overrun(void)
+{
+    uart_stats_t st;
+
+    printf("rx overrun hardware\n");
+    setup(UART_TX_BLOCK);
+    rx_source(10);
+    hw_set_irq(false);
+    hw_rx_feed(s_rx_src, 10, 5);
+    hw_step(100);
+    hw_set_irq(true);
+    hw_step(1);
+    const size_t n = rx_drain(0);
+    uart_get_stats(&st);
+
+    CHECK(n == HW_FIFO_DEPTH && memcmp(s_rx_got, s_rx_src, n) == 0);
+    CHECK(st.rx_overrun == 1u);
+    CHECK(hw_rx_lost() == 10u - HW_FIFO_DEPTH);
+    CHECK(!hw_oerr());
+    CHECK(hw_errors() == 0u);
+}
+
+// RX continuo mentre uart_putc() svuota a mano il buffer TX pieno: l'ISR
+// entra dentro uart_tx_pump() e non deve servire anche il TX
+static void test_rx_during_tx_pump(void)
+{
+    uart_stats_t st;
+    size_t n = 0;
+
+    printf("rx durante lo svuotamento TX\n");
+    setup(UART_TX_BLOCK);
+    hw_set_tx_period(30);
+    rx_source(N_RX);
+    hw_rx_feed(s_rx_src, N_RX, 7);
+    for (uint32_t i = 0; i < N_CHARS; i++) {
+        s_ref[i] = (uint8_t)(i ^ (i >> 8));
+        uart_putc((char)s_ref[i]);
+        if (i % 16u == 0u) n = rx_drain(n);
+    }
+    uart_flush();
+    while (hw_rx_pending()) {
+        hw_step(100);
+        n = rx_drain(n);
+    }
+    hw_step(100);
+    n = rx_drain(n);
+    uart_get_stats(&st);
+
+    CHECK(tx_equals(s_ref, N_CHARS));
+    CHECK(n == N_RX && memcmp(s_rx_got, s_rx_src, n) == 0);
+    CHECK(st.rx_dropped == 0u && st.rx_overrun == 0u);
+    CHECK(hw_errors() == 0u);
+}
+
+int main(void)
+{
+    test_tx_block();
+    test_tx_noirq();
+    test_tx_drop();
+    test_rx_burst();
+    test_rx_full();
+    test_rx_overrun();
+    test_rx_during_tx_pump();
+
+    return check_report();
+}
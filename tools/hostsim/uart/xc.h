@@ -0,0 +1,62 @@
+/*
+ * xc.h per il build host di firmware/src/uart.c: i registri UART4 e di
+ * interrupt che usa il driver, collegati al modello in hw_uart4.c.
+ *
+ * In C un'assegnazione non si intercetta: le scritture a U4TXREG e ai
+ * registri SET/CLR passano da un latch (hw_latch()) che il modello
+ * applica al suo accesso successivo. Ogni lettura di U4STA dal superloop
+ * fa avanzare il tempo simulato ed e' il punto in cui entra l'interrupt.
+ */
+#ifndef HOSTSIM_UART_XC_H
+#define HOSTSIM_UART_XC_H
+
+#include <stdint.h>
+
+typedef struct {
+    unsigned UTXBF, TRMT, URXDA, OERR, FERR, UTXISEL, URXISEL, UTXEN, URXEN;
+} hw_u4sta_t;
+typedef struct { unsigned ON, BRGH, PDSEL, STSEL; } hw_u4mode_t;
+typedef struct { unsigned U4TXIF, U4RXIF, U4EIF; } hw_ifs2_t;
+typedef struct { unsigned U4TXIE, U4RXIE, U4EIE; } hw_iec2_t;
+typedef struct { unsigned U4IP, U4IS; } hw_ipc9_t;
+typedef struct { unsigned TRISF12, TRISF13; } hw_trisf_t;
+typedef struct { unsigned LATF12; } hw_latf_t;
+typedef struct { unsigned U4RXR; } hw_u4rxr_t;
+
+enum { HW_U4TXREG, HW_U4STACLR, HW_IEC2SET, HW_IEC2CLR, HW_IFS2CLR };
+
+hw_u4sta_t *hw_u4sta(void);
+uint32_t hw_u4rxreg(void);
+volatile uint32_t *hw_latch(int reg);
+hw_ifs2_t hw_ifs2(void);
+hw_iec2_t hw_iec2(void);
+
+extern hw_u4mode_t U4MODEbits;
+extern hw_ipc9_t   IPC9bits;
+extern hw_trisf_t  TRISFbits;
+extern hw_latf_t   LATFbits;
+extern hw_u4rxr_t  U4RXRbits;
+extern uint32_t    U4BRG;
+extern uint32_t    RPF12R;
+
+#define U4STAbits   (*hw_u4sta())
+#define U4RXREG     (hw_u4rxreg())
+#define U4TXREG     (*hw_latch(HW_U4TXREG))
+#define U4STACLR    (*hw_latch(HW_U4STACLR))
+#define IEC2SET     (*hw_latch(HW_IEC2SET))
+#define IEC2CLR     (*hw_latch(HW_IEC2CLR))
+#define IFS2CLR     (*hw_latch(HW_IFS2CLR))
+#define IFS2bits    (hw_ifs2())
+#define IEC2bits    (hw_iec2())
+
+#define _IEC2_U4EIE_MASK    0x1u
+#define _IEC2_U4RXIE_MASK   0x2u
+#define _IEC2_U4TXIE_MASK   0x4u
+#define _IFS2_U4EIF_MASK    0x1u
+#define _IFS2_U4RXIF_MASK   0x2u
+#define _IFS2_U4TXIF_MASK   0x4u
+#define _U4STA_OERR_MASK    0x2u
+
+#define _UART_4_VECTOR      39
+
+#endif // HOSTSIM_UART_XC_H
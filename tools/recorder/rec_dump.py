@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Scarica l'ultima registrazione di campioni grezzi (menu "0) Dump
+recording", app_rec_dump()), decodifica i blocchi compressi (reclog.py)
+e la salva in CSV:
+    t_us,c,r,g,b,agc_step,stale,seq
+t_us viene srotolato (wrap a 2^32 us) e i buchi di seq segnalano i
+campioni persi.
+
+Uso:
+    python3 rec_dump.py /dev/ttyUSB0 out.csv [--fast 921600]
+--fast porta prima la UART al baud indicato (menu "b", app_baud_switch()):
+se la scheda non riceve la conferma torna da sola a --baud.
+Richiede pyserial.
+"""
+import argparse
+import re
+import sys
+import time
+
+import serial
+
+from reclog import PAGE, crc16, decode
+
+F_STALE = 0x01
+
+
+def wait_line(port, pattern, timeout):
+    t0 = time.time()
+    while time.time() - t0 < timeout:
+        line = port.readline().decode(errors="replace")
+        m = re.search(pattern, line)
+        if m:
+            return m
+    sys.exit("timeout in attesa di %r" % pattern)
+
+
+def negotiate_baud(port, baud):
+    port.reset_input_buffer()
+    port.write(b"b%d\r" % baud)
+    # "[BAUD] SWITCH n (err ...)" oppure "[BAUD][ERR] n not supported"
+    m = wait_line(port, r"\[BAUD\](?: SWITCH (\d+)|\[ERR\])", 5.0)
+    if m.group(1) is None:
+        sys.exit("baud %d rifiutato dalla scheda" % baud)
+
+    old = port.baudrate
+    time.sleep(0.05)                    # la scheda svuota il TX e cambia
+    port.baudrate = baud
+    port.reset_input_buffer()
+    for _ in range(4):
+        port.write(b"K")
+        t0 = time.time()
+        while time.time() - t0 < 0.5:
+            line = port.readline().decode(errors="replace")
+            if "[BAUD] OK" in line:
+                return
+    # la scheda torna al baud precedente da sola (APP_BAUD_CONFIRM_MS)
+    port.baudrate = old
+    sys.exit("cambio a %d fallito, scheda di nuovo a %d" % (baud, old))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("port")
+    ap.add_argument("out")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--fast", type=int, default=0,
+                    help="baud per il dump (es. 921600, 1000000, 2000000)")
+    args = ap.parse_args()
+
+    with serial.Serial(args.port, args.baud, timeout=1) as port:
+        if args.fast:
+            port.timeout = 0.1
+            negotiate_baud(port, args.fast)
+            port.timeout = 1
+        port.reset_input_buffer()
+        port.write(b"0")
+        n = int(wait_line(port, r"\[REC\] DUMP (\d+)", 10.0).group(1))
+
+        size = n * PAGE
+        port.timeout = 10
+        data = port.read(size)
+        if len(data) != size:
+            sys.exit("ricevuti %d byte su %d" % (len(data), size))
+
+        crc = int(wait_line(port, r"\[REC\] END ([0-9A-F]{4})", 10.0).group(1), 16)
+        if crc != crc16(data):
+            sys.exit("CRC errato: dump corrotto")
+
+    recs, bad = decode(data)
+
+    lost = 0
+    stale = 0
+    with open(args.out, "w") as f:
+        f.write("t_us,c,r,g,b,agc_step,stale,seq\n")
+        wraps = 0
+        prev_t = prev_seq = None
+        for t, c, r, g, b, step, flags, seq in recs:
+            if prev_t is not None:
+                if t < prev_t:
+                    wraps += 1
+                lost += (seq - prev_seq - 1) & 0xFFFF
+            prev_t, prev_seq = t, seq
+            stale += 1 if flags & F_STALE else 0
+            f.write("%d,%d,%d,%d,%d,%d,%d,%d\n" %
+                    (t + (wraps << 32), c, r, g, b, step, flags & F_STALE, seq))
+
+    print("%d campioni (%d scartati dall'AGC), %d persi" % (len(recs), stale, lost))
+    print("%d blocchi (%d corrotti), %.1f byte/campione" %
+          (n, bad, size / len(recs) if recs else 0.0))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""
+Decodifica dei blocchi compressi del registratore (firmware/src/recorder.c):
+una pagina da 256 byte per blocco, decodificabile da sola.
+
+    [0] record  [1] byte di payload  [2..3] CRC16 (LE) di [0..1] + payload
+    payload: primo record intero (recorder_rec_t, 16 byte), poi varint:
+        (zigzag(dt - dt precedente) << 2) | packed << 1 | ext
+        se ext: (buco di seq << 1) | chg, e se chg agc_step, flags
+        packed: zigzag(delta) di C, R, G, B a nibble in 2 byte (C alto),
+        altrimenti un varint zigzag(delta) per canale
+
+Uso come modulo (rec_dump.py) o da riga di comando su un dump binario:
+    python3 reclog.py dump.bin
+"""
+import struct
+import sys
+
+PAGE = 256
+HDR = 4
+REC = struct.Struct("<IHHHHBBH")     # recorder_rec_t, 16 byte
+
+
+class BlockError(Exception):
+    pass
+
+
+def crc16(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def varint(buf, i):
+    v = shift = 0
+    while True:
+        if i >= len(buf):
+            raise BlockError("varint troncato")
+        b = buf[i]
+        i += 1
+        v |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return v, i
+
+
+def decode_page(page):
+    """Lista di record (t_us, c, r, g, b, agc_step, flags, seq); [] se vuota."""
+    n, used = page[0], page[1]
+    if n == 0xFF:
+        return []
+    if used > PAGE - HDR or used < REC.size:
+        raise BlockError("lunghezza non valida")
+    crc = page[2] | (page[3] << 8)
+    if crc != crc16(page[HDR:HDR + used], crc16(page[:2])):
+        raise BlockError("CRC errato")
+
+    payload = page[HDR:HDR + used]
+    t, c, r, g, b, step, flags, seq = REC.unpack_from(payload, 0)
+    out = [(t, c, r, g, b, step, flags, seq)]
+    i = REC.size
+    dt = 0
+    for _ in range(n - 1):
+        v, i = varint(payload, i)
+        dt = (dt + unzigzag(v >> 2)) & 0xFFFFFFFF
+        gap = 0
+        if v & 1:
+            e, i = varint(payload, i)
+            gap = e >> 1
+            if e & 1:
+                step, flags = payload[i], payload[i + 1]
+                i += 2
+        if v & 2:
+            z = payload[i:i + 2]
+            i += 2
+            d = [unzigzag(z[0] >> 4), unzigzag(z[0] & 15),
+                 unzigzag(z[1] >> 4), unzigzag(z[1] & 15)]
+        else:
+            d = []
+            for _ in range(4):
+                z, i = varint(payload, i)
+                d.append(unzigzag(z))
+        t = (t + dt) & 0xFFFFFFFF
+        c, r, g, b = c + d[0], r + d[1], g + d[2], b + d[3]
+        seq = (seq + 1 + gap) & 0xFFFF
+        out.append((t, c, r, g, b, step, flags, seq))
+    if i != used:
+        raise BlockError("payload non consumato")
+    return out
+
+
+def decode(data):
+    """Record di tutte le pagine; (record, blocchi scartati)."""
+    recs = []
+    bad = 0
+    for off in range(0, len(data) - PAGE + 1, PAGE):
+        try:
+            recs += decode_page(data[off:off + PAGE])
+        except BlockError:
+            bad += 1
+    return recs, bad
+
+
+def main():
+    data = open(sys.argv[1], "rb").read()
+    recs, bad = decode(data)
+    print("%d blocchi, %d record, %d blocchi corrotti, %.1f byte/record" %
+          (len(data) // PAGE, len(recs), bad,
+           len(data) / len(recs) if recs else 0.0))
+
+
+if __name__ == "__main__":
+    main()
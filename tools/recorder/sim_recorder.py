@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""
+Modello sul PC del registratore (firmware/src/recorder.c) con una flash
+simulata: superloop che chiama recorder_task(), un campione del sensore
+per ciclo di integrazione, page program via DMA (la CPU paga solo
+comando e indirizzo) e tPP durante il quale la flash resta occupata (WIP).
+
+Un campione e' perso se il superloop non lo legge prima della fine del
+ciclo successivo (il sensore lo sovrascrive) o se non c'e' un buffer
+libero. Confronto fra:
+  blocking  flash_write() della pagina piena dentro il superloop
+  dma x1    un buffer, programmazione via DMA
+  dma x2    doppio buffer (recorder.c)
+
+Uso:
+    python3 sim_recorder.py [--sck-hz 1000000] [--tpp-us 3000] [--loop-us 50]
+                            [--rec-bytes 4]
+"""
+import argparse
+
+PAGE = 256
+HDR = 4                     # header del blocco compresso
+
+
+class Flash:
+    """WIP alto fino a busy_until dopo il page program (CE alto)."""
+
+    def __init__(self, tpp_us):
+        self.tpp_us = tpp_us
+        self.busy_until = 0.0
+
+
+class Recorder:
+    """Stessa macchina a stati di recorder.c (solo RUN)."""
+
+    def __init__(self, flash, nbuf, byte_us, per_page):
+        self.flash = flash
+        self.nbuf = nbuf
+        self.per_page = per_page
+        self.byte_us = byte_us
+        self.ready = [False] * nbuf
+        self.fill = 0
+        self.fill_n = 0
+        self.prog = 0
+        self.dma_end = None         # fine trasferimento DMA in corso
+        self.dropped = 0
+
+    def add(self):
+        if self.ready[self.fill]:
+            self.dropped += 1
+            return
+        self.fill_n += 1
+        if self.fill_n >= self.per_page:
+            self.ready[self.fill] = True
+            self.fill = (self.fill + 1) % self.nbuf
+            self.fill_n = 0
+
+    def task(self, now):
+        """Ritorna il tempo di CPU speso (us)."""
+        if self.dma_end is not None:
+            # flash_task(): blocco DMA finito, CE alto, parte il tPP
+            if now < self.dma_end:
+                return 0.0
+            self.flash.busy_until = self.dma_end + self.flash.tpp_us
+            self.dma_end = None
+            self.ready[self.prog] = False
+            self.prog = (self.prog + 1) % self.nbuf
+            return 0.0
+        if not self.ready[self.prog]:
+            return 0.0
+        spent = 2 * self.byte_us                # RDSR
+        if now + spent < self.flash.busy_until:
+            return spent
+        spent += 5 * self.byte_us               # WREN + PP + indirizzo, poi DMA
+        self.dma_end = now + spent + PAGE * self.byte_us
+        return spent
+
+
+def run(mode, period_us, seconds, args):
+    byte_us = 8.0 / args.sck_hz * 1e6
+    flash = Flash(args.tpp_us)
+    rec = Recorder(flash, 1 if mode == "dma x1" else 2, byte_us, args.per_page)
+    t = 0.0
+    cycle = 0           # prossimo ciclo del sensore da leggere
+    missed = 0
+    end = seconds * 1e6
+    while t < end:
+        # lettura: l'ultimo ciclo completato; i precedenti non letti sono persi
+        done = int(t // period_us)
+        if done > cycle:
+            missed += done - cycle - 1
+            cycle = done
+            rec.add()
+            if mode == "blocking" and rec.ready[0] | rec.ready[1]:
+                # flash_write(): trasferimento + attesa WIP nel superloop
+                t = max(t, flash.busy_until) + (5 + PAGE) * byte_us
+                flash.busy_until = t + flash.tpp_us
+                t = flash.busy_until
+                rec.ready = [False, False]
+        if mode != "blocking":
+            t += rec.task(t)
+        t += args.loop_us
+    return cycle, missed + rec.dropped
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--sck-hz", type=float, default=1e6, help="clock SPI1 (FLASH_SPI1_BRG)")
+    ap.add_argument("--tpp-us", type=float, default=3000.0, help="page program (max datasheet)")
+    ap.add_argument("--loop-us", type=float, default=50.0, help="giro del superloop senza flash")
+    ap.add_argument("--seconds", type=float, default=60.0)
+    ap.add_argument("--rec-bytes", type=float, default=4.0,
+                    help="byte medi per campione (blocchi compressi ~4, record fissi 16)")
+    args = ap.parse_args()
+    args.per_page = max(1, int((PAGE - HDR - 16) / args.rec_bytes) + 1)
+
+    page_us = (5 + PAGE) * 8 / args.sck_hz * 1e6 + args.tpp_us
+    print("SCK %.2f MHz, tPP %.0f us: %.0f us per pagina, %.0f us per campione" %
+          (args.sck_hz / 1e6, args.tpp_us, page_us, page_us / args.per_page))
+    print("%10s %9s %9s %9s" % ("periodo", "modo", "cicli", "persi"))
+
+    for period in (2400.0, 24000.0):
+        for mode in ("blocking", "dma x1", "dma x2"):
+            n, lost = run(mode, period, args.seconds, args)
+            print("%7.0f us %9s %9d %9d" % (period, mode, n, lost))
+
+if __name__ == "__main__":
+    main()
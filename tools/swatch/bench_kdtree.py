@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""
+Benchmark sul PC della ricerca nel k-d tree al variare della dimensione
+della libreria: nodi visitati e letture flash (cache RAM compresa) per
+query, latenza stimata dalla lettura di un nodo via flash_read()
+e confronto con la scansione lineare. A ogni N un sottoinsieme casuale
+di query (--check) viene verificato contro la ricerca esaustiva.
+
+Uso:
+    python3 bench_kdtree.py [--sck-hz 1000000] [--queries 2000]
+"""
+import argparse
+import random
+
+import swatchlib
+
+
+def random_lab(rng):
+    return swatchlib.to_q4((rng.uniform(5, 95), rng.uniform(-80, 80), rng.uniform(-80, 80)))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--sck-hz", type=float, default=1e6, help="clock SPI1 (FLASH_SPI1_BRG)")
+    ap.add_argument("--queries", type=int, default=2000)
+    ap.add_argument("--check", type=int, default=200,
+                    help="query verificate con la scansione lineare, per ogni N")
+    ap.add_argument("--seed", type=int, default=1)
+    args = ap.parse_args()
+
+    # flash_read di un nodo: comando + 3 byte indirizzo + nodo, 8 bit per byte
+    t_read_us = (4 + swatchlib.NODE_SIZE) * 8 / args.sck_hz * 1e6
+
+    rng = random.Random(args.seed)
+    print("SCK %.2f MHz, %.0f us per nodo letto" % (args.sck_hz / 1e6, t_read_us))
+    print("%7s %9s %9s %9s %9s %11s %11s" %
+          ("N", "visit", "visit max", "reads", "reads max", "kd us", "linear us"))
+
+    for n in (100, 250, 500, 1000, 2000, 5000, 10000, 14000):
+        items = [(random_lab(rng), i, "S%d" % i) for i in range(n)]
+        swatchlib.build_kdtree(items)
+        s = swatchlib.Search(items)
+
+        check = set(rng.sample(range(args.queries), min(args.check, args.queries)))
+        visits, reads = [], []
+        for k in range(args.queries):
+            q = random_lab(rng)
+            idx, d2 = s.nearest(q)
+            if k in check:
+                best = min(sum((a - b) ** 2 for a, b in zip(q, it[0])) for it in items)
+                assert d2 == best, "k-d tree diverso dalla scansione lineare (N=%d)" % n
+            visits.append(s.visited)
+            reads.append(s.reads)
+
+        avg_r = sum(reads) / len(reads)
+        print("%7d %9.1f %9d %9.1f %9d %11.0f %11.0f" %
+              (n, sum(visits) / len(visits), max(visits), avg_r, max(reads),
+               avg_r * t_read_us, n * t_read_us))
+    print("%d query per N verificate con la scansione lineare" % len(check))
+
+
+if __name__ == "__main__":
+    main()
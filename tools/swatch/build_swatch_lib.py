@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""
+Genera l'immagine della libreria campioni per FLASH_REGION_SWATCH.
+
+CSV con intestazione: id,code e poi L,a,b oppure hex (sRGB, es. #A52019).
+
+Uso:
+    python3 build_swatch_lib.py library.csv -o library.bin
+"""
+import argparse
+import csv
+import sys
+
+import swatchlib
+
+
+def load(path):
+    items = []
+    with open(path, newline="") as f:
+        rows = (l for l in f if l.strip() and not l.lstrip().startswith("#"))
+        for row in csv.DictReader(rows):
+            sid = int(row["id"])
+            code = row["code"].strip()
+            if not 0 <= sid <= 0xFFFF:
+                sys.exit("id fuori range: %d" % sid)
+            if len(code) > swatchlib.CODE_LEN:
+                sys.exit("codice troppo lungo (max %d): %r" % (swatchlib.CODE_LEN, code))
+            if row.get("hex"):
+                h = row["hex"].strip().lstrip("#")
+                lab = swatchlib.srgb_to_lab(int(h[0:2], 16), int(h[2:4], 16), int(h[4:6], 16))
+            else:
+                lab = (float(row["L"]), float(row["a"]), float(row["b"]))
+            items.append((swatchlib.to_q4(lab), sid, code))
+    if not items:
+        sys.exit("nessun campione in %s" % path)
+    if len(items) > 0xFFFF:
+        sys.exit("troppi campioni")
+    return items
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("csv")
+    ap.add_argument("-o", "--out", default="library.bin")
+    args = ap.parse_args()
+
+    items = swatchlib.build_kdtree(load(args.csv))
+    image = swatchlib.pack(items)
+    with open(args.out, "wb") as f:
+        f.write(image)
+    print("%s: %d campioni, %d byte" % (args.out, len(items), len(image)))
+
+
+if __name__ == "__main__":
+    main()
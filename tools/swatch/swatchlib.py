@@ -0,0 +1,120 @@
+"""
+Formato della libreria campioni (firmware/inc/swatch.h) e k-d tree implicito.
+Condiviso da build_swatch_lib.py e bench_kdtree.py.
+"""
+import struct
+
+MAGIC = 0x424C5753          # "SWLB"
+VERSION = 1
+CODE_LEN = 10
+NODE_FMT = "<hhhH%ds" % CODE_LEN    # L, a, b (Q4), id, code
+NODE_SIZE = struct.calcsize(NODE_FMT)
+HDR_FMT = "<IHHHHH"                 # magic, version, count, node_size, reserved, crc_nodes
+HDR_SIZE = struct.calcsize(HDR_FMT) + 2
+REGION_SIZE = 0x40000               # FLASH_REGION_SWATCH_SIZE
+CACHE_SIZE = 64                     # SWATCH_CACHE_SIZE
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT come utils_crc16()."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if (crc & 0x8000) else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def srgb_to_lab(r8, g8, b8):
+    """sRGB (0..255, con gamma) -> CIELAB D65."""
+    def lin(c):
+        c /= 255.0
+        return c / 12.92 if c <= 0.04045 else ((c + 0.055) / 1.055) ** 2.4
+
+    r, g, b = lin(r8), lin(g8), lin(b8)
+    x = (0.4124 * r + 0.3576 * g + 0.1805 * b) / 0.95047
+    y = 0.2126 * r + 0.7152 * g + 0.0722 * b
+    z = (0.0193 * r + 0.1192 * g + 0.9505 * b) / 1.08883
+
+    def f(t):
+        return t ** (1.0 / 3.0) if t > (6.0 / 29.0) ** 3 else t / (3 * (6.0 / 29.0) ** 2) + 4.0 / 29.0
+
+    fx, fy, fz = f(x), f(y), f(z)
+    return 116 * fy - 16, 500 * (fx - fy), 200 * (fy - fz)
+
+
+def to_q4(lab):
+    return tuple(int(round(v * 16)) for v in lab)
+
+
+def build_kdtree(items):
+    """
+    items: lista di (lab_q4, id, code). Riordina in place come k-d tree
+    implicito: nodo di [lo, hi) = (lo + hi) // 2, asse = profondita' % 3.
+    """
+    def build(lo, hi, depth):
+        if hi - lo <= 1:
+            return
+        axis = depth % 3
+        items[lo:hi] = sorted(items[lo:hi], key=lambda it: it[0][axis])
+        mid = (lo + hi) // 2
+        build(lo, mid, depth + 1)
+        build(mid + 1, hi, depth + 1)
+
+    build(0, len(items), 0)
+    return items
+
+
+def pack(items):
+    nodes = b"".join(struct.pack(NODE_FMT, lab[0], lab[1], lab[2], sid,
+                                 code.encode("ascii")[:CODE_LEN])
+                     for lab, sid, code in items)
+    hdr = struct.pack(HDR_FMT, MAGIC, VERSION, len(items), NODE_SIZE, 0, crc16(nodes))
+    hdr += struct.pack("<H", crc16(hdr))
+    image = hdr + nodes
+    if len(image) > REGION_SIZE:
+        raise ValueError("libreria troppo grande: %d byte (max %d)" % (len(image), REGION_SIZE))
+    return image
+
+
+class Search:
+    """Stessa ricerca di sw_search() (swatch.c), con conteggio letture flash."""
+
+    def __init__(self, items):
+        self.items = items
+        self.cache = [None] * CACHE_SIZE
+
+    def nearest(self, q):
+        self.best = (1 << 32) - 1
+        self.best_idx = 0
+        self.visited = 0
+        self.reads = 0
+        self._search(q, 0, len(self.items), 0)
+        return self.best_idx, self.best
+
+    def _node(self, idx):
+        slot = idx & (CACHE_SIZE - 1)
+        if self.cache[slot] != idx:
+            self.cache[slot] = idx
+            self.reads += 1
+        return self.items[idx]
+
+    def _search(self, q, lo, hi, depth):
+        while lo < hi:
+            mid = (lo + hi) // 2
+            lab = self._node(mid)[0]
+            self.visited += 1
+            d2 = sum((a - b) ** 2 for a, b in zip(q, lab))
+            if d2 < self.best:
+                self.best, self.best_idx = d2, mid
+            axis = depth % 3
+            diff = q[axis] - lab[axis]
+            depth += 1
+            if diff < 0:
+                self._search(q, lo, mid, depth)
+                lo = mid + 1
+            else:
+                self._search(q, mid + 1, hi, depth)
+                hi = mid
+            if diff * diff >= self.best:
+                return
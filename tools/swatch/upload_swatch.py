@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""
+Carica un'immagine di build_swatch_lib.py sulla scheda (UART4, 115200 8N1).
+La scheda deve essere sul menu principale: lo script entra in "9) Identify
+color" e avvia il caricamento con 'u' (handshake in app_swatch_upload()).
+
+Uso:
+    python3 upload_swatch.py /dev/ttyUSB0 library.bin
+Richiede pyserial.
+"""
+import argparse
+import struct
+import sys
+import time
+
+import serial
+
+PAGE = 256
+
+
+def wait_for(port, token, timeout=10.0):
+    buf = b""
+    t0 = time.time()
+    while time.time() - t0 < timeout:
+        buf += port.read(port.in_waiting or 1)
+        if token in buf:
+            return buf
+    sys.exit("timeout in attesa di %r (ricevuto %r)" % (token, buf[-80:]))
+
+
+def expect_ack(port, timeout):
+    port.timeout = timeout
+    c = port.read(1)
+    if c != b"K":
+        sys.exit("risposta inattesa: %r" % c)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("port")
+    ap.add_argument("image")
+    ap.add_argument("--baud", type=int, default=115200)
+    args = ap.parse_args()
+
+    data = open(args.image, "rb").read()
+
+    with serial.Serial(args.port, args.baud, timeout=1) as port:
+        port.reset_input_buffer()
+        port.write(b"9")
+        wait_for(port, b"u=upload")
+        port.write(b"u")
+        wait_for(port, b"[SWL] READY\r\n")
+
+        port.write(struct.pack("<I", len(data)))
+        expect_ack(port, 120.0)      # erase di piu' settori
+
+        for off in range(0, len(data), PAGE):
+            port.write(data[off:off + PAGE])
+            expect_ack(port, 5.0)
+            print("\r%d/%d" % (min(off + PAGE, len(data)), len(data)), end="", flush=True)
+        print()
+
+        print(wait_for(port, b"\r\n[SWL]", 10.0).decode(errors="replace").strip())
+        port.timeout = 2
+        print(port.readline().decode(errors="replace").strip())
+
+
+if __name__ == "__main__":
+    main()